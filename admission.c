@@ -0,0 +1,191 @@
+//*******ADMISSION CONTROL*******
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "admission.h"
+#include "metrics.h"
+
+typedef struct
+{
+    int fd;
+    int from_unix;
+    long long queued_ns;
+} WaitingConnection;
+
+static AdmissionConfig limits = {0, 0, 0, 0, 0, 0};
+
+// Sessions are admitted and handed over under one lock; it is taken once
+// per connection, never per request.
+static pthread_mutex_t session_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int active_sessions = 0;
+static WaitingConnection waiting[ADMISSION_MAX_SESSION_QUEUE];
+static int waiting_head = 0;
+static int waiting_count = 0;
+static int waiting_capacity = 0;
+
+static int pending_requests = 0;
+
+static long long now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+void admission_configure(const AdmissionConfig *config)
+{
+    pthread_mutex_lock(&session_mutex);
+    limits = *config;
+    if (limits.session_queue > ADMISSION_MAX_SESSION_QUEUE)
+        limits.session_queue = ADMISSION_MAX_SESSION_QUEUE;
+    if (limits.burst <= 0)
+        limits.burst = limits.rate;
+    waiting_capacity = limits.session_queue > 0 ? limits.session_queue : 0;
+    waiting_head = waiting_count = 0;
+    pthread_mutex_unlock(&session_mutex);
+}
+
+//SESSIONS
+// Says why before closing. Whatever the client already sent is drained
+// first, so the close is a FIN rather than a reset that could discard the
+// reply before the client reads it.
+static void reject_connection(int fd)
+{
+    char discard[1024];
+    send(fd, SERVER_BUSY_REPLY, strlen(SERVER_BUSY_REPLY), MSG_NOSIGNAL | MSG_DONTWAIT);
+    shutdown(fd, SHUT_WR);
+    while (recv(fd, discard, sizeof(discard), MSG_DONTWAIT) > 0)
+        ;
+    close(fd);
+}
+
+Admission admission_accept(int fd, int from_unix)
+{
+    pthread_mutex_lock(&session_mutex);
+    if (limits.max_sessions <= 0 || active_sessions < limits.max_sessions)
+    {
+        active_sessions++;
+        pthread_mutex_unlock(&session_mutex);
+        return ADMIT_RUN;
+    }
+    if (waiting_count < waiting_capacity)
+    {
+        WaitingConnection *slot = &waiting[(waiting_head + waiting_count) % waiting_capacity];
+        slot->fd = fd;
+        slot->from_unix = from_unix;
+        slot->queued_ns = now_ns();
+        waiting_count++;
+        pthread_mutex_unlock(&session_mutex);
+        metrics_sessions_waiting(1);
+        return ADMIT_QUEUED;
+    }
+    pthread_mutex_unlock(&session_mutex);
+
+    reject_connection(fd);
+    metrics_rejected(REJECT_SESSION_LIMIT);
+    return ADMIT_REJECTED;
+}
+
+int admission_next(int *fd, int *from_unix)
+{
+    pthread_mutex_lock(&session_mutex);
+    if (waiting_count > 0)
+    {
+        WaitingConnection *slot = &waiting[waiting_head];
+        *fd = slot->fd;
+        *from_unix = slot->from_unix;
+        waiting_head = (waiting_head + 1) % waiting_capacity;
+        waiting_count--;
+        pthread_mutex_unlock(&session_mutex);
+        metrics_sessions_waiting(-1);
+        return 1;
+    }
+    if (active_sessions > 0)
+        active_sessions--;
+    pthread_mutex_unlock(&session_mutex);
+    return 0;
+}
+
+void admission_expire_waiting(void)
+{
+    if (limits.session_wait <= 0)
+        return;
+
+    long long deadline = now_ns() - limits.session_wait * 1000000000LL;
+    while (1)
+    {
+        pthread_mutex_lock(&session_mutex);
+        if (!waiting_count || waiting[waiting_head].queued_ns > deadline)
+        {
+            pthread_mutex_unlock(&session_mutex);
+            return;
+        }
+        int fd = waiting[waiting_head].fd;
+        waiting_head = (waiting_head + 1) % waiting_capacity;
+        waiting_count--;
+        pthread_mutex_unlock(&session_mutex);
+
+        reject_connection(fd);
+        metrics_sessions_waiting(-1);
+        metrics_rejected(REJECT_WAIT_TIMEOUT);
+    }
+}
+
+void admission_release(void)
+{
+    pthread_mutex_lock(&session_mutex);
+    if (active_sessions > 0)
+        active_sessions--;
+    pthread_mutex_unlock(&session_mutex);
+}
+
+//REQUESTS
+int admission_request_begin(void)
+{
+    int limit = limits.max_pending;
+    if (limit <= 0)
+        return 1;
+    if (__atomic_add_fetch(&pending_requests, 1, __ATOMIC_ACQ_REL) > limit)
+    {
+        __atomic_sub_fetch(&pending_requests, 1, __ATOMIC_ACQ_REL);
+        metrics_rejected(REJECT_REQUEST_LIMIT);
+        return 0;
+    }
+    return 1;
+}
+
+void admission_request_end(void)
+{
+    if (limits.max_pending > 0)
+        __atomic_sub_fetch(&pending_requests, 1, __ATOMIC_ACQ_REL);
+}
+
+void admission_bucket_init(RateBucket *bucket)
+{
+    bucket->tokens = limits.burst;
+    bucket->refilled_ns = now_ns();
+}
+
+int admission_bucket_take(RateBucket *bucket)
+{
+    if (limits.rate <= 0)
+        return 1;
+
+    long long now = now_ns();
+    bucket->tokens += (now - bucket->refilled_ns) / 1e9 * limits.rate;
+    if (bucket->tokens > limits.burst)
+        bucket->tokens = limits.burst;
+    bucket->refilled_ns = now;
+
+    if (bucket->tokens < 1)
+    {
+        metrics_rejected(REJECT_RATE_LIMIT);
+        return 0;
+    }
+    bucket->tokens -= 1;
+    return 1;
+}
@@ -0,0 +1,71 @@
+//*******ADMISSION CONTROL*******
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#define ADMISSION_MAX_SESSIONS_ENV "LIBRARY_MAX_SESSIONS" // sessions served at once (default 64, 0 = unlimited)
+#define ADMISSION_SESSION_QUEUE_ENV "LIBRARY_SESSION_QUEUE" // accepted connections waiting for a session slot (default 64)
+#define ADMISSION_MAX_PENDING_ENV "LIBRARY_MAX_PENDING"   // catalog requests in flight at once (default 0 = unlimited)
+#define ADMISSION_RATE_ENV "LIBRARY_RATE_LIMIT"           // requests per second per session (default 0 = off)
+#define ADMISSION_BURST_ENV "LIBRARY_RATE_BURST"          // bucket size (default: one second's worth)
+#define ADMISSION_SESSION_WAIT_ENV "LIBRARY_SESSION_WAIT"  // seconds a connection may wait for a slot (default 5)
+#define ADMISSION_DEFAULT_MAX_SESSIONS 64
+#define ADMISSION_DEFAULT_SESSION_QUEUE 64
+#define ADMISSION_DEFAULT_MAX_PENDING 0 // at most max_sessions are in flight anyway
+#define ADMISSION_DEFAULT_SESSION_WAIT 5
+#define ADMISSION_MAX_SESSION_QUEUE 1024 // upper bound for the session queue
+
+// Every rejection starts with this, so clients can tell overload from a
+// failed operation.
+#define SERVER_BUSY_REPLY "Server busy"
+
+typedef struct
+{
+    int max_sessions;
+    int session_queue;
+    // A count of requests in flight, not a queue: one that would exceed it
+    // gets a busy reply at once instead of waiting its turn.
+    int max_pending;
+    double rate;
+    double burst;
+    int session_wait; // seconds; 0 = wait as long as it takes
+} AdmissionConfig;
+
+typedef enum
+{
+    ADMIT_RUN,     // serve it on a new thread
+    ADMIT_QUEUED,  // parked; a finishing session thread picks it up
+    ADMIT_REJECTED // told the server is busy and closed
+} Admission;
+
+// Zeroed limits mean unlimited; that is also the state before the call.
+void admission_configure(const AdmissionConfig *config);
+
+// Accept loop: decides what happens to a new connection.
+Admission admission_accept(int fd, int from_unix);
+// Session threads, when a session ends: 1 with the next waiting connection
+// (the slot passes to it), or 0 once the slot has been released.
+int admission_next(int *fd, int *from_unix);
+// Accept loop, at least once a second: refuses connections that have
+// waited longer than session_wait, oldest first.
+void admission_expire_waiting(void);
+// Gives back a slot from ADMIT_RUN when no thread could be started for it.
+void admission_release(void);
+
+// Around each catalog request; 0 means reply busy without serving it.
+// Nothing waits here: the request is refused as soon as max_pending others
+// are in flight.
+int admission_request_begin(void);
+void admission_request_end(void);
+
+// Per-session token bucket, kept on the connection thread's stack.
+typedef struct
+{
+    double tokens;
+    long long refilled_ns;
+} RateBucket;
+
+void admission_bucket_init(RateBucket *bucket);
+// 1 when the session may send another request now.
+int admission_bucket_take(RateBucket *bucket);
+
+#endif
@@ -0,0 +1,498 @@
+//*******STORAGE BENCHMARK*******
+// Times the file-backed catalog operations against generated catalogs of
+// increasing size, single-threaded and with concurrent callers.
+//   ./bench_storage                                  1k, 10k and 100k rows
+//   ./bench_storage -s 1000,100000,10000000 -t 1,8   full sweep
+//   ./bench_storage -c now.csv -b baseline.csv -T 15 fail if any p50 regressed by >15%
+// Runs in a scratch directory, so the books.txt of the current directory is never touched.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "histogram.h"
+#include "catalog.h"
+#include "storage.h"
+
+#define MAX_SIZES 16
+#define MAX_THREAD_COUNTS 8
+#define MAX_RESULTS 1024
+#define WORK_BUDGET_ROWS 2000000LL // rows scanned per cell before iterations are cut down
+#define MIN_ITERATIONS 3
+#define MAX_ITERATIONS 200
+
+// Driven in-process through the same engine the socket handlers call.
+static const StorageBackend *backend = &storage_text;
+static Catalog *catalog = NULL;
+
+typedef enum
+{
+    BENCH_GET_NEXT_ID,
+    BENCH_ADD,
+    BENCH_DELETE,
+    BENCH_RENT,
+    BENCH_RETURN,
+    BENCH_MODIFY,
+    BENCH_OP_COUNT
+} BenchOp;
+
+static const char *bench_op_names[BENCH_OP_COUNT] = {"get_next_id", "add", "delete", "rent", "return", "modify"};
+
+typedef struct
+{
+    BenchOp op;
+    long rows;
+    int threads;
+    int iterations;
+    double mean_us;
+    double p50_us;
+    double p99_us;
+    double ops_per_sec;
+} BenchResult;
+
+typedef struct
+{
+    BenchOp op;
+    long rows;
+    int first;  // global index of this thread's first call
+    int count;
+    long step;  // id stride, coprime with rows so ids never repeat
+    Histogram latency;
+} BenchThread;
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int parse_list(const char *text, long *values, int max)
+{
+    char copy[256];
+    int count = 0;
+    snprintf(copy, sizeof(copy), "%s", text);
+    for (char *item = strtok(copy, ","); item && count < max; item = strtok(NULL, ","))
+    {
+        values[count] = atol(item);
+        if (values[count] <= 0)
+            return 0;
+        count++;
+    }
+    return count;
+}
+
+static long gcd(long a, long b)
+{
+    while (b)
+    {
+        long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Same line format the server writes: "id title author is_rented". Other
+// backends start from a fresh store filled through the catalog API.
+static int generate_catalog(long rows, int rented)
+{
+    if (backend != &storage_text)
+    {
+        catalog_close(catalog);
+        unlink(STORAGE_BINARY_DEFAULT_PATH);
+        if (!(catalog = catalog_open_backend(backend, NULL)))
+            return 0;
+        char title[50], author[50];
+        for (long id = 1; id <= rows; id++)
+        {
+            snprintf(title, sizeof(title), "Title%ld", id);
+            snprintf(author, sizeof(author), "Author%ld", id % 997);
+            if (catalog_add(catalog, title, author, NULL) != CATALOG_OK || (rented && catalog_rent(catalog, (int)id) != CATALOG_OK))
+                return 0;
+        }
+        return 1;
+    }
+
+    FILE *file = fopen("books.txt", "w");
+    if (!file)
+    {
+        perror("Error creating books.txt");
+        return 0;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+    for (long id = 1; id <= rows; id++)
+        fprintf(file, "%ld Title%ld Author%ld %d\n", id, id, id % 997, rented);
+    fclose(file);
+    return 1;
+}
+
+static void *bench_thread(void *arg)
+{
+    BenchThread *t = arg;
+    char title[50];
+
+    for (int i = 0; i < t->count; i++)
+    {
+        int id = (int)(1 + ((long)(t->first + i) * t->step) % t->rows);
+        long long started = now_ns();
+        switch (t->op)
+        {
+        case BENCH_GET_NEXT_ID:
+            get_next_id("books.txt");
+            break;
+        case BENCH_ADD:
+            snprintf(title, sizeof(title), "Bench%d", t->first + i);
+            catalog_add(catalog, title, "BenchAuthor", NULL);
+            break;
+        case BENCH_DELETE:
+            catalog_delete(catalog, id);
+            break;
+        case BENCH_RENT:
+            catalog_rent(catalog, id);
+            break;
+        case BENCH_RETURN:
+            catalog_return(catalog, id);
+            break;
+        case BENCH_MODIFY:
+            snprintf(title, sizeof(title), "Modified%d", t->first + i);
+            catalog_modify(catalog, id, title, "BenchAuthor");
+            break;
+        default:
+            break;
+        }
+        histogram_record(&t->latency, now_ns() - started);
+    }
+    return NULL;
+}
+
+static int run_cell(BenchOp op, long rows, int threads, int iterations, BenchResult *result)
+{
+    // Every book starts rented for the return benchmark, unrented otherwise.
+    if (!generate_catalog(rows, op == BENCH_RETURN))
+        return 0;
+
+    long step = 7919;
+    while (gcd(step, rows) != 1)
+        step++;
+
+    BenchThread *workers = calloc((size_t)threads, sizeof(BenchThread));
+    pthread_t *tids = calloc((size_t)threads, sizeof(pthread_t));
+    int per_thread = iterations / threads > 0 ? iterations / threads : 1;
+
+    for (int t = 0; t < threads; t++)
+    {
+        workers[t].op = op;
+        workers[t].rows = rows;
+        workers[t].first = t * per_thread;
+        workers[t].count = per_thread;
+        workers[t].step = step;
+        histogram_init(&workers[t].latency);
+    }
+
+    long long started = now_ns();
+    for (int t = 0; t < threads; t++)
+        pthread_create(&tids[t], NULL, bench_thread, &workers[t]);
+    for (int t = 0; t < threads; t++)
+        pthread_join(tids[t], NULL);
+    double elapsed = (now_ns() - started) / 1e9;
+
+    Histogram *all = malloc(sizeof(Histogram));
+    histogram_init(all);
+    for (int t = 0; t < threads; t++)
+        histogram_merge(all, &workers[t].latency);
+
+    result->op = op;
+    result->rows = rows;
+    result->threads = threads;
+    result->iterations = (int)all->total;
+    result->mean_us = histogram_mean(all) / 1000.0;
+    result->p50_us = histogram_percentile(all, 50.0) / 1000.0;
+    result->p99_us = histogram_percentile(all, 99.0) / 1000.0;
+    result->ops_per_sec = elapsed > 0 ? all->total / elapsed : 0;
+
+    free(all);
+    free(workers);
+    free(tids);
+    return 1;
+}
+
+//OUTPUT
+static void write_csv(const char *path, const BenchResult *results, int count)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        perror(path);
+        return;
+    }
+    fprintf(out, "op,rows,threads,iterations,mean_us,p50_us,p99_us,ops_per_sec\n");
+    for (int i = 0; i < count; i++)
+    {
+        const BenchResult *r = &results[i];
+        fprintf(out, "%s,%ld,%d,%d,%.2f,%.2f,%.2f,%.1f\n", bench_op_names[r->op], r->rows, r->threads,
+                r->iterations, r->mean_us, r->p50_us, r->p99_us, r->ops_per_sec);
+    }
+    fclose(out);
+}
+
+static void write_json(const char *path, const BenchResult *results, int count)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        perror(path);
+        return;
+    }
+    fprintf(out, "[\n");
+    for (int i = 0; i < count; i++)
+    {
+        const BenchResult *r = &results[i];
+        fprintf(out, "  {\"op\":\"%s\",\"rows\":%ld,\"threads\":%d,\"iterations\":%d,\"mean_us\":%.2f,"
+                     "\"p50_us\":%.2f,\"p99_us\":%.2f,\"ops_per_sec\":%.1f}%s\n",
+                bench_op_names[r->op], r->rows, r->threads, r->iterations, r->mean_us, r->p50_us, r->p99_us,
+                r->ops_per_sec, i + 1 < count ? "," : "");
+    }
+    fprintf(out, "]\n");
+    fclose(out);
+}
+
+// Compares p50 per (op, rows, threads) with a CSV written by an earlier run.
+// Returns the number of cells slower than baseline by more than threshold percent,
+// or -1 when the baseline cannot be read or shares no cell with this run.
+static int compare_baseline(const char *path, const BenchResult *results, int count, double threshold)
+{
+    FILE *in = fopen(path, "r");
+    char line[256];
+    int regressions = 0;
+    int compared = 0;
+
+    if (!in)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), in))
+    {
+        char op[32];
+        long rows;
+        int threads, iterations;
+        double mean_us, p50_us;
+        if (sscanf(line, "%31[^,],%ld,%d,%d,%lf,%lf", op, &rows, &threads, &iterations, &mean_us, &p50_us) != 6)
+            continue; // header
+
+        for (int i = 0; i < count; i++)
+        {
+            const BenchResult *r = &results[i];
+            if (strcmp(op, bench_op_names[r->op]) != 0 || rows != r->rows || threads != r->threads)
+                continue;
+            compared++;
+            double change = p50_us > 0 ? (r->p50_us - p50_us) / p50_us * 100.0 : 0;
+            if (change > threshold)
+            {
+                fprintf(stderr, "REGRESSION %s rows=%ld threads=%d: p50 %.2fus -> %.2fus (+%.1f%%, threshold %.1f%%)\n",
+                        op, rows, threads, p50_us, r->p50_us, change, threshold);
+                regressions++;
+            }
+        }
+    }
+    fclose(in);
+
+    if (compared == 0)
+    {
+        fprintf(stderr, "Baseline %s shares no (op, rows, threads) cells with this run\n", path);
+        return -1;
+    }
+    return regressions;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -s rows,...     catalog sizes (1000,10000,100000)\n"
+            "  -t n,...        concurrent caller counts (1,4)\n"
+            "  -o op,...       get_next_id,add,delete,rent,return,modify (all)\n"
+            "  -i n            calls per cell (default: fewer for bigger catalogs, %d-%d)\n"
+            "  -c file         write results as CSV\n"
+            "  -j file         write results as JSON\n"
+            "  -b file         compare p50 against a CSV from an earlier run\n"
+            "  -T percent      allowed p50 slowdown against the baseline (20)\n"
+            "  -d dir          scratch directory (a fresh one under /tmp)\n"
+            "  -B backend      text, binary or memory storage (text); get_next_id is text-only.\n"
+            "                  Compare against baselines of the same backend.\n",
+            program, MIN_ITERATIONS, MAX_ITERATIONS);
+}
+
+int main(int argc, char *argv[])
+{
+    long sizes[MAX_SIZES] = {1000, 10000, 100000};
+    long thread_counts[MAX_THREAD_COUNTS] = {1, 4};
+    int size_count = 3, thread_count_count = 2;
+    int selected[BENCH_OP_COUNT] = {1, 1, 1, 1, 1, 1};
+    int fixed_iterations = 0;
+    double threshold = 20.0;
+    const char *csv_path = NULL, *json_path = NULL, *baseline_path = NULL, *work_dir = NULL;
+    char cwd[4096], scratch[] = "/tmp/bench_storage.XXXXXX";
+    char resolved[3][8192];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:t:o:i:c:j:b:T:d:B:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            size_count = parse_list(optarg, sizes, MAX_SIZES);
+            break;
+        case 't':
+            thread_count_count = parse_list(optarg, thread_counts, MAX_THREAD_COUNTS);
+            break;
+        case 'o':
+        {
+            char copy[256];
+            memset(selected, 0, sizeof(selected));
+            snprintf(copy, sizeof(copy), "%s", optarg);
+            for (char *name = strtok(copy, ","); name; name = strtok(NULL, ","))
+            {
+                int known = 0;
+                for (int op = 0; op < BENCH_OP_COUNT; op++)
+                {
+                    if (strcmp(name, bench_op_names[op]) == 0)
+                        selected[op] = known = 1;
+                }
+                if (!known)
+                {
+                    fprintf(stderr, "Unknown op: %s\n", name);
+                    return 2;
+                }
+            }
+            break;
+        }
+        case 'i': fixed_iterations = atoi(optarg); break;
+        case 'c': csv_path = optarg; break;
+        case 'j': json_path = optarg; break;
+        case 'b': baseline_path = optarg; break;
+        case 'T': threshold = atof(optarg); break;
+        case 'd': work_dir = optarg; break;
+        case 'B':
+            if (!(backend = storage_backend_named(optarg)))
+            {
+                fprintf(stderr, "Unknown storage backend: %s\n", optarg);
+                return 2;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (size_count == 0 || thread_count_count == 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // Output paths are relative to where we were started, not the scratch directory.
+    if (!getcwd(cwd, sizeof(cwd)))
+        return 1;
+    const char **paths[3] = {&csv_path, &json_path, &baseline_path};
+    for (int i = 0; i < 3; i++)
+    {
+        if (*paths[i] && (*paths[i])[0] != '/')
+        {
+            snprintf(resolved[i], sizeof(resolved[i]), "%s/%s", cwd, *paths[i]);
+            *paths[i] = resolved[i];
+        }
+    }
+
+    if (!work_dir && !(work_dir = mkdtemp(scratch)))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    if (chdir(work_dir) < 0)
+    {
+        perror(work_dir);
+        return 1;
+    }
+    if (backend != &storage_text)
+        selected[BENCH_GET_NEXT_ID] = 0;
+    if (!(catalog = catalog_open_backend(backend, NULL)))
+    {
+        perror("catalog_open");
+        return 1;
+    }
+
+    BenchResult *results = calloc(MAX_RESULTS, sizeof(BenchResult));
+    int result_count = 0;
+
+    printf("%-12s %10s %7s %6s %12s %12s %12s %12s\n", "op", "rows", "threads", "calls", "mean_us", "p50_us", "p99_us", "ops/s");
+    for (int s = 0; s < size_count; s++)
+    {
+        int iterations = fixed_iterations;
+        if (iterations <= 0)
+        {
+            long long budget = WORK_BUDGET_ROWS / sizes[s];
+            iterations = budget < MIN_ITERATIONS ? MIN_ITERATIONS : budget > MAX_ITERATIONS ? MAX_ITERATIONS : (int)budget;
+        }
+
+        for (int op = 0; op < BENCH_OP_COUNT; op++)
+        {
+            if (!selected[op])
+                continue;
+            int op_iterations = iterations;
+            // Ids are drawn without repetition, so a cell cannot make more calls than there are rows.
+            if (op_iterations > sizes[s])
+                op_iterations = (int)sizes[s];
+
+            for (int t = 0; t < thread_count_count && result_count < MAX_RESULTS; t++)
+            {
+                BenchResult *r = &results[result_count];
+                if (!run_cell((BenchOp)op, sizes[s], (int)thread_counts[t], op_iterations, r))
+                    return 1;
+                result_count++;
+                printf("%-12s %10ld %7d %6d %12.2f %12.2f %12.2f %12.1f\n", bench_op_names[r->op], r->rows,
+                       r->threads, r->iterations, r->mean_us, r->p50_us, r->p99_us, r->ops_per_sec);
+                fflush(stdout);
+            }
+        }
+    }
+
+    catalog_close(catalog);
+    const char *leftovers[] = {"books.txt", "books_temp.txt", STORAGE_BINARY_DEFAULT_PATH};
+    for (size_t i = 0; i < sizeof(leftovers) / sizeof(leftovers[0]); i++)
+        unlink(leftovers[i]);
+    if (work_dir == scratch)
+        rmdir(scratch);
+
+    if (csv_path)
+        write_csv(csv_path, results, result_count);
+    if (json_path)
+        write_json(json_path, results, result_count);
+
+    int status = 0;
+    if (baseline_path)
+    {
+        int regressions = compare_baseline(baseline_path, results, result_count, threshold);
+        if (regressions < 0)
+        {
+            status = 1;
+        }
+        else if (regressions > 0)
+        {
+            fprintf(stderr, "*** %d benchmark regression%s against %s ***\n", regressions,
+                    regressions == 1 ? "" : "s", baseline_path);
+            status = 1;
+        }
+        else
+        {
+            printf("No regressions against %s (threshold %.1f%%)\n", baseline_path, threshold);
+        }
+    }
+
+    free(results);
+    return status;
+}
@@ -0,0 +1,193 @@
+//*******WORKLOAD CAPTURE*******
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "capture.h"
+
+// Bounded multi-producer ring: a producer claims a slot by advancing head,
+// fills it and publishes it through the slot's sequence number, so the
+// connection threads never take a lock. The writer thread is the only consumer.
+typedef struct
+{
+    unsigned long sequence;
+    RequestContext record;
+} CaptureSlot;
+
+static CaptureSlot *ring = NULL;
+static unsigned long ring_head = 0; // next slot to claim (producers)
+static unsigned long ring_tail = 0; // next slot to write out (writer thread)
+static long long dropped = 0;
+
+static int capturing = 0;
+static int users = 0; // producers inside capture_record; the ring outlives them
+static int stopping = 0;
+static FILE *trace_file = NULL;
+static pthread_t writer_thread;
+
+static void write_json_string(FILE *out, const char *text)
+{
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fprintf(out, "\\%c", *c);
+        else if (*c < 0x20)
+            fprintf(out, "\\u%04x", *c);
+        else
+            fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+static void write_record(const RequestContext *r)
+{
+    fprintf(trace_file, "{\"ts_us\":%lld,\"session\":%d,\"role\":%d,\"op\":\"%s\",\"book_id\":%d,\"title\":",
+            r->timestamp_us, r->session, r->role, request_op_name(r->op), r->book_id);
+    write_json_string(trace_file, r->title);
+    fputs(",\"author\":", trace_file);
+    write_json_string(trace_file, r->author);
+    fprintf(trace_file, ",\"latency_us\":%lld,\"status\":\"%s\"}\n", r->latency_ns / 1000, r->failed ? "fail" : "ok");
+}
+
+// Writes out every published record; returns how many.
+static int drain(void)
+{
+    int written = 0;
+    while (1)
+    {
+        CaptureSlot *slot = &ring[ring_tail & (CAPTURE_RING_SIZE - 1)];
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != ring_tail + 1)
+            break;
+        write_record(&slot->record);
+        // Hand the slot back to producers for the next lap of the ring.
+        __atomic_store_n(&slot->sequence, ring_tail + CAPTURE_RING_SIZE, __ATOMIC_RELEASE);
+        ring_tail++;
+        written++;
+    }
+    if (written)
+        fflush(trace_file);
+    return written;
+}
+
+static void *writer_main(void *arg)
+{
+    (void)arg;
+    struct timespec pause = {0, CAPTURE_FLUSH_INTERVAL_MS * 1000000L};
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+    {
+        if (!drain())
+            nanosleep(&pause, NULL);
+    }
+    drain();
+    return NULL;
+}
+
+int capture_start(const char *path)
+{
+    if (capturing)
+        return -1;
+
+    trace_file = fopen(path, "a");
+    if (!trace_file)
+    {
+        perror("Error opening capture file");
+        return -1;
+    }
+
+    ring = calloc(CAPTURE_RING_SIZE, sizeof(CaptureSlot));
+    if (!ring)
+    {
+        fclose(trace_file);
+        trace_file = NULL;
+        return -1;
+    }
+    for (unsigned long i = 0; i < CAPTURE_RING_SIZE; i++)
+        ring[i].sequence = i;
+    ring_head = ring_tail = 0;
+    dropped = 0;
+    stopping = 0;
+
+    if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0)
+    {
+        free(ring);
+        ring = NULL;
+        fclose(trace_file);
+        trace_file = NULL;
+        return -1;
+    }
+    __atomic_store_n(&capturing, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void capture_stop(void)
+{
+    if (!capturing)
+        return;
+
+    // Producers that saw capture on finish publishing before the writer's
+    // last drain, and none is left to touch the ring when it is freed.
+    __atomic_store_n(&capturing, 0, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&users, __ATOMIC_SEQ_CST) > 0)
+        sched_yield();
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(writer_thread, NULL);
+
+    free(ring);
+    ring = NULL;
+    fclose(trace_file);
+    trace_file = NULL;
+}
+
+long long capture_dropped(void)
+{
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+//RECORDING
+static void publish(const RequestContext *request)
+{
+    unsigned long position = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    while (1)
+    {
+        CaptureSlot *slot = &ring[position & (CAPTURE_RING_SIZE - 1)];
+        long difference = (long)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - position);
+        if (difference == 0)
+        {
+            if (__atomic_compare_exchange_n(&ring_head, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                slot->record = *request;
+                __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+                return;
+            }
+            // position was reloaded by the failed exchange
+        }
+        else if (difference < 0)
+        {
+            // The writer is a full ring behind: drop rather than stall the request.
+            __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        {
+            position = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Counting the user before looking at capturing again (both sequentially
+// consistent) means capture_stop either waits for this call or the call sees
+// capture off, as with the result cache's table. The first look only keeps
+// the shared counter untouched while capture is off.
+void capture_record(const RequestContext *request)
+{
+    if (!__atomic_load_n(&capturing, __ATOMIC_RELAXED))
+        return;
+    __atomic_add_fetch(&users, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&capturing, __ATOMIC_SEQ_CST))
+        publish(request);
+    __atomic_sub_fetch(&users, 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,27 @@
+//*******WORKLOAD CAPTURE*******
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "request.h"
+
+// Trace files are JSON lines, one request per line:
+// {"ts_us":...,"session":3,"role":1,"op":"rent","book_id":5,"title":"","author":"","latency_us":87,"status":"ok"}
+// ts_us is wall-clock microseconds at the start of the request; replay uses
+// the gaps between them for pacing.
+#define CAPTURE_ENV "LIBRARY_CAPTURE" // server records to this file when set
+#define CAPTURE_RING_SIZE 16384       // records buffered before new ones are dropped (power of two)
+#define CAPTURE_FLUSH_INTERVAL_MS 20
+
+// Starts the background writer; returns 0, or -1 if the file cannot be opened.
+int capture_start(const char *path);
+// Waits for records being copied in, flushes everything buffered and closes
+// the file. Requests that end after it is called are not recorded.
+void capture_stop(void);
+long long capture_dropped(void);
+
+// Called by request_end on the connection thread. Copies the request into
+// one ring slot, so the request path never waits on the disk; a no-op while
+// capture is off.
+void capture_record(const RequestContext *request);
+
+#endif
@@ -0,0 +1,404 @@
+//*******CATALOG ENGINE*******
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "catalog.h"
+#include "storage.h"
+#include "trace.h"
+
+struct Catalog
+{
+    const StorageBackend *backend;
+    void *store;
+    // Threads of this process queue here; backends on files add a file
+    // lock to keep other processes out.
+    pthread_mutex_t mutex;
+    // Books out per member, sorted by member, and the row and rental
+    // counts, built by the first call that needs them and kept up to date by
+    // every edit after that.
+    int loan_limit;
+    int ledger_ready;
+    struct MemberLoans *ledger;
+    size_t ledger_count;
+    size_t ledger_capacity;
+    long long rows;
+    long long rented;
+};
+
+typedef struct MemberLoans
+{
+    int member;
+    int loans;
+} MemberLoans;
+
+typedef enum
+{
+    EDIT_DELETE,
+    EDIT_MODIFY,
+    EDIT_RENT,
+    EDIT_RETURN
+} CatalogEdit;
+
+typedef struct
+{
+    CatalogEdit edit;
+    const Book *change;
+    int member;     // renting member, for EDIT_RENT
+    int renter;     // set by a delete or return of a book a member had out
+    int was_rented; // set by a delete of a rented book
+} EditRequest;
+
+const StorageBackend *storage_backend_named(const char *name)
+{
+    const StorageBackend *backends[] = {&storage_text, &storage_memory, &storage_binary};
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+    {
+        if (name && strcmp(name, backends[i]->name) == 0)
+            return backends[i];
+    }
+    return NULL;
+}
+
+Catalog *catalog_open_backend(const StorageBackend *backend, const char *path)
+{
+    Catalog *catalog = calloc(1, sizeof(Catalog));
+    if (!catalog)
+        return NULL;
+
+    catalog->backend = backend;
+    catalog->store = backend->open(path);
+    if (!catalog->store)
+    {
+        free(catalog);
+        return NULL;
+    }
+    pthread_mutex_init(&catalog->mutex, NULL);
+    return catalog;
+}
+
+Catalog *catalog_open(const char *path)
+{
+    return catalog_open_backend(&storage_text, path);
+}
+
+void catalog_close(Catalog *catalog)
+{
+    if (!catalog)
+        return;
+    catalog->backend->close(catalog->store);
+    pthread_mutex_destroy(&catalog->mutex);
+    free(catalog->ledger);
+    free(catalog);
+}
+
+const char *catalog_location(Catalog *catalog)
+{
+    return catalog->backend->location(catalog->store);
+}
+
+//LOCKING
+static void lock_catalog(Catalog *catalog)
+{
+    long long span = trace_mark();
+    pthread_mutex_lock(&catalog->mutex);
+    trace_span(TRACE_MUTEX_WAIT, span);
+}
+
+static void unlock_catalog(Catalog *catalog)
+{
+    pthread_mutex_unlock(&catalog->mutex);
+}
+
+//ADD BOOK
+CatalogStatus catalog_add(Catalog *catalog, const char *title, const char *author, int *book_id)
+{
+    Book book;
+    snprintf(book.title, sizeof(book.title), "%s", title);
+    snprintf(book.author, sizeof(book.author), "%s", author);
+    book.is_rented = 0;
+    book.renter = 0;
+
+    lock_catalog(catalog);
+    CatalogStatus status = catalog->backend->add(catalog->store, &book);
+    if (status == CATALOG_OK)
+        catalog->rows++;
+    else
+        catalog->ledger_ready = 0; // the file may have grown anyway
+    unlock_catalog(catalog);
+
+    if (status == CATALOG_OK && book_id)
+        *book_id = book.id;
+    return status;
+}
+
+//LOANS
+// The member's entry, added with no loans when create is set; NULL when it
+// is absent or could not be added. Caller holds the catalog lock.
+static MemberLoans *ledger_entry(Catalog *catalog, int member, int create)
+{
+    size_t low = 0, high = catalog->ledger_count;
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (catalog->ledger[mid].member == member)
+            return &catalog->ledger[mid];
+        if (catalog->ledger[mid].member < member)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (!create)
+        return NULL;
+
+    if (catalog->ledger_count == catalog->ledger_capacity)
+    {
+        size_t capacity = catalog->ledger_capacity ? catalog->ledger_capacity * 2 : 16;
+        MemberLoans *grown = realloc(catalog->ledger, capacity * sizeof(MemberLoans));
+        if (!grown)
+            return NULL;
+        catalog->ledger = grown;
+        catalog->ledger_capacity = capacity;
+    }
+    memmove(&catalog->ledger[low + 1], &catalog->ledger[low], (catalog->ledger_count - low) * sizeof(MemberLoans));
+    catalog->ledger[low].member = member;
+    catalog->ledger[low].loans = 0;
+    catalog->ledger_count++;
+    return &catalog->ledger[low];
+}
+
+typedef struct
+{
+    Catalog *catalog;
+    int failed;
+} LedgerLoad;
+
+static void count_loan(const Book *book, void *context)
+{
+    LedgerLoad *load = context;
+    load->catalog->rows++;
+    load->catalog->rented += book->is_rented != 0;
+    if (!book->is_rented || book->renter == 0)
+        return;
+    MemberLoans *entry = ledger_entry(load->catalog, book->renter, 1);
+    if (entry)
+        entry->loans++;
+    else
+        load->failed = 1;
+}
+
+// 0 when the catalog could not be read. Caller holds the catalog lock.
+static int ledger_load(Catalog *catalog)
+{
+    if (catalog->ledger_ready)
+        return 1;
+    LedgerLoad load = {catalog, 0};
+    catalog->ledger_count = 0;
+    catalog->rows = 0;
+    catalog->rented = 0;
+    catalog->ledger_ready = catalog->backend->each(catalog->store, count_loan, &load) && !load.failed;
+    return catalog->ledger_ready;
+}
+
+static void ledger_credit(Catalog *catalog, int member)
+{
+    MemberLoans *entry = ledger_entry(catalog, member, 0);
+    if (entry && entry->loans > 0)
+        entry->loans--;
+}
+
+static void ledger_debit(Catalog *catalog, int member)
+{
+    MemberLoans *entry = ledger_entry(catalog, member, 1);
+    if (entry)
+        entry->loans++;
+    else
+        catalog->ledger_ready = 0; // rebuilt from the catalog next time
+}
+
+//EDITS
+// Applied by the backend to the row of the book being edited.
+static CatalogStatus edit_row(Book *book, int *keep, void *context)
+{
+    EditRequest *request = context;
+
+    switch (request->edit)
+    {
+    case EDIT_DELETE:
+        *keep = 0;
+        request->was_rented = book->is_rented != 0;
+        request->renter = book->is_rented ? book->renter : 0;
+        return CATALOG_OK;
+
+    case EDIT_MODIFY:
+    {
+        Book new_book = *request->change;
+
+        // An edit changes title and author, never the loan.
+        new_book.is_rented = book->is_rented;
+        new_book.renter = book->renter;
+
+        *book = new_book;
+        return CATALOG_OK;
+    }
+
+    case EDIT_RENT:
+        if (book->is_rented == 0)
+        {
+            book->is_rented = 1;
+            book->renter = request->member;
+            return CATALOG_OK;
+        }
+        return CATALOG_UNAVAILABLE;
+
+    case EDIT_RETURN:
+        if (book->is_rented == 1)
+        {
+            book->is_rented = 0; // Set to unrented
+            request->renter = book->renter;
+            book->renter = 0;
+            return CATALOG_OK;
+        }
+        return CATALOG_UNAVAILABLE;
+    }
+    return CATALOG_ERROR;
+}
+
+// A member's rent is refused before any I/O when the ledger says they are
+// at the limit; the ledger follows every edit that succeeds.
+static CatalogStatus edit_catalog(Catalog *catalog, CatalogEdit edit, const Book *change, int member)
+{
+    EditRequest request = {edit, change, member, 0, 0};
+    lock_catalog(catalog);
+    if (member != 0 && catalog->loan_limit > 0)
+    {
+        if (!ledger_load(catalog))
+        {
+            unlock_catalog(catalog);
+            return CATALOG_ERROR;
+        }
+        MemberLoans *entry = ledger_entry(catalog, member, 0);
+        if (entry && entry->loans >= catalog->loan_limit)
+        {
+            unlock_catalog(catalog);
+            return CATALOG_LIMIT;
+        }
+    }
+    CatalogStatus status = catalog->backend->update(catalog->store, change->id, edit_row, &request);
+    if (status == CATALOG_OK && catalog->ledger_ready)
+    {
+        if (edit == EDIT_RENT && member != 0)
+            ledger_debit(catalog, member);
+        else if (request.renter != 0)
+            ledger_credit(catalog, request.renter);
+        catalog->rows -= edit == EDIT_DELETE;
+        catalog->rented += (edit == EDIT_RENT) - (edit == EDIT_RETURN) - request.was_rented;
+    }
+    else if (status == CATALOG_ERROR)
+        catalog->ledger_ready = 0; // a failed rewrite may have left the row either way
+    unlock_catalog(catalog);
+    return status;
+}
+
+CatalogStatus catalog_delete(Catalog *catalog, int book_id)
+{
+    Book change = {.id = book_id};
+    return edit_catalog(catalog, EDIT_DELETE, &change, 0);
+}
+
+CatalogStatus catalog_modify(Catalog *catalog, int book_id, const char *title, const char *author)
+{
+    Book change = {.id = book_id};
+    snprintf(change.title, sizeof(change.title), "%s", title);
+    snprintf(change.author, sizeof(change.author), "%s", author);
+    return edit_catalog(catalog, EDIT_MODIFY, &change, 0);
+}
+
+CatalogStatus catalog_rent(Catalog *catalog, int book_id)
+{
+    Book change = {.id = book_id};
+    return edit_catalog(catalog, EDIT_RENT, &change, 0);
+}
+
+CatalogStatus catalog_rent_for(Catalog *catalog, int book_id, int member_id)
+{
+    Book change = {.id = book_id};
+    return edit_catalog(catalog, EDIT_RENT, &change, member_id);
+}
+
+CatalogStatus catalog_return(Catalog *catalog, int book_id)
+{
+    Book change = {.id = book_id};
+    return edit_catalog(catalog, EDIT_RETURN, &change, 0);
+}
+
+void catalog_set_loan_limit(Catalog *catalog, int limit)
+{
+    lock_catalog(catalog);
+    catalog->loan_limit = limit > 0 ? limit : 0;
+    unlock_catalog(catalog);
+}
+
+int catalog_loan_limit(Catalog *catalog)
+{
+    lock_catalog(catalog);
+    int limit = catalog->loan_limit;
+    unlock_catalog(catalog);
+    return limit;
+}
+
+int catalog_loans(Catalog *catalog, int member_id)
+{
+    lock_catalog(catalog);
+    int loans = -1;
+    if (ledger_load(catalog))
+    {
+        MemberLoans *entry = ledger_entry(catalog, member_id, 0);
+        loans = entry ? entry->loans : 0;
+    }
+    unlock_catalog(catalog);
+    return loans;
+}
+
+//SEARCH BOOK
+CatalogStatus catalog_search(Catalog *catalog, int book_id, Book *book)
+{
+    Book found;
+    lock_catalog(catalog);
+    CatalogStatus status = catalog->backend->find(catalog->store, book_id, &found);
+    unlock_catalog(catalog);
+
+    if (status == CATALOG_OK && book)
+        *book = found;
+    return status;
+}
+
+//STATISTICS
+// Unlocked: the slow-op log sizes the catalog from the request thread and
+// must not queue behind the next writer.
+long long catalog_bytes(Catalog *catalog)
+{
+    return catalog->backend->bytes(catalog->store);
+}
+
+int catalog_counts(Catalog *catalog, CatalogStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    lock_catalog(catalog);
+    int ok = ledger_load(catalog);
+    stats->rows = catalog->rows;
+    stats->rented = catalog->rented;
+    unlock_catalog(catalog);
+    stats->bytes = catalog_bytes(catalog);
+    return ok;
+}
+
+int catalog_stats(Catalog *catalog, CatalogStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_lock(&catalog->mutex);
+    int ok = catalog->backend->stats(catalog->store, stats);
+    pthread_mutex_unlock(&catalog->mutex);
+    return ok;
+}
@@ -0,0 +1,79 @@
+//*******CATALOG ENGINE*******
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#define CATALOG_DEFAULT_PATH "books.txt"
+#define CATALOG_FIELD_LENGTH 50 // title and author, including the terminator
+#define CATALOG_LOAN_LIMIT_ENV "LIBRARY_LOAN_LIMIT" // books one member may have out at once (default 0 = no limit)
+
+typedef struct
+{
+    int id;
+    char title[CATALOG_FIELD_LENGTH];
+    char author[CATALOG_FIELD_LENGTH];
+    int is_rented;
+    int renter; // member who has it out; 0 when not rented or rented without one
+} Book;
+
+typedef enum
+{
+    CATALOG_OK,
+    CATALOG_NOT_FOUND,   // no book with that ID (or no catalog file yet)
+    CATALOG_UNAVAILABLE, // rent of a rented book, return of one that is not rented
+    CATALOG_ERROR,       // the file could not be opened, locked or rewritten
+    CATALOG_LIMIT        // the member already has the loan limit's worth of books out
+} CatalogStatus;
+
+typedef struct
+{
+    long long bytes;
+    long long rows;
+    long long rented;
+} CatalogStats;
+
+// One catalog on one storage backend (storage.h); the handle may be shared
+// by any number of threads.
+typedef struct Catalog Catalog;
+typedef struct StorageBackend StorageBackend;
+
+// The text backend on path (NULL for books.txt). Nothing is read or created
+// until the first operation.
+Catalog *catalog_open(const char *path);
+Catalog *catalog_open_backend(const StorageBackend *backend, const char *path);
+void catalog_close(Catalog *catalog);
+const char *catalog_location(Catalog *catalog);
+
+// Titles and authors are single words, as in the file format; longer ones
+// are cut to CATALOG_FIELD_LENGTH - 1 characters.
+CatalogStatus catalog_add(Catalog *catalog, const char *title, const char *author, int *book_id);
+CatalogStatus catalog_delete(Catalog *catalog, int book_id);
+// Keeps the rental status.
+CatalogStatus catalog_modify(Catalog *catalog, int book_id, const char *title, const char *author);
+CatalogStatus catalog_rent(Catalog *catalog, int book_id);
+// Also gives the loan back to the member who rented it.
+CatalogStatus catalog_return(Catalog *catalog, int book_id);
+
+// A rent on behalf of a member records the member on the book's row, so the
+// loan and the member's count change in the one write that flips is_rented.
+// The counts are kept in memory from the first call that needs them (one
+// read of the catalog), so checking the limit costs no I/O; loans made
+// through other handles on the same file after that are not counted.
+CatalogStatus catalog_rent_for(Catalog *catalog, int book_id, int member_id);
+// 0, the default, for no limit.
+void catalog_set_loan_limit(Catalog *catalog, int limit);
+// The limit rents are checked against, 0 for none.
+int catalog_loan_limit(Catalog *catalog);
+// Books member_id has out, or -1 when the catalog could not be read.
+int catalog_loans(Catalog *catalog, int member_id);
+CatalogStatus catalog_search(Catalog *catalog, int book_id, Book *book);
+
+// Size on disk (memory in use for the memory backend); cheap.
+long long catalog_bytes(Catalog *catalog);
+// Row and rental counts; reads the whole catalog.
+int catalog_stats(Catalog *catalog, CatalogStats *stats);
+// The same counts as this handle's edits left them, with catalog_bytes for
+// the size: the first call reads the catalog once, later ones cost nothing.
+// As with the loan counts, edits through other handles are not seen.
+int catalog_counts(Catalog *catalog, CatalogStats *stats);
+
+#endif
@@ -1,72 +1,91 @@
 //*******CLIENT CODE*******
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <arpa/inet.h>
+#include "client_proto.h"
 
-#define PORT 8080
-#define BUFFER_SIZE 1024
+#define MAX_SCRIPT_OPS 4096
 
 void user_menu(int sock);
 void admin_menu(int sock);
 
+typedef struct
+{
+    int repeat;
+    char op[16];
+    int book_id;
+    char title[50];
+    char author[50];
+    char args[256];
+} ScriptOp;
+
+
+// Successful logins carry a token that lets the next connection skip the password.
+static void print_session_token(const char *token) {
+    if (token[0]) {
+        printf("Session token (use option 3 to reconnect): %s\n", token);
+    }
+}
 
+// Returns the role the server granted (1 = user, 2 = admin), or 0 on failure.
 int authenticate(int sock, int role) {
-    char buffer[BUFFER_SIZE];
+    char reply[BUFFER_SIZE] = {0};
+    char token[TOKEN_LENGTH + 1] = {0};
+    int granted = 0;
 
-    if (role != 1 && role != 2) {
+    if (role != 1 && role != 2 && role != 3) {
         printf("Invalid role. Authentication failed.\n");
         return 0;
     }
 
     if (role == 1) {
         char username[50];
-        char password[50];
-        int rented_book_id=0;
+        char password[130]; // the server refuses over 128, so send what was typed
         int member_id;
         printf("Enter username: ");
-        scanf("%s", username);
+        scanf("%49s", username);
         printf("Enter Member ID: ");
         scanf("%d", &member_id);
         printf("Enter password: ");
-        scanf("%s", password);
-
-        sprintf(buffer, "%s %s %d", username, password,member_id);
-        send(sock, buffer, sizeof(buffer), 0);
-        send(sock,&rented_book_id,sizeof(rented_book_id),0);
-        recv(sock,buffer,sizeof(buffer),0);
-        printf("%s\n", buffer);
-
+        scanf("%129s", password);
 
+        granted = proto_login_user(sock, username, password, member_id, token, reply);
     } else if (role == 2) {
         char username[50];
-        char password[50];
+        char password[130];
 
         printf("Enter admin username: ");
-        scanf("%s", username);
+        scanf("%49s", username);
         printf("Enter admin password: ");
-        scanf("%s", password);
+        scanf("%129s", password);
 
-        sprintf(buffer, "%s %s", username, password);
-        send(sock, buffer, sizeof(buffer), 0);
-    }
+        granted = proto_login_admin(sock, username, password, token, reply);
+    } else if (role == 3) {
+        char saved[64];
 
-    recv(sock, buffer, sizeof(buffer), 0);
+        printf("Enter session token: ");
+        scanf("%63s", saved);
 
-    if (strcmp(buffer, "Authentication failed!") == 0) {
+        granted = proto_resume(sock, saved, NULL, reply);
+    }
+
+    printf("%s\n", reply);
+    if (!granted) {
         printf("Authentication failed. Exiting...\n");
         return 0;
     }
 
-    return 1;
+    print_session_token(token);
+    return granted;
 }
 
 
 //USER MENU
 void user_menu(int sock)
 {
-    int role = 1;
     int choice;
     char buffer[BUFFER_SIZE] = {0};
 
@@ -80,48 +99,39 @@ void user_menu(int sock)
         printf("Enter your choice: ");
         scanf("%d", &choice);
 
-        send(sock, &role, sizeof(role), 0);
-        send(sock, &choice, sizeof(choice), 0);
-
+        int id;
+        int result = 0;
         switch (choice)
         {
         case 1:
-        {
-            int id;
             printf("Enter book ID to rent: ");
             scanf("%d", &id);
-            send(sock, &id , sizeof(id), 0);
-
+            result = proto_rent(sock, id, buffer);
             break;
-        }
         case 2:
-        {
-            int id;
             printf("Enter book ID to return: ");
             scanf("%d", &id);
-            send(sock, &id, sizeof(id), 0);
-
+            result = proto_return(sock, id, buffer);
             break;
-        }
         case 3:
-        {
-            int id;
             printf("Enter book ID to search: ");
             scanf("%d", &id);
-            sprintf(buffer, "%d", id);
-            send(sock, buffer, strlen(buffer), 0);
+            result = proto_search(sock, ROLE_USER, id, buffer);
             break;
-        }
-        
         case 4:
+            proto_exit(sock, ROLE_USER);
             printf("Exiting...\n");
             return;
         default:
             printf("Invalid Choice\n");
-            break;
+            continue;
         }
 
-        read(sock, buffer, BUFFER_SIZE);
+        if (result < 0)
+        {
+            printf("Connection lost\n");
+            return;
+        }
         printf("%s\n", buffer);
     }
 }
@@ -129,7 +139,6 @@ void user_menu(int sock)
 //ADMIN MENU
 void admin_menu(int sock)
 {
-    int role = 2;
     int choice;
     char buffer[BUFFER_SIZE] = {0};
 
@@ -141,97 +150,74 @@ void admin_menu(int sock)
         printf("3. Modify Book\n");
         printf("4. Search Book by ID\n");
         printf("5. Exit\n");
+        printf("6. Server Metrics\n");
         printf("Enter your choice: ");
         scanf("%d", &choice);
 
-        send(sock, &role, sizeof(role), 0);
-        send(sock, &choice, sizeof(choice), 0);
-
+        int id;
+        int result = 0;
+        char title[50];
+        char author[50];
         switch (choice)
         {
         case 1:
-        {
-            char title[50];
-            char author[50];
             printf("Enter title of the book: ");
-            scanf("%s", title);
+            scanf("%49s", title);
             printf("Enter author of the book: ");
-            scanf("%s", author);
-            send(sock, title, sizeof(title), 0);
-            send(sock, author, sizeof(author), 0);
+            scanf("%49s", author);
+            result = proto_add(sock, title, author, buffer);
             break;
-        }
         case 2:
-        {
-            int id;
             printf("Enter book ID to delete: ");
             scanf("%d", &id);
-            sprintf(buffer, "%d", id);
-            send(sock, buffer, strlen(buffer), 0);
+            result = proto_delete(sock, id, buffer);
             break;
-        }
         case 3:
-        {
-            int id;
-            char title[50];
-            char author[50];
             printf("Enter book ID to modify: ");
             scanf("%d", &id);
-            send(sock,&id, sizeof(id), 0);
             printf("Enter new title ");
-            scanf("%s",title);
+            scanf("%49s", title);
             printf("Enter new author: ");
-            scanf("%s",author);
-            sprintf(buffer, "%s %s", title,author);
-            send(sock,buffer,sizeof(buffer),0);
-         
+            scanf("%49s", author);
+            result = proto_modify(sock, id, title, author, buffer);
             break;
-        }
         case 4:
-        {
-            int id;
             printf("Enter book ID to search: ");
             scanf("%d", &id);
-            sprintf(buffer, "%d", id);
-            send(sock, buffer, strlen(buffer), 0);
+            result = proto_search(sock, ROLE_ADMIN, id, buffer);
             break;
-        }
         case 5:
+            proto_exit(sock, ROLE_ADMIN);
             printf("Exiting...\n");
             return;
+        case 6:
+        {
+            char *metrics = NULL;
+            result = proto_metrics(sock, &metrics);
+            if (metrics)
+                fputs(metrics, stdout);
+            free(metrics);
+            buffer[0] = '\0';
+            break;
+        }
         default:
             printf("Invalid Choice\n");
-            break;
+            continue;
         }
 
-        read(sock, buffer, BUFFER_SIZE);
+        if (result < 0)
+        {
+            printf("Connection lost\n");
+            return;
+        }
         printf("%s\n", buffer);
     }
 }
 
-int main()
+//INTERACTIVE MODE
+static int interactive_main(int sock)
 {
-    int sock = 0;
-    struct sockaddr_in serv_addr;
-    char buffer[BUFFER_SIZE] = {0};
-    char username[50];
-
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0)
-    {
-        printf("\n Socket creation error \n");
-        return -1;
-    }
-
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(PORT);
-
-    if (inet_pton(AF_INET, "127.0.0.1", &serv_addr.sin_addr) <= 0)
-    {
-        printf("\nInvalid address/ Address not supported \n");
-        return -1;
-    }
-
-    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0)
+    if (sock < 0)
     {
         printf("\nConnection Failed \n");
         return -1;
@@ -245,12 +231,11 @@ int main()
     printf("Choose option:\n");
     printf("1. Login as User\n");
     printf("2. Login as Admin\n");
+    printf("3. Resume session\n");
     scanf("%d", &role);
 
-    send(sock, &role, sizeof(role), 0);
-
-
-    if (authenticate(sock, role))
+    role = authenticate(sock, role);
+    if (role)
     {
         printf("Authentication successful!\n");
 
@@ -268,6 +253,333 @@ int main()
         }
     }
 
-    close(sock);
+    proto_close(sock);
+    return 0;
+}
+
+//SCRIPTED MODE
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [connection]            interactive menus\n"
+            "       %s [connection] login ops   scripted mode\n"
+            "connection: -h host (127.0.0.1)  -p port (%d)  -U unix-socket  -S unix-socket (shared memory)\n"
+            "login:      -a admin:password | -u username:password:member-id | -t session-token\n"
+            "ops:        -e 'op args' (repeatable)  -f file ('-' = stdin)  -n times-to-run-the-list  -q (omit replies)\n"
+            "            -C  answer searches from a cache while the server's leases last\n"
+            "            -M file  admin: save the server's Prometheus metrics after the ops ('-' = stdout)\n"
+            "op syntax:  [count*]search|rent|return|delete ID, [count*]add TITLE AUTHOR, [count*]modify ID TITLE AUTHOR\n",
+            program, program, PORT);
+}
+
+// Parses "[count*]op args" into op. Returns 0 for malformed lines.
+static int parse_script_op(const char *line, ScriptOp *op)
+{
+    char rest[256];
+    const char *star = strchr(line, '*');
+
+    memset(op, 0, sizeof(*op));
+    op->repeat = 1;
+    if (star && sscanf(line, "%d*", &op->repeat) == 1)
+        line = star + 1;
+    if (op->repeat < 1)
+        return 0;
+
+    rest[0] = '\0';
+    if (sscanf(line, " %15s %255[^\n]", op->op, rest) < 1)
+        return 0;
+    snprintf(op->args, sizeof(op->args), "%s", rest);
+
+    if (strcmp(op->op, "add") == 0)
+        return sscanf(rest, "%49s %49s", op->title, op->author) == 2;
+    if (strcmp(op->op, "modify") == 0)
+        return sscanf(rest, "%d %49s %49s", &op->book_id, op->title, op->author) == 3;
+    if (strcmp(op->op, "search") == 0 || strcmp(op->op, "rent") == 0 ||
+        strcmp(op->op, "return") == 0 || strcmp(op->op, "delete") == 0)
+        return sscanf(rest, "%d", &op->book_id) == 1;
+    return 0;
+}
+
+static int load_script_file(const char *path, ScriptOp *ops, int *count)
+{
+    char line[512];
+    int line_number = 0;
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!file)
+    {
+        perror(path);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), file))
+    {
+        line_number++;
+        char *start = line + strspn(line, " \t");
+        if (*start == '#' || *start == '\n' || *start == '\0')
+            continue;
+        if (*count >= MAX_SCRIPT_OPS || !parse_script_op(start, &ops[*count]))
+        {
+            fprintf(stderr, "%s:%d: bad operation: %s", path, line_number, line);
+            if (file != stdin)
+                fclose(file);
+            return 0;
+        }
+        (*count)++;
+    }
+
+    if (file != stdin)
+        fclose(file);
+    return 1;
+}
+
+static double elapsed_us(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e6 + (now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+// Replies are printed on one line with tabs/newlines flattened, so every
+// result stays one TSV record.
+static void print_result(long seq, const ScriptOp *op, const char *status, double latency, const char *reply, int quiet)
+{
+    printf("%ld\t%s\t%s\t%s\t%.1f\t", seq, op->op, op->args, status, latency);
+    if (!quiet)
+    {
+        for (const char *c = reply; *c; c++)
+            putchar(*c == '\t' || *c == '\n' ? ' ' : *c);
+    }
+    putchar('\n');
+}
+
+static int run_script_op(int sock, int role, const ScriptOp *op, char *reply)
+{
+    if (strcmp(op->op, "search") == 0)
+        return proto_search(sock, role, op->book_id, reply);
+
+    if (role == ROLE_USER)
+    {
+        if (strcmp(op->op, "rent") == 0)
+            return proto_rent(sock, op->book_id, reply);
+        if (strcmp(op->op, "return") == 0)
+            return proto_return(sock, op->book_id, reply);
+    }
+    else
+    {
+        if (strcmp(op->op, "add") == 0)
+            return proto_add(sock, op->title, op->author, reply);
+        if (strcmp(op->op, "delete") == 0)
+            return proto_delete(sock, op->book_id, reply);
+        if (strcmp(op->op, "modify") == 0)
+            return proto_modify(sock, op->book_id, op->title, op->author, reply);
+    }
+
+    // Never sent: the session's role has no such menu entry.
+    snprintf(reply, BUFFER_SIZE, "Invalid operation for this role");
+    return 0;
+}
+
+static int save_metrics(int sock, int role, const char *path)
+{
+    char *metrics = NULL;
+    if (role != ROLE_ADMIN)
+    {
+        fprintf(stderr, "Metrics need an admin session\n");
+        return 0;
+    }
+    if (proto_metrics(sock, &metrics) < 0)
+    {
+        fprintf(stderr, "Metrics request failed\n");
+        return -1;
+    }
+
+    FILE *out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!out)
+    {
+        perror(path);
+        free(metrics);
+        return 0;
+    }
+    fputs(metrics, out);
+    if (out != stdout)
+        fclose(out);
+    free(metrics);
     return 0;
 }
+
+static int scripted_main(int argc, char *argv[])
+{
+    static ScriptOp ops[MAX_SCRIPT_OPS];
+    int op_count = 0;
+    const char *host = "127.0.0.1";
+    const char *unix_path = NULL;
+    const char *login = NULL;
+    int login_role = 0;
+    int port = PORT;
+    int use_shm = 0;
+    int passes = 1;
+    int quiet = 0;
+    const char *metrics_path = NULL;
+    int use_cache = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "h:p:U:S:a:u:t:e:f:n:qM:C")) != -1)
+    {
+        switch (opt)
+        {
+        case 'h':
+            host = optarg;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'U':
+        case 'S':
+            unix_path = optarg;
+            use_shm = opt == 'S';
+            break;
+        case 'a':
+        case 'u':
+        case 't':
+            login = optarg;
+            login_role = opt == 'a' ? ROLE_ADMIN : opt == 'u' ? ROLE_USER : ROLE_RESUME;
+            break;
+        case 'e':
+            if (op_count >= MAX_SCRIPT_OPS || !parse_script_op(optarg, &ops[op_count]))
+            {
+                fprintf(stderr, "Bad operation: %s\n", optarg);
+                return 2;
+            }
+            op_count++;
+            break;
+        case 'f':
+            if (!load_script_file(optarg, ops, &op_count))
+                return 2;
+            break;
+        case 'n':
+            passes = atoi(optarg);
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        case 'M':
+            metrics_path = optarg;
+            break;
+        case 'C':
+            use_cache = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!login && op_count == 0 && !metrics_path)
+        return interactive_main(proto_connect(host, port, unix_path, use_shm));
+    if (!login || (op_count == 0 && !metrics_path) || passes < 1)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int sock = proto_connect(host, port, unix_path, use_shm);
+    if (sock < 0)
+    {
+        fprintf(stderr, "Connection failed\n");
+        return 1;
+    }
+
+    char reply[BUFFER_SIZE] = {0};
+    char credentials[128];
+    char token[TOKEN_LENGTH + 1] = {0};
+    struct timespec started;
+    int role = 0;
+
+    snprintf(credentials, sizeof(credentials), "%s", login);
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    if (login_role == ROLE_RESUME)
+    {
+        role = proto_resume(sock, credentials, NULL, reply);
+    }
+    else
+    {
+        char *password = strchr(credentials, ':');
+        char *member = password ? strchr(password + 1, ':') : NULL;
+        if (password)
+            *password++ = '\0';
+        if (member)
+            *member++ = '\0';
+
+        if (!password || (login_role == ROLE_USER && !member))
+            fprintf(stderr, "Login must be name:password%s\n", login_role == ROLE_USER ? ":member-id" : "");
+        else if (login_role == ROLE_ADMIN)
+            role = proto_login_admin(sock, credentials, password, token, reply);
+        else
+            role = proto_login_user(sock, credentials, password, atoi(member), token, reply);
+    }
+
+    // Header, then one record per operation: seq op args status latency_us reply
+    printf("seq\top\targs\tstatus\tlatency_us\treply\n");
+    ScriptOp login_op = {1, "login", 0, "", "", ""};
+    snprintf(login_op.args, sizeof(login_op.args), "%s", token);
+    print_result(0, &login_op, role ? "ok" : "fail", elapsed_us(&started), reply, quiet);
+    if (!role)
+    {
+        proto_close(sock);
+        return 1;
+    }
+
+    if (use_cache && proto_cache_enable(sock, role, reply) <= 0)
+        fprintf(stderr, "No cache: %s\n", reply);
+
+    long seq = 0, failed = 0, errors = 0;
+    struct timespec run_started;
+    clock_gettime(CLOCK_MONOTONIC, &run_started);
+
+    for (int pass = 0; pass < passes && !errors; pass++)
+    {
+        for (int i = 0; i < op_count && !errors; i++)
+        {
+            for (int r = 0; r < ops[i].repeat; r++)
+            {
+                struct timespec op_started;
+                clock_gettime(CLOCK_MONOTONIC, &op_started);
+                int result = run_script_op(sock, role, &ops[i], reply);
+                double latency = elapsed_us(&op_started);
+
+                const char *status = result < 0 ? "error" : proto_reply_failed(reply) ? "fail" : "ok";
+                print_result(++seq, &ops[i], status, latency, reply, quiet);
+                if (result < 0)
+                {
+                    errors++;
+                    break;
+                }
+                if (proto_reply_failed(reply))
+                    failed++;
+            }
+        }
+    }
+
+    double total = elapsed_us(&run_started);
+    fprintf(stderr, "ops=%ld failed=%ld errors=%ld elapsed_us=%.0f ops_per_sec=%.0f\n",
+            seq, failed, errors, total, total > 0 ? seq / (total / 1e6) : 0.0);
+    ProtoCacheStats cache;
+    if (proto_cache_stats(sock, &cache))
+        fprintf(stderr, "cache_hits=%lld cache_misses=%lld cache_invalidations=%lld\n",
+                cache.hits, cache.misses, cache.invalidations);
+
+    if (metrics_path && !errors && save_metrics(sock, role, metrics_path) < 0)
+        errors++;
+
+    if (!errors)
+        proto_exit(sock, role);
+    proto_close(sock);
+    return errors ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+        return scripted_main(argc, argv);
+    return interactive_main(proto_connect("127.0.0.1", PORT, NULL, 0));
+}
@@ -0,0 +1,412 @@
+//*******CLIENT CONNECTION POOL*******
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "client_pool.h"
+
+struct PoolFuture
+{
+    ProtoOp op;
+    int book_id;
+    char title[50];
+    char author[50];
+    PoolCallback callback;
+    void *arg;
+
+    pthread_mutex_t lock;
+    pthread_cond_t completed;
+    int done;
+    int abandoned; // freed by the caller before completion; the pool frees it
+    int status;
+    char reply[BUFFER_SIZE];
+
+    struct PoolFuture *next;
+};
+
+typedef struct
+{
+    ClientPool *pool;
+    pthread_t thread;
+    int conn;
+    char token[TOKEN_LENGTH + 1]; // lets a dropped connection resume without a full login
+} PoolConnection;
+
+struct ClientPool
+{
+    PoolConfig config;
+    char host[64];
+    char unix_path[108];
+    char username[USERNAME_MAX_LENGTH + 1];
+    char password[PASSWORD_MAX_LENGTH + 1];
+
+    PoolConnection *connections;
+
+    pthread_mutex_t lock;
+    pthread_cond_t pending;
+    PoolFuture *head;
+    PoolFuture *tail;
+    int queued;
+    int closing;
+    long long reconnects;
+};
+
+//SESSIONS
+// Opens pc's connection, resuming its session by token when it has one.
+static int pool_login(ClientPool *pool, PoolConnection *pc)
+{
+    char reply[BUFFER_SIZE];
+    const PoolConfig *config = &pool->config;
+    int conn = proto_connect(config->host, config->port, config->unix_path, config->use_shm);
+    if (conn < 0)
+        return 0;
+
+    if (pc->token[0])
+    {
+        if (proto_resume(conn, pc->token, NULL, reply) == config->role)
+        {
+            pc->conn = conn;
+            return 1;
+        }
+        // Expired or revoked: the server hangs up, so log in from scratch.
+        proto_close(conn);
+        pc->token[0] = '\0';
+        conn = proto_connect(config->host, config->port, config->unix_path, config->use_shm);
+        if (conn < 0)
+            return 0;
+    }
+
+    int role;
+    if (config->role == ROLE_ADMIN)
+        role = proto_login_admin(conn, config->username, config->password, pc->token, reply);
+    else
+        role = proto_login_user(conn, config->username, config->password, config->member_id, pc->token, reply);
+
+    if (role != config->role)
+    {
+        proto_close(conn);
+        pc->token[0] = '\0';
+        return 0;
+    }
+    pc->conn = conn;
+    return 1;
+}
+
+static void drop_connection(PoolConnection *pc)
+{
+    proto_close(pc->conn);
+    pc->conn = -1;
+}
+
+// Runs one request, reconnecting once if the connection turns out to be dead.
+static int pool_execute(ClientPool *pool, PoolConnection *pc, PoolFuture *f)
+{
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if (pc->conn < 0)
+        {
+            if (!pool_login(pool, pc))
+                break;
+            pthread_mutex_lock(&pool->lock);
+            pool->reconnects++;
+            pthread_mutex_unlock(&pool->lock);
+        }
+
+        int sent = proto_send(pc->conn, pool->config.role, f->op, f->book_id, f->title, f->author) == 0;
+        if (sent)
+        {
+            int status = proto_read_reply(pc->conn, f->reply);
+            if (status >= 0)
+                return status;
+        }
+        drop_connection(pc);
+
+        // Once a write went out the server may have acted on it; only a
+        // search is safe to send twice.
+        if (sent && f->op != OP_SEARCH)
+            break;
+    }
+
+    snprintf(f->reply, sizeof(f->reply), "Connection failed");
+    return -1;
+}
+
+//FUTURES
+static void future_destroy(PoolFuture *f)
+{
+    pthread_mutex_destroy(&f->lock);
+    pthread_cond_destroy(&f->completed);
+    free(f);
+}
+
+static void future_complete(PoolFuture *f, int status)
+{
+    if (f->callback)
+    {
+        f->callback(status, f->reply, f->arg);
+        future_destroy(f);
+        return;
+    }
+
+    pthread_mutex_lock(&f->lock);
+    f->status = status;
+    f->done = 1;
+    int abandoned = f->abandoned;
+    pthread_cond_broadcast(&f->completed);
+    pthread_mutex_unlock(&f->lock);
+
+    if (abandoned)
+        future_destroy(f);
+}
+
+int pool_future_ready(PoolFuture *future)
+{
+    pthread_mutex_lock(&future->lock);
+    int done = future->done;
+    pthread_mutex_unlock(&future->lock);
+    return done;
+}
+
+int pool_future_wait(PoolFuture *future, int timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    if (timeout_ms > 0)
+    {
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&future->lock);
+    while (!future->done)
+    {
+        if (timeout_ms < 0)
+            pthread_cond_wait(&future->completed, &future->lock);
+        else if (pthread_cond_timedwait(&future->completed, &future->lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+    int done = future->done;
+    pthread_mutex_unlock(&future->lock);
+    return done;
+}
+
+int pool_future_status(PoolFuture *future)
+{
+    return future->status;
+}
+
+const char *pool_future_reply(PoolFuture *future)
+{
+    return future->reply;
+}
+
+void pool_future_free(PoolFuture *future)
+{
+    if (!future)
+        return;
+
+    pthread_mutex_lock(&future->lock);
+    int done = future->done;
+    future->abandoned = 1;
+    pthread_mutex_unlock(&future->lock);
+
+    if (done)
+        future_destroy(future);
+}
+
+//QUEUE
+static void *pool_worker(void *arg)
+{
+    PoolConnection *pc = arg;
+    ClientPool *pool = pc->pool;
+
+    while (1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->head && !pool->closing)
+            pthread_cond_wait(&pool->pending, &pool->lock);
+
+        PoolFuture *f = pool->head;
+        if (!f)
+        {
+            // Closing and drained.
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        pool->head = f->next;
+        if (!pool->head)
+            pool->tail = NULL;
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+
+        future_complete(f, pool_execute(pool, pc, f));
+    }
+    return NULL;
+}
+
+static PoolFuture *enqueue(ClientPool *pool, ProtoOp op, int book_id, const char *title, const char *author,
+                           PoolCallback callback, void *arg)
+{
+    if (!proto_op_allowed(op, pool->config.role))
+        return NULL;
+
+    PoolFuture *f = calloc(1, sizeof(PoolFuture));
+    if (!f)
+        return NULL;
+    f->op = op;
+    f->book_id = book_id;
+    snprintf(f->title, sizeof(f->title), "%s", title ? title : "");
+    snprintf(f->author, sizeof(f->author), "%s", author ? author : "");
+    f->callback = callback;
+    f->arg = arg;
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->completed, NULL);
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->closing || (pool->config.max_queue > 0 && pool->queued >= pool->config.max_queue))
+    {
+        pthread_mutex_unlock(&pool->lock);
+        future_destroy(f);
+        return NULL;
+    }
+    if (pool->tail)
+        pool->tail->next = f;
+    else
+        pool->head = f;
+    pool->tail = f;
+    pool->queued++;
+    pthread_cond_signal(&pool->pending);
+    pthread_mutex_unlock(&pool->lock);
+    return f;
+}
+
+int pool_submit(ClientPool *pool, ProtoOp op, int book_id, const char *title, const char *author,
+                PoolCallback callback, void *arg)
+{
+    if (!callback)
+        return -1;
+    return enqueue(pool, op, book_id, title, author, callback, arg) ? 0 : -1;
+}
+
+PoolFuture *pool_request(ClientPool *pool, ProtoOp op, int book_id, const char *title, const char *author)
+{
+    return enqueue(pool, op, book_id, title, author, NULL, NULL);
+}
+
+int pool_call(ClientPool *pool, ProtoOp op, int book_id, const char *title, const char *author, char *reply)
+{
+    PoolFuture *f = pool_request(pool, op, book_id, title, author);
+    if (!f)
+    {
+        snprintf(reply, BUFFER_SIZE, "Request refused");
+        return -1;
+    }
+
+    pool_future_wait(f, -1);
+    int status = f->status;
+    snprintf(reply, BUFFER_SIZE, "%s", f->reply);
+    pool_future_free(f);
+    return status;
+}
+
+//POOL
+ClientPool *pool_create(const PoolConfig *config)
+{
+    if (config->connections < 1 || (config->role != ROLE_USER && config->role != ROLE_ADMIN) ||
+        !config->username || !config->password)
+        return NULL;
+    // A cut-short login would only fail later, against the server.
+    if (strlen(config->username) > USERNAME_MAX_LENGTH || strlen(config->password) > PASSWORD_MAX_LENGTH)
+        return NULL;
+
+    ClientPool *pool = calloc(1, sizeof(ClientPool));
+    if (!pool)
+        return NULL;
+
+    pool->config = *config;
+    snprintf(pool->host, sizeof(pool->host), "%s", config->host ? config->host : "127.0.0.1");
+    snprintf(pool->username, sizeof(pool->username), "%s", config->username);
+    snprintf(pool->password, sizeof(pool->password), "%s", config->password);
+    pool->config.host = pool->host;
+    pool->config.username = pool->username;
+    pool->config.password = pool->password;
+    if (config->unix_path)
+    {
+        snprintf(pool->unix_path, sizeof(pool->unix_path), "%s", config->unix_path);
+        pool->config.unix_path = pool->unix_path;
+    }
+    if (pool->config.port == 0)
+        pool->config.port = PORT;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->pending, NULL);
+    pool->connections = calloc((size_t)config->connections, sizeof(PoolConnection));
+    if (!pool->connections)
+    {
+        free(pool);
+        return NULL;
+    }
+
+    // Log everything in before the first request so no caller pays for a login.
+    for (int i = 0; i < config->connections; i++)
+    {
+        pool->connections[i].pool = pool;
+        pool->connections[i].conn = -1;
+        if (!pool_login(pool, &pool->connections[i]))
+        {
+            for (int j = 0; j < i; j++)
+                drop_connection(&pool->connections[j]);
+            free(pool->connections);
+            free(pool);
+            return NULL;
+        }
+    }
+
+    for (int i = 0; i < config->connections; i++)
+        pthread_create(&pool->connections[i].thread, NULL, pool_worker, &pool->connections[i]);
+    return pool;
+}
+
+void pool_destroy(ClientPool *pool)
+{
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->closing = 1;
+    pthread_cond_broadcast(&pool->pending);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->config.connections; i++)
+        pthread_join(pool->connections[i].thread, NULL);
+
+    for (int i = 0; i < pool->config.connections; i++)
+    {
+        PoolConnection *pc = &pool->connections[i];
+        if (pc->conn < 0)
+            continue;
+        proto_exit(pc->conn, pool->config.role);
+        drop_connection(pc);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->pending);
+    free(pool->connections);
+    free(pool);
+}
+
+long long pool_reconnects(ClientPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    long long reconnects = pool->reconnects;
+    pthread_mutex_unlock(&pool->lock);
+    return reconnects;
+}
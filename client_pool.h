@@ -0,0 +1,58 @@
+//*******CLIENT CONNECTION POOL*******
+#ifndef CLIENT_POOL_H
+#define CLIENT_POOL_H
+
+#include "client_proto.h"
+
+// A pool keeps a few logged-in connections of one role and serves any number
+// of queued requests over them. The protocol has no request ids, so each
+// connection carries one request at a time; fan-in happens in the queue.
+typedef struct
+{
+    const char *host;      // TCP server (ignored when unix_path is set)
+    int port;
+    const char *unix_path; // Unix socket path, or NULL for TCP
+    int use_shm;           // with unix_path: move each session onto shared memory
+    int connections;
+    int role;              // ROLE_USER or ROLE_ADMIN
+    const char *username;
+    const char *password;
+    int member_id;         // users only
+    int max_queue;         // pending requests before submits are refused; 0 = no limit
+} PoolConfig;
+
+typedef struct ClientPool ClientPool;
+typedef struct PoolFuture PoolFuture;
+
+// status is the reply length, or -1 when the request could not be delivered.
+// Callbacks run on a pool thread and must not block for long.
+typedef void (*PoolCallback)(int status, const char *reply, void *arg);
+
+// Connects and logs in every connection up front; NULL if any login fails or
+// the username or password is too long for the server.
+ClientPool *pool_create(const PoolConfig *config);
+// Finishes queued requests, then logs out and closes every connection.
+void pool_destroy(ClientPool *pool);
+
+// Non-blocking submit with a completion callback. Returns 0, or -1 when the
+// op is not allowed for the pool's role, the queue is full or the pool is closing.
+int pool_submit(ClientPool *pool, ProtoOp op, int book_id, const char *title, const char *author,
+                PoolCallback callback, void *arg);
+
+// Non-blocking submit returning a future to poll or wait on; NULL as for pool_submit.
+PoolFuture *pool_request(ClientPool *pool, ProtoOp op, int book_id, const char *title, const char *author);
+int pool_future_ready(PoolFuture *future);
+// Waits up to timeout_ms (-1 = forever); returns 1 once complete, 0 on timeout.
+int pool_future_wait(PoolFuture *future, int timeout_ms);
+int pool_future_status(PoolFuture *future);
+const char *pool_future_reply(PoolFuture *future);
+// Safe to call before completion: the pool then drops the result itself.
+void pool_future_free(PoolFuture *future);
+
+// Blocking convenience wrapper; returns the status and copies the reply.
+int pool_call(ClientPool *pool, ProtoOp op, int book_id, const char *title, const char *author, char *reply);
+
+// Sessions re-established after a dropped connection (by token or fresh login).
+long long pool_reconnects(ClientPool *pool);
+
+#endif
@@ -0,0 +1,496 @@
+//*******CLIENT PROTOCOL*******
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include "client_proto.h"
+#include "transport.h"
+
+#define PROTO_CACHE_SLOTS 256       // direct-mapped by book ID
+#define PROTO_CACHE_REPLY_SIZE 192 // longer replies are not cached
+
+typedef struct
+{
+    int book_id;
+    long long expires_ms; // 0 once invalidated
+    char reply[PROTO_CACHE_REPLY_SIZE];
+} CachedReply;
+
+// A connection with leases. Only the thread using the connection touches
+// its state; leases_mutex guards the list.
+typedef struct ProtoLease
+{
+    int conn;
+    int lease_ms;
+    size_t remaining;    // reply bytes of the current frame still unread
+    int watched;         // book of the search in flight
+    int watched_changed; // an invalidation for it came before its reply
+    ProtoCacheStats stats;
+    CachedReply slots[PROTO_CACHE_SLOTS];
+    struct ProtoLease *next;
+} ProtoLease;
+
+static pthread_mutex_t leases_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ProtoLease *leases = NULL;
+static int lease_count = 0; // while 0 no read looks up the list
+
+// Sends use MSG_NOSIGNAL: a server that went away is an error return, not a
+// SIGPIPE that kills the program using this code.
+int proto_connect(const char *host, int port, const char *unix_path, int use_shm)
+{
+    if (unix_path)
+        return use_shm ? transport_connect_shm(unix_path) : transport_connect_unix(unix_path);
+
+    struct sockaddr_in serv_addr;
+    int nodelay = 1;
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0)
+        return -1;
+
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &serv_addr.sin_addr) <= 0 ||
+        connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+
+    // Logins go out as several small writes; don't let Nagle hold them back.
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return sock;
+}
+
+//LEASE FRAMES
+static ProtoLease *find_lease(int conn)
+{
+    if (__atomic_load_n(&lease_count, __ATOMIC_ACQUIRE) == 0)
+        return NULL;
+    pthread_mutex_lock(&leases_mutex);
+    ProtoLease *lease = leases;
+    while (lease && lease->conn != conn)
+        lease = lease->next;
+    pthread_mutex_unlock(&leases_mutex);
+    return lease;
+}
+
+static long long now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void invalidate(ProtoLease *lease, int book_id)
+{
+    CachedReply *slot = &lease->slots[(unsigned int)book_id % PROTO_CACHE_SLOTS];
+    if (slot->book_id == book_id)
+        slot->expires_ms = 0;
+    if (lease->watched == book_id)
+        lease->watched_changed = 1;
+    lease->stats.invalidations++;
+}
+
+// Reads frame headers, applying invalidations, until a reply starts.
+// Returns 1 then, -1 when the connection failed, and with dont_wait 0 as
+// soon as nothing more has arrived.
+static int next_frame(ProtoLease *lease, int dont_wait)
+{
+    while (lease->remaining == 0)
+    {
+        int32_t header;
+        ssize_t n = conn_recv(lease->conn, &header, sizeof(header), dont_wait ? MSG_DONTWAIT : MSG_WAITALL);
+        if (n < 0 && dont_wait && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        // A frame is written whole, so the rest of a split header is on its way.
+        if (n > 0 && n < (ssize_t)sizeof(header))
+            n += conn_recv(lease->conn, (char *)&header + n, sizeof(header) - (size_t)n, MSG_WAITALL);
+        if (n != (ssize_t)sizeof(header))
+            return -1;
+        if (header < 0)
+            invalidate(lease, -header);
+        else
+            lease->remaining = (size_t)header;
+    }
+    return 1;
+}
+
+// Invalidations that arrived since the last reply. A reply nobody asked
+// for means the connection is out of step.
+static int drain_invalidations(ProtoLease *lease)
+{
+    int started = next_frame(lease, 1);
+    return started == 0 ? 0 : -1;
+}
+
+// conn_read for replies: on a connection with leases it returns reply bytes
+// only, and at most the rest of one frame, so one read is still one reply.
+static ssize_t reply_read(int conn, void *buffer, size_t length)
+{
+    ProtoLease *lease = find_lease(conn);
+    if (!lease)
+        return conn_read(conn, buffer, length);
+    if (next_frame(lease, 0) < 0)
+        return -1;
+    size_t wanted = length < lease->remaining ? length : lease->remaining;
+    ssize_t n = conn_recv(conn, buffer, wanted, MSG_WAITALL);
+    if (n > 0)
+        lease->remaining -= (size_t)n;
+    return n;
+}
+
+void proto_close(int conn)
+{
+    pthread_mutex_lock(&leases_mutex);
+    for (ProtoLease **link = &leases; *link; link = &(*link)->next)
+    {
+        if ((*link)->conn == conn)
+        {
+            ProtoLease *lease = *link;
+            *link = lease->next;
+            free(lease);
+            __atomic_sub_fetch(&lease_count, 1, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&leases_mutex);
+    conn_close(conn);
+}
+
+// One reply per request: the server answers with a single write.
+int proto_read_reply(int conn, char *reply)
+{
+    ssize_t n = reply_read(conn, reply, BUFFER_SIZE - 1);
+    if (n <= 0)
+    {
+        reply[0] = '\0';
+        return -1;
+    }
+    reply[n] = '\0';
+    return (int)n;
+}
+
+// Reads until marker shows up (or the login fails or the server is busy); the user login answer
+// arrives as two writes that TCP may or may not merge.
+static int read_until(int conn, char *reply, const char *marker)
+{
+    size_t used = 0;
+    reply[0] = '\0';
+    while (!strstr(reply, marker) && !strstr(reply, "Authentication failed!") && !strstr(reply, "Server busy"))
+    {
+        if (used >= BUFFER_SIZE - 1)
+            break;
+        ssize_t n = reply_read(conn, reply + used, BUFFER_SIZE - 1 - used);
+        if (n <= 0)
+            return -1;
+        used += (size_t)n;
+        reply[used] = '\0';
+    }
+    return (int)used;
+}
+
+static void copy_token(const char *reply, char *token)
+{
+    const char *found = strstr(reply, "Session token: ");
+    if (token && found)
+    {
+        strncpy(token, found + strlen("Session token: "), TOKEN_LENGTH);
+        token[TOKEN_LENGTH] = '\0';
+    }
+}
+
+//LOGIN
+int proto_login_user(int conn, const char *username, const char *password, int member_id, char *token, char *reply)
+{
+    char buffer[BUFFER_SIZE] = {0};
+    int role = ROLE_USER;
+    int rented_book_id = 0;
+
+    snprintf(buffer, sizeof(buffer), "%s %s %d", username, password, member_id);
+    if (conn_send(conn, &role, sizeof(role), MSG_NOSIGNAL) != sizeof(role) ||
+        conn_send(conn, buffer, sizeof(buffer), MSG_NOSIGNAL) != sizeof(buffer) ||
+        conn_send(conn, &rented_book_id, sizeof(rented_book_id), MSG_NOSIGNAL) != sizeof(rented_book_id))
+        return 0;
+
+    if (read_until(conn, reply, "logged in succesfully") < 0 || strstr(reply, "Authentication failed!"))
+        return 0;
+
+    copy_token(reply, token);
+    return ROLE_USER;
+}
+
+int proto_login_admin(int conn, const char *username, const char *password, char *token, char *reply)
+{
+    char buffer[BUFFER_SIZE] = {0};
+    int role = ROLE_ADMIN;
+
+    snprintf(buffer, sizeof(buffer), "%s %s", username, password);
+    if (conn_send(conn, &role, sizeof(role), MSG_NOSIGNAL) != sizeof(role) ||
+        conn_send(conn, buffer, sizeof(buffer), MSG_NOSIGNAL) != sizeof(buffer))
+        return 0;
+
+    if (proto_read_reply(conn, reply) < 0 || strstr(reply, "Authentication failed!"))
+        return 0;
+
+    copy_token(reply, token);
+    return ROLE_ADMIN;
+}
+
+int proto_resume(int conn, const char *token, int *member_id, char *reply)
+{
+    char buffer[BUFFER_SIZE] = {0};
+    int role = ROLE_RESUME;
+    int resumed_role = 0;
+    int resumed_member = 0;
+
+    snprintf(buffer, sizeof(buffer), "%s", token);
+    if (conn_send(conn, &role, sizeof(role), MSG_NOSIGNAL) != sizeof(role) ||
+        conn_send(conn, buffer, sizeof(buffer), MSG_NOSIGNAL) != sizeof(buffer))
+        return 0;
+
+    if (proto_read_reply(conn, reply) < 0 ||
+        sscanf(reply, "Session resumed: role %d member %d", &resumed_role, &resumed_member) != 2)
+        return 0;
+
+    if (member_id)
+        *member_id = resumed_member;
+    return resumed_role;
+}
+
+//REQUESTS
+static const char *op_names[OP_COUNT] = {"search", "rent", "return", "add", "modify", "delete"};
+
+const char *proto_op_name(ProtoOp op)
+{
+    return op >= 0 && op < OP_COUNT ? op_names[op] : "unknown";
+}
+
+int proto_op_allowed(ProtoOp op, int role)
+{
+    if (op == OP_SEARCH)
+        return role == ROLE_USER || role == ROLE_ADMIN;
+    if (op == OP_RENT || op == OP_RETURN)
+        return role == ROLE_USER;
+    return role == ROLE_ADMIN;
+}
+
+int proto_send(int conn, int role, ProtoOp op, int book_id, const char *title, const char *author)
+{
+    // role, menu choice, payload
+    unsigned char message[2 * sizeof(int) + sizeof(int) + BUFFER_SIZE];
+    size_t length = 2 * sizeof(int);
+    int choice = 0;
+
+    if (!proto_op_allowed(op, role))
+        return -1;
+
+    switch (op)
+    {
+    case OP_SEARCH:
+        choice = role == ROLE_ADMIN ? ADMIN_SEARCH : USER_SEARCH;
+        length += (size_t)sprintf((char *)message + length, "%d", book_id);
+        break;
+    case OP_RENT:
+        choice = USER_RENT;
+        memcpy(message + length, &book_id, sizeof(book_id));
+        length += sizeof(book_id);
+        break;
+    case OP_RETURN:
+        // The server parses the id of a return as text.
+        choice = USER_RETURN;
+        length += (size_t)sprintf((char *)message + length, "%d", book_id);
+        break;
+    case OP_ADD:
+        // Title and author travel as two fixed 50-byte fields.
+        choice = ADMIN_ADD;
+        memset(message + length, 0, 100);
+        strncpy((char *)message + length, title, 49);
+        strncpy((char *)message + length + 50, author, 49);
+        length += 100;
+        break;
+    case OP_MODIFY:
+        choice = ADMIN_MODIFY;
+        memcpy(message + length, &book_id, sizeof(book_id));
+        length += sizeof(book_id);
+        memset(message + length, 0, BUFFER_SIZE);
+        snprintf((char *)message + length, BUFFER_SIZE, "%.49s %.49s", title, author);
+        length += BUFFER_SIZE;
+        break;
+    case OP_DELETE:
+        choice = ADMIN_DELETE;
+        length += (size_t)sprintf((char *)message + length, "%d", book_id);
+        break;
+    default:
+        return -1;
+    }
+
+    memcpy(message, &role, sizeof(role));
+    memcpy(message + sizeof(role), &choice, sizeof(choice));
+    return conn_send(conn, message, length, MSG_NOSIGNAL) == (ssize_t)length ? 0 : -1;
+}
+
+static int request(int conn, int role, ProtoOp op, int book_id, const char *title, const char *author, char *reply)
+{
+    if (proto_send(conn, role, op, book_id, title, author) < 0)
+        return -1;
+    return proto_read_reply(conn, reply);
+}
+
+int proto_rent(int conn, int book_id, char *reply)
+{
+    return request(conn, ROLE_USER, OP_RENT, book_id, NULL, NULL, reply);
+}
+
+int proto_return(int conn, int book_id, char *reply)
+{
+    return request(conn, ROLE_USER, OP_RETURN, book_id, NULL, NULL, reply);
+}
+
+// With a cache, a book found within its lease is answered from memory.
+int proto_search(int conn, int role, int book_id, char *reply)
+{
+    ProtoLease *lease = find_lease(conn);
+    if (!lease)
+        return request(conn, role, OP_SEARCH, book_id, NULL, NULL, reply);
+
+    if (drain_invalidations(lease) < 0)
+        return -1;
+    CachedReply *slot = &lease->slots[(unsigned int)book_id % PROTO_CACHE_SLOTS];
+    long long sent = now_ms();
+    if (slot->book_id == book_id && slot->expires_ms > sent)
+    {
+        lease->stats.hits++;
+        size_t length = strlen(slot->reply);
+        memcpy(reply, slot->reply, length + 1);
+        return (int)length;
+    }
+
+    lease->stats.misses++;
+    lease->watched = book_id;
+    lease->watched_changed = 0;
+    int n = request(conn, role, OP_SEARCH, book_id, NULL, NULL, reply);
+    lease->watched = 0;
+    // Only found books are leased; a reply the book changed under is shown but not kept.
+    if (n > 0 && n < PROTO_CACHE_REPLY_SIZE && !lease->watched_changed && strncmp(reply, "ID: ", 4) == 0)
+    {
+        slot->book_id = book_id;
+        slot->expires_ms = sent + lease->lease_ms;
+        memcpy(slot->reply, reply, (size_t)n + 1);
+    }
+    return n;
+}
+
+int proto_add(int conn, const char *title, const char *author, char *reply)
+{
+    return request(conn, ROLE_ADMIN, OP_ADD, 0, title, author, reply);
+}
+
+int proto_delete(int conn, int book_id, char *reply)
+{
+    return request(conn, ROLE_ADMIN, OP_DELETE, book_id, NULL, NULL, reply);
+}
+
+int proto_modify(int conn, int book_id, const char *title, const char *author, char *reply)
+{
+    return request(conn, ROLE_ADMIN, OP_MODIFY, book_id, title, author, reply);
+}
+
+int proto_exit(int conn, int role)
+{
+    char reply[BUFFER_SIZE];
+    int header[2] = {role, role == ROLE_ADMIN ? ADMIN_EXIT : USER_EXIT};
+    if (conn_send(conn, header, sizeof(header), MSG_NOSIGNAL) != sizeof(header))
+        return -1;
+    // Wait for the goodbye so closing right after does not race the server's last write.
+    return proto_read_reply(conn, reply) < 0 ? -1 : 0;
+}
+
+// Unlike the other replies the metrics text can exceed BUFFER_SIZE, so it
+// arrives as an int length followed by that many bytes.
+int proto_metrics(int conn, char **text)
+{
+    int header[2] = {ROLE_ADMIN, ADMIN_METRICS};
+    int length = 0;
+    size_t used = 0;
+
+    *text = NULL;
+    if (conn_send(conn, header, sizeof(header), MSG_NOSIGNAL) != sizeof(header))
+        return -1;
+    while (used < sizeof(length))
+    {
+        ssize_t n = reply_read(conn, (char *)&length + used, sizeof(length) - used);
+        if (n <= 0)
+            return -1;
+        used += (size_t)n;
+    }
+    if (length < 0)
+        return -1;
+
+    char *body = malloc((size_t)length + 1);
+    if (!body)
+        return -1;
+    for (used = 0; used < (size_t)length;)
+    {
+        ssize_t n = reply_read(conn, body + used, (size_t)length - used);
+        if (n <= 0)
+        {
+            free(body);
+            return -1;
+        }
+        used += (size_t)n;
+    }
+    body[length] = '\0';
+    *text = body;
+    return length;
+}
+
+//CLIENT CACHE
+int proto_cache_enable(int conn, int role, char *reply)
+{
+    int header[2] = {role, role == ROLE_ADMIN ? ADMIN_LEASES : USER_LEASES};
+    int lease_ms = 0;
+
+    ProtoLease *existing = find_lease(conn);
+    if (conn_send(conn, header, sizeof(header), MSG_NOSIGNAL) != sizeof(header) || proto_read_reply(conn, reply) < 0)
+        return -1;
+    if (sscanf(reply, "Leases on: %d ms", &lease_ms) != 1 || lease_ms <= 0)
+        return 0;
+    if (existing)
+        return existing->lease_ms;
+
+    // The server frames everything after this reply.
+    ProtoLease *lease = calloc(1, sizeof(ProtoLease));
+    if (!lease)
+        return -1;
+    lease->conn = conn;
+    lease->lease_ms = lease_ms;
+    pthread_mutex_lock(&leases_mutex);
+    lease->next = leases;
+    leases = lease;
+    __atomic_add_fetch(&lease_count, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&leases_mutex);
+    return lease_ms;
+}
+
+int proto_cache_stats(int conn, ProtoCacheStats *stats)
+{
+    ProtoLease *lease = find_lease(conn);
+    if (!lease)
+        return 0;
+    *stats = lease->stats;
+    return 1;
+}
+
+int proto_reply_failed(const char *reply)
+{
+    return strstr(reply, "not found") != NULL || strstr(reply, "Invalid") != NULL ||
+           strstr(reply, "denied") != NULL || strstr(reply, "failed") != NULL || strstr(reply, "busy") != NULL;
+}
@@ -0,0 +1,100 @@
+//*******CLIENT PROTOCOL*******
+#ifndef CLIENT_PROTO_H
+#define CLIENT_PROTO_H
+
+#define PORT 8080
+#define BUFFER_SIZE 1024
+#define TOKEN_LENGTH 32
+#define USERNAME_MAX_LENGTH 49  // the server's account names are shorter
+#define PASSWORD_MAX_LENGTH 128 // the server refuses longer passwords
+
+#define ROLE_USER 1
+#define ROLE_ADMIN 2
+#define ROLE_RESUME 3
+
+// Menu choices, as sent after the role on every request.
+#define USER_RENT 1
+#define USER_RETURN 2
+#define USER_SEARCH 3
+#define USER_EXIT 4
+#define USER_LEASES 5
+
+#define ADMIN_ADD 1
+#define ADMIN_DELETE 2
+#define ADMIN_MODIFY 3
+#define ADMIN_SEARCH 4
+#define ADMIN_EXIT 5
+#define ADMIN_METRICS 6
+#define ADMIN_LEASES 7
+
+// Catalog operations independent of the menu numbering of each role.
+typedef enum
+{
+    OP_SEARCH,
+    OP_RENT,
+    OP_RETURN,
+    OP_ADD,
+    OP_MODIFY,
+    OP_DELETE,
+    OP_COUNT
+} ProtoOp;
+
+// Connects over TCP (host:port) or, when unix_path is set, over the Unix
+// socket; use_shm additionally moves the session onto shared memory.
+// Returns a connection id for the calls below, or -1.
+int proto_connect(const char *host, int port, const char *unix_path, int use_shm);
+void proto_close(int conn);
+
+// Logins return the granted role (0 on failure) and copy the session token
+// into token when it is not NULL. reply receives the server's text.
+int proto_login_user(int conn, const char *username, const char *password, int member_id, char *token, char *reply);
+int proto_login_admin(int conn, const char *username, const char *password, char *token, char *reply);
+int proto_resume(int conn, const char *token, int *member_id, char *reply);
+
+// Split request/reply for callers that keep several connections in flight.
+// proto_send writes the whole request (header and payload) in one call and
+// returns 0, or -1 when the connection failed or the role cannot run op.
+int proto_send(int conn, int role, ProtoOp op, int book_id, const char *title, const char *author);
+int proto_read_reply(int conn, char *reply);
+const char *proto_op_name(ProtoOp op);
+int proto_op_allowed(ProtoOp op, int role);
+
+// Requests return the reply length, or -1 when the connection failed.
+int proto_rent(int conn, int book_id, char *reply);
+int proto_return(int conn, int book_id, char *reply);
+int proto_search(int conn, int role, int book_id, char *reply);
+int proto_add(int conn, const char *title, const char *author, char *reply);
+int proto_delete(int conn, int book_id, char *reply);
+int proto_modify(int conn, int book_id, const char *title, const char *author, char *reply);
+int proto_exit(int conn, int role);
+
+// Admin only: fetches the server's Prometheus metrics into a malloc'd string
+// the caller frees. Returns its length, or -1.
+int proto_metrics(int conn, char **text);
+
+// 1 when a reply reports that the operation did not happen.
+int proto_reply_failed(const char *reply);
+
+// Optional search cache. proto_cache_enable asks the server for leases on
+// the connection; from then on proto_search answers a book it found within
+// the lease from memory, and the invalidations the server sends when the
+// book is rented, returned, modified or deleted, read before every cached
+// answer and with every reply, drop it at once. The server frames every
+// message on the connection from then on, which the functions above undo;
+// nothing else may read from it. A lease runs from when the search was
+// sent, so it never outlasts the server's.
+// Returns the lease length in ms, 0 when the server grants none (the
+// connection is then unchanged), or -1 when the connection failed.
+int proto_cache_enable(int conn, int role, char *reply);
+
+typedef struct
+{
+    long long hits;
+    long long misses;
+    long long invalidations;
+} ProtoCacheStats;
+
+// 0 when conn has no cache.
+int proto_cache_stats(int conn, ProtoCacheStats *stats);
+
+#endif
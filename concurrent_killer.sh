@@ -3,9 +3,9 @@
 # --- Concurrency Killer Script (concurrent_killer.sh) ---
 
 compile_server() {
-    echo "Compiling server $1..."
-    # Now that the function is named 'main', use standard compilation:
-    gcc server.c -o $1 -pthread 
+    echo "Compiling mutant schemata server..."
+    # One build holds every mutant; LIBRARY_MUTANT picks the live one
+    make server_mutants > /dev/null
     if [ $? -ne 0 ]; then
         echo "Server compilation failed."
         exit 1
@@ -14,8 +14,14 @@ compile_server() {
 
 # 1. Setup: Clean up old files and compile
 make clean > /dev/null
-compile_server mutant_server
-gcc client.c -o client -pthread # Compile client
+compile_server
+# The lock deletion mutant on the catalog mutex
+MUTANT_ID=$(python3 mutate.py list | awk '$2 == "LCK" && $3 ~ /^catalog.c/ { print $1; exit }')
+if [ -z "$MUTANT_ID" ]; then
+    echo "No lock deletion mutant in schemata/mutants.tsv."
+    exit 1
+fi
+make client > /dev/null # Compile client
 if [ $? -ne 0 ]; then
     echo "Client compilation failed."
     exit 1
@@ -23,8 +29,8 @@ fi
 rm -f books.txt # Ensure file is clean before test
 
 # 2. Launch the Mutant Server in the background
-echo "--- 🚀 Launching MUTANT Server (Lock Deleted) ---"
-./mutant_server &
+echo "--- 🚀 Launching MUTANT Server (Lock Deleted, mutant $MUTANT_ID) ---"
+LIBRARY_MUTANT=$MUTANT_ID ./server_mutants &
 SERVER_PID=$!
 sleep 1 # Give server time to bind to port
 
@@ -38,8 +44,9 @@ run_client() {
     
     echo "--- Client $CLIENT_ID trying to add $BOOK_TITLE ---"
     
-    # Input sequence: 2 (Admin) -> admin -> admin -> 1 (Add) -> Title -> Author -> 5 (Exit)
-    (sleep $DELAY; echo 2; echo admin; echo admin; echo 1; echo $BOOK_TITLE; echo $BOOK_AUTHOR; echo 5) | ./client 
+    # Scripted mode: admin login, one add, exit. No prompts to pipe through.
+    sleep $DELAY
+    ./client -a admin:admin -e "add $BOOK_TITLE $BOOK_AUTHOR"
 }
 
 # 4. Execute the clients concurrently
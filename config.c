@@ -0,0 +1,344 @@
+//*******SERVER CONFIGURATION*******
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <getopt.h>
+#include "config.h"
+#include "transport.h"
+#include "credentials.h"
+#include "capture.h"
+#include "metrics.h"
+#include "trace.h"
+#include "slowlog.h"
+#include "idle.h"
+#include "storage.h"
+#include "result_cache.h"
+#include "lease.h"
+
+#define CONFIG_LINE_SIZE 1024
+
+typedef enum
+{
+    CONFIG_INT,
+    CONFIG_DOUBLE,
+    CONFIG_STRING
+} ConfigType;
+
+typedef struct
+{
+    const char *key;
+    int short_flag; // 0: long form only
+    const char *env; // NULL: no environment variable
+    ConfigType type;
+    size_t offset;
+    size_t size; // strings: buffer size
+    int min;     // numbers: smallest accepted value
+    int max;     // numbers: largest accepted value, 0 for no limit
+    const char *help;
+} ConfigOption;
+
+#define STRING_FIELD(field) CONFIG_STRING, offsetof(ServerConfig, field), sizeof(((ServerConfig *)0)->field), 0, 0
+#define INT_FIELD(field, min, max) CONFIG_INT, offsetof(ServerConfig, field), 0, min, max
+#define DOUBLE_FIELD(field) CONFIG_DOUBLE, offsetof(ServerConfig, field), 0, 0, 0
+
+static const ConfigOption options[] = {
+    {"listen-address", 'l', NULL, STRING_FIELD(listen_address), "IPv4 address for TCP clients"},
+    {"port", 'p', NULL, INT_FIELD(port, 1, 65535), "TCP port"},
+    {"unix-socket", 0, NULL, STRING_FIELD(unix_socket), "Unix socket path, empty for none"},
+    {"data-dir", 'd', NULL, STRING_FIELD(data_dir), "directory holding every relative path (created if missing)"},
+    {"credentials", 0, NULL, STRING_FIELD(credentials), "account file"},
+    {"storage", 0, STORAGE_ENV, STRING_FIELD(storage), "catalog backend: text, binary or memory"},
+    {"catalog", 0, STORAGE_PATH_ENV, STRING_FIELD(catalog), "catalog file (backend default when empty)"},
+    {"loan-limit", 0, CATALOG_LOAN_LIMIT_ENV, INT_FIELD(loan_limit, 0, 0), "books one member may have out at once, 0 unlimited"},
+    {"result-cache", 0, RESULT_CACHE_ENV, INT_FIELD(result_cache, 0, 0), "search replies kept in memory, 0 off"},
+    {"lease-ms", 0, LEASE_ENV, INT_FIELD(lease_ms, 0, 0), "how long clients may cache a search, 0 no leases"},
+    {"backlog", 0, NULL, INT_FIELD(backlog, 1, 0), "listen backlog"},
+    {"max-sessions", 0, ADMISSION_MAX_SESSIONS_ENV, INT_FIELD(admission.max_sessions, 0, 0), "sessions (connection threads) at once, 0 unlimited"},
+    {"session-queue", 0, ADMISSION_SESSION_QUEUE_ENV, INT_FIELD(admission.session_queue, 0, ADMISSION_MAX_SESSION_QUEUE), "connections waiting for a session"},
+    {"session-wait", 0, ADMISSION_SESSION_WAIT_ENV, INT_FIELD(admission.session_wait, 0, 0), "seconds a connection may wait, 0 forever"},
+    {"max-pending", 0, ADMISSION_MAX_PENDING_ENV, INT_FIELD(admission.max_pending, 0, 0), "catalog requests in flight before more are refused busy, 0 unlimited"},
+    {"rate-limit", 0, ADMISSION_RATE_ENV, DOUBLE_FIELD(admission.rate), "requests per second per session, 0 off"},
+    {"rate-burst", 0, ADMISSION_BURST_ENV, DOUBLE_FIELD(admission.burst), "token bucket size, 0 for one second's worth"},
+    {"idle-timeout", 0, IDLE_TIMEOUT_ENV, INT_FIELD(idle_timeout, 0, 0), "seconds before an idle session is closed, 0 never"},
+    {"metrics-port", 0, METRICS_PORT_ENV, INT_FIELD(metrics_port, 0, 65535), "serve /metrics on 127.0.0.1:port, 0 off"},
+    {"capture", 0, CAPTURE_ENV, STRING_FIELD(capture), "record requests for replay to this file"},
+    {"trace", 0, TRACE_ENV, STRING_FIELD(trace), "write sampled Chrome traces to this file"},
+    {"trace-rate", 0, TRACE_RATE_ENV, DOUBLE_FIELD(trace_rate), "fraction of requests traced"},
+    {"slowlog", 0, SLOWLOG_ENV, STRING_FIELD(slowlog), "log slow requests to this file"},
+    {"slowlog-ms", 0, SLOWLOG_THRESHOLD_ENV, INT_FIELD(slowlog_ms, 0, 0), "slow-request threshold in ms"},
+    {"slowlog-rate", 0, SLOWLOG_RATE_ENV, INT_FIELD(slowlog_rate, 1, 0), "slow-log records per second"},
+};
+
+#define OPTION_COUNT (sizeof(options) / sizeof(options[0]))
+
+void config_defaults(ServerConfig *config)
+{
+    memset(config, 0, sizeof(*config));
+    snprintf(config->listen_address, sizeof(config->listen_address), "0.0.0.0");
+    config->port = CONFIG_DEFAULT_PORT;
+    snprintf(config->unix_socket, sizeof(config->unix_socket), "%s", UNIX_SOCKET_PATH);
+    snprintf(config->data_dir, sizeof(config->data_dir), ".");
+    snprintf(config->credentials, sizeof(config->credentials), "%s", CREDENTIALS_FILE);
+    snprintf(config->storage, sizeof(config->storage), "%s", storage_text.name);
+    config->backlog = CONFIG_DEFAULT_BACKLOG;
+    config->admission.max_sessions = ADMISSION_DEFAULT_MAX_SESSIONS;
+    config->admission.session_queue = ADMISSION_DEFAULT_SESSION_QUEUE;
+    config->admission.session_wait = ADMISSION_DEFAULT_SESSION_WAIT;
+    config->admission.max_pending = ADMISSION_DEFAULT_MAX_PENDING;
+    config->idle_timeout = IDLE_DEFAULT_TIMEOUT;
+    config->trace_rate = TRACE_DEFAULT_RATE;
+    config->slowlog_ms = SLOWLOG_DEFAULT_THRESHOLD_MS;
+    config->slowlog_rate = SLOWLOG_DEFAULT_RATE;
+    config->result_cache = RESULT_CACHE_DEFAULT_ENTRIES;
+    config->lease_ms = LEASE_DEFAULT_MS;
+}
+
+static const ConfigOption *find_option(const char *key)
+{
+    for (size_t i = 0; i < OPTION_COUNT; i++)
+    {
+        if (strcmp(options[i].key, key) == 0)
+            return &options[i];
+    }
+    return NULL;
+}
+
+//SETTING VALUES
+static int set_option(ServerConfig *config, const ConfigOption *option, const char *value)
+{
+    char *field = (char *)config + option->offset;
+    char *end = NULL;
+    errno = 0;
+
+    switch (option->type)
+    {
+    case CONFIG_STRING:
+        if (strlen(value) >= option->size)
+        {
+            fprintf(stderr, "%s: value longer than %zu characters\n", option->key, option->size - 1);
+            return -1;
+        }
+        memcpy(field, value, strlen(value) + 1);
+        return 0;
+
+    case CONFIG_INT:
+    {
+        long number = strtol(value, &end, 10);
+        if (errno || end == value || *end || number < option->min || (option->max && number > option->max) ||
+            number > 2147483647L)
+        {
+            if (option->max)
+                fprintf(stderr, "%s: expected a whole number from %d to %d, got '%s'\n", option->key, option->min, option->max, value);
+            else
+                fprintf(stderr, "%s: expected a whole number of at least %d, got '%s'\n", option->key, option->min, value);
+            return -1;
+        }
+        *(int *)field = (int)number;
+        return 0;
+    }
+
+    case CONFIG_DOUBLE:
+    {
+        double number = strtod(value, &end);
+        if (errno || end == value || *end || number < 0)
+        {
+            fprintf(stderr, "%s: expected a non-negative number, got '%s'\n", option->key, value);
+            return -1;
+        }
+        *(double *)field = number;
+        return 0;
+    }
+    }
+    return -1;
+}
+
+int config_set(ServerConfig *config, const char *key, const char *value)
+{
+    const ConfigOption *option = find_option(key);
+    if (!option)
+    {
+        fprintf(stderr, "Unknown setting '%s'\n", key);
+        return -1;
+    }
+    return set_option(config, option, value);
+}
+
+static char *trim(char *text)
+{
+    while (*text == ' ' || *text == '\t')
+        text++;
+    char *end = text + strlen(text);
+    while (end > text && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r'))
+        *--end = '\0';
+    return text;
+}
+
+int config_load_file(ServerConfig *config, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        perror(path);
+        return -1;
+    }
+
+    char buffer[CONFIG_LINE_SIZE];
+    int line = 0, result = 0;
+    while (fgets(buffer, sizeof(buffer), file))
+    {
+        line++;
+        char *text = trim(buffer);
+        if (!*text || *text == '#')
+            continue;
+
+        char *equals = strchr(text, '=');
+        if (!equals)
+        {
+            fprintf(stderr, "%s:%d: expected key = value\n", path, line);
+            result = -1;
+            continue;
+        }
+        *equals = '\0';
+        if (config_set(config, trim(text), trim(equals + 1)) < 0)
+        {
+            fprintf(stderr, "%s:%d: bad setting\n", path, line);
+            result = -1;
+        }
+    }
+    fclose(file);
+    return result;
+}
+
+int config_load_env(ServerConfig *config)
+{
+    int result = 0;
+    for (size_t i = 0; i < OPTION_COUNT; i++)
+    {
+        const char *value = options[i].env ? getenv(options[i].env) : NULL;
+        if (value && set_option(config, &options[i], value) < 0)
+        {
+            fprintf(stderr, "(from %s)\n", options[i].env);
+            result = -1;
+        }
+    }
+    return result;
+}
+
+//COMMAND LINE
+// Long options are the setting keys; their getopt codes are 256 + table index.
+int config_parse(ServerConfig *config, int argc, char *argv[])
+{
+    struct option long_options[OPTION_COUNT + 3];
+    char short_options[2 * OPTION_COUNT + 8] = "c:h";
+    const char *config_path = NULL;
+    size_t used = strlen(short_options);
+
+    for (size_t i = 0; i < OPTION_COUNT; i++)
+    {
+        long_options[i] = (struct option){options[i].key, required_argument, NULL, 256 + (int)i};
+        if (options[i].short_flag)
+        {
+            short_options[used++] = (char)options[i].short_flag;
+            short_options[used++] = ':';
+        }
+    }
+    short_options[used] = '\0';
+    long_options[OPTION_COUNT] = (struct option){"config", required_argument, NULL, 'c'};
+    long_options[OPTION_COUNT + 1] = (struct option){"help", no_argument, NULL, 'h'};
+    long_options[OPTION_COUNT + 2] = (struct option){NULL, 0, NULL, 0};
+
+    config_defaults(config);
+
+    // First pass: only the config file, so flags override what it says
+    // whatever their order.
+    int opt;
+    opterr = 0;
+    optind = 1;
+    while ((opt = getopt_long(argc, argv, short_options, long_options, NULL)) != -1)
+    {
+        if (opt == 'c')
+            config_path = optarg;
+        else if (opt == 'h')
+        {
+            config_usage(stdout, argv[0]);
+            return 1;
+        }
+    }
+    if (config_path && config_load_file(config, config_path) < 0)
+        return -1;
+    if (config_load_env(config) < 0)
+        return -1;
+
+    opterr = 1;
+    optind = 1;
+    while ((opt = getopt_long(argc, argv, short_options, long_options, NULL)) != -1)
+    {
+        const ConfigOption *option = NULL;
+        if (opt >= 256 && opt < 256 + (int)OPTION_COUNT)
+            option = &options[opt - 256];
+        for (size_t i = 0; !option && opt > 0 && opt < 256 && i < OPTION_COUNT; i++)
+        {
+            if (options[i].short_flag == opt)
+                option = &options[i];
+        }
+
+        if (opt == 'c')
+            continue;
+        if (!option)
+        {
+            config_usage(stderr, argv[0]);
+            return -1;
+        }
+        if (set_option(config, option, optarg) < 0)
+            return -1;
+    }
+    if (optind < argc)
+    {
+        fprintf(stderr, "Unexpected argument '%s'\n", argv[optind]);
+        return -1;
+    }
+    return 0;
+}
+
+void config_usage(FILE *out, const char *program)
+{
+    fprintf(out,
+            "Usage: %s [-c file] [--key value ...]\n"
+            "  -c, --config FILE         read key = value settings from FILE first\n"
+            "  -h, --help                show this\n",
+            program);
+    for (size_t i = 0; i < OPTION_COUNT; i++)
+    {
+        char flag[48];
+        if (options[i].short_flag)
+            snprintf(flag, sizeof(flag), "-%c, --%s", options[i].short_flag, options[i].key);
+        else
+            snprintf(flag, sizeof(flag), "    --%s", options[i].key);
+        fprintf(out, "  %-25s %s%s%s%s\n", flag, options[i].help, options[i].env ? " [" : "",
+                options[i].env ? options[i].env : "", options[i].env ? "]" : "");
+    }
+    fprintf(out, "Environment variables override the config file; flags override both.\n");
+}
+
+void config_write(FILE *out, const ServerConfig *config)
+{
+    for (size_t i = 0; i < OPTION_COUNT; i++)
+    {
+        const char *field = (const char *)config + options[i].offset;
+        switch (options[i].type)
+        {
+        case CONFIG_STRING:
+            fprintf(out, "%s = %s\n", options[i].key, field);
+            break;
+        case CONFIG_INT:
+            fprintf(out, "%s = %d\n", options[i].key, *(const int *)field);
+            break;
+        case CONFIG_DOUBLE:
+            fprintf(out, "%s = %g\n", options[i].key, *(const double *)field);
+            break;
+        }
+    }
+}
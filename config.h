@@ -0,0 +1,57 @@
+//*******SERVER CONFIGURATION*******
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdio.h>
+#include "admission.h"
+
+#define CONFIG_PATH_LENGTH 256
+#define CONFIG_DEFAULT_PORT 8080
+#define CONFIG_DEFAULT_BACKLOG 10
+
+// Everything the server reads at startup. Each setting has one key, used
+// as-is in the config file ("port = 9000") and as a flag ("--port 9000");
+// settings that had an environment variable keep it.
+// Later sources win: defaults, config file, environment, flags.
+typedef struct
+{
+    char listen_address[64];
+    int port;
+    char unix_socket[CONFIG_PATH_LENGTH]; // empty: no Unix listener
+    // The server changes into this directory first; the relative paths
+    // below (and books.txt, members.txt) all live there.
+    char data_dir[CONFIG_PATH_LENGTH];
+    char credentials[CONFIG_PATH_LENGTH];
+    char storage[16];
+    char catalog[CONFIG_PATH_LENGTH]; // empty: the backend's default file
+    int loan_limit;                   // 0: no limit
+    int result_cache;                 // search replies cached; 0: off
+    int lease_ms;                     // client cache leases on searches; 0: none
+    int backlog;
+    AdmissionConfig admission; // max_sessions is also the connection thread limit
+    int idle_timeout;
+    int metrics_port; // 0: no HTTP endpoint
+    char capture[CONFIG_PATH_LENGTH];
+    char trace[CONFIG_PATH_LENGTH];
+    double trace_rate;
+    char slowlog[CONFIG_PATH_LENGTH];
+    int slowlog_ms;
+    int slowlog_rate;
+} ServerConfig;
+
+void config_defaults(ServerConfig *config);
+// Returns 0, or -1 after printing what was wrong.
+int config_set(ServerConfig *config, const char *key, const char *value);
+// "key = value" lines; blank lines and lines starting with # are skipped.
+int config_load_file(ServerConfig *config, const char *path);
+int config_load_env(ServerConfig *config);
+
+// The whole startup sequence: defaults, --config FILE (or -c FILE), the
+// environment, then the other flags. Returns 0 to run, 1 after printing
+// --help, -1 on a bad setting.
+int config_parse(ServerConfig *config, int argc, char *argv[]);
+void config_usage(FILE *out, const char *program);
+// As a config file that config_load_file reads back.
+void config_write(FILE *out, const ServerConfig *config);
+
+#endif
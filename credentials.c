@@ -0,0 +1,479 @@
+//*******CREDENTIAL STORE*******
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "credentials.h"
+
+#define MAX_USERNAME_LENGTH 50
+#define HASH_LENGTH 32 // SHA-256 digest
+
+typedef struct
+{
+    int role;
+    char username[MAX_USERNAME_LENGTH];
+    unsigned char salt[SALT_LENGTH];
+    unsigned char hash[HASH_LENGTH];
+} Account;
+
+typedef struct Session
+{
+    char token[SESSION_TOKEN_LENGTH + 1];
+    int role;
+    int member_id;
+    time_t expires;
+    struct Session *next;
+} Session;
+
+// Open addressing table of indexes into accounts[]; -1 marks an empty slot.
+static Account *accounts = NULL;
+static int account_count = 0;
+static int *account_table = NULL;
+static size_t table_mask = 0;
+
+static Session *session_table[SESSION_BUCKETS];
+static pthread_mutex_t session_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+//SHA-256
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t state[8], const unsigned char block[64])
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+// Hashes salt || password. Callers refuse passwords over PASSWORD_MAX_LENGTH,
+// so one pass over a stack buffer is enough.
+static void hash_password(const unsigned char salt[SALT_LENGTH], const char *password, unsigned char out[HASH_LENGTH])
+{
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    unsigned char message[SALT_LENGTH + PASSWORD_MAX_LENGTH + 72];
+    size_t password_length = strlen(password);
+    size_t length = SALT_LENGTH + password_length;
+
+    memcpy(message, salt, SALT_LENGTH);
+    memcpy(message + SALT_LENGTH, password, password_length);
+
+    size_t padded = ((length + 8) / 64 + 1) * 64;
+    memset(message + length, 0, padded - length);
+    message[length] = 0x80;
+    uint64_t bits = (uint64_t)length * 8;
+    for (int i = 0; i < 8; i++)
+        message[padded - 1 - i] = (unsigned char)(bits >> (8 * i));
+
+    for (size_t offset = 0; offset < padded; offset += 64)
+        sha256_block(state, message + offset);
+
+    for (int i = 0; i < 8; i++)
+    {
+        out[i * 4] = (unsigned char)(state[i] >> 24);
+        out[i * 4 + 1] = (unsigned char)(state[i] >> 16);
+        out[i * 4 + 2] = (unsigned char)(state[i] >> 8);
+        out[i * 4 + 3] = (unsigned char)state[i];
+    }
+}
+
+static int constant_time_equal(const unsigned char *a, const unsigned char *b, size_t len)
+{
+    volatile unsigned char diff = 0;
+    for (size_t i = 0; i < len; i++)
+        diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+
+static void random_bytes(unsigned char *out, size_t len)
+{
+    int fd = open("/dev/urandom", O_RDONLY);
+    size_t got = 0;
+    if (fd >= 0)
+    {
+        while (got < len)
+        {
+            ssize_t n = read(fd, out + got, len - got);
+            if (n <= 0)
+                break;
+            got += (size_t)n;
+        }
+        close(fd);
+    }
+    if (got < len)
+    {
+        perror("Error reading /dev/urandom");
+        srand((unsigned int)(time(NULL) ^ getpid()));
+        for (; got < len; got++)
+            out[got] = (unsigned char)rand();
+    }
+}
+
+static void to_hex(const unsigned char *in, size_t len, char *out)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++)
+    {
+        out[i * 2] = digits[in[i] >> 4];
+        out[i * 2 + 1] = digits[in[i] & 0xf];
+    }
+    out[len * 2] = '\0';
+}
+
+static int from_hex(const char *in, unsigned char *out, size_t len)
+{
+    if (strlen(in) != len * 2)
+        return 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned int byte;
+        if (sscanf(in + i * 2, "%2x", &byte) != 1)
+            return 0;
+        out[i] = (unsigned char)byte;
+    }
+    return 1;
+}
+
+// FNV-1a
+static uint32_t hash_string(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s)
+    {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+//ACCOUNT TABLE
+static int find_account(int role, const char *username)
+{
+    if (!account_table)
+        return -1;
+
+    size_t slot = (hash_string(username) ^ (uint32_t)role) & table_mask;
+    while (account_table[slot] >= 0)
+    {
+        Account *account = &accounts[account_table[slot]];
+        if (account->role == role && strcmp(account->username, username) == 0)
+            return account_table[slot];
+        slot = (slot + 1) & table_mask;
+    }
+    return -1;
+}
+
+static int password_too_long(const char *password)
+{
+    return strnlen(password, PASSWORD_MAX_LENGTH + 1) > PASSWORD_MAX_LENGTH;
+}
+
+// Returns 0 when the table cannot be allocated.
+static int build_table(void)
+{
+    size_t capacity = 16;
+    while (capacity < (size_t)account_count * 2)
+        capacity <<= 1;
+
+    free(account_table);
+    account_table = malloc(capacity * sizeof(int));
+    if (!account_table)
+        return 0;
+    table_mask = capacity - 1;
+    memset(account_table, -1, capacity * sizeof(int));
+
+    for (int i = 0; i < account_count; i++)
+    {
+        int existing = find_account(accounts[i].role, accounts[i].username);
+        if (existing >= 0)
+        {
+            // Later lines override earlier ones for the same account.
+            accounts[existing] = accounts[i];
+            continue;
+        }
+        size_t slot = (hash_string(accounts[i].username) ^ (uint32_t)accounts[i].role) & table_mask;
+        while (account_table[slot] >= 0)
+            slot = (slot + 1) & table_mask;
+        account_table[slot] = i;
+    }
+    return 1;
+}
+
+static int add_account(int *capacity, int role, const char *username, const unsigned char *salt, const unsigned char *hash)
+{
+    if (account_count == *capacity)
+    {
+        int new_capacity = *capacity ? *capacity * 2 : 1024;
+        Account *grown = realloc(accounts, (size_t)new_capacity * sizeof(Account));
+        if (!grown)
+            return 0;
+        accounts = grown;
+        *capacity = new_capacity;
+    }
+
+    Account *account = &accounts[account_count++];
+    account->role = role;
+    strncpy(account->username, username, MAX_USERNAME_LENGTH - 1);
+    account->username[MAX_USERNAME_LENGTH - 1] = '\0';
+    memcpy(account->salt, salt, SALT_LENGTH);
+    memcpy(account->hash, hash, HASH_LENGTH);
+    return 1;
+}
+
+static int parse_role(const char *name)
+{
+    if (strcmp(name, "user") == 0)
+        return ROLE_USER;
+    if (strcmp(name, "admin") == 0)
+        return ROLE_ADMIN;
+    return 0;
+}
+
+int credentials_load(const char *filename)
+{
+    credentials_free();
+    int capacity = 0;
+
+    FILE *file = fopen(filename, "r");
+    if (!file)
+    {
+        // No credentials file: keep the historical built-in accounts working.
+        unsigned char salt[SALT_LENGTH];
+        unsigned char hash[HASH_LENGTH];
+
+        random_bytes(salt, SALT_LENGTH);
+        hash_password(salt, "user", hash);
+        add_account(&capacity, ROLE_USER, "user", salt, hash);
+
+        random_bytes(salt, SALT_LENGTH);
+        hash_password(salt, "admin", hash);
+        add_account(&capacity, ROLE_ADMIN, "admin", salt, hash);
+
+        return build_table() ? account_count : -1;
+    }
+
+    char buffer[1024];
+    int line = 0;
+    while (fgets(buffer, sizeof(buffer), file))
+    {
+        line++;
+        char role_name[16], username[MAX_USERNAME_LENGTH], salt_hex[SALT_LENGTH * 2 + 1], hash_hex[HASH_LENGTH * 2 + 1];
+        unsigned char salt[SALT_LENGTH];
+        unsigned char hash[HASH_LENGTH];
+
+        if (buffer[0] == '#' || buffer[0] == '\n')
+            continue;
+
+        if (sscanf(buffer, "%15s %49s %32s %64s", role_name, username, salt_hex, hash_hex) != 4 ||
+            !parse_role(role_name) || !from_hex(salt_hex, salt, SALT_LENGTH) || !from_hex(hash_hex, hash, HASH_LENGTH))
+        {
+            fprintf(stderr, "%s:%d: malformed credentials entry skipped\n", filename, line);
+            continue;
+        }
+
+        if (!add_account(&capacity, parse_role(role_name), username, salt, hash))
+        {
+            perror("Error allocating credentials");
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+
+    if (!build_table())
+    {
+        perror("Error allocating credentials");
+        return -1;
+    }
+    return account_count;
+}
+
+void credentials_free(void)
+{
+    free(accounts);
+    free(account_table);
+    accounts = NULL;
+    account_table = NULL;
+    account_count = 0;
+    table_mask = 0;
+}
+
+int credentials_check(int role, const char *username, const char *password)
+{
+    static const unsigned char dummy_salt[SALT_LENGTH] = {0};
+    unsigned char expected[HASH_LENGTH] = {0};
+    unsigned char actual[HASH_LENGTH];
+
+    int too_long = password_too_long(password);
+    int index = find_account(role, username);
+    if (index < 0 || too_long)
+    {
+        // Hash anyway so unknown usernames cost the same as wrong passwords.
+        hash_password(dummy_salt, too_long ? "" : password, actual);
+        constant_time_equal(actual, expected, HASH_LENGTH);
+        return 0;
+    }
+
+    hash_password(accounts[index].salt, password, actual);
+    return constant_time_equal(actual, accounts[index].hash, HASH_LENGTH);
+}
+
+int credentials_format_entry(int role, const char *username, const char *password, char *line, size_t len)
+{
+    unsigned char salt[SALT_LENGTH];
+    unsigned char hash[HASH_LENGTH];
+    char salt_hex[SALT_LENGTH * 2 + 1];
+    char hash_hex[HASH_LENGTH * 2 + 1];
+
+    if ((role != ROLE_USER && role != ROLE_ADMIN) || strlen(username) >= MAX_USERNAME_LENGTH || strchr(username, ' ') ||
+        password_too_long(password))
+        return 0;
+
+    random_bytes(salt, SALT_LENGTH);
+    hash_password(salt, password, hash);
+    to_hex(salt, SALT_LENGTH, salt_hex);
+    to_hex(hash, HASH_LENGTH, hash_hex);
+
+    return snprintf(line, len, "%s %s %s %s\n", role == ROLE_USER ? "user" : "admin",
+                    username, salt_hex, hash_hex) < (int)len;
+}
+
+//SESSION TOKENS
+static Session **session_bucket(const char *token)
+{
+    return &session_table[hash_string(token) % SESSION_BUCKETS];
+}
+
+int session_issue(int role, int member_id, char *token)
+{
+    unsigned char raw[SESSION_TOKEN_LENGTH / 2];
+    Session *session = malloc(sizeof(Session));
+    if (!session)
+        return 0;
+
+    random_bytes(raw, sizeof(raw));
+    to_hex(raw, sizeof(raw), session->token);
+    session->role = role;
+    session->member_id = member_id;
+    session->expires = time(NULL) + SESSION_TTL_SECONDS;
+
+    pthread_mutex_lock(&session_mutex);
+    Session **bucket = session_bucket(session->token);
+
+    // Drop expired sessions from this bucket while we hold it.
+    time_t now = time(NULL);
+    for (Session **p = bucket; *p;)
+    {
+        if ((*p)->expires <= now)
+        {
+            Session *expired = *p;
+            *p = expired->next;
+            free(expired);
+            continue;
+        }
+        p = &(*p)->next;
+    }
+
+    session->next = *bucket;
+    *bucket = session;
+    pthread_mutex_unlock(&session_mutex);
+
+    strcpy(token, session->token);
+    return 1;
+}
+
+int session_resume(const char *token, int *role, int *member_id)
+{
+    int found = 0;
+    time_t now = time(NULL);
+
+    if (strlen(token) != SESSION_TOKEN_LENGTH)
+        return 0;
+
+    pthread_mutex_lock(&session_mutex);
+    for (Session **p = session_bucket(token); *p; p = &(*p)->next)
+    {
+        Session *session = *p;
+        if (!constant_time_equal((const unsigned char *)session->token, (const unsigned char *)token, SESSION_TOKEN_LENGTH))
+            continue;
+
+        if (session->expires <= now)
+        {
+            *p = session->next;
+            free(session);
+            break;
+        }
+
+        // Sliding expiry: every resume keeps the session alive.
+        session->expires = now + SESSION_TTL_SECONDS;
+        *role = session->role;
+        *member_id = session->member_id;
+        found = 1;
+        break;
+    }
+    pthread_mutex_unlock(&session_mutex);
+    return found;
+}
+
+void session_revoke(const char *token)
+{
+    pthread_mutex_lock(&session_mutex);
+    for (Session **p = session_bucket(token); *p; p = &(*p)->next)
+    {
+        if (strcmp((*p)->token, token) == 0)
+        {
+            Session *session = *p;
+            *p = session->next;
+            free(session);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&session_mutex);
+}
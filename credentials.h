@@ -0,0 +1,38 @@
+//*******CREDENTIAL STORE*******
+#ifndef CREDENTIALS_H
+#define CREDENTIALS_H
+
+#include <stddef.h>
+
+#define CREDENTIALS_FILE "credentials.txt"
+
+#define ROLE_USER 1
+#define ROLE_ADMIN 2
+#define ROLE_RESUME 3 // login option: resume an earlier session with its token
+
+#define SALT_LENGTH 16          // raw bytes, stored as hex
+#define PASSWORD_MAX_LENGTH 128 // longer passwords are refused, never cut short
+#define SESSION_TOKEN_LENGTH 32 // hex characters
+#define SESSION_TTL_SECONDS 3600
+#define SESSION_BUCKETS 65536
+
+// Loads "role username salt hash" lines into the lookup table.
+// Falls back to the built-in user/user and admin/admin accounts when the
+// file does not exist. Returns the number of accounts loaded, -1 on error.
+int credentials_load(const char *filename);
+void credentials_free(void);
+
+// Returns 1 when the username exists for that role and the password matches.
+// A password longer than PASSWORD_MAX_LENGTH never matches.
+int credentials_check(int role, const char *username, const char *password);
+
+// Formats a credentials file line for a new account with a fresh random salt.
+// Returns 0 for a bad username or a password longer than PASSWORD_MAX_LENGTH.
+int credentials_format_entry(int role, const char *username, const char *password, char *line, size_t len);
+
+// Session tokens let reconnecting clients skip the password check.
+int session_issue(int role, int member_id, char *token);
+int session_resume(const char *token, int *role, int *member_id);
+void session_revoke(const char *token);
+
+#endif
@@ -0,0 +1,27 @@
+//*******CREDENTIAL GENERATOR*******
+// Prints a credentials.txt line for a new account:
+//   ./credgen user alice secret >> credentials.txt
+#include <stdio.h>
+#include <string.h>
+#include "credentials.h"
+
+int main(int argc, char *argv[])
+{
+    char line[256];
+
+    if (argc != 4 || (strcmp(argv[1], "user") != 0 && strcmp(argv[1], "admin") != 0))
+    {
+        fprintf(stderr, "Usage: %s user|admin <username> <password>\n", argv[0]);
+        return 1;
+    }
+
+    int role = strcmp(argv[1], "user") == 0 ? ROLE_USER : ROLE_ADMIN;
+    if (!credentials_format_entry(role, argv[2], argv[3], line, sizeof(line)))
+    {
+        fprintf(stderr, "Invalid username '%s' or password longer than %d characters\n", argv[2], PASSWORD_MAX_LENGTH);
+        return 1;
+    }
+
+    fputs(line, stdout);
+    return 0;
+}
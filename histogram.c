@@ -0,0 +1,111 @@
+//*******LATENCY HISTOGRAM*******
+#include <stdio.h>
+#include <string.h>
+#include "histogram.h"
+
+static int bucket_index(long long value)
+{
+    if (value < 0)
+        value = 0;
+    if (value < 2 * HISTOGRAM_SUB_BUCKETS)
+        return (int)value;
+
+    int msb = 63 - __builtin_clzll((unsigned long long)value);
+    int exponent = msb - HISTOGRAM_SUB_BITS;
+    if (exponent > HISTOGRAM_MAX_EXPONENT)
+        return HISTOGRAM_BUCKETS - 1;
+
+    int sub = (int)(value >> exponent) - HISTOGRAM_SUB_BUCKETS;
+    return (exponent + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+static long long bucket_upper_value(int index)
+{
+    if (index < 2 * HISTOGRAM_SUB_BUCKETS)
+        return index;
+
+    int exponent = index / HISTOGRAM_SUB_BUCKETS - 1;
+    long long sub = index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+    return ((sub + 1) << exponent) - 1;
+}
+
+void histogram_init(Histogram *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min = -1;
+}
+
+void histogram_record(Histogram *h, long long value)
+{
+    h->counts[bucket_index(value)]++;
+    h->total++;
+    h->sum += (double)value;
+    if (h->min < 0 || value < h->min)
+        h->min = value;
+    if (value > h->max)
+        h->max = value;
+}
+
+void histogram_merge(Histogram *into, const Histogram *from)
+{
+    if (from->total == 0)
+        return;
+
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+        into->counts[i] += from->counts[i];
+    into->total += from->total;
+    into->sum += from->sum;
+    if (into->min < 0 || from->min < into->min)
+        into->min = from->min;
+    if (from->max > into->max)
+        into->max = from->max;
+}
+
+long long histogram_percentile(const Histogram *h, double percentile)
+{
+    if (h->total == 0)
+        return 0;
+
+    long long wanted = (long long)(percentile / 100.0 * (double)h->total + 0.5);
+    if (wanted < 1)
+        wanted = 1;
+
+    long long seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += h->counts[i];
+        if (seen >= wanted)
+        {
+            long long value = bucket_upper_value(i);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+double histogram_mean(const Histogram *h)
+{
+    return h->total ? h->sum / (double)h->total : 0.0;
+}
+
+void histogram_write_distribution(const Histogram *h, FILE *out, double unit)
+{
+    long long seen = 0;
+
+    fprintf(out, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        if (h->counts[i] == 0)
+            continue;
+        seen += h->counts[i];
+
+        double fraction = (double)seen / (double)h->total;
+        long long value = bucket_upper_value(i) < h->max ? bucket_upper_value(i) : h->max;
+        if (seen < h->total)
+            fprintf(out, "%12.3f %14.12f %10lld %14.2f\n", value / unit, fraction, seen, 1.0 / (1.0 - fraction));
+        else
+            fprintf(out, "%12.3f %14.12f %10lld\n", value / unit, fraction, seen);
+    }
+    fprintf(out, "#[Mean    = %12.3f, Max     = %12.3f]\n", histogram_mean(h) / unit, h->max / unit);
+    fprintf(out, "#[Total count    = %12lld]\n", h->total);
+}
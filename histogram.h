@@ -0,0 +1,37 @@
+//*******LATENCY HISTOGRAM*******
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdio.h>
+
+// Log-linear buckets in the style of HdrHistogram: values below
+// 2 * HISTOGRAM_SUB_BUCKETS are exact, above that every power of two is split
+// into HISTOGRAM_SUB_BUCKETS buckets (about 3% relative error). Covers 0 to 2^45
+// (nine hours in nanoseconds) in fixed memory, so recording never allocates.
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_EXPONENT 40
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_EXPONENT + 2) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct
+{
+    long long counts[HISTOGRAM_BUCKETS];
+    long long total;
+    long long min;
+    long long max;
+    double sum;
+} Histogram;
+
+void histogram_init(Histogram *h);
+void histogram_record(Histogram *h, long long value);
+void histogram_merge(Histogram *into, const Histogram *from);
+
+// Highest value equivalent to the bucket holding the given percentile (0-100).
+long long histogram_percentile(const Histogram *h, double percentile);
+double histogram_mean(const Histogram *h);
+
+// HdrHistogram-style percentile distribution (Value Percentile TotalCount
+// 1/(1-Percentile)), with values divided by unit (1000 for ns -> us).
+void histogram_write_distribution(const Histogram *h, FILE *out, double unit);
+
+#endif
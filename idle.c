@@ -0,0 +1,189 @@
+//*******IDLE CONNECTION REAPER*******
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "idle.h"
+#include "transport.h"
+#include "metrics.h"
+
+// Requests only store a timestamp; an entry is moved in the wheel when its
+// slot comes round and it turns out to have been active since it was armed.
+struct IdleEntry
+{
+    int conn;
+    long long last_active; // monotonic milliseconds
+    int busy;
+    int slot; // -1 once reaped or not yet armed
+    IdleEntry *next;
+    IdleEntry *prev;
+};
+
+static pthread_mutex_t wheel_mutex = PTHREAD_MUTEX_INITIALIZER;
+static IdleEntry *wheel[IDLE_WHEEL_SLOTS];
+static long long wheel_tick = 0;
+static long long timeout_ms = 0;
+static long long reaped = 0;
+static int reaping = 0;
+static int stopping = 0;
+static pthread_t reaper_thread;
+
+static long long now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Caller holds wheel_mutex. Rounds up, so nothing is reaped early.
+static void arm(IdleEntry *entry, long long remaining_ms)
+{
+    long long ticks_ahead = (remaining_ms + 999) / 1000;
+    if (ticks_ahead < 1)
+        ticks_ahead = 1;
+    if (ticks_ahead > IDLE_WHEEL_SLOTS - 1)
+        ticks_ahead = IDLE_WHEEL_SLOTS - 1;
+
+    int slot = (int)((wheel_tick + ticks_ahead) % IDLE_WHEEL_SLOTS);
+    entry->slot = slot;
+    entry->prev = NULL;
+    entry->next = wheel[slot];
+    if (wheel[slot])
+        wheel[slot]->prev = entry;
+    wheel[slot] = entry;
+}
+
+// Caller holds wheel_mutex.
+static void disarm(IdleEntry *entry)
+{
+    if (entry->slot < 0)
+        return;
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        wheel[entry->slot] = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    entry->slot = -1;
+}
+
+static void expire_slot(void)
+{
+    long long now = now_ms();
+    int slot = (int)(wheel_tick % IDLE_WHEEL_SLOTS);
+    IdleEntry *entry = wheel[slot];
+    wheel[slot] = NULL;
+
+    while (entry)
+    {
+        IdleEntry *next = entry->next;
+        entry->slot = -1;
+        long long idle_for = now - __atomic_load_n(&entry->last_active, __ATOMIC_RELAXED);
+
+        if (__atomic_load_n(&entry->busy, __ATOMIC_RELAXED))
+        {
+            arm(entry, timeout_ms);
+        }
+        else if (idle_for >= timeout_ms)
+        {
+            // The owner sees EOF, unregisters and closes; the entry stays theirs.
+            conn_shutdown(entry->conn);
+            reaped++;
+            metrics_connection_reaped();
+        }
+        else
+        {
+            arm(entry, timeout_ms - idle_for);
+        }
+        entry = next;
+    }
+}
+
+static void *reaper_main(void *arg)
+{
+    (void)arg;
+    struct timespec tick = {1, 0};
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+    {
+        nanosleep(&tick, NULL);
+        pthread_mutex_lock(&wheel_mutex);
+        wheel_tick++;
+        expire_slot();
+        pthread_mutex_unlock(&wheel_mutex);
+    }
+    return NULL;
+}
+
+int idle_start(int timeout_seconds)
+{
+    if (reaping || timeout_seconds < 1)
+        return -1;
+
+    timeout_ms = timeout_seconds * 1000LL;
+    stopping = 0;
+    if (pthread_create(&reaper_thread, NULL, reaper_main, NULL) != 0)
+        return -1;
+    __atomic_store_n(&reaping, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Registered connections stay registered; they just stop being reaped.
+void idle_stop(void)
+{
+    if (!reaping)
+        return;
+    __atomic_store_n(&reaping, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(reaper_thread, NULL);
+}
+
+//CONNECTION HOOKS
+IdleEntry *idle_register(int conn)
+{
+    if (!__atomic_load_n(&reaping, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    IdleEntry *entry = calloc(1, sizeof(IdleEntry));
+    if (!entry)
+        return NULL;
+    entry->conn = conn;
+    entry->last_active = now_ms();
+
+    pthread_mutex_lock(&wheel_mutex);
+    arm(entry, timeout_ms);
+    pthread_mutex_unlock(&wheel_mutex);
+    return entry;
+}
+
+void idle_busy(IdleEntry *entry)
+{
+    if (entry)
+        __atomic_store_n(&entry->busy, 1, __ATOMIC_RELAXED);
+}
+
+void idle_done(IdleEntry *entry)
+{
+    if (!entry)
+        return;
+    __atomic_store_n(&entry->last_active, now_ms(), __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->busy, 0, __ATOMIC_RELAXED);
+}
+
+void idle_unregister(IdleEntry *entry)
+{
+    if (!entry)
+        return;
+    pthread_mutex_lock(&wheel_mutex);
+    disarm(entry);
+    pthread_mutex_unlock(&wheel_mutex);
+    free(entry);
+}
+
+long long idle_reaped(void)
+{
+    pthread_mutex_lock(&wheel_mutex);
+    long long count = reaped;
+    pthread_mutex_unlock(&wheel_mutex);
+    return count;
+}
@@ -0,0 +1,27 @@
+//*******IDLE CONNECTION REAPER*******
+#ifndef IDLE_H
+#define IDLE_H
+
+#define IDLE_TIMEOUT_ENV "LIBRARY_IDLE_TIMEOUT" // seconds a session may sit idle (0 = never reaped)
+#define IDLE_DEFAULT_TIMEOUT 300
+#define IDLE_WHEEL_SLOTS 64 // one-second ticks; longer timeouts are re-armed as they come round
+
+typedef struct IdleEntry IdleEntry;
+
+// Starts the reaper thread. Connections registered afterwards are shut down
+// once they have been idle (not inside a request) for timeout_seconds.
+int idle_start(int timeout_seconds);
+void idle_stop(void);
+
+// Connection threads call these; all accept NULL, which is what
+// idle_register returns while the reaper is off.
+IdleEntry *idle_register(int conn);
+void idle_busy(IdleEntry *entry); // a request is being served; never reaped meanwhile
+void idle_done(IdleEntry *entry); // request finished; the idle clock restarts
+// Must be called before conn_close, so the reaper never shuts down a
+// descriptor that has been closed and reused.
+void idle_unregister(IdleEntry *entry);
+
+long long idle_reaped(void);
+
+#endif
@@ -0,0 +1,288 @@
+//*******SEARCH LEASES*******
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "lease.h"
+#include "transport.h"
+
+// A holder is freed by whoever drops the last reference: the session that
+// closes it, or a revoke that was still writing to it.
+struct LeaseHolder
+{
+    int conn;
+    pthread_mutex_t write_mutex;
+    int closed; // set under table_mutex; nothing is written once set
+    int refs;
+};
+
+typedef struct Lease
+{
+    int book_id;
+    LeaseHolder *holder;
+    long long expires_ms;
+    struct Lease *next;
+} Lease;
+
+static pthread_mutex_t table_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Lease *table[LEASE_BUCKETS];
+static int duration_ms = 0;
+static long long active = 0;
+static long long granted = 0;
+static long long invalidations = 0;
+static long long dropped = 0;
+
+static long long now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static Lease **bucket_of(int book_id)
+{
+    return &table[(unsigned int)book_id % LEASE_BUCKETS];
+}
+
+static void release(LeaseHolder *holder)
+{
+    if (__atomic_sub_fetch(&holder->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        pthread_mutex_destroy(&holder->write_mutex);
+        free(holder);
+    }
+}
+
+void lease_configure(int lease_ms)
+{
+    __atomic_store_n(&duration_ms, lease_ms > 0 ? lease_ms : 0, __ATOMIC_RELAXED);
+}
+
+int lease_duration_ms(void)
+{
+    return __atomic_load_n(&duration_ms, __ATOMIC_RELAXED);
+}
+
+//HOLDERS
+LeaseHolder *lease_holder_open(int conn)
+{
+    if (lease_duration_ms() <= 0)
+        return NULL;
+    LeaseHolder *holder = calloc(1, sizeof(LeaseHolder));
+    if (!holder)
+        return NULL;
+    holder->conn = conn;
+    holder->refs = 1;
+    pthread_mutex_init(&holder->write_mutex, NULL);
+    return holder;
+}
+
+void lease_holder_close(LeaseHolder *holder)
+{
+    if (!holder)
+        return;
+
+    pthread_mutex_lock(&table_mutex);
+    __atomic_store_n(&holder->closed, 1, __ATOMIC_RELEASE);
+    for (int b = 0; b < LEASE_BUCKETS; b++)
+    {
+        Lease **link = &table[b];
+        while (*link)
+        {
+            Lease *lease = *link;
+            if (lease->holder == holder)
+            {
+                *link = lease->next;
+                free(lease);
+                active--;
+            }
+            else
+                link = &lease->next;
+        }
+    }
+    pthread_mutex_unlock(&table_mutex);
+
+    // A revoke may still be mid-write; the connection outlives it.
+    pthread_mutex_lock(&holder->write_mutex);
+    pthread_mutex_unlock(&holder->write_mutex);
+    release(holder);
+}
+
+// Shuts the holder's connection down unless its session already closed
+// it; under table_mutex, so the descriptor cannot be closed (and reused)
+// meanwhile. The session's blocked read or write fails and it ends.
+static void drop_holder(LeaseHolder *holder)
+{
+    pthread_mutex_lock(&table_mutex);
+    if (!__atomic_load_n(&holder->closed, __ATOMIC_ACQUIRE))
+    {
+        __atomic_store_n(&holder->closed, 1, __ATOMIC_RELEASE);
+        conn_shutdown(holder->conn);
+        dropped++;
+    }
+    pthread_mutex_unlock(&table_mutex);
+}
+
+// Caller holds write_mutex. One write for all but the largest replies, so
+// Nagle never holds a reply back behind its header. MSG_NOSIGNAL: a client
+// that hung up is a failed write here, whichever thread is writing.
+static int write_frame(LeaseHolder *holder, int32_t header, const void *buffer, size_t length, int flags)
+{
+    unsigned char frame[sizeof(int32_t) + LEASE_FRAME_INLINE];
+
+    if (__atomic_load_n(&holder->closed, __ATOMIC_ACQUIRE))
+        return -1;
+    if (length <= LEASE_FRAME_INLINE)
+    {
+        memcpy(frame, &header, sizeof(header));
+        if (length > 0)
+            memcpy(frame + sizeof(header), buffer, length);
+        size_t total = sizeof(header) + length;
+        return conn_send(holder->conn, frame, total, MSG_NOSIGNAL | flags) == (ssize_t)total ? 0 : -1;
+    }
+    if (conn_send(holder->conn, &header, sizeof(header), MSG_NOSIGNAL | flags) != sizeof(header))
+        return -1;
+    return conn_send(holder->conn, buffer, length, MSG_NOSIGNAL | flags) == (ssize_t)length ? 0 : -1;
+}
+
+ssize_t lease_write(LeaseHolder *holder, const void *buffer, size_t length)
+{
+    pthread_mutex_lock(&holder->write_mutex);
+    int written = write_frame(holder, (int32_t)length, buffer, length, 0);
+    pthread_mutex_unlock(&holder->write_mutex);
+    return written == 0 ? (ssize_t)length : -1;
+}
+
+//LEASES
+void lease_grant(LeaseHolder *holder, int book_id)
+{
+    int lease_ms = lease_duration_ms();
+    if (!holder || book_id <= 0 || lease_ms <= 0)
+        return;
+
+    long long now = now_ms();
+    Lease *found = NULL;
+    pthread_mutex_lock(&table_mutex);
+    // Expired leases in the chain go on the way past.
+    Lease **link = bucket_of(book_id);
+    while (*link)
+    {
+        Lease *lease = *link;
+        if (lease->book_id == book_id && lease->holder == holder)
+            found = lease;
+        if (lease != found && lease->expires_ms <= now)
+        {
+            *link = lease->next;
+            free(lease);
+            active--;
+            continue;
+        }
+        link = &lease->next;
+    }
+    if (!found && (found = malloc(sizeof(Lease))) != NULL)
+    {
+        found->book_id = book_id;
+        found->holder = holder;
+        found->next = *bucket_of(book_id);
+        *bucket_of(book_id) = found;
+        active++;
+    }
+    if (found)
+        found->expires_ms = now + lease_ms;
+    pthread_mutex_unlock(&table_mutex);
+}
+
+void lease_settle(LeaseHolder *holder, int book_id, int found)
+{
+    if (!holder || book_id <= 0)
+        return;
+
+    pthread_mutex_lock(&table_mutex);
+    for (Lease **link = bucket_of(book_id); *link; link = &(*link)->next)
+    {
+        Lease *lease = *link;
+        if (lease->book_id != book_id || lease->holder != holder)
+            continue;
+        if (found)
+            granted++;
+        else
+        {
+            *link = lease->next;
+            free(lease);
+            active--;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&table_mutex);
+}
+
+void lease_revoke(int book_id)
+{
+    if (book_id <= 0)
+        return;
+
+    // Live leases move to a private list, so the frames go out without the
+    // table lock held.
+    long long now = now_ms();
+    Lease *revoked = NULL;
+    pthread_mutex_lock(&table_mutex);
+    Lease **link = bucket_of(book_id);
+    while (*link)
+    {
+        Lease *lease = *link;
+        if (lease->book_id != book_id)
+        {
+            link = &lease->next;
+            continue;
+        }
+        *link = lease->next;
+        active--;
+        if (lease->expires_ms > now)
+        {
+            __atomic_add_fetch(&lease->holder->refs, 1, __ATOMIC_ACQ_REL);
+            lease->next = revoked;
+            revoked = lease;
+        }
+        else
+            free(lease);
+    }
+    pthread_mutex_unlock(&table_mutex);
+
+    // A holder whose session is stuck writing a reply, or whose socket
+    // buffer is full, is dropped rather than waited for.
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += LEASE_REVOKE_WAIT_MS * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    while (revoked)
+    {
+        Lease *lease = revoked;
+        revoked = lease->next;
+        int sent = -1;
+        if (pthread_mutex_timedlock(&lease->holder->write_mutex, &deadline) == 0)
+        {
+            sent = write_frame(lease->holder, -(int32_t)book_id, NULL, 0, MSG_DONTWAIT);
+            pthread_mutex_unlock(&lease->holder->write_mutex);
+        }
+        if (sent == 0)
+            __atomic_add_fetch(&invalidations, 1, __ATOMIC_RELAXED);
+        else
+            drop_holder(lease->holder);
+        release(lease->holder);
+        free(lease);
+    }
+}
+
+void lease_stats(LeaseStats *stats)
+{
+    pthread_mutex_lock(&table_mutex);
+    stats->active = active;
+    stats->granted = granted;
+    stats->dropped = dropped;
+    pthread_mutex_unlock(&table_mutex);
+    stats->invalidations = __atomic_load_n(&invalidations, __ATOMIC_RELAXED);
+}
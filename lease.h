@@ -0,0 +1,57 @@
+//*******SEARCH LEASES*******
+#ifndef LEASE_H
+#define LEASE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define LEASE_ENV "LIBRARY_LEASE_MS" // how long a client may answer a search from its own cache (default 2000, 0 = no leases)
+#define LEASE_DEFAULT_MS 2000
+#define LEASE_BUCKETS 1024      // chains of leases by book ID
+#define LEASE_FRAME_INLINE 1024 // replies up to this size go out with their header in one write
+#define LEASE_REVOKE_WAIT_MS 100 // longest an edit waits for a holder busy writing a reply
+
+// A connection that asked for leases. From then on everything the server
+// writes on it is a frame: an int header, then for a header n >= 0 n bytes
+// of reply; a header of -id on its own tells the client that book id
+// changed. Frames are written under the holder's lock, so an invalidation
+// sent by the thread that made the edit never lands inside a reply.
+// An editor never blocks on a slow holder: when the lock stays taken past
+// LEASE_REVOKE_WAIT_MS or the invalidation does not fit in the socket
+// buffer, the holder is dropped instead (its connection is shut down, so
+// its cache goes with it).
+typedef struct LeaseHolder LeaseHolder;
+
+typedef struct
+{
+    long long active; // leases not yet revoked, expired ones included until swept
+    long long granted;
+    long long invalidations; // frames sent to holders of a live lease
+    long long dropped;       // holders shut down because an invalidation could not go out at once
+} LeaseStats;
+
+void lease_configure(int lease_ms);
+int lease_duration_ms(void);
+
+// NULL while leases are off.
+LeaseHolder *lease_holder_open(int conn);
+// Drops the holder's leases and waits out an invalidation being written to
+// it. Call before the connection is closed; accepts NULL.
+void lease_holder_close(LeaseHolder *holder);
+// One reply frame. Returns length, or -1 when the write failed.
+ssize_t lease_write(LeaseHolder *holder, const void *buffer, size_t length);
+
+// Lets holder cache book_id's search reply for the lease length. Take it
+// before the catalog is read, so an edit that lands after the read still
+// finds the lease, and settle it once the search is answered. Accepts NULL.
+void lease_grant(LeaseHolder *holder, int book_id);
+// Counts the lease as granted when the search found the book; otherwise
+// the client has nothing to cache and the lease is ended. Accepts NULL.
+void lease_settle(LeaseHolder *holder, int book_id, int found);
+// Sends an invalidation to every holder of a live lease on book_id and
+// ends those leases. Call once the edit is written and before its reply.
+void lease_revoke(int book_id);
+
+void lease_stats(LeaseStats *stats);
+
+#endif
@@ -0,0 +1,596 @@
+//*******LOAD GENERATOR*******
+// Drives a running server with many concurrent sessions and reports latency
+// percentiles and throughput per operation.
+//   ./loadgen -c 64 -t 4 -d 30 -w 5 -m search=80,rent=10,return=10
+//   ./loadgen -c 64 -t 4 -r 2000 ...   open loop: 2000 requests/second in total
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include "client_proto.h"
+#include "histogram.h"
+
+#define MAX_PENDING 65536 // open-loop arrivals waiting for a free connection, per queue
+
+// Arrivals are queued by the role they need: user-only, admin-only, or either.
+#define QUEUE_USER 0
+#define QUEUE_ADMIN 1
+#define QUEUE_ANY 2
+#define QUEUE_COUNT 3
+
+typedef struct
+{
+    int conn;
+    int role;
+    int busy;
+    ProtoOp op;
+    long long started; // intended start, so queueing delay counts (no coordinated omission)
+} LoadConnection;
+
+typedef struct
+{
+    ProtoOp op;
+    long long intended;
+} Arrival;
+
+typedef struct
+{
+    Arrival *items;
+    int head;
+    int count;
+} ArrivalQueue;
+
+typedef struct
+{
+    int index;
+    pthread_t tid;
+    LoadConnection *connections;
+    int connection_count;
+    int has_role[3];
+    unsigned int seed;
+    double rate; // this thread's share of the arrival rate; 0 = closed loop
+    ArrivalQueue queues[QUEUE_COUNT];
+    Histogram latency[OP_COUNT];
+    long long ok[OP_COUNT];
+    long long failed[OP_COUNT];
+    long long errors;
+    long long overflowed;
+    long long unserved;
+} LoadThread;
+
+static struct
+{
+    const char *host;
+    int port;
+    const char *unix_path;
+    int connections;
+    int threads;
+    double duration;
+    double warmup;
+    double rate;
+    int weights[OP_COUNT];
+    int preload;
+    const char *admin;
+    const char *user;
+    unsigned int seed;
+    const char *histogram_file;
+} options;
+
+static int max_book_id = 1;
+static long long measure_from_ns;
+static long long stop_at_ns;
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -h host        server address (127.0.0.1)\n"
+            "  -p port        server port (%d)\n"
+            "  -U path        use the server's Unix socket instead of TCP\n"
+            "  -c n           connections (16)\n"
+            "  -t n           threads (4)\n"
+            "  -d seconds     measured duration (10)\n"
+            "  -w seconds     warmup before measuring (2)\n"
+            "  -r rate        open loop at rate requests/second; 0 = closed loop (0)\n"
+            "  -m mix         op weights, e.g. search=70,rent=10,return=10,add=4,modify=3,delete=3\n"
+            "  -b n           books to add before the run (100)\n"
+            "  -a name:pass   admin login (admin:admin)\n"
+            "  -u name:pass:member  user login (user:user:1)\n"
+            "  -s seed        random seed\n"
+            "  -H file        write the full latency distribution (HdrHistogram format)\n",
+            program, PORT);
+}
+
+static int parse_mix(const char *mix)
+{
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", mix);
+    memset(options.weights, 0, sizeof(options.weights));
+
+    for (char *item = strtok(copy, ","); item; item = strtok(NULL, ","))
+    {
+        char name[16];
+        int weight;
+        int found = 0;
+        if (sscanf(item, "%15[^=]=%d", name, &weight) != 2 || weight < 0)
+            return 0;
+        for (int op = 0; op < OP_COUNT; op++)
+        {
+            if (strcmp(name, proto_op_name((ProtoOp)op)) == 0)
+            {
+                options.weights[op] = weight;
+                found = 1;
+            }
+        }
+        if (!found)
+            return 0;
+    }
+    return 1;
+}
+
+static int queue_for(ProtoOp op)
+{
+    if (op == OP_SEARCH)
+        return QUEUE_ANY;
+    return proto_op_allowed(op, ROLE_USER) ? QUEUE_USER : QUEUE_ADMIN;
+}
+
+// Picks an op by weight among those the given roles can run.
+static ProtoOp pick_op(unsigned int *seed, int user, int admin)
+{
+    int total = 0;
+    for (int op = 0; op < OP_COUNT; op++)
+    {
+        if ((user && proto_op_allowed((ProtoOp)op, ROLE_USER)) || (admin && proto_op_allowed((ProtoOp)op, ROLE_ADMIN)))
+            total += options.weights[op];
+    }
+    if (total == 0)
+        return OP_SEARCH;
+
+    int r = rand_r(seed) % total;
+    for (int op = 0; op < OP_COUNT; op++)
+    {
+        if ((user && proto_op_allowed((ProtoOp)op, ROLE_USER)) || (admin && proto_op_allowed((ProtoOp)op, ROLE_ADMIN)))
+        {
+            r -= options.weights[op];
+            if (r < 0)
+                return (ProtoOp)op;
+        }
+    }
+    return OP_SEARCH;
+}
+
+static int open_session(int role)
+{
+    char reply[BUFFER_SIZE];
+    char login[128];
+    int conn = proto_connect(options.host, options.port, options.unix_path, 0);
+    if (conn < 0)
+        return -1;
+
+    snprintf(login, sizeof(login), "%s", role == ROLE_ADMIN ? options.admin : options.user);
+    char *password = strchr(login, ':');
+    char *member = password ? strchr(password + 1, ':') : NULL;
+    if (password)
+        *password++ = '\0';
+    if (member)
+        *member++ = '\0';
+
+    int granted = 0;
+    if (password && role == ROLE_ADMIN)
+        granted = proto_login_admin(conn, login, password, NULL, reply);
+    else if (password && member)
+        granted = proto_login_user(conn, login, password, atoi(member), NULL, reply);
+
+    if (granted != role)
+    {
+        proto_close(conn);
+        return -1;
+    }
+    return conn;
+}
+
+static void issue(LoadThread *thread, LoadConnection *c, ProtoOp op, long long intended)
+{
+    char title[50];
+    int book_id = 1 + rand_r(&thread->seed) % __atomic_load_n(&max_book_id, __ATOMIC_RELAXED);
+
+    snprintf(title, sizeof(title), "LoadTitle%d", thread->index);
+    if (proto_send(c->conn, c->role, op, book_id, title, "LoadAuthor") < 0)
+    {
+        thread->errors++;
+        proto_close(c->conn);
+        c->conn = -1;
+        return;
+    }
+    c->busy = 1;
+    c->op = op;
+    c->started = intended;
+}
+
+static void complete(LoadThread *thread, LoadConnection *c)
+{
+    char reply[BUFFER_SIZE];
+    int result = proto_read_reply(c->conn, reply);
+    long long finished = now_ns();
+
+    c->busy = 0;
+    if (result < 0)
+    {
+        thread->errors++;
+        proto_close(c->conn);
+        c->conn = -1;
+        return;
+    }
+
+    int added;
+    if (c->op == OP_ADD && sscanf(reply, "Book added with ID: %d", &added) == 1)
+    {
+        int seen = __atomic_load_n(&max_book_id, __ATOMIC_RELAXED);
+        while (added > seen && !__atomic_compare_exchange_n(&max_book_id, &seen, added, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;
+    }
+
+    // Windowed on completion so an overloaded open loop still reports its
+    // (growing) latency instead of nothing.
+    if (finished < measure_from_ns)
+        return;
+    histogram_record(&thread->latency[c->op], finished - c->started);
+    if (proto_reply_failed(reply))
+        thread->failed[c->op]++;
+    else
+        thread->ok[c->op]++;
+}
+
+static void enqueue(LoadThread *thread, ProtoOp op, long long intended)
+{
+    ArrivalQueue *q = &thread->queues[queue_for(op)];
+    if (q->count == MAX_PENDING)
+    {
+        thread->overflowed++;
+        return;
+    }
+    q->items[(q->head + q->count) % MAX_PENDING] = (Arrival){op, intended};
+    q->count++;
+}
+
+// Oldest queued arrival this connection's role can serve, or 0.
+static int dequeue(LoadThread *thread, int role, Arrival *out)
+{
+    ArrivalQueue *own = &thread->queues[role == ROLE_ADMIN ? QUEUE_ADMIN : QUEUE_USER];
+    ArrivalQueue *any = &thread->queues[QUEUE_ANY];
+    ArrivalQueue *q = NULL;
+
+    if (own->count && any->count)
+        q = own->items[own->head].intended <= any->items[any->head].intended ? own : any;
+    else if (own->count)
+        q = own;
+    else if (any->count)
+        q = any;
+    if (!q)
+        return 0;
+
+    *out = q->items[q->head];
+    q->head = (q->head + 1) % MAX_PENDING;
+    q->count--;
+    return 1;
+}
+
+static void *load_thread(void *arg)
+{
+    LoadThread *thread = arg;
+    struct pollfd *fds = calloc((size_t)thread->connection_count, sizeof(struct pollfd));
+    int *fd_owner = calloc((size_t)thread->connection_count, sizeof(int));
+    long long next_arrival = now_ns();
+
+    while (1)
+    {
+        long long now = now_ns();
+        if (now >= stop_at_ns)
+            break;
+
+        if (thread->rate > 0)
+        {
+            // Poisson arrivals at the target rate, independent of how fast replies come back.
+            while (next_arrival <= now)
+            {
+                enqueue(thread, pick_op(&thread->seed, thread->has_role[ROLE_USER], thread->has_role[ROLE_ADMIN]), next_arrival);
+                double u = (rand_r(&thread->seed) + 1.0) / ((double)RAND_MAX + 2.0);
+                next_arrival += (long long)(-log(u) / thread->rate * 1e9);
+            }
+        }
+
+        for (int i = 0; i < thread->connection_count; i++)
+        {
+            LoadConnection *c = &thread->connections[i];
+            if (c->conn < 0 || c->busy)
+                continue;
+            if (thread->rate > 0)
+            {
+                Arrival arrival;
+                if (dequeue(thread, c->role, &arrival))
+                    issue(thread, c, arrival.op, arrival.intended);
+            }
+            else
+            {
+                issue(thread, c, pick_op(&thread->seed, c->role == ROLE_USER, c->role == ROLE_ADMIN), now);
+            }
+        }
+
+        int nfds = 0;
+        for (int i = 0; i < thread->connection_count; i++)
+        {
+            if (thread->connections[i].conn >= 0 && thread->connections[i].busy)
+            {
+                fds[nfds] = (struct pollfd){thread->connections[i].conn, POLLIN, 0};
+                fd_owner[nfds++] = i;
+            }
+        }
+
+        long long wait = stop_at_ns - now;
+        if (thread->rate > 0 && next_arrival - now < wait)
+            wait = next_arrival - now > 0 ? next_arrival - now : 0;
+        struct timespec timeout = {wait / 1000000000LL, wait % 1000000000LL};
+
+        if (nfds == 0)
+        {
+            if (thread->rate <= 0)
+                break; // closed loop with every connection dead
+            nanosleep(&timeout, NULL);
+            continue;
+        }
+
+        if (ppoll(fds, (nfds_t)nfds, &timeout, NULL) <= 0)
+            continue;
+        for (int i = 0; i < nfds; i++)
+        {
+            if (fds[i].revents)
+                complete(thread, &thread->connections[fd_owner[i]]);
+        }
+    }
+
+    // Let in-flight requests finish so the server is not left mid-reply.
+    for (int i = 0; i < thread->connection_count; i++)
+    {
+        LoadConnection *c = &thread->connections[i];
+        if (c->conn >= 0 && c->busy)
+            complete(thread, c);
+    }
+
+    for (int q = 0; q < QUEUE_COUNT; q++)
+        thread->unserved += thread->queues[q].count;
+    free(fds);
+    free(fd_owner);
+    return NULL;
+}
+
+static int preload_books(void)
+{
+    char reply[BUFFER_SIZE];
+    int conn = open_session(ROLE_ADMIN);
+    if (conn < 0)
+        return 0;
+
+    for (int i = 0; i < options.preload; i++)
+    {
+        int id;
+        if (proto_add(conn, "PreloadTitle", "PreloadAuthor", reply) < 0)
+        {
+            proto_close(conn);
+            return 0;
+        }
+        if (sscanf(reply, "Book added with ID: %d", &id) == 1 && id > max_book_id)
+            max_book_id = id;
+    }
+    proto_exit(conn, ROLE_ADMIN);
+    proto_close(conn);
+    return 1;
+}
+
+static void print_row(const char *name, const Histogram *h, long long ok, long long failed)
+{
+    printf("%-8s %10lld %10lld %10.1f %10.1f %10.1f %10.1f %10.1f\n", name, ok, failed,
+           histogram_mean(h) / 1000.0,
+           histogram_percentile(h, 50.0) / 1000.0,
+           histogram_percentile(h, 99.0) / 1000.0,
+           histogram_percentile(h, 99.9) / 1000.0,
+           h->max / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+
+    options.host = "127.0.0.1";
+    options.port = PORT;
+    options.connections = 16;
+    options.threads = 4;
+    options.duration = 10;
+    options.warmup = 2;
+    options.preload = 100;
+    options.admin = "admin:admin";
+    options.user = "user:user:1";
+    options.seed = (unsigned int)time(NULL);
+    parse_mix("search=70,rent=10,return=10,add=4,modify=3,delete=3");
+
+    while ((opt = getopt(argc, argv, "h:p:U:c:t:d:w:r:m:b:a:u:s:H:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'h': options.host = optarg; break;
+        case 'p': options.port = atoi(optarg); break;
+        case 'U': options.unix_path = optarg; break;
+        case 'c': options.connections = atoi(optarg); break;
+        case 't': options.threads = atoi(optarg); break;
+        case 'd': options.duration = atof(optarg); break;
+        case 'w': options.warmup = atof(optarg); break;
+        case 'r': options.rate = atof(optarg); break;
+        case 'b': options.preload = atoi(optarg); break;
+        case 'a': options.admin = optarg; break;
+        case 'u': options.user = optarg; break;
+        case 's': options.seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+        case 'H': options.histogram_file = optarg; break;
+        case 'm':
+            if (!parse_mix(optarg))
+            {
+                fprintf(stderr, "Bad op mix: %s\n", optarg);
+                return 2;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (options.threads < 1 || options.connections < options.threads || options.duration <= 0 || options.warmup < 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // Split connections between the roles in proportion to the ops that need them.
+    int user_weight = options.weights[OP_RENT] + options.weights[OP_RETURN];
+    int admin_weight = options.weights[OP_ADD] + options.weights[OP_MODIFY] + options.weights[OP_DELETE];
+    int admin_connections = 0;
+    if (admin_weight > 0)
+    {
+        admin_connections = (int)((double)options.connections * admin_weight / (admin_weight + user_weight) + 0.5);
+        if (admin_connections < options.threads)
+            admin_connections = options.threads < options.connections ? options.threads : options.connections;
+        if (user_weight > 0 && admin_connections > options.connections - options.threads)
+            admin_connections = options.connections - options.threads;
+    }
+    if (user_weight > 0 && admin_weight > 0 && options.connections < 2 * options.threads)
+    {
+        fprintf(stderr, "This mix needs at least %d connections (a user and an admin session per thread)\n", 2 * options.threads);
+        return 2;
+    }
+
+    if (options.preload > 0 && !preload_books())
+    {
+        fprintf(stderr, "Could not preload books (is the server running, are the admin credentials right?)\n");
+        return 1;
+    }
+
+    LoadThread *threads = calloc((size_t)options.threads, sizeof(LoadThread));
+    for (int t = 0; t < options.threads; t++)
+    {
+        threads[t].index = t;
+        threads[t].seed = options.seed + (unsigned int)t * 7919u;
+        threads[t].rate = options.rate / options.threads;
+        threads[t].connections = calloc((size_t)options.connections, sizeof(LoadConnection));
+        for (int q = 0; q < QUEUE_COUNT; q++)
+            threads[t].queues[q].items = options.rate > 0 ? malloc(MAX_PENDING * sizeof(Arrival)) : NULL;
+        for (int op = 0; op < OP_COUNT; op++)
+            histogram_init(&threads[t].latency[op]);
+    }
+
+    // Connection i goes to thread i % threads. Admin sessions come first, so
+    // they go round the threads before users do and, with the bounds above,
+    // every thread of a mixed load holds both roles.
+    for (int i = 0; i < options.connections; i++)
+    {
+        LoadThread *thread = &threads[i % options.threads];
+        int admin = i < admin_connections;
+        int role = admin ? ROLE_ADMIN : ROLE_USER;
+        int conn = open_session(role);
+        if (conn < 0)
+        {
+            fprintf(stderr, "Connection %d failed to log in as %s\n", i, admin ? "admin" : "user");
+            return 1;
+        }
+        thread->connections[thread->connection_count++] = (LoadConnection){conn, role, 0, OP_SEARCH, 0};
+        thread->has_role[role] = 1;
+    }
+
+    long long started = now_ns();
+    measure_from_ns = started + (long long)(options.warmup * 1e9);
+    stop_at_ns = measure_from_ns + (long long)(options.duration * 1e9);
+
+    for (int t = 0; t < options.threads; t++)
+        pthread_create(&threads[t].tid, NULL, load_thread, &threads[t]);
+    for (int t = 0; t < options.threads; t++)
+        pthread_join(threads[t].tid, NULL);
+
+    Histogram *all = malloc(sizeof(Histogram));
+    Histogram *per_op = malloc(sizeof(Histogram) * OP_COUNT);
+    long long ok[OP_COUNT] = {0}, failed[OP_COUNT] = {0}, errors = 0, overflowed = 0, unserved = 0, total_ok = 0, total_failed = 0;
+    histogram_init(all);
+    for (int op = 0; op < OP_COUNT; op++)
+    {
+        histogram_init(&per_op[op]);
+        for (int t = 0; t < options.threads; t++)
+        {
+            histogram_merge(&per_op[op], &threads[t].latency[op]);
+            ok[op] += threads[t].ok[op];
+            failed[op] += threads[t].failed[op];
+        }
+        histogram_merge(all, &per_op[op]);
+        total_ok += ok[op];
+        total_failed += failed[op];
+    }
+    for (int t = 0; t < options.threads; t++)
+    {
+        errors += threads[t].errors;
+        overflowed += threads[t].overflowed;
+        unserved += threads[t].unserved;
+    }
+
+    printf("mode=%s connections=%d threads=%d duration=%.1fs warmup=%.1fs seed=%u\n",
+           options.rate > 0 ? "open" : "closed", options.connections, options.threads,
+           options.duration, options.warmup, options.seed);
+    printf("%-8s %10s %10s %10s %10s %10s %10s %10s\n", "op", "ok", "failed", "mean_us", "p50_us", "p99_us", "p999_us", "max_us");
+    for (int op = 0; op < OP_COUNT; op++)
+    {
+        if (per_op[op].total)
+            print_row(proto_op_name((ProtoOp)op), &per_op[op], ok[op], failed[op]);
+    }
+    print_row("all", all, total_ok, total_failed);
+
+    printf("throughput=%.1f ops/s", (double)all->total / options.duration);
+    if (options.rate > 0)
+        printf(" target=%.1f ops/s unserved=%lld overflowed=%lld", options.rate, unserved, overflowed);
+    printf(" errors=%lld\n", errors);
+
+    if (options.histogram_file)
+    {
+        FILE *out = fopen(options.histogram_file, "w");
+        if (out)
+        {
+            histogram_write_distribution(all, out, 1000.0);
+            fclose(out);
+        }
+        else
+        {
+            perror(options.histogram_file);
+        }
+    }
+
+    // Admin sessions say goodbye; user sessions just hang up.
+    for (int t = 0; t < options.threads; t++)
+    {
+        for (int i = 0; i < threads[t].connection_count; i++)
+        {
+            LoadConnection *c = &threads[t].connections[i];
+            if (c->conn < 0)
+                continue;
+            if (c->role == ROLE_ADMIN)
+                proto_exit(c->conn, ROLE_ADMIN);
+            proto_close(c->conn);
+        }
+    }
+    return errors ? 1 : 0;
+}
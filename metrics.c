@@ -0,0 +1,344 @@
+//*******METRICS*******
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "metrics.h"
+#include "result_cache.h"
+#include "lease.h"
+
+// Upper bounds in microseconds; the last bucket is +Inf.
+static const long long latency_bounds_us[METRICS_LATENCY_BUCKETS - 1] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000};
+
+// One slot per thread, aligned so two threads never write the same cache line.
+typedef struct __attribute__((aligned(64)))
+{
+    unsigned long long requests[REQUEST_OP_COUNT];
+    unsigned long long errors[REQUEST_OP_COUNT];
+    unsigned long long latency_sum_ns[REQUEST_OP_COUNT];
+    unsigned long long latency_buckets[REQUEST_OP_COUNT][METRICS_LATENCY_BUCKETS];
+} MetricsSlot;
+
+static MetricsSlot slots[METRICS_SLOTS];
+static int slot_owned[METRICS_SLOTS];
+static unsigned int next_shared = 0;
+static pthread_key_t slot_key;
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+static __thread MetricsSlot *thread_slot = NULL;
+
+// Connection-level counters change once per connection, not per request.
+static long long connections_active = 0;
+static long long connections_total = 0;
+static long long connections_reaped = 0;
+static long long auth_failures_total = 0;
+static long long rejected_total[REJECT_REASON_COUNT];
+static long long sessions_waiting = 0;
+static time_t started_at = 0;
+static Catalog *stats_catalog = NULL;
+
+static const char *reject_reasons[REJECT_REASON_COUNT] = {"session_limit", "wait_timeout", "request_limit", "rate_limit"};
+
+//RECORDING
+// A slot goes back to the pool when its thread exits; its counts stay and
+// the next owner adds to them.
+static void release_slot(void *slot)
+{
+    __atomic_store_n(&slot_owned[(MetricsSlot *)slot - slots], 0, __ATOMIC_RELEASE);
+}
+
+static void create_slot_key(void)
+{
+    pthread_key_create(&slot_key, release_slot);
+}
+
+static MetricsSlot *claim_slot(void)
+{
+    pthread_once(&slot_key_once, create_slot_key);
+    for (int s = 0; s < METRICS_SLOTS; s++)
+    {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&slot_owned[s], &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            pthread_setspecific(slot_key, &slots[s]);
+            return &slots[s];
+        }
+    }
+    // More live threads than slots: this one shares.
+    return &slots[__atomic_fetch_add(&next_shared, 1, __ATOMIC_RELAXED) % METRICS_SLOTS];
+}
+
+void metrics_record(const RequestContext *request)
+{
+    if (!thread_slot)
+        thread_slot = claim_slot();
+
+    int op = request->op;
+    long long latency_us = request->latency_ns / 1000;
+    int bucket = 0;
+    while (bucket < METRICS_LATENCY_BUCKETS - 1 && latency_us > latency_bounds_us[bucket])
+        bucket++;
+
+    // Relaxed atomics: uncontended unless more than METRICS_SLOTS threads share slots.
+    __atomic_fetch_add(&thread_slot->requests[op], 1, __ATOMIC_RELAXED);
+    if (request->failed)
+        __atomic_fetch_add(&thread_slot->errors[op], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&thread_slot->latency_sum_ns[op], (unsigned long long)request->latency_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&thread_slot->latency_buckets[op][bucket], 1, __ATOMIC_RELAXED);
+}
+
+void metrics_connection_opened(void)
+{
+    if (!started_at)
+        started_at = time(NULL);
+    __atomic_add_fetch(&connections_active, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&connections_total, 1, __ATOMIC_RELAXED);
+}
+
+void metrics_connection_closed(void)
+{
+    __atomic_sub_fetch(&connections_active, 1, __ATOMIC_RELAXED);
+}
+
+void metrics_connection_reaped(void)
+{
+    __atomic_add_fetch(&connections_reaped, 1, __ATOMIC_RELAXED);
+}
+
+void metrics_auth_failed(void)
+{
+    __atomic_add_fetch(&auth_failures_total, 1, __ATOMIC_RELAXED);
+}
+
+void metrics_rejected(RejectReason reason)
+{
+    __atomic_add_fetch(&rejected_total[reason], 1, __ATOMIC_RELAXED);
+}
+
+void metrics_sessions_waiting(int delta)
+{
+    __atomic_add_fetch(&sessions_waiting, delta, __ATOMIC_RELAXED);
+}
+
+void metrics_catalog(Catalog *catalog)
+{
+    __atomic_store_n(&stats_catalog, catalog, __ATOMIC_RELEASE);
+}
+
+//RENDERING
+static int process_threads(void)
+{
+    char line[256];
+    int threads = 0;
+    FILE *status = fopen("/proc/self/status", "r");
+    if (!status)
+        return 0;
+    while (fgets(line, sizeof(line), status))
+    {
+        if (sscanf(line, "Threads: %d", &threads) == 1)
+            break;
+    }
+    fclose(status);
+    return threads;
+}
+
+static void write_header(FILE *out, const char *name, const char *type, const char *help)
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+char *metrics_render(size_t *length)
+{
+    char *text = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+    if (!out)
+        return NULL;
+
+    unsigned long long requests[REQUEST_OP_COUNT] = {0};
+    unsigned long long errors[REQUEST_OP_COUNT] = {0};
+    unsigned long long latency_sum_ns[REQUEST_OP_COUNT] = {0};
+    unsigned long long buckets[REQUEST_OP_COUNT][METRICS_LATENCY_BUCKETS];
+    memset(buckets, 0, sizeof(buckets));
+
+    for (int s = 0; s < METRICS_SLOTS; s++)
+    {
+        for (int op = 0; op < REQUEST_OP_COUNT; op++)
+        {
+            requests[op] += __atomic_load_n(&slots[s].requests[op], __ATOMIC_RELAXED);
+            errors[op] += __atomic_load_n(&slots[s].errors[op], __ATOMIC_RELAXED);
+            latency_sum_ns[op] += __atomic_load_n(&slots[s].latency_sum_ns[op], __ATOMIC_RELAXED);
+            for (int b = 0; b < METRICS_LATENCY_BUCKETS; b++)
+                buckets[op][b] += __atomic_load_n(&slots[s].latency_buckets[op][b], __ATOMIC_RELAXED);
+        }
+    }
+
+    write_header(out, "library_requests_total", "counter", "Requests served, by operation.");
+    for (int op = 0; op < REQUEST_OP_COUNT; op++)
+        fprintf(out, "library_requests_total{op=\"%s\"} %llu\n", request_op_name((RequestOp)op), requests[op]);
+
+    write_header(out, "library_request_errors_total", "counter", "Requests whose reply reported a failure, by operation.");
+    for (int op = 0; op < REQUEST_OP_COUNT; op++)
+        fprintf(out, "library_request_errors_total{op=\"%s\"} %llu\n", request_op_name((RequestOp)op), errors[op]);
+
+    write_header(out, "library_request_duration_seconds", "histogram", "Time from reading the request to sending the reply.");
+    for (int op = 0; op < REQUEST_OP_COUNT; op++)
+    {
+        // The bucket total, not requests[op]: both are read without a lock and may differ by a few.
+        unsigned long long cumulative = 0;
+        const char *name = request_op_name((RequestOp)op);
+        for (int b = 0; b < METRICS_LATENCY_BUCKETS; b++)
+        {
+            cumulative += buckets[op][b];
+            if (b < METRICS_LATENCY_BUCKETS - 1)
+                fprintf(out, "library_request_duration_seconds_bucket{op=\"%s\",le=\"%g\"} %llu\n",
+                        name, latency_bounds_us[b] / 1e6, cumulative);
+            else
+                fprintf(out, "library_request_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n", name, cumulative);
+        }
+        fprintf(out, "library_request_duration_seconds_sum{op=\"%s\"} %.9f\n", name, latency_sum_ns[op] / 1e9);
+        fprintf(out, "library_request_duration_seconds_count{op=\"%s\"} %llu\n", name, cumulative);
+    }
+
+    write_header(out, "library_connections_active", "gauge", "Connections with a running handler thread.");
+    fprintf(out, "library_connections_active %lld\n", __atomic_load_n(&connections_active, __ATOMIC_RELAXED));
+    write_header(out, "library_connections_total", "counter", "Connections accepted.");
+    fprintf(out, "library_connections_total %lld\n", __atomic_load_n(&connections_total, __ATOMIC_RELAXED));
+    write_header(out, "library_connections_reaped_total", "counter", "Idle connections closed by the server.");
+    fprintf(out, "library_connections_reaped_total %lld\n", __atomic_load_n(&connections_reaped, __ATOMIC_RELAXED));
+    write_header(out, "library_sessions_waiting", "gauge", "Accepted connections waiting for a session slot.");
+    fprintf(out, "library_sessions_waiting %lld\n", __atomic_load_n(&sessions_waiting, __ATOMIC_RELAXED));
+    write_header(out, "library_rejected_total", "counter", "Connections and requests turned away with a busy reply.");
+    for (int reason = 0; reason < REJECT_REASON_COUNT; reason++)
+        fprintf(out, "library_rejected_total{reason=\"%s\"} %lld\n", reject_reasons[reason],
+                __atomic_load_n(&rejected_total[reason], __ATOMIC_RELAXED));
+    write_header(out, "library_auth_failures_total", "counter", "Logins and session resumes that were refused.");
+    fprintf(out, "library_auth_failures_total %lld\n", __atomic_load_n(&auth_failures_total, __ATOMIC_RELAXED));
+    write_header(out, "library_process_threads", "gauge", "Threads in the server process.");
+    fprintf(out, "library_process_threads %d\n", process_threads());
+    if (started_at)
+    {
+        write_header(out, "library_start_time_seconds", "gauge", "Unix time of the first connection.");
+        fprintf(out, "library_start_time_seconds %lld\n", (long long)started_at);
+    }
+
+    // Counts the catalog keeps as it is edited, so a scrape never scans it.
+    CatalogStats books = {0, 0, 0};
+    Catalog *catalog = __atomic_load_n(&stats_catalog, __ATOMIC_ACQUIRE);
+    const char *books_file = catalog ? catalog_location(catalog) : CATALOG_DEFAULT_PATH;
+    int have_books = catalog && catalog_counts(catalog, &books);
+    write_header(out, "library_storage_bytes", "gauge", "Size of the catalog.");
+    fprintf(out, "library_storage_bytes{file=\"%s\"} %lld\n", books_file, have_books ? books.bytes : 0);
+    write_header(out, "library_storage_rows", "gauge", "Books in the catalog.");
+    fprintf(out, "library_storage_rows{file=\"%s\"} %lld\n", books_file, have_books ? books.rows : 0);
+    write_header(out, "library_books_rented", "gauge", "Books currently rented out.");
+    fprintf(out, "library_books_rented %lld\n", have_books ? books.rented : 0);
+
+    ResultCacheStats cache;
+    result_cache_stats(&cache);
+    long long lookups = cache.hits + cache.misses;
+    write_header(out, "library_result_cache_lookups_total", "counter", "Searches looked up in the result cache, by outcome.");
+    fprintf(out, "library_result_cache_lookups_total{result=\"hit\"} %lld\n", cache.hits);
+    fprintf(out, "library_result_cache_lookups_total{result=\"miss\"} %lld\n", cache.misses);
+    write_header(out, "library_result_cache_hit_ratio", "gauge", "Hits over lookups since the cache started.");
+    fprintf(out, "library_result_cache_hit_ratio %g\n", lookups ? (double)cache.hits / lookups : 0.0);
+    write_header(out, "library_result_cache_invalidations_total", "counter", "Cached replies dropped by an edit of their book.");
+    fprintf(out, "library_result_cache_invalidations_total %lld\n", cache.invalidations);
+    write_header(out, "library_result_cache_evictions_total", "counter", "Cached replies pushed out by newer ones.");
+    fprintf(out, "library_result_cache_evictions_total %lld\n", cache.evictions);
+    write_header(out, "library_result_cache_entries", "gauge", "Replies in the result cache, and how many fit.");
+    fprintf(out, "library_result_cache_entries{state=\"used\"} %lld\n", cache.entries);
+    fprintf(out, "library_result_cache_entries{state=\"capacity\"} %lld\n", cache.capacity);
+    write_header(out, "library_result_cache_bytes", "gauge", "Memory allocated for the result cache.");
+    fprintf(out, "library_result_cache_bytes %lld\n", cache.bytes);
+
+    LeaseStats leases;
+    lease_stats(&leases);
+    write_header(out, "library_leases_active", "gauge", "Client cache leases on searches not yet revoked or swept.");
+    fprintf(out, "library_leases_active %lld\n", leases.active);
+    write_header(out, "library_leases_granted_total", "counter", "Search replies a client was allowed to cache.");
+    fprintf(out, "library_leases_granted_total %lld\n", leases.granted);
+    write_header(out, "library_lease_invalidations_total", "counter", "Invalidations sent to clients holding a lease on an edited book.");
+    fprintf(out, "library_lease_invalidations_total %lld\n", leases.invalidations);
+    write_header(out, "library_lease_holders_dropped_total", "counter", "Lease holders disconnected because an invalidation could not be sent at once.");
+    fprintf(out, "library_lease_holders_dropped_total %lld\n", leases.dropped);
+
+    fclose(out);
+    if (length)
+        *length = size;
+    return text;
+}
+
+//HTTP ENDPOINT
+static void *http_main(void *arg)
+{
+    int listener = (int)(long)arg;
+    char request[1024];
+    char header[256];
+
+    while (1)
+    {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0)
+            continue;
+
+        // A scraper that connects and says nothing must not wedge the endpoint.
+        struct timeval timeout = {1, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ssize_t n = recv(client, request, sizeof(request) - 1, 0);
+        request[n > 0 ? n : 0] = '\0';
+
+        size_t length = 0;
+        char *body = NULL;
+        if (strncmp(request, "GET /metrics", 12) == 0 || strncmp(request, "GET / ", 6) == 0)
+            body = metrics_render(&length);
+
+        if (body)
+        {
+            int header_length = snprintf(header, sizeof(header),
+                                         "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                         "Content-Length: %zu\r\nConnection: close\r\n\r\n", length);
+            send(client, header, (size_t)header_length, MSG_NOSIGNAL);
+            send(client, body, length, MSG_NOSIGNAL);
+            free(body);
+        }
+        else
+        {
+            const char *not_found = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            send(client, not_found, strlen(not_found), MSG_NOSIGNAL);
+        }
+        close(client);
+    }
+    return NULL;
+}
+
+int metrics_serve_http(int port)
+{
+    struct sockaddr_in addr;
+    int reuse = 1;
+    pthread_t tid;
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0)
+        return -1;
+
+    // Loopback only: the endpoint has no authentication.
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listener, 8) < 0 ||
+        pthread_create(&tid, NULL, http_main, (void *)(long)listener) != 0)
+    {
+        perror("Metrics endpoint failed");
+        close(listener);
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
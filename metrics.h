@@ -0,0 +1,45 @@
+//*******METRICS*******
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include "request.h"
+#include "catalog.h"
+
+#define METRICS_PORT_ENV "LIBRARY_METRICS_PORT" // serve GET /metrics on 127.0.0.1:<port> when set
+#define METRICS_SLOTS 64                        // per-thread counter slots, reused as threads exit; threads beyond share
+#define METRICS_LATENCY_BUCKETS 16              // 15 bounds plus +Inf
+
+typedef enum
+{
+    REJECT_SESSION_LIMIT, // session slots and their wait queue were full
+    REJECT_WAIT_TIMEOUT,  // waited too long for a session slot
+    REJECT_REQUEST_LIMIT, // too many requests already in flight
+    REJECT_RATE_LIMIT,    // the session ran out of tokens
+    REJECT_REASON_COUNT
+} RejectReason;
+
+// Called by request_end: counts the request, its failure and its latency in
+// the calling thread's own slot, so connection threads never share a cache line.
+void metrics_record(const RequestContext *request);
+
+// Gauges and counters outside the request path.
+void metrics_connection_opened(void);
+void metrics_connection_closed(void);
+void metrics_connection_reaped(void);
+void metrics_auth_failed(void);
+void metrics_rejected(RejectReason reason);
+void metrics_sessions_waiting(int delta);
+
+// The catalog the storage gauges describe; until one is set they read 0.
+void metrics_catalog(Catalog *catalog);
+
+// Prometheus text exposition (format 0.0.4) of everything above plus the
+// storage gauges, from the counts the catalog keeps (catalog_counts).
+// Returns a malloc'd string the caller frees, or NULL.
+char *metrics_render(size_t *length);
+
+// Starts a thread serving metrics_render over HTTP on 127.0.0.1:port.
+int metrics_serve_http(int port);
+
+#endif
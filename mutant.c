@@ -0,0 +1,26 @@
+//*******MUTANT SELECTION*******
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <pthread.h>
+#include "mutant.h"
+
+static int active;
+static pthread_once_t active_once = PTHREAD_ONCE_INIT;
+
+static void read_active(void)
+{
+    const char *value = getenv(MUTANT_ENV);
+    active = value ? atoi(value) : 0;
+}
+
+int mutant_active(void)
+{
+    pthread_once(&active_once, read_active);
+    return active;
+}
+
+void mutant_select(int id)
+{
+    pthread_once(&active_once, read_active);
+    active = id;
+}
@@ -0,0 +1,21 @@
+//*******MUTANT SELECTION*******
+#ifndef MUTANT_H
+#define MUTANT_H
+
+// Files generated by mutate.py carry every mutant at once; each mutated
+// expression checks which one is live. 0 (or unset) runs the original code.
+#define MUTANT_ENV "LIBRARY_MUTANT"
+
+// The id from LIBRARY_MUTANT, read on first use.
+int mutant_active(void);
+// Makes id the live mutant from now on, whatever LIBRARY_MUTANT says; the
+// test fork server calls it in each child.
+void mutant_select(int id);
+
+// mutate.py equivalent builds one mutant at a time with -DMUTANT_FIXED=<id>,
+// which lets the compiler fold away every other alternative.
+#ifdef MUTANT_FIXED
+#define mutant_active() (MUTANT_FIXED)
+#endif
+
+#endif
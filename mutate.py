@@ -0,0 +1,1069 @@
+#!/usr/bin/env python3
+"""Mutant schemata for the library server.
+
+Instead of hand-editing one commented-out mutant at a time and rebuilding,
+generate writes copies of the target C files with every mutant compiled in.
+Each mutated expression becomes
+
+    (mutant_active() == 7 ? (mutated) : (original))
+
+so a single build holds them all and LIBRARY_MUTANT=7 picks the live one
+(mutant.h). Alternatives go on the first line of the original expression,
+so line numbers, compiler messages and __LINE__ still match the source.
+
+    python3 mutate.py generate -o schemata catalog.c:edit_row storage_text.c
+    python3 mutate.py list
+    python3 mutate.py run -j 8
+
+run executes the tests once per mutant across all cores, each run in a
+fresh working directory, and writes the mutation score with a breakdown
+per operator to mutation_report.txt (per-mutant outcomes in
+schemata/results.tsv). By default each job is a test binary in
+--fork-server mode that forks a child per mutant from a warm suite, stops
+at the first failing test and times tests out against a baseline run;
+--no-fork-server starts the binary afresh per mutant instead. A mutant the
+binary could not run at all is reported as an error, left out of the
+score and of the cache, and tried again next run.
+
+coverage runs each test alone in the gcov build (make test_runner_coverage)
+and records the lines it executes in schemata/coverage.tsv. From then on
+run gives each mutant only the tests that reach its line, ordered by how
+many mutants each test has killed before (schemata/history.tsv), so the
+first kill usually comes from the first test; a mutant no test reaches is
+reported as uncovered without running. --all-tests ignores the map.
+
+equivalent compiles each mutant on its own at -O2 (mutant.h turns
+mutant_active() into the constant MUTANT_FIXED, so every other alternative
+folds away) and compares the object code. A mutant whose code is the
+original's cannot be killed and one whose code matches an earlier mutant's
+cannot do anything that one does not; schemata/equivalent.tsv lists both
+kinds, run skips them and the report counts them apart from the score.
+
+run is incremental: schemata/cache.tsv keeps each outcome under the digest
+of the mutated function's source, the mutation itself and the digests of
+the tests it was given (each with the test-file helpers it calls). A
+mutant is re-run only when its function, its mutation or one of those
+tests changed (--no-cache re-runs everything); the report gives the hit rate.
+
+A target is FILE or FILE:function,function; a bare FILE mutates every
+function in it. make mutants does the generate and the one build.
+
+Operators:
+    AOR  arithmetic operator replacement      + - * / % ++ -- += -=
+    ROR  relational operator replacement      == != < <= > >=
+    COR  conditional operator replacement     && ||, negated if/while conditions
+    SDL  statement deletion                   expression statements
+    VRR  variable reference replacement       locals, parameters and struct
+                                              fields of the same declared type
+    LCK  lock deletion                        pthread_mutex_lock and flock calls
+    SCR  system call flag removal             O_* flags or'ed into open()
+"""
+
+import argparse
+import bisect
+import concurrent.futures
+import glob
+import hashlib
+import json
+import os
+import queue
+import re
+import shutil
+import signal
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from collections import namedtuple
+
+MUTANT_ENV = 'LIBRARY_MUTANT'
+MANIFEST = 'mutants.tsv'
+MANIFEST_FIELDS = ('id', 'operator', 'file', 'line', 'function', 'change', 'origin')
+RESULTS = 'results.tsv'
+COVERAGE = 'coverage.tsv'
+HISTORY = 'history.tsv'
+CACHE = 'cache.tsv'
+EQUIVALENT = 'equivalent.tsv'
+EQUIVALENCE_FLAGS = '-std=c99 -O2 -ffunction-sections -fdata-sections'
+DEFAULT_TESTS = 'test_server.c'
+DEFAULT_COVERAGE_RUNNER = './test_runner_coverage'
+DEFAULT_COVERAGE_OBJECTS = 'coverage'
+DEFAULT_REPORT = 'mutation_report.txt'
+DEFAULT_DIR = 'schemata'
+DEFAULT_RUNNER = './test_runner_mutants'
+DEFAULT_TIMEOUT = 60.0
+# Lines the generated file adds ahead of the source; #line puts the count back.
+HEADER = '// Generated by mutate.py from {0}; edit {0} instead.\n#include "mutant.h"\n#line 1 "{0}"\n'
+HEADER_LINES = 3
+MAX_CHECK_PASSES = 20
+
+#TOKENS
+Token = namedtuple('Token', 'kind text start end')
+
+TOKEN_RE = re.compile(r'''
+    (?P<space>\s+)
+  | (?P<comment>//[^\n]*|/\*.*?\*/)
+  | (?P<directive>\#(?:\\\n|[^\n])*)
+  | (?P<string>"(?:\\.|[^"\\\n])*")
+  | (?P<char>'(?:\\.|[^'\\\n])*')
+  | (?P<number>\.?\d(?:[eEpP][+-]|[\w.])*)
+  | (?P<ident>[A-Za-z_]\w*)
+  | (?P<punct>\.\.\.|<<=|>>=|->|\+\+|--|<<|>>|<=|>=|==|!=|&&|\|\||[-+*/%&|^]=|.)
+''', re.VERBOSE | re.DOTALL)
+
+KEYWORDS = {
+    'auto', 'break', 'case', 'char', 'const', 'continue', 'default', 'do', 'double', 'else', 'enum',
+    'extern', 'float', 'for', 'goto', 'if', 'inline', 'int', 'long', 'register', 'restrict', 'return',
+    'short', 'signed', 'sizeof', 'static', 'struct', 'switch', 'typedef', 'union', 'unsigned', 'void',
+    'volatile', 'while',
+}
+TYPE_WORDS = {
+    'char', 'const', 'double', 'enum', 'float', 'int', 'long', 'short', 'signed', 'static', 'struct',
+    'union', 'unsigned', 'void', 'volatile',
+}
+OPEN_BRACKETS = {'(': ')', '[': ']', '{': '}'}
+CLOSE_BRACKETS = {v: k for k, v in OPEN_BRACKETS.items()}
+
+RELATIONAL = {
+    '==': ['!='], '!=': ['=='],
+    '<': ['<=', '>='], '<=': ['<', '>'],
+    '>': ['>=', '<='], '>=': ['>', '<'],
+}
+ARITHMETIC = {'+': ['-'], '-': ['+'], '*': ['/'], '/': ['*'], '%': ['*']}
+UPDATE = {'++': '--', '--': '++', '+=': '-=', '-=': '+='}
+LOGICAL = {'&&': '||', '||': '&&'}
+LOCK_CALLS = {'pthread_mutex_lock', 'flock'}
+
+
+def tokenize(source):
+    tokens = []
+    for match in TOKEN_RE.finditer(source):
+        kind = match.lastgroup
+        if kind not in ('space', 'comment', 'directive'):
+            tokens.append(Token(kind, match.group(), match.start(), match.end()))
+    return tokens
+
+
+class LineMap:
+    """Offset to 1-based line and column."""
+
+    def __init__(self, text):
+        self.starts = [0] + [m.end() for m in re.finditer('\n', text)]
+
+    def line(self, offset):
+        return bisect.bisect_right(self.starts, offset)
+
+    def column(self, offset):
+        return offset - self.starts[self.line(offset) - 1] + 1
+
+
+def match_forward(tokens, i):
+    """Index of the bracket closing tokens[i]."""
+    depth = 0
+    for j in range(i, len(tokens)):
+        if tokens[j].text in OPEN_BRACKETS:
+            depth += 1
+        elif tokens[j].text in CLOSE_BRACKETS:
+            depth -= 1
+            if depth == 0:
+                return j
+    raise ValueError('unbalanced %r' % tokens[i].text)
+
+
+def match_backward(tokens, i):
+    """Index of the bracket opening tokens[i]."""
+    depth = 0
+    for j in range(i, -1, -1):
+        if tokens[j].text in CLOSE_BRACKETS:
+            depth += 1
+        elif tokens[j].text in OPEN_BRACKETS:
+            depth -= 1
+            if depth == 0:
+                return j
+    raise ValueError('unbalanced %r' % tokens[i].text)
+
+
+def find_top(tokens, i, texts, limit=None):
+    """First index from i of a token in texts outside any brackets; limit
+    when there is none before it."""
+    depth = 0
+    for j in range(i, len(tokens) if limit is None else limit):
+        text = tokens[j].text
+        if depth == 0 and text in texts:
+            return j
+        if text in OPEN_BRACKETS:
+            depth += 1
+        elif text in CLOSE_BRACKETS:
+            depth -= 1
+    if limit is not None:
+        return limit
+    raise ValueError('no %s after offset %d' % ('/'.join(texts), tokens[i].start))
+
+
+#DECLARATIONS
+Function = namedtuple('Function', 'name params_open body_open body_close')
+
+
+def functions(tokens):
+    depth = 0
+    for i, token in enumerate(tokens):
+        if token.text == '{':
+            if depth == 0 and i > 0 and tokens[i - 1].text == ')':
+                params_open = match_backward(tokens, i - 1)
+                if params_open > 0 and tokens[params_open - 1].kind == 'ident':
+                    yield Function(tokens[params_open - 1].text, params_open, i, match_forward(tokens, i))
+            depth += 1
+        elif token.text == '}':
+            depth -= 1
+
+
+def declarators(tokens, first, last):
+    """(name, type, initializer range or None, index) for a declaration
+    spanning tokens[first..last], the ; excluded."""
+    result = []
+    start = first
+    base = None
+    while start <= last:
+        end = find_top(tokens, start, {',', '='}, last + 1)
+        # The name is the last identifier before any array brackets.
+        j = end - 1
+        array = ''
+        while j > start and tokens[j].text == ']':
+            j = match_backward(tokens, j) - 1
+            array = '[]'
+        name_index = j
+        stars = 0
+        k = name_index - 1
+        while k >= start and tokens[k].text == '*':
+            stars += 1
+            k -= 1
+        if base is None:
+            base = ' '.join(t.text for t in tokens[start:k + 1])
+        kind = (base + ' ' + '*' * stars).strip() + array
+        init = None
+        if end <= last and tokens[end].text == '=':
+            init_end = find_top(tokens, end + 1, {','}, last + 1)
+            init = (end + 1, init_end - 1)
+            end = init_end
+        if tokens[name_index].kind == 'ident':
+            result.append((tokens[name_index].text, kind, init, name_index))
+        start = end + 1
+    return result
+
+
+def parameters(tokens, function):
+    close = match_forward(tokens, function.params_open)
+    result = []
+    start = function.params_open + 1
+    while start < close:
+        end = find_top(tokens, start, {','}, close)
+        if end - start > 1:
+            result.extend(declarators(tokens, start, end - 1))
+        start = end + 1
+    return result
+
+
+def struct_fields(sources):
+    """field name -> {struct name: field type} over the structs in sources."""
+    fields = {}
+    pattern = re.compile(r'struct\s*(\w*)\s*\{([^{}]*)\}\s*(\w*)\s*;', re.DOTALL)
+    for source in sources:
+        for match in pattern.finditer(source):
+            struct = match.group(3) or match.group(1)
+            tokens = tokenize(match.group(2))
+            start = 0
+            while start < len(tokens):
+                end = find_top(tokens, start, {';'}, len(tokens))
+                if end > start:
+                    for name, kind, _, _ in declarators(tokens, start, end - 1):
+                        fields.setdefault(name, {})[struct] = kind
+                start = end + 1
+    return fields
+
+
+def is_declaration(tokens, i):
+    if tokens[i].text in TYPE_WORDS:
+        return True
+    if tokens[i].kind != 'ident' or tokens[i].text in KEYWORDS:
+        return False
+    j = i + 1
+    while tokens[j].text == '*':
+        j += 1
+    return tokens[j].kind == 'ident'
+
+
+#SITES
+# An expression that can carry mutants: an if/while condition, a return
+# value, an initializer or a whole expression statement.
+Site = namedtuple('Site', 'kind first last')
+
+
+def function_sites(tokens, function):
+    """Sites in the body, plus the locals declared along the way as
+    (name, type, index) for VRR."""
+    sites = []
+    names = [(name, kind, index) for name, kind, _, index in parameters(tokens, function)]
+    i = function.body_open + 1
+    last = function.body_close
+    while i < last:
+        text = tokens[i].text
+        if text in ('{', '}', ';', 'else', 'do'):
+            i += 1
+        elif text in ('if', 'while', 'switch', 'for'):
+            close = match_forward(tokens, i + 1)
+            if text in ('if', 'while') and close > i + 2:
+                sites.append(Site('cond', i + 2, close - 1))
+            i = close + 1
+        elif text in ('case', 'default'):
+            i = find_top(tokens, i, {':'}) + 1
+        elif text == 'return':
+            end = find_top(tokens, i, {';'})
+            if end > i + 1:
+                sites.append(Site('return', i + 1, end - 1))
+            i = end + 1
+        elif text in ('break', 'continue', 'goto'):
+            i = find_top(tokens, i, {';'}) + 1
+        elif tokens[i].kind == 'ident' and tokens[i + 1].text == ':':
+            i += 2
+        else:
+            end = find_top(tokens, i, {';'})
+            if is_declaration(tokens, i):
+                for name, kind, init, index in declarators(tokens, i, end - 1):
+                    names.append((name, kind, index))
+                    if init and tokens[init[0]].text != '{':
+                        sites.append(Site('init', init[0], init[1]))
+            else:
+                sites.append(Site('stmt', i, end - 1))
+            i = end + 1
+    return sites, names
+
+
+def operand_end(token):
+    return (token.kind in ('ident', 'number', 'char', 'string') and token.text not in KEYWORDS) or token.text in (')', ']')
+
+
+def calls_lock(tokens):
+    for k, token in enumerate(tokens[:-1]):
+        if token.text in LOCK_CALLS and tokens[k + 1].text == '(':
+            close = match_forward(tokens, k + 1)
+            return not any(t.text == 'LOCK_UN' for t in tokens[k + 1:close])
+    return False
+
+
+def site_mutations(tokens, site, names, fields):
+    """(operator, first, count, replacement, change) for each mutant of the
+    site; first is relative to the site, or None when the whole site goes."""
+    toks = tokens[site.first:site.last + 1]
+    # Declared earlier, and not the variable this initializer is for.
+    in_scope = {}
+    for name, kind, index in names:
+        if index < site.first and not (site.kind == 'init' and index == site.first - 2):
+            in_scope[name] = kind
+    mutations = []
+    for k, token in enumerate(toks):
+        text = token.text
+        previous = toks[k - 1] if k > 0 else None
+        following = toks[k + 1] if k + 1 < len(toks) else None
+        if text in RELATIONAL:
+            for replacement in RELATIONAL[text]:
+                mutations.append(('ROR', k, 1, replacement, '%s -> %s' % (text, replacement)))
+        elif text in LOGICAL:
+            mutations.append(('COR', k, 1, LOGICAL[text], '%s -> %s' % (text, LOGICAL[text])))
+        elif text in UPDATE:
+            mutations.append(('AOR', k, 1, UPDATE[text], '%s -> %s' % (text, UPDATE[text])))
+        elif text in ARITHMETIC and previous is not None and operand_end(previous):
+            for replacement in ARITHMETIC[text]:
+                mutations.append(('AOR', k, 1, replacement, '%s -> %s' % (text, replacement)))
+        elif (text == '|' and previous is not None and previous.text.startswith('O_')
+              and following is not None and following.text.startswith('O_')):
+            mutations.append(('SCR', k, 2, '', 'drop %s' % following.text))
+        elif token.kind == 'ident' and previous is not None and previous.text in ('->', '.'):
+            owners = fields.get(text, {})
+            if len(owners) == 1:
+                (struct, kind), = owners.items()
+                for other, other_owners in sorted(fields.items()):
+                    if other != text and other_owners.get(struct) == kind:
+                        mutations.append(('VRR', k, 1, other, '%s%s -> %s%s' % (previous.text, text, previous.text, other)))
+        elif (token.kind == 'ident' and text in in_scope
+              and (following is None or following.text != '(')):
+            for other, kind in sorted(in_scope.items()):
+                if other != text and kind == in_scope[text]:
+                    mutations.append(('VRR', k, 1, other, '%s -> %s' % (text, other)))
+
+    summary = ' '.join(t.text for t in toks)
+    if len(summary) > 60:
+        summary = summary[:57] + '...'
+    if site.kind == 'cond':
+        mutations.append(('COR', None, 0, '!', 'negate (%s)' % summary))
+    elif site.kind == 'stmt':
+        mutations.append(('LCK' if calls_lock(toks) else 'SDL', None, 0, '', 'delete %s;' % summary))
+    elif site.kind == 'init' and calls_lock(toks):
+        mutations.append(('LCK', None, 0, '0', 'skip %s' % summary))
+    return mutations
+
+
+def mutated_text(toks, mutation):
+    _, first, count, replacement, _ = mutation
+    texts = [t.text for t in toks]
+    if first is None:
+        return None
+    texts[first:first + count] = [replacement] if replacement else []
+    return ' '.join(texts)
+
+
+#SCHEMATA
+# origin names the mutant by what it is made from rather than its id: a
+# digest of its function's source and its place among that function's
+# mutants. It stays the same until the function itself is edited.
+Mutant = namedtuple('Mutant', 'id operator file line function change origin')
+
+
+def digest(text):
+    return hashlib.sha1(text.encode()).hexdigest()[:16]
+
+
+def parse_target(target):
+    path, _, names = target.partition(':')
+    return path, set(filter(None, names.split(',')))
+
+
+def included_headers(path, source):
+    directory = os.path.dirname(path)
+    headers = []
+    for name in re.findall(r'^\s*#\s*include\s+"([^"]+)"', source, re.MULTILINE):
+        header = os.path.join(directory, name)
+        if os.path.exists(header):
+            with open(header) as f:
+                headers.append(f.read())
+    return headers
+
+
+def plan_file(path, wanted):
+    """Every (function, source digest, site, [mutation]) of the chosen
+    functions in path."""
+    with open(path) as f:
+        source = f.read()
+    tokens = tokenize(source)
+    fields = struct_fields([source] + included_headers(path, source))
+    plan = []
+    found = set()
+    for function in functions(tokens):
+        if wanted and function.name not in wanted:
+            continue
+        found.add(function.name)
+        text = source[tokens[function.params_open - 1].start:tokens[function.body_close].end]
+        sites, names = function_sites(tokens, function)
+        for site in sites:
+            mutations = site_mutations(tokens, site, names, fields)
+            if mutations:
+                plan.append((function.name, digest(text), site, mutations))
+    missing = wanted - found
+    if missing:
+        raise SystemExit('%s: no function %s' % (path, ', '.join(sorted(missing))))
+    return source, tokens, plan
+
+
+def render_file(path, source, tokens, plan, next_id, skipped):
+    """The schemata text of one file. Returns (text, mutants, spans) where
+    spans maps each mutant id to the source line and generated column where
+    its alternative starts, and its key in skipped."""
+    name = os.path.basename(path)
+    pieces = [HEADER.format(name)]
+    length = len(pieces[0])
+    cursor = 0
+    mutants = []
+    offsets = {}
+    lines = LineMap(source)
+
+    def emit(text):
+        nonlocal length
+        pieces.append(text)
+        length += len(text)
+
+    ordinals = {}
+    for function, function_digest, site, mutations in plan:
+        toks = tokens[site.first:site.last + 1]
+        start, end = toks[0].start, toks[-1].end
+        original = source[start:end]
+        choices = []
+        for mutation in mutations:
+            ordinals[function] = ordinals.get(function, 0) + 1
+            key = (name, function, lines.line(start), mutation[4], mutation[0])
+            if key in skipped:
+                continue
+            mutant_id = next_id + len(mutants)
+            origin = '%s.%d' % (function_digest, ordinals[function])
+            mutants.append(Mutant(mutant_id, mutation[0], name, lines.line(start), function, mutation[4], origin))
+            choices.append((mutant_id, mutation, key))
+        if not choices:
+            continue
+
+        emit(source[cursor:start])
+        emit('(')
+        # Arms of a condition are all made 0 or 1, so a negated pointer
+        # test has the same type as the original.
+        wrap = {'stmt': '(void)', 'cond': '!!'}.get(site.kind, '')
+        for mutant_id, mutation, key in choices:
+            if site.kind == 'stmt' and mutation[1] is None:
+                alternative = '(void)0'
+            elif mutation[1] is None and mutation[0] == 'COR':
+                alternative = '(!(%s))' % ' '.join(t.text for t in toks)
+            elif mutation[1] is None:
+                alternative = '(%s)' % mutation[3]
+            else:
+                alternative = '%s(%s)' % (wrap, mutated_text(toks, mutation))
+            emit('mutant_active() == %d ? ' % mutant_id)
+            offsets[mutant_id] = (length, key)
+            emit(alternative)
+            emit(' : ')
+        emit(wrap + '(')
+        emit(original)
+        emit('))')
+        cursor = end
+    emit(source[cursor:])
+
+    text = ''.join(pieces)
+    generated = LineMap(text)
+    spans = {}
+    for mutant_id, (offset, key) in offsets.items():
+        spans[mutant_id] = (generated.line(offset) - HEADER_LINES, generated.column(offset), key)
+    return text, mutants, spans
+
+
+DIAGNOSTIC_RE = re.compile(r'^([^:\n]+):(\d+):(\d+): error:', re.MULTILINE)
+
+
+def compile_errors(path, text, directory, compiler):
+    """(line, column) of each error gcc finds in the generated text."""
+    process = subprocess.run(
+        compiler.split() + ['-std=c99', '-fsyntax-only', '-fdiagnostics-column-unit=byte', '-fmax-errors=0',
+                            '-I', directory or '.', '-x', 'c', '-'],
+        input=text, capture_output=True, text=True)
+    name = os.path.basename(path)
+    return [(int(line), int(column)) for file, line, column in DIAGNOSTIC_RE.findall(process.stderr)
+            if os.path.basename(file) == name], process.stderr
+
+
+def generate(args):
+    os.makedirs(args.output, exist_ok=True)
+    mutants = []
+    dropped = 0
+    for target in args.targets:
+        path, wanted = parse_target(target)
+        source, tokens, plan = plan_file(path, wanted)
+        # A mutant that does not compile (a VRR to a variable that is out
+        # of scope there, say) would break the whole build, so each file
+        # is checked and such mutants are left out.
+        skipped = set()
+        for _ in range(MAX_CHECK_PASSES):
+            text, file_mutants, spans = render_file(path, source, tokens, plan, len(mutants) + 1, skipped)
+            if not args.check:
+                break
+            errors, stderr = compile_errors(path, text, os.path.dirname(path), args.cc)
+            if not errors:
+                break
+            blamed = set()
+            for line, column in errors:
+                candidates = [(span[1], span[2]) for span in spans.values() if span[0] == line and span[1] <= column]
+                if candidates:
+                    blamed.add(max(candidates)[1])
+            if not blamed:
+                sys.stderr.write(stderr)
+                raise SystemExit('%s: errors outside any mutant' % path)
+            skipped |= blamed
+        else:
+            raise SystemExit('%s: still failing after %d passes' % (path, MAX_CHECK_PASSES))
+        dropped += len(skipped)
+        with open(os.path.join(args.output, os.path.basename(path)), 'w') as f:
+            f.write(text)
+        mutants.extend(file_mutants)
+
+    with open(os.path.join(args.output, MANIFEST), 'w') as f:
+        f.write('\t'.join(MANIFEST_FIELDS) + '\n')
+        for mutant in mutants:
+            f.write('\t'.join(str(field).replace('\t', ' ') for field in mutant) + '\n')
+    print('%d mutants in %d files (%d left out: did not compile)' % (len(mutants), len(args.targets), dropped))
+
+
+#RUNS
+def load_manifest(directory):
+    path = os.path.join(directory, MANIFEST)
+    try:
+        with open(path) as f:
+            rows = [line.rstrip('\n').split('\t') for line in f]
+    except FileNotFoundError:
+        raise SystemExit('%s: run make mutants (or mutate.py generate) first' % path)
+    if rows and tuple(rows[0]) != MANIFEST_FIELDS:
+        raise SystemExit('%s: written by an older mutate.py; run make mutants again' % path)
+    return [Mutant(int(r[0]), r[1], r[2], int(r[3]), r[4], r[5], r[6]) for r in rows[1:]]
+
+
+def list_mutants(args):
+    for mutant in load_manifest(args.directory):
+        print('%4d  %s  %s:%d  %s  %s' % (mutant.id, mutant.operator, mutant.file, mutant.line, mutant.function, mutant.change))
+
+
+def test_arguments(tests):
+    return [] if tests is None else ['--only', ','.join(str(test) for test in tests)]
+
+
+def run_once(runner, mutant_id, timeout, tests=None):
+    """('killed' | 'survived' | 'timeout', seconds, -1) for one run of the test
+    binary, over all tests or the listed ones. Each run gets a directory of
+    its own as cwd and TMPDIR, so runs in parallel never share books.txt,
+    sockets or the test scratch directory, and whatever a killed run leaves
+    behind goes with it."""
+    sandbox = tempfile.mkdtemp(prefix='mutant-%d.' % mutant_id)
+    env = dict(os.environ, TMPDIR=sandbox, **{MUTANT_ENV: str(mutant_id)})
+    started = time.monotonic()
+    try:
+        process = subprocess.Popen([runner] + test_arguments(tests), cwd=sandbox, env=env, stdout=subprocess.DEVNULL,
+                                   stderr=subprocess.DEVNULL, start_new_session=True)
+        try:
+            outcome = 'survived' if process.wait(timeout=timeout) == 0 else 'killed'
+        except subprocess.TimeoutExpired:
+            os.killpg(process.pid, signal.SIGKILL)
+            process.wait()
+            outcome = 'timeout'
+        return outcome, time.monotonic() - started, -1
+    finally:
+        shutil.rmtree(sandbox, ignore_errors=True)
+
+
+class ForkServer:
+    """A test binary started once with --fork-server, in a sandbox of its
+    own. It sets up the suite and times a baseline run once, then forks a
+    child per mutant, stops at the first failing test and times out tests
+    against their baseline times. run returns what run_once does, with the
+    index of the deciding test in place of -1."""
+
+    def __init__(self, runner):
+        self.sandbox = tempfile.mkdtemp(prefix='fork-server.')
+        self.process = subprocess.Popen([runner, '--fork-server'], cwd=self.sandbox,
+                                        env=dict(os.environ, TMPDIR=self.sandbox),
+                                        stdin=subprocess.PIPE, stdout=subprocess.PIPE, text=True, bufsize=1)
+
+    def run(self, mutant_id, tests=None):
+        self.process.stdin.write('%d %s\n' % (mutant_id, ','.join(str(test) for test in tests or [])))
+        self.process.stdin.flush()
+        line = self.process.stdout.readline().split()
+        if len(line) != 4 or int(line[0]) != mutant_id:
+            raise SystemExit('fork server exited; run the test binary alone to see why')
+        return line[1], float(line[3]), int(line[2])
+
+    def close(self):
+        self.process.stdin.close()
+        self.process.wait()
+        shutil.rmtree(self.sandbox, ignore_errors=True)
+
+
+#COVERAGE
+def list_tests(runner):
+    """[(index, name)] in the order the test binary registers them."""
+    output = subprocess.run([runner, '--list'], capture_output=True, text=True, check=True).stdout
+    return [(int(index), name) for index, name in (line.split('\t', 1) for line in output.splitlines())]
+
+
+def executed_lines(objects):
+    """{file name: lines run at least once} from the .gcda files in objects."""
+    lines = {}
+    for gcda in sorted(glob.glob(os.path.join(objects, '*.gcda'))):
+        output = subprocess.run(['gcov', '--json-format', '--stdout', '-o', objects, gcda],
+                                capture_output=True, text=True, check=True).stdout
+        for document in output.splitlines():
+            for entry in json.loads(document)['files']:
+                ran = {line['line_number'] for line in entry['lines'] if line['count'] > 0}
+                lines.setdefault(os.path.basename(entry['file']), set()).update(ran)
+    return lines
+
+
+def coverage(args):
+    """Runs each test alone in the gcov build and writes, per test, the
+    lines of the instrumented files it executes."""
+    runner = os.path.abspath(args.runner)
+    rows = []
+    for index, name in list_tests(runner):
+        for gcda in glob.glob(os.path.join(args.objects, '*.gcda')):
+            os.remove(gcda)
+        sandbox = tempfile.mkdtemp(prefix='coverage.')
+        try:
+            process = subprocess.run([runner, '--only', str(index)], cwd=sandbox, env=dict(os.environ, TMPDIR=sandbox),
+                                     stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, timeout=args.timeout)
+            # A test that fails alone stops early, and the map would send
+            # mutants past it to tests that never reach them.
+            if process.returncode != 0:
+                raise SystemExit('%s fails when run alone (%s --only %d); fix it before mapping coverage'
+                                 % (name, args.runner, index))
+        except subprocess.TimeoutExpired:
+            print('%s: timed out; its coverage is partial' % name)
+        finally:
+            shutil.rmtree(sandbox, ignore_errors=True)
+        for file, lines in sorted(executed_lines(args.objects).items()):
+            rows.append((index, name, file, lines))
+
+    with open(os.path.join(args.directory, COVERAGE), 'w') as f:
+        f.write('test\tname\tfile\tlines\n')
+        for index, name, file, lines in rows:
+            f.write('%d\t%s\t%s\t%s\n' % (index, name, file, ','.join(str(line) for line in sorted(lines))))
+    print('%d tests mapped to %d covered lines' % (len({row[0] for row in rows}), sum(len(row[3]) for row in rows)))
+
+
+def load_coverage(directory):
+    """{(file, line): set of test names}, or None without a coverage pass."""
+    try:
+        with open(os.path.join(directory, COVERAGE)) as f:
+            rows = [line.rstrip('\n').split('\t') for line in f][1:]
+    except FileNotFoundError:
+        return None
+    covered = {}
+    for _, name, file, lines in rows:
+        for line in filter(None, lines.split(',')):
+            covered.setdefault((file, int(line)), set()).add(name)
+    return covered
+
+
+def load_history(directory):
+    """{test name: mutants it has killed over past runs}."""
+    try:
+        with open(os.path.join(directory, HISTORY)) as f:
+            return {name: int(kills) for name, kills in (line.rstrip('\n').split('\t') for line in f)}
+    except FileNotFoundError:
+        return {}
+
+
+def save_history(directory, history):
+    with open(os.path.join(directory, HISTORY), 'w') as f:
+        for name, kills in sorted(history.items(), key=lambda item: -item[1]):
+            f.write('%s\t%d\n' % (name, kills))
+
+
+def select_tests(mutant, covered, history, tests):
+    """Indexes of the tests that reach the mutant's line, the ones that have
+    killed the most mutants before first; None means every test."""
+    if covered is None:
+        return None
+    names = covered.get((mutant.file, mutant.line), set())
+    chosen = [(index, name) for index, name in tests if name in names]
+    chosen.sort(key=lambda test: (-history.get(test[1], 0), test[0]))
+    return [index for index, _ in chosen]
+
+
+#CACHE
+# Outcomes of earlier runs, keyed by what decides them: the mutant's origin
+# and mutation, and the source of the tests it is given. Editing one
+# function re-runs its mutants only; editing a test or a helper it calls
+# re-runs the mutants that test covers.
+def test_digests(path):
+    """{test name: digest} for the tests path registers with CU_add_test.
+    A test's digest covers its function, every function of the file it
+    calls directly or through other helpers, and all the file has outside
+    functions (includes, macros, types, globals). Comments do not count."""
+    with open(path) as f:
+        source = f.read()
+    tokens = tokenize(source)
+    spans = {function.name: (function.params_open - 1, function.body_close) for function in functions(tokens)}
+    inside = set()
+    for first, last in spans.values():
+        inside.update(range(first, last + 1))
+    shared = ' '.join(token.text for i, token in enumerate(tokens) if i not in inside)
+    bodies = {name: ' '.join(token.text for token in tokens[first:last + 1]) for name, (first, last) in spans.items()}
+    calls = {name: {token.text for token in tokens[first + 1:last + 1] if token.text in spans}
+             for name, (first, last) in spans.items()}
+
+    def reached(function):
+        seen, pending = set(), [function]
+        while pending:
+            name = pending.pop()
+            if name in spans and name not in seen:
+                seen.add(name)
+                pending.extend(calls[name])
+        return seen
+
+    return {name: digest(shared + ''.join(bodies[f] for f in sorted(reached(function))))
+            for name, function in re.findall(r'CU_add_test\(\s*\w+\s*,\s*"([^"]*)"\s*,\s*(\w+)\s*\)', source)}
+
+
+def cache_key(mutant, names, digests):
+    return '%s/%s/%s' % (mutant.origin, digest(mutant.operator + ' ' + mutant.change),
+                         digest(''.join(sorted(name + digests.get(name, '') for name in names))))
+
+
+def load_cache(directory):
+    """{key: (outcome, seconds, deciding test name)}."""
+    try:
+        with open(os.path.join(directory, CACHE)) as f:
+            rows = [line.rstrip('\n').split('\t') for line in f][1:]
+    except FileNotFoundError:
+        return {}
+    return {key: (outcome, float(seconds), test) for key, outcome, seconds, test in rows}
+
+
+def save_cache(directory, cache):
+    with open(os.path.join(directory, CACHE), 'w') as f:
+        f.write('key\toutcome\tseconds\ttest\n')
+        for key, (outcome, seconds, test) in sorted(cache.items()):
+            f.write('%s\t%s\t%.3f\t%s\n' % (key, outcome, seconds, test))
+
+
+#EQUIVALENCE
+def object_digest(compiler, flags, source, mutant_id, scratch):
+    """Digest of the code and data gcc makes of source with mutant_id fixed
+    as the live one. Every function has a section of its own, so the
+    mutated function changes only its own bytes and those of the callers
+    it got inlined into; the dump of the whole object therefore matches
+    exactly when that function compiled to the same machine code."""
+    path = os.path.join(scratch, '%d.o' % mutant_id)
+    subprocess.run(compiler.split() + flags.split() + ['-I', '.', '-DMUTANT_FIXED=%d' % mutant_id,
+                                                       '-c', source, '-o', path], check=True, capture_output=True)
+    dump = subprocess.run(['objdump', '-s', '-r', path], capture_output=True, text=True, check=True).stdout
+    os.remove(path)
+    return digest('\n'.join(line for line in dump.splitlines() if 'file format' not in line))
+
+
+def equivalent(args):
+    mutants = load_manifest(args.directory)
+    builds = sorted({(m.file, 0) for m in mutants} | {(m.file, m.id) for m in mutants})
+    scratch = tempfile.mkdtemp(prefix='equivalent.')
+    try:
+        with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as pool:
+            digests = dict(zip(builds, pool.map(
+                lambda build: object_digest(args.cc, args.flags, os.path.join(args.directory, build[0]), build[1],
+                                            scratch), builds)))
+    finally:
+        shutil.rmtree(scratch, ignore_errors=True)
+
+    # The lowest id of each distinct object stands for the rest.
+    pruned = {}
+    first = {}
+    for mutant in mutants:
+        code = digests[(mutant.file, mutant.id)]
+        if code == digests[(mutant.file, 0)]:
+            pruned[mutant.id] = 'original'
+        elif code in first:
+            pruned[mutant.id] = str(first[code])
+        else:
+            first[code] = mutant.id
+
+    with open(os.path.join(args.directory, EQUIVALENT), 'w') as f:
+        f.write('id\tsame_as\n')
+        for mutant_id, same_as in sorted(pruned.items()):
+            f.write('%d\t%s\n' % (mutant_id, same_as))
+    same = sum(1 for same_as in pruned.values() if same_as == 'original')
+    print('%d of %d mutants pruned: %d compile to the original, %d duplicate another mutant'
+          % (len(pruned), len(mutants), same, len(pruned) - same))
+
+
+def load_equivalent(directory):
+    """{id: 'original' or the id of the mutant with the same code}, empty
+    without an equivalent pass or when mutants.tsv is newer than it."""
+    path = os.path.join(directory, EQUIVALENT)
+    try:
+        if os.path.getmtime(path) < os.path.getmtime(os.path.join(directory, MANIFEST)):
+            print('%s is older than %s; run mutate.py equivalent again' % (path, MANIFEST))
+            return {}
+        with open(path) as f:
+            rows = [line.rstrip('\n').split('\t') for line in f][1:]
+    except FileNotFoundError:
+        return {}
+    return {int(mutant_id): same_as for mutant_id, same_as in rows}
+
+
+#REPORT
+# 'error' is the fork server failing to run a mutant at all (fork or pipe
+# failed, or a bad test list), which says nothing about the tests.
+OUTCOMES = ('killed', 'timeout', 'survived', 'uncovered', 'error')
+
+
+def score_line(label, results):
+    counts = {outcome: 0 for outcome in OUTCOMES}
+    for outcome in results:
+        if outcome not in counts:
+            raise SystemExit('unknown mutant outcome %r; mutate.py and the test binary disagree' % outcome)
+        counts[outcome] += 1
+    detected = counts['killed'] + counts['timeout']
+    scored = len(results) - counts['error']
+    score = 100.0 * detected / scored if scored else 0.0
+    return '%-8s %7d %7d %7d %8d %9d %6d %7.1f%%' % (label, len(results), counts['killed'], counts['timeout'],
+                                                    counts['survived'], counts['uncovered'], counts['error'], score)
+
+
+def write_report(out, mutants, results, seconds, jobs, reused, runnable, pruned):
+    """Mutation score overall and per operator, then every survivor.
+    Uncovered mutants, which no test reaches, count as surviving; pruned
+    ones, and ones whose run failed, count not at all."""
+    same = sum(1 for same_as in pruned.values() if same_as == 'original')
+    out.write('%d mutants, %d jobs, %.0fs\n' % (len(mutants), jobs, seconds))
+    out.write('equivalence: %d pruned, %d compile to the original, %d duplicate another mutant\n'
+              % (len(pruned), same, len(pruned) - same))
+    mutants = [m for m in mutants if m.id not in pruned]
+    outcomes = [results[m.id][0] for m in mutants]
+    out.write('cache: %d of %d runnable mutants reused (%.1f%%)\n\n'
+              % (reused, runnable, 100.0 * reused / runnable if runnable else 0.0))
+    out.write('%-8s %7s %7s %7s %8s %9s %6s %8s\n' % ('operator', 'mutants', 'killed', 'timeout', 'survived',
+                                                     'uncovered', 'error', 'score'))
+    for operator in sorted({m.operator for m in mutants}):
+        out.write(score_line(operator, [results[m.id][0] for m in mutants if m.operator == operator]) + '\n')
+    out.write(score_line('total', outcomes) + '\n')
+
+    survivors = [m for m in mutants if results[m.id][0] in ('survived', 'uncovered')]
+    if survivors:
+        out.write('\nsurvived:\n')
+        for mutant in survivors:
+            out.write('%4d  %s  %s:%d  %s  %s%s\n' % (mutant.id, mutant.operator, mutant.file, mutant.line,
+                                                    mutant.function, mutant.change,
+                                                    ' (no test reaches it)' if results[mutant.id][0] == 'uncovered' else ''))
+
+    failed = [m for m in mutants if results[m.id][0] == 'error']
+    if failed:
+        out.write('\nnot run (the test binary could not run them; run again):\n')
+        for mutant in failed:
+            out.write('%4d  %s  %s:%d  %s  %s\n' % (mutant.id, mutant.operator, mutant.file, mutant.line,
+                                                  mutant.function, mutant.change))
+
+
+def run(args):
+    mutants = load_manifest(args.directory)
+    runner = os.path.abspath(args.runner)
+
+    # With a coverage pass, each mutant gets only the tests that reach its
+    # line, best killers first, and the run stops at the first kill.
+    tests = list_tests(runner)
+    names = dict(tests)
+    indexes = {name: index for index, name in tests}
+    covered = None if args.all_tests else load_coverage(args.directory)
+    history = load_history(args.directory)
+    digests = test_digests(args.tests)
+    cache = {} if args.no_cache else load_cache(args.directory)
+    pruned = load_equivalent(args.directory)
+    keys = {}
+    reused = set()
+
+    # Fork servers (or the baseline check without them) start only once a
+    # mutant misses the cache.
+    lock = threading.Lock()
+    servers = queue.Queue()
+    started_servers = []
+    checked = []
+
+    def run_fresh(mutant, selected):
+        if not args.fork_server:
+            with lock:
+                if not checked and run_once(runner, 0, args.timeout)[0] != 'survived':
+                    raise SystemExit('%s fails without any mutant; fix the tests first' % args.runner)
+                checked.append(True)
+            return run_once(runner, mutant.id, args.timeout, selected)
+        server = None
+        with lock:
+            if servers.empty() and len(started_servers) < args.jobs:
+                server = ForkServer(runner)
+                started_servers.append(server)
+        server = server or servers.get()
+        try:
+            return server.run(mutant.id, selected)
+        finally:
+            servers.put(server)
+
+    def run_mutant(mutant):
+        if mutant.id in pruned:
+            return ('equivalent' if pruned[mutant.id] == 'original' else 'duplicate'), 0.0, -1
+        selected = select_tests(mutant, covered, history, tests)
+        if selected == []:
+            return 'uncovered', 0.0, -1
+        key = keys[mutant.id] = cache_key(mutant, [names[i] for i in (names if selected is None else selected)],
+                                          digests)
+        if key in cache:
+            reused.add(mutant.id)
+            outcome, seconds, test = cache[key]
+            return outcome, seconds, indexes.get(test, -1)
+        return run_fresh(mutant, selected)
+
+    # The runs spend most of their time waiting on sockets and sleeps, so
+    # threads that each wait on one child are enough.
+    results = {}
+    started = time.monotonic()
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        futures = {pool.submit(run_mutant, m): m for m in mutants}
+        for future in concurrent.futures.as_completed(futures):
+            mutant = futures[future]
+            results[mutant.id] = future.result()
+            if args.verbose:
+                print('%4d  %-8s  %s  %s:%d  %s%s' % (mutant.id, results[mutant.id][0], mutant.operator, mutant.file,
+                                                     mutant.line, mutant.change,
+                                                     ' (cached)' if mutant.id in reused else ''), flush=True)
+    seconds = time.monotonic() - started
+    for server in started_servers:
+        server.close()
+
+    with open(os.path.join(args.directory, RESULTS), 'w') as f:
+        f.write('id\toutcome\tseconds\ttest\n')
+        for mutant in mutants:
+            f.write('%d\t%s\t%.3f\t%d\n' % ((mutant.id,) + results[mutant.id]))
+    # Only what this run learned counts toward the history; the cache keeps
+    # the outcome of every mutant that ran, now or before.
+    for mutant in mutants:
+        outcome, _, test = results[mutant.id]
+        if mutant.id not in reused and outcome in ('killed', 'timeout') and test in names:
+            history[names[test]] = history.get(names[test], 0) + 1
+    save_history(args.directory, history)
+    # A failed run is not an outcome worth keeping; the next run retries it.
+    save_cache(args.directory, {keys[m.id]: results[m.id][:2] + (names.get(results[m.id][2], ''),)
+                                for m in mutants if m.id in keys and results[m.id][0] != 'error'})
+
+    runnable = len(keys)
+    with open(args.report, 'w') as f:
+        write_report(f, mutants, results, seconds, args.jobs, len(reused), runnable, pruned)
+    write_report(sys.stdout, mutants, results, seconds, args.jobs, len(reused), runnable, pruned)
+    return 0 if all(results[m.id][0] in ('killed', 'timeout') for m in mutants if m.id not in pruned) else 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Mutant schemata for the library server.')
+    commands = parser.add_subparsers(dest='command', required=True)
+
+    command = commands.add_parser('generate', help='write the schemata sources and mutants.tsv')
+    command.add_argument('-o', '--output', default=DEFAULT_DIR)
+    command.add_argument('--cc', default=os.environ.get('CC', 'gcc'), help='compiler used to check the mutants')
+    command.add_argument('--no-check', dest='check', action='store_false', help='keep mutants that do not compile')
+    command.add_argument('targets', nargs='+', metavar='FILE[:function,...]')
+    command.set_defaults(handler=generate)
+
+    command = commands.add_parser('list', help='print the generated mutants')
+    command.add_argument('-d', '--directory', default=DEFAULT_DIR)
+    command.set_defaults(handler=list_mutants)
+
+    command = commands.add_parser('equivalent', help='find mutants that compile to the same code')
+    command.add_argument('-d', '--directory', default=DEFAULT_DIR)
+    command.add_argument('--cc', default=os.environ.get('CC', 'gcc'))
+    command.add_argument('--flags', default=EQUIVALENCE_FLAGS, help='compiler flags for the comparison builds')
+    command.add_argument('-j', '--jobs', type=int, default=os.cpu_count() or 1, help='builds at once (default: cores)')
+    command.set_defaults(handler=equivalent)
+
+    command = commands.add_parser('coverage', help='map each test to the lines it runs')
+    command.add_argument('-d', '--directory', default=DEFAULT_DIR, help='where coverage.tsv goes')
+    command.add_argument('-r', '--runner', default=DEFAULT_COVERAGE_RUNNER)
+    command.add_argument('--objects', default=DEFAULT_COVERAGE_OBJECTS, help='where the gcov build keeps its data')
+    command.add_argument('-t', '--timeout', type=float, default=DEFAULT_TIMEOUT, help='seconds per test')
+    command.set_defaults(handler=coverage)
+
+    command = commands.add_parser('run', help='run the tests once per mutant')
+    command.add_argument('-d', '--directory', default=DEFAULT_DIR)
+    command.add_argument('-r', '--runner', default=DEFAULT_RUNNER)
+    command.add_argument('-t', '--timeout', type=float, default=DEFAULT_TIMEOUT,
+                         help='seconds per run with --no-fork-server')
+    command.add_argument('--no-fork-server', dest='fork_server', action='store_false',
+                         help='start the test binary afresh for every mutant')
+    command.add_argument('--all-tests', action='store_true', help='ignore the coverage map and run every test')
+    command.add_argument('--no-cache', action='store_true', help='run every mutant, even unchanged ones')
+    command.add_argument('--tests', default=DEFAULT_TESTS, help='test source, for the cache keys')
+    command.add_argument('-j', '--jobs', type=int, default=os.cpu_count() or 1, help='runs at once (default: cores)')
+    command.add_argument('-o', '--report', default=DEFAULT_REPORT)
+    command.add_argument('-v', '--verbose', action='store_true', help='print each mutant as it finishes')
+    command.set_defaults(handler=run)
+
+    args = parser.parse_args()
+    return args.handler(args) or 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,421 @@
+//*******TRACE REPLAY*******
+// Re-issues a trace captured by the server (LIBRARY_CAPTURE=trace.jsonl ./server)
+// and compares the replayed latencies with the captured ones.
+//   ./replay trace.jsonl              original pacing
+//   ./replay -x 10 trace.jsonl        ten times faster
+//   ./replay -x 0 -R 3 trace.jsonl    as fast as possible, fail if p99 tripled
+// Book ids are replayed as captured, so point it at a server holding the same
+// catalog the trace was taken from. Captured latencies are server-side service
+// times while replayed ones include the network and client, so -R wants some
+// headroom (2-3x) rather than 1.1.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "client_pool.h"
+#include "histogram.h"
+
+#define TRACE_LINE_LENGTH 1024
+
+typedef struct
+{
+    long long timestamp_us;
+    long long latency_us;
+    int role;
+    ProtoOp op;
+    int book_id;
+    char title[50];
+    char author[50];
+} TraceRecord;
+
+typedef struct
+{
+    ProtoOp op;
+    long long scheduled;
+} InFlight;
+
+static Histogram captured[OP_COUNT];
+static Histogram replayed[OP_COUNT];
+static long long ok_count[OP_COUNT];
+static long long failed_count[OP_COUNT];
+static long long errors = 0;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_until(long long deadline)
+{
+    long long wait = deadline - now_ns();
+    if (wait <= 0)
+        return;
+    struct timespec pause = {wait / 1000000000LL, wait % 1000000000LL};
+    nanosleep(&pause, NULL);
+}
+
+//TRACE PARSING
+// The capture writer's fixed layout makes a keyed scan enough; no general JSON parser needed.
+static const char *find_value(const char *line, const char *key)
+{
+    char pattern[32];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *found = strstr(line, pattern);
+    return found ? found + strlen(pattern) : NULL;
+}
+
+static int json_number(const char *line, const char *key, long long *value)
+{
+    const char *found = find_value(line, key);
+    return found && sscanf(found, "%lld", value) == 1;
+}
+
+static int json_string(const char *line, const char *key, char *out, size_t length)
+{
+    const char *c = find_value(line, key);
+    size_t used = 0;
+    if (!c || *c != '"')
+        return 0;
+
+    for (c++; *c && *c != '"'; c++)
+    {
+        char ch = *c;
+        if (ch == '\\' && c[1])
+        {
+            c++;
+            if (*c == 'u')
+            {
+                unsigned int code = 0;
+                if (sscanf(c + 1, "%4x", &code) != 1)
+                    return 0;
+                ch = (char)code;
+                c += 4;
+            }
+            else
+            {
+                ch = *c;
+            }
+        }
+        if (used + 1 < length)
+            out[used++] = ch;
+    }
+    out[used] = '\0';
+    return *c == '"';
+}
+
+static int parse_record(const char *line, TraceRecord *record)
+{
+    char op_name[16];
+    long long role, book_id;
+
+    memset(record, 0, sizeof(*record));
+    if (!json_number(line, "ts_us", &record->timestamp_us) || !json_number(line, "role", &role) ||
+        !json_string(line, "op", op_name, sizeof(op_name)) || !json_number(line, "book_id", &book_id))
+        return 0;
+    json_number(line, "latency_us", &record->latency_us);
+    json_string(line, "title", record->title, sizeof(record->title));
+    json_string(line, "author", record->author, sizeof(record->author));
+
+    record->role = (int)role;
+    record->book_id = (int)book_id;
+    for (int op = 0; op < OP_COUNT; op++)
+    {
+        if (strcmp(op_name, proto_op_name((ProtoOp)op)) == 0)
+        {
+            record->op = (ProtoOp)op;
+            return proto_op_allowed(record->op, record->role);
+        }
+    }
+    return 0;
+}
+
+static int by_timestamp(const void *a, const void *b)
+{
+    long long x = ((const TraceRecord *)a)->timestamp_us;
+    long long y = ((const TraceRecord *)b)->timestamp_us;
+    return (x > y) - (x < y);
+}
+
+static TraceRecord *load_trace(const char *path, int *count, int limit)
+{
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    char line[TRACE_LINE_LENGTH];
+    int capacity = 1024;
+    int skipped = 0;
+    TraceRecord *records = malloc((size_t)capacity * sizeof(TraceRecord));
+
+    if (!file)
+    {
+        perror(path);
+        free(records);
+        return NULL;
+    }
+
+    *count = 0;
+    while ((limit <= 0 || *count < limit) && fgets(line, sizeof(line), file))
+    {
+        if (*count == capacity)
+        {
+            capacity *= 2;
+            records = realloc(records, (size_t)capacity * sizeof(TraceRecord));
+        }
+        if (parse_record(line, &records[*count]))
+            (*count)++;
+        else if (line[0] != '\n')
+            skipped++;
+    }
+    if (file != stdin)
+        fclose(file);
+
+    if (skipped)
+        fprintf(stderr, "Skipped %d unreadable trace lines\n", skipped);
+    qsort(records, (size_t)*count, sizeof(TraceRecord), by_timestamp);
+    return records;
+}
+
+//REPLAY
+static void completed(int status, const char *reply, void *arg)
+{
+    InFlight *request = arg;
+    long long latency = now_ns() - request->scheduled;
+
+    pthread_mutex_lock(&stats_mutex);
+    if (status < 0)
+    {
+        errors++;
+    }
+    else
+    {
+        histogram_record(&replayed[request->op], latency);
+        if (proto_reply_failed(reply))
+            failed_count[request->op]++;
+        else
+            ok_count[request->op]++;
+    }
+    pthread_mutex_unlock(&stats_mutex);
+    free(request);
+}
+
+static ClientPool *open_pool(int role, const char *login, const char *host, int port, const char *unix_path, int connections)
+{
+    char copy[128];
+    PoolConfig config;
+
+    snprintf(copy, sizeof(copy), "%s", login);
+    char *password = strchr(copy, ':');
+    char *member = password ? strchr(password + 1, ':') : NULL;
+    if (password)
+        *password++ = '\0';
+    if (member)
+        *member++ = '\0';
+    if (!password || (role == ROLE_USER && !member))
+        return NULL;
+
+    memset(&config, 0, sizeof(config));
+    config.host = host;
+    config.port = port;
+    config.unix_path = unix_path;
+    config.connections = connections;
+    config.role = role;
+    config.username = copy;
+    config.password = password;
+    config.member_id = member ? atoi(member) : 0;
+    // Bounded so that "as fast as possible" applies backpressure instead of queueing the whole trace.
+    config.max_queue = connections * 4;
+    return pool_create(&config);
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options] trace.jsonl|-\n"
+            "  -h host        server address (127.0.0.1)\n"
+            "  -p port        server port (%d)\n"
+            "  -U path        use the server's Unix socket instead of TCP\n"
+            "  -x speed       pacing multiplier; 1 = as captured, 0 = as fast as possible (1)\n"
+            "  -c n           pooled connections per role (4)\n"
+            "  -a name:pass   admin login (admin:admin)\n"
+            "  -u name:pass:member  user login (user:user:1)\n"
+            "  -n count       replay only the first count records\n"
+            "  -R ratio       exit 1 if replayed p99 exceeds ratio x captured p99\n"
+            "  -H file        write the replayed latency distribution (HdrHistogram format)\n",
+            program, PORT);
+}
+
+static void print_row(const char *name, const Histogram *before, const Histogram *after, long long ok, long long failed)
+{
+    printf("%-8s %9lld %9lld %12.1f %12.1f %12.1f %12.1f %12.1f\n", name, ok, failed,
+           histogram_percentile(before, 50.0) / 1000.0, histogram_percentile(before, 99.0) / 1000.0,
+           histogram_percentile(after, 50.0) / 1000.0, histogram_percentile(after, 99.0) / 1000.0,
+           histogram_percentile(after, 99.9) / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *host = "127.0.0.1";
+    const char *unix_path = NULL;
+    const char *admin = "admin:admin";
+    const char *user = "user:user:1";
+    const char *histogram_file = NULL;
+    int port = PORT;
+    int connections = 4;
+    int limit = 0;
+    double speed = 1.0;
+    double regression_ratio = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "h:p:U:x:c:a:u:n:R:H:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'h': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'U': unix_path = optarg; break;
+        case 'x': speed = atof(optarg); break;
+        case 'c': connections = atoi(optarg); break;
+        case 'a': admin = optarg; break;
+        case 'u': user = optarg; break;
+        case 'n': limit = atoi(optarg); break;
+        case 'R': regression_ratio = atof(optarg); break;
+        case 'H': histogram_file = optarg; break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc - 1 || connections < 1 || speed < 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int count = 0;
+    TraceRecord *records = load_trace(argv[optind], &count, limit);
+    if (!records)
+        return 1;
+    if (count == 0)
+    {
+        fprintf(stderr, "Trace has no requests\n");
+        free(records);
+        return 1;
+    }
+
+    int needs_role[3] = {0, 0, 0};
+    for (int op = 0; op < OP_COUNT; op++)
+    {
+        histogram_init(&captured[op]);
+        histogram_init(&replayed[op]);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        histogram_record(&captured[records[i].op], records[i].latency_us * 1000);
+        needs_role[records[i].role] = 1;
+    }
+
+    ClientPool *pools[3] = {NULL, NULL, NULL};
+    for (int role = ROLE_USER; role <= ROLE_ADMIN; role++)
+    {
+        if (!needs_role[role])
+            continue;
+        pools[role] = open_pool(role, role == ROLE_ADMIN ? admin : user, host, port, unix_path, connections);
+        if (!pools[role])
+        {
+            fprintf(stderr, "Could not log in the %s connections\n", role == ROLE_ADMIN ? "admin" : "user");
+            return 1;
+        }
+    }
+
+    long long started = now_ns();
+    long long max_lag = 0;
+    for (int i = 0; i < count; i++)
+    {
+        TraceRecord *r = &records[i];
+        InFlight *request = malloc(sizeof(InFlight));
+        request->op = r->op;
+
+        if (speed > 0)
+        {
+            // Latency counts from the scheduled time, so a server that falls
+            // behind the captured pacing shows up as latency, not as a slower replay.
+            request->scheduled = started + (long long)((r->timestamp_us - records[0].timestamp_us) * 1000.0 / speed);
+            sleep_until(request->scheduled);
+            long long lag = now_ns() - request->scheduled;
+            if (lag > max_lag)
+                max_lag = lag;
+        }
+
+        while (1)
+        {
+            if (speed == 0)
+                request->scheduled = now_ns();
+            if (pool_submit(pools[r->role], r->op, r->book_id, r->title, r->author, completed, request) == 0)
+                break;
+            // Pool queue full: wait for a connection to free up.
+            struct timespec pause = {0, 100000};
+            nanosleep(&pause, NULL);
+        }
+    }
+
+    for (int role = ROLE_USER; role <= ROLE_ADMIN; role++)
+        pool_destroy(pools[role]);
+    double elapsed = (now_ns() - started) / 1e9;
+    double captured_span = (records[count - 1].timestamp_us - records[0].timestamp_us) / 1e6;
+
+    Histogram *all_before = malloc(sizeof(Histogram));
+    Histogram *all_after = malloc(sizeof(Histogram));
+    long long total_ok = 0, total_failed = 0;
+    histogram_init(all_before);
+    histogram_init(all_after);
+
+    printf("requests=%d captured_span=%.2fs replay_time=%.2fs speed=%s%.1f max_lag_us=%.1f\n",
+           count, captured_span, elapsed, speed > 0 ? "x" : "max ", speed, max_lag / 1000.0);
+    printf("%-8s %9s %9s %12s %12s %12s %12s %12s\n", "op", "ok", "failed",
+           "cap_p50_us", "cap_p99_us", "p50_us", "p99_us", "p999_us");
+    for (int op = 0; op < OP_COUNT; op++)
+    {
+        if (!captured[op].total)
+            continue;
+        print_row(proto_op_name((ProtoOp)op), &captured[op], &replayed[op], ok_count[op], failed_count[op]);
+        histogram_merge(all_before, &captured[op]);
+        histogram_merge(all_after, &replayed[op]);
+        total_ok += ok_count[op];
+        total_failed += failed_count[op];
+    }
+    print_row("all", all_before, all_after, total_ok, total_failed);
+    printf("throughput=%.1f ops/s errors=%lld\n", all_after->total / elapsed, errors);
+
+    if (histogram_file)
+    {
+        FILE *out = fopen(histogram_file, "w");
+        if (out)
+        {
+            histogram_write_distribution(all_after, out, 1000.0);
+            fclose(out);
+        }
+        else
+        {
+            perror(histogram_file);
+        }
+    }
+
+    int status = errors ? 1 : 0;
+    if (regression_ratio > 0 &&
+        histogram_percentile(all_after, 99.0) > regression_ratio * histogram_percentile(all_before, 99.0))
+    {
+        printf("REGRESSION: replayed p99 %.1fus > %.2f x captured p99 %.1fus\n",
+               histogram_percentile(all_after, 99.0) / 1000.0, regression_ratio,
+               histogram_percentile(all_before, 99.0) / 1000.0);
+        status = 1;
+    }
+
+    free(records);
+    free(all_before);
+    free(all_after);
+    return status;
+}
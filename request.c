@@ -0,0 +1,96 @@
+//*******REQUEST CONTEXT*******
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "request.h"
+#include "capture.h"
+#include "metrics.h"
+#include "slowlog.h"
+#include "trace.h"
+
+static __thread RequestContext current;
+static __thread int current_active = 0;
+
+static const char *op_names[REQUEST_OP_COUNT] = {"rent", "return", "search", "add", "delete", "modify"};
+
+int request_op_index(int role, int choice)
+{
+    static const int user_ops[] = {-1, REQUEST_RENT, REQUEST_RETURN, REQUEST_SEARCH};
+    static const int admin_ops[] = {-1, REQUEST_ADD, REQUEST_DELETE, REQUEST_MODIFY, REQUEST_SEARCH};
+
+    if (role == 1 && choice >= 1 && choice <= 3)
+        return user_ops[choice];
+    if (role == 2 && choice >= 1 && choice <= 4)
+        return admin_ops[choice];
+    return -1;
+}
+
+const char *request_op_name(RequestOp op)
+{
+    return op >= 0 && op < REQUEST_OP_COUNT ? op_names[op] : "unknown";
+}
+
+void request_begin(int session, int role, int choice)
+{
+    int op = request_op_index(role, choice);
+    current_active = op >= 0;
+    if (!current_active)
+        return;
+
+    struct timespec wall, now;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    memset(&current, 0, sizeof(current));
+    current.timestamp_us = (long long)wall.tv_sec * 1000000LL + wall.tv_nsec / 1000;
+    current.started_ns = (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+    current.session = session;
+    current.role = role;
+    current.choice = choice;
+    current.op = (RequestOp)op;
+    trace_request_begin(&current);
+}
+
+void request_member(int member_id)
+{
+    if (current_active)
+        current.member_id = member_id;
+}
+
+void request_args(int book_id, const char *title, const char *author)
+{
+    if (!current_active)
+        return;
+
+    current.book_id = book_id;
+    if (title)
+        snprintf(current.title, sizeof(current.title), "%.49s", title);
+    if (author)
+        snprintf(current.author, sizeof(current.author), "%.49s", author);
+}
+
+void request_reply(const char *reply)
+{
+    if (!current_active)
+        return;
+
+    current.failed = strstr(reply, "not found") != NULL || strstr(reply, "Invalid") != NULL ||
+                     strstr(reply, "Failed") != NULL || strstr(reply, "failed") != NULL;
+}
+
+void request_end(void)
+{
+    if (!current_active)
+        return;
+    current_active = 0;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    current.latency_ns = (long long)now.tv_sec * 1000000000LL + now.tv_nsec - current.started_ns;
+
+    capture_record(&current);
+    metrics_record(&current);
+    slowlog_record(&current, trace_phase_totals());
+    trace_request_end(&current);
+}
@@ -0,0 +1,50 @@
+//*******REQUEST CONTEXT*******
+#ifndef REQUEST_H
+#define REQUEST_H
+
+#define REQUEST_TEXT_LENGTH 50
+
+// Catalog operations, independent of each role's menu numbering.
+typedef enum
+{
+    REQUEST_RENT,
+    REQUEST_RETURN,
+    REQUEST_SEARCH,
+    REQUEST_ADD,
+    REQUEST_DELETE,
+    REQUEST_MODIFY,
+    REQUEST_OP_COUNT
+} RequestOp;
+
+// What the connection thread knows about the request it is serving.
+typedef struct
+{
+    long long timestamp_us; // wall clock at the start
+    long long started_ns;   // monotonic clock at the start
+    long long latency_ns;   // filled in by request_end
+    int session;
+    int member_id; // 0 for admin sessions
+    int role;
+    int choice;
+    RequestOp op;
+    int book_id;
+    int failed;
+    char title[REQUEST_TEXT_LENGTH];
+    char author[REQUEST_TEXT_LENGTH];
+} RequestContext;
+
+// Hooks around each menu request on a connection thread. The context is
+// thread-local; request_end hands it to the capture, metrics, slow-op log
+// and trace sinks.
+// Exits and invalid choices are not requests and are ignored.
+void request_begin(int session, int role, int choice);
+void request_member(int member_id);
+void request_args(int book_id, const char *title, const char *author);
+void request_reply(const char *reply);
+void request_end(void);
+
+// -1 for exits and invalid choices.
+int request_op_index(int role, int choice);
+const char *request_op_name(RequestOp op);
+
+#endif
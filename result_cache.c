@@ -0,0 +1,294 @@
+//*******SEARCH RESULT CACHE*******
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include "result_cache.h"
+
+// Entries live in one array per shard and link to each other by index: a
+// hash chain through next, the LRU list through newer and older, and the
+// free list through next again.
+typedef struct
+{
+    int book_id;
+    int length;
+    int next;
+    int newer;
+    int older;
+    char reply[RESULT_CACHE_REPLY_SIZE];
+} ResultEntry;
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    ResultEntry *entries;
+    int *buckets; // first entry of each chain, -1 when empty
+    int bucket_mask;
+    int capacity;
+    int count;
+    int free_list;
+    int newest;
+    int oldest;
+    unsigned long long generation; // bumped by every invalidation
+    long long hits;
+    long long misses;
+    long long invalidations;
+    long long evictions;
+} ResultShard;
+
+static ResultShard *shards = NULL;
+static long long table_bytes = 0;
+// Calls that may be using the table; stop frees it only once this is 0.
+static int users = 0;
+
+static unsigned int hash_id(int book_id)
+{
+    return (unsigned int)book_id * 2654435761u;
+}
+
+// NULL while the cache is off. Otherwise the table stays allocated until
+// the matching release_table. Counting the user before looking at shards
+// (both sequentially consistent) means stop either sees the count or the
+// caller sees NULL.
+static ResultShard *acquire_table(void)
+{
+    __atomic_add_fetch(&users, 1, __ATOMIC_SEQ_CST);
+    ResultShard *table = __atomic_load_n(&shards, __ATOMIC_SEQ_CST);
+    if (!table)
+        __atomic_sub_fetch(&users, 1, __ATOMIC_RELEASE);
+    return table;
+}
+
+static void release_table(void)
+{
+    __atomic_sub_fetch(&users, 1, __ATOMIC_RELEASE);
+}
+
+static ResultShard *shard_of(ResultShard *table, unsigned int hash)
+{
+    return &table[(hash >> 24) % RESULT_CACHE_SHARDS];
+}
+
+int result_cache_start(int entries)
+{
+    if (entries <= 0 || shards)
+        return 0;
+
+    int capacity = (entries + RESULT_CACHE_SHARDS - 1) / RESULT_CACHE_SHARDS;
+    int buckets = 1;
+    while (buckets < capacity)
+        buckets *= 2;
+
+    ResultShard *table = calloc(RESULT_CACHE_SHARDS, sizeof(ResultShard));
+    if (!table)
+        return -1;
+    for (int s = 0; s < RESULT_CACHE_SHARDS; s++)
+    {
+        ResultShard *shard = &table[s];
+        shard->entries = malloc((size_t)capacity * sizeof(ResultEntry));
+        shard->buckets = malloc((size_t)buckets * sizeof(int));
+        if (!shard->entries || !shard->buckets)
+        {
+            for (int t = 0; t <= s; t++)
+            {
+                free(table[t].entries);
+                free(table[t].buckets);
+            }
+            free(table);
+            return -1;
+        }
+        pthread_mutex_init(&shard->mutex, NULL);
+        memset(shard->buckets, 0xff, (size_t)buckets * sizeof(int));
+        shard->bucket_mask = buckets - 1;
+        shard->capacity = capacity;
+        for (int i = 0; i < capacity; i++)
+            shard->entries[i].next = i + 1 < capacity ? i + 1 : -1;
+        shard->free_list = 0;
+        shard->newest = shard->oldest = -1;
+    }
+    table_bytes = (long long)RESULT_CACHE_SHARDS *
+                  ((long long)sizeof(ResultShard) + (long long)capacity * (long long)sizeof(ResultEntry) +
+                   (long long)buckets * (long long)sizeof(int));
+    __atomic_store_n(&shards, table, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Sessions may still be inside a lookup; new calls see the cache off at
+// once, and the table goes when the last call in it has left.
+void result_cache_stop(void)
+{
+    ResultShard *table = __atomic_exchange_n(&shards, NULL, __ATOMIC_SEQ_CST);
+    if (!table)
+        return;
+    while (__atomic_load_n(&users, __ATOMIC_SEQ_CST) > 0)
+        sched_yield();
+    for (int s = 0; s < RESULT_CACHE_SHARDS; s++)
+    {
+        pthread_mutex_destroy(&table[s].mutex);
+        free(table[s].entries);
+        free(table[s].buckets);
+    }
+    free(table);
+    table_bytes = 0;
+}
+
+//ENTRIES
+// The rest of this section runs with the shard's mutex held.
+static int find_entry(ResultShard *shard, int book_id, unsigned int hash)
+{
+    for (int i = shard->buckets[hash & shard->bucket_mask]; i >= 0; i = shard->entries[i].next)
+    {
+        if (shard->entries[i].book_id == book_id)
+            return i;
+    }
+    return -1;
+}
+
+static void lru_unlink(ResultShard *shard, int i)
+{
+    ResultEntry *entry = &shard->entries[i];
+    if (entry->newer >= 0)
+        shard->entries[entry->newer].older = entry->older;
+    else
+        shard->newest = entry->older;
+    if (entry->older >= 0)
+        shard->entries[entry->older].newer = entry->newer;
+    else
+        shard->oldest = entry->newer;
+}
+
+static void lru_push(ResultShard *shard, int i)
+{
+    ResultEntry *entry = &shard->entries[i];
+    entry->newer = -1;
+    entry->older = shard->newest;
+    if (shard->newest >= 0)
+        shard->entries[shard->newest].newer = i;
+    shard->newest = i;
+    if (shard->oldest < 0)
+        shard->oldest = i;
+}
+
+static void remove_entry(ResultShard *shard, int i)
+{
+    int *link = &shard->buckets[hash_id(shard->entries[i].book_id) & shard->bucket_mask];
+    while (*link != i)
+        link = &shard->entries[*link].next;
+    *link = shard->entries[i].next;
+    lru_unlink(shard, i);
+    shard->entries[i].next = shard->free_list;
+    shard->free_list = i;
+    shard->count--;
+}
+
+//LOOKUPS
+int result_cache_get(int book_id, char *reply, size_t size, unsigned long long *ticket)
+{
+    unsigned int hash = hash_id(book_id);
+    ResultShard *table = acquire_table();
+    if (!table)
+        return -1;
+
+    ResultShard *shard = shard_of(table, hash);
+    int length = -1;
+    pthread_mutex_lock(&shard->mutex);
+    int i = find_entry(shard, book_id, hash);
+    if (i >= 0 && (size_t)shard->entries[i].length < size)
+    {
+        lru_unlink(shard, i);
+        lru_push(shard, i);
+        length = shard->entries[i].length;
+        memcpy(reply, shard->entries[i].reply, (size_t)length + 1);
+        shard->hits++;
+    }
+    else
+    {
+        *ticket = shard->generation;
+        shard->misses++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    release_table();
+    return length;
+}
+
+void result_cache_put(int book_id, const char *reply, unsigned long long ticket)
+{
+    unsigned int hash = hash_id(book_id);
+    size_t length = strlen(reply);
+    if (length >= RESULT_CACHE_REPLY_SIZE)
+        return;
+    ResultShard *table = acquire_table();
+    if (!table)
+        return;
+
+    ResultShard *shard = shard_of(table, hash);
+    pthread_mutex_lock(&shard->mutex);
+    if (ticket == shard->generation)
+    {
+        int i = find_entry(shard, book_id, hash);
+        if (i >= 0)
+            lru_unlink(shard, i);
+        else
+        {
+            if (shard->free_list < 0)
+            {
+                remove_entry(shard, shard->oldest);
+                shard->evictions++;
+            }
+            i = shard->free_list;
+            shard->free_list = shard->entries[i].next;
+            shard->entries[i].book_id = book_id;
+            shard->entries[i].next = shard->buckets[hash & shard->bucket_mask];
+            shard->buckets[hash & shard->bucket_mask] = i;
+            shard->count++;
+        }
+        lru_push(shard, i);
+        shard->entries[i].length = (int)length;
+        memcpy(shard->entries[i].reply, reply, length + 1);
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    release_table();
+}
+
+void result_cache_invalidate(int book_id)
+{
+    unsigned int hash = hash_id(book_id);
+    ResultShard *table = acquire_table();
+    if (!table)
+        return;
+
+    ResultShard *shard = shard_of(table, hash);
+    pthread_mutex_lock(&shard->mutex);
+    shard->generation++;
+    int i = find_entry(shard, book_id, hash);
+    if (i >= 0)
+    {
+        remove_entry(shard, i);
+        shard->invalidations++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    release_table();
+}
+
+//STATISTICS
+void result_cache_stats(ResultCacheStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    ResultShard *table = acquire_table();
+    if (!table)
+        return;
+    for (int s = 0; s < RESULT_CACHE_SHARDS; s++)
+    {
+        pthread_mutex_lock(&table[s].mutex);
+        stats->hits += table[s].hits;
+        stats->misses += table[s].misses;
+        stats->invalidations += table[s].invalidations;
+        stats->evictions += table[s].evictions;
+        stats->entries += table[s].count;
+        stats->capacity += table[s].capacity;
+        pthread_mutex_unlock(&table[s].mutex);
+    }
+    stats->bytes = table_bytes;
+    release_table();
+}
@@ -0,0 +1,47 @@
+//*******SEARCH RESULT CACHE*******
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <stddef.h>
+
+#define RESULT_CACHE_ENV "LIBRARY_RESULT_CACHE" // search replies kept in memory (default 4096, 0 = off)
+#define RESULT_CACHE_DEFAULT_ENTRIES 4096
+#define RESULT_CACHE_SHARDS 16      // each with its own lock and LRU list
+#define RESULT_CACHE_REPLY_SIZE 160 // longest search reply, terminator included
+
+// Encoded search replies by book ID, so repeated lookups of popular books
+// never reach the catalog. The server drops a book's entry after every
+// rent, return, modify or delete of it. Edits made by another process on
+// the same catalog file are not seen; run such a server with the cache off.
+typedef struct
+{
+    long long hits;
+    long long misses;
+    long long invalidations; // entries dropped by an edit of their book
+    long long evictions;     // least recently used entries pushed out by new ones
+    long long entries;
+    long long capacity;
+    long long bytes; // allocated for the table, in use or not
+} ResultCacheStats;
+
+// entries is rounded up to a multiple of the shard count; 0 leaves the
+// cache off. Returns 0, or -1 when the table cannot be allocated.
+int result_cache_start(int entries);
+// Safe while sessions are still searching: they see the cache off from
+// here on, and stop waits for any call already inside to finish.
+void result_cache_stop(void);
+
+// Copies book_id's reply into reply and returns its length, or -1 on a
+// miss (always, while the cache is off). A miss sets *ticket, which the
+// reply read from the catalog afterwards is stored under.
+int result_cache_get(int book_id, char *reply, size_t size, unsigned long long *ticket);
+// Dropped when an edit in the book's shard came after the ticket, so a
+// reply read before an edit never outlives it.
+void result_cache_put(int book_id, const char *reply, unsigned long long ticket);
+// Call once the edit is written and before its reply is sent.
+void result_cache_invalidate(int book_id);
+
+// Zeros while the cache is off.
+void result_cache_stats(ResultCacheStats *stats);
+
+#endif
@@ -1,4 +1,5 @@
 //*******SERVER CODE*******
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,22 +8,36 @@
 #include <pthread.h>
 #include <fcntl.h>
 #include <sys/file.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
+#include "credentials.h"
+#include "transport.h"
+#include "capture.h"
+#include "request.h"
+#include "metrics.h"
+#include "trace.h"
+#include "slowlog.h"
+#include "idle.h"
+#include "admission.h"
+#include "result_cache.h"
+#include "lease.h"
+#include "catalog.h"
+#include "storage.h"
+#include "config.h"
+#include <errno.h>
+#include <sys/stat.h>
 
-#define PORT 8080
 #define MAX_CLIENTS 10
 #define BUFFER_SIZE 1024
 #define MAX_USERNAME_LENGTH 50
 #define MAX_PASSWORD_LENGTH 50
+#define CATALOG_FAILED_REPLY "Catalog operation failed"
 
 pthread_mutex_t file_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-typedef struct
-{
-    int id;
-    char title[50];
-    char author[50];
-    int is_rented;
-} Book;
+static int next_session = 0; // numbers connections in captured traces
+static __thread LeaseHolder *session_leases = NULL; // set once the session asks for leases
+static __thread IdleEntry *session_idle = NULL; // the session's place on the idle wheel
 
 typedef struct
 {
@@ -43,109 +58,240 @@ typedef struct
 } admin_credentials;
 
 void *handle_client(void *client_socket);
-void register_member(int client_socket, int id, int rent_id);
-void rent_book(int client_socket);
+int authenticate(int client_socket, int *member_id);
+int register_member(int client_socket, int id, int rent_id);
+void rent_book(int client_socket, int member_id);
 void return_book(int client_socket);
 void add_book(int client_socket);
 void delete_book(int client_socket);
 void modify_book(int client_socket);
 void search_book(int client_socket);
-void number_of_rented_books(/*int client_socket,*/ int ptr, int member_id);
+void send_metrics(int client_socket);
+void start_leases(int client_socket);
+static int attach_unix_client(int sock);
 
 // Function to authenticate
-int authenticate(int client_socket)
+// Returns the authenticated role (1 = user, 2 = admin), or 0 when the login failed.
+int authenticate(int client_socket, int *member_id)
 {
     char buffer[1024];
+    char reply[BUFFER_SIZE];
+    char token[SESSION_TOKEN_LENGTH + 1];
     int role;
 
-    recv(client_socket, &role, sizeof(int), 0);
+    if (conn_recv(client_socket, &role, sizeof(int), MSG_WAITALL) <= 0)
+        return 0;
 
-    if (role == 1)
+    if (role == ROLE_USER)
     {
-        // user_credentials user;
-        user_credentials valid_user = {"user", "user"};
-
-        if (recv(client_socket, buffer, sizeof(buffer), 0) <= 0)
+        if (conn_recv(client_socket, buffer, sizeof(buffer), MSG_WAITALL) <= 0)
         {
             perror("Error receiving user credentials from client");
             return 0;
         }
+        buffer[sizeof(buffer) - 1] = '\0';
 
-        char username[50];
-        char password[50];
+        char username[50] = "";
+        char password[PASSWORD_MAX_LENGTH + 2] = ""; // one byte over, so a longer password is refused
         int rent_id;
-        int member_id;
-        sscanf(buffer, "%s %s %d", username, password, &member_id);
-
-        Member new_entry;
-        new_entry.id = member_id;
+        int id = 0;
+        sscanf(buffer, "%49s %129s %d", username, password, &id);
 
-        if (strcmp(username, valid_user.username) == 0 && strcmp(password, valid_user.password) == 0)
+        if (credentials_check(ROLE_USER, username, password) && session_issue(ROLE_USER, id, token))
         {
             printf("Logged in Succesfully!\n");
-            send(client_socket, "Logged in Succesfully", strlen("Logged in Succesfully"), 0); // send-1
+            sprintf(reply, "Logged in Succesfully. Session token: %s", token);
+            conn_send(client_socket, reply, strlen(reply), 0); // send-1
 
-            recv(client_socket, &rent_id, sizeof(rent_id), 0);
+            conn_recv(client_socket, &rent_id, sizeof(rent_id), MSG_WAITALL);
 
-            register_member(client_socket, member_id, rent_id);
+            if (!register_member(client_socket, id, rent_id))
+            {
+                session_revoke(token);
+                return 0;
+            }
 
-            return 1;
+            *member_id = id;
+            return ROLE_USER;
         }
         else
         {
             printf("Authentication failed for user: %s\n", username);
-            send(client_socket, "Authentication failed!", strlen("Authentication failed!"), 0);
+            conn_send(client_socket, "Authentication failed!", strlen("Authentication failed!"), 0);
             return 0;
         }
     }
-    else if (role == 2)
+    else if (role == ROLE_ADMIN)
     {
-        // admin_credentials valid_user = {"admin", "admin"};
-
-        if (recv(client_socket, buffer, sizeof(buffer), 0) <= 0)
+        if (conn_recv(client_socket, buffer, sizeof(buffer), MSG_WAITALL) <= 0)
         {
             perror("Error receiving user credentials from client");
             return 0;
         }
-        char username[50];
-        char password[50];
-        sscanf(buffer, "%s %s", username, password);
+        buffer[sizeof(buffer) - 1] = '\0';
+
+        char username[50] = "";
+        char password[PASSWORD_MAX_LENGTH + 2] = "";
+        sscanf(buffer, "%49s %129s", username, password);
 
-        if (strcmp(username, "admin") == 0 && strcmp(password, "admin") == 0)
+        if (credentials_check(ROLE_ADMIN, username, password) && session_issue(ROLE_ADMIN, 0, token))
         {
             printf("Logged in Succesfully!\n");
-            send(client_socket, "Logged in Succesfully", strlen("Logged in Succesfully"), 0); // send-1
-            return 1;
+            sprintf(reply, "Logged in Succesfully. Session token: %s", token);
+            conn_send(client_socket, reply, strlen(reply), 0); // send-1
+            *member_id = 0;
+            return ROLE_ADMIN;
         }
         else
         {
             printf("Authentication failed for user: %s\n", username);
-            send(client_socket, "Authentication failed!", strlen("Authentication failed!"), 0);
+            conn_send(client_socket, "Authentication failed!", strlen("Authentication failed!"), 0);
+            return 0;
+        }
+    }
+    else if (role == ROLE_RESUME)
+    {
+        // Reconnecting client: a token check replaces the full login.
+        if (conn_recv(client_socket, buffer, sizeof(buffer), MSG_WAITALL) <= 0)
+        {
+            perror("Error receiving session token from client");
             return 0;
         }
+        buffer[sizeof(buffer) - 1] = '\0';
+
+        int resumed_role;
+        token[0] = '\0';
+        sscanf(buffer, "%32s", token);
+
+        if (session_resume(token, &resumed_role, member_id))
+        {
+            sprintf(reply, "Session resumed: role %d member %d", resumed_role, *member_id);
+            conn_send(client_socket, reply, strlen(reply), 0);
+            return resumed_role;
+        }
+
+        printf("Session resume failed\n");
+        conn_send(client_socket, "Authentication failed!", strlen("Authentication failed!"), 0);
+        return 0;
     }
     return 0;
 }
 
-void *handle_client(void *client_socket)
+// Reads one int of the request header; 0 when the client hung up, the read
+// failed or the idle reaper shut the connection down.
+static int read_header_int(int sock, int *value)
+{
+    return conn_recv(sock, value, sizeof(*value), MSG_WAITALL) == (ssize_t)sizeof(*value);
+}
+
+// A refused request still has its payload on the wire; read it the way the
+// handler would have, so the next request starts at the right byte.
+static void drain_payload(int sock, int role, int choice)
+{
+    char buffer[BUFFER_SIZE];
+    Book book;
+    int book_id;
+
+    if (role == 1 && choice == 1)
+    {
+        conn_read(sock, &book_id, sizeof(book_id));
+    }
+    else if (role == 2 && choice == 1)
+    {
+        conn_read(sock, book.title, sizeof(book.title));
+        conn_read(sock, book.author, sizeof(book.author));
+    }
+    else if (role == 2 && choice == 3)
+    {
+        conn_read(sock, &book_id, sizeof(book_id));
+        conn_read(sock, buffer, BUFFER_SIZE);
+    }
+    else
+    {
+        conn_read(sock, buffer, BUFFER_SIZE);
+    }
+}
+
+// Every write after login goes through here: on a session with leases it
+// becomes a reply frame, kept apart from the invalidations other sessions'
+// edits send on the same connection.
+static ssize_t session_write(int sock, const void *buffer, size_t length)
+{
+    if (session_leases)
+        return lease_write(session_leases, buffer, length);
+    return conn_write(sock, buffer, length);
+}
+
+// Applies the session's rate limit and the in-flight request bound to
+// catalog requests. Returns 1 when the request may run (the caller then
+// calls admission_request_end), 0 when it was refused with a busy reply.
+static int admit_request(int sock, int role, int choice, RateBucket *bucket)
+{
+    const char *reply = NULL;
+    if (request_op_index(role, choice) < 0)
+        return 1;
+
+    if (!admission_bucket_take(bucket))
+        reply = SERVER_BUSY_REPLY ": rate limit exceeded";
+    else if (!admission_request_begin())
+        reply = SERVER_BUSY_REPLY ", try again later";
+    if (!reply)
+        return 1;
+
+    drain_payload(sock, role, choice);
+    session_write(sock, reply, strlen(reply));
+    return 0;
+}
+
+// Serves one session until it ends; run_session owns and closes the socket.
+static void serve_client(int sock, IdleEntry *idle)
 {
-    int sock = *(int *)client_socket;
     // char buffer[BUFFER_SIZE];
     int role;
     int choice;
+    int member_id = 0;
+    RateBucket bucket;
+
+    // Authenticate on the client's own thread so a slow login never stalls accept().
+    int session_role = authenticate(sock, &member_id);
+    if (!session_role)
+    {
+        metrics_auth_failed();
+        return;
+    }
+    int session = __atomic_add_fetch(&next_session, 1, __ATOMIC_RELAXED);
+    admission_bucket_init(&bucket);
+
     while (1)
     {
-        read(sock, &role, sizeof(role));
+        idle_done(idle);
+        if (!read_header_int(sock, &role))
+            return;
+
+        if (role != session_role && (role == 1 || role == 2))
+        {
+            // A user session must not reach the admin menu (and vice versa).
+            session_write(sock, "Permission denied", strlen("Permission denied"));
+            return;
+        }
 
         if (role == 1)
         {
             // User menu
-            read(sock, &choice, sizeof(choice));
+            if (!read_header_int(sock, &choice))
+                return;
+            if (!admit_request(sock, role, choice, &bucket))
+                continue;
+            // Catalog requests go busy in payload_read, once their payload is in.
+            if (request_op_index(role, choice) < 0)
+                idle_busy(idle);
+            request_begin(session, role, choice);
+            request_member(member_id);
 
             switch (choice)
             {
             case 1:
-                rent_book(sock);
+                rent_book(sock, member_id);
                 break;
             case 2:
                 return_book(sock);
@@ -155,18 +301,30 @@ void *handle_client(void *client_socket)
                 break;
 
             case 4:
-                write(sock, "Exiting", strlen("Exiting"));
-                close(sock);
-                free(client_socket);
+                session_write(sock, "Exiting", strlen("Exiting"));
+                return;
+            case 5:
+                start_leases(sock);
+                break;
             default:
-                write(sock, "Invalid Choice", strlen("Invalid Choice"));
+                session_write(sock, "Invalid Choice", strlen("Invalid Choice"));
                 break;
             }
+            request_end();
+            if (request_op_index(role, choice) >= 0)
+                admission_request_end();
         }
         else if (role == 2)
         {
             // Admin menu
-            read(sock, &choice, sizeof(choice));
+            if (!read_header_int(sock, &choice))
+                return;
+            if (!admit_request(sock, role, choice, &bucket))
+                continue;
+            // Catalog requests go busy in payload_read, once their payload is in.
+            if (request_op_index(role, choice) < 0)
+                idle_busy(idle);
+            request_begin(session, role, choice);
 
             switch (choice)
             {
@@ -183,918 +341,616 @@ void *handle_client(void *client_socket)
                 search_book(sock);
                 break;
             case 5:
-                write(sock, "Exiting", strlen("Exiting"));
-                close(sock);
-                free(client_socket);
-                return NULL;
+                session_write(sock, "Exiting", strlen("Exiting"));
+                return;
+            case 6:
+                send_metrics(sock);
+                break;
+            case 7:
+                start_leases(sock);
+                break;
             default:
-                write(sock, "Invalid Choice", strlen("Invalid Choice"));
+                session_write(sock, "Invalid Choice", strlen("Invalid Choice"));
                 break;
             }
+            request_end();
+            if (request_op_index(role, choice) >= 0)
+                admission_request_end();
         }
         else
         {
-            write(sock, "Invalid login option", strlen("Invalid login option"));
+            session_write(sock, "Invalid login option", strlen("Invalid login option"));
         }
     }
 }
 
-int get_next_id(const char *filename)
+static void run_session(int sock, int from_unix)
 {
-    FILE *file = fopen(filename, "r");
-    if (!file)
-        return 1;
-
-    int id = 0;
-    char buffer[BUFFER_SIZE];
-
-    while (fgets(buffer, BUFFER_SIZE, file))
-    {
-        int current_id;
-        sscanf(buffer, "%d", &current_id);
-        if (current_id > id)
+    metrics_connection_opened();
+    IdleEntry *idle = idle_register(sock);
+    if (from_unix)
+    {
+        // Attaching waits for the client's first bytes, so it runs on the
+        // wheel: a Unix client that never sends anything is reaped too.
+        int conn = attach_unix_client(sock);
+        if (conn != sock)
         {
-            id = current_id;
+            idle_unregister(idle);
+            if (conn < 0)
+            {
+                close(sock);
+                metrics_connection_closed();
+                return;
+            }
+            sock = conn;
+            idle = idle_register(sock);
         }
     }
+    session_idle = idle;
+    serve_client(sock, idle);
+    session_idle = NULL;
+    // No invalidation may be written to the descriptor once it is closed.
+    lease_holder_close(session_leases);
+    session_leases = NULL;
+    // Off the wheel before the descriptor is released and can be reused.
+    idle_unregister(idle);
+    conn_close(sock);
+    metrics_connection_closed();
+}
+
+static void *serve_connections(int sock, int from_unix)
+{
+    if (sock >= 0)
+        run_session(sock, from_unix);
+    // This thread's session slot passes straight to a connection that waited
+    // for one, so the number of threads never exceeds the session limit.
+    while (admission_next(&sock, &from_unix))
+        run_session(sock, from_unix);
+    return NULL;
+}
 
-    fclose(file);
+void *handle_client(void *client_socket)
+{
+    int sock = *(int *)client_socket;
+    free(client_socket);
+    return serve_connections(sock, 0);
+}
 
-    // Original Code (must be changed to create the mutant)
-    return id + 1;
-    
-    // MUTANT CODE: Change '+' to '-'
-    // return id - 1;
+// Admin-only: the Prometheus text is sent as an int length followed by the body.
+void send_metrics(int client_socket)
+{
+    size_t length = 0;
+    char *text = metrics_render(&length);
+    int reply_length = text ? (int)length : 0;
+
+    session_write(client_socket, &reply_length, sizeof(reply_length));
+    if (reply_length > 0)
+        session_write(client_socket, text, length);
+    free(text);
 }
 
-void register_member(int client_socket, int id, int rent_id)
+// The catalog the socket handlers serve; opened on first use, so handlers
+// driven without server_main (the CUnit runner) get it too.
+static pthread_once_t catalog_once = PTHREAD_ONCE_INIT;
+static Catalog *catalog = NULL;
+
+// Settings from server_main; handlers driven without it see an empty
+// config and get the text backend on books.txt.
+static ServerConfig server_config;
+
+static void open_server_catalog(void)
 {
-    pthread_mutex_lock(&file_mutex);
-    int fd = open("members.txt", O_WRONLY | O_APPEND | O_CREAT, 0644);
-    if (fd < 0)
+    const char *backend_name = server_config.storage[0] ? server_config.storage : storage_text.name;
+    const StorageBackend *backend = storage_backend_named(backend_name);
+    if (!backend)
     {
-        perror("Error opening file");
-        pthread_mutex_unlock(&file_mutex);
+        fprintf(stderr, "Unknown storage backend '%s' (text, binary or memory)\n", backend_name);
         return;
     }
 
-    if (flock(fd, LOCK_EX) < 0)
+    catalog = catalog_open_backend(backend, server_config.catalog[0] ? server_config.catalog : NULL);
+    if (!catalog)
     {
-        perror("Error locking file");
-        close(fd);
-        pthread_mutex_unlock(&file_mutex);
+        perror("Error opening catalog");
         return;
     }
+    catalog_set_loan_limit(catalog, server_config.loan_limit);
+    metrics_catalog(catalog);
+    slowlog_catalog(catalog);
+}
 
-    Member member;
-    member.id = id;
-    member.rented_book_id = rent_id;
-
-    char buffer[BUFFER_SIZE];
+static Catalog *server_catalog(void)
+{
+    pthread_once(&catalog_once, open_server_catalog);
+    return catalog;
+}
 
-    dprintf(fd, "%d  %d\n", member.id, member.rented_book_id);
+// Runs an operation, or reports a failure when the catalog never opened.
+#define CATALOG_CALL(call) (server_catalog() ? (call) : CATALOG_ERROR)
 
-    flock(fd, LOCK_UN);
-    close(fd);
-    pthread_mutex_unlock(&file_mutex);
+// Called by every catalog handler once its payload has been read: a client
+// that stalls mid-request stays on the idle wheel until then. A handler whose
+// read failed (the client hung up or was reaped) returns without a reply.
+static void payload_read(long long span)
+{
+    trace_span(TRACE_SOCKET_READ, span);
+    idle_busy(session_idle);
+}
 
-    sprintf(buffer, "Member with registered ID '%d' logged in succesfully", member.id);
-    write(client_socket, buffer, strlen(buffer));
+static void send_reply(int client_socket, const char *buffer)
+{
+    request_reply(buffer);
+    long long span = trace_mark();
+    session_write(client_socket, buffer, strlen(buffer));
+    trace_span(TRACE_REPLY, span);
 }
 
-//ADD BOOK 
-void add_book(int client_socket)
+// Both menus: after this reply, which still goes out unframed, every
+// message on the connection is a frame (see lease.h).
+void start_leases(int client_socket)
 {
-    pthread_mutex_lock(&file_mutex); // Lock the mutex before file operations) (ORIGINAL CODE)
+    char buffer[BUFFER_SIZE];
+    int lease_ms = lease_duration_ms();
+    LeaseHolder *holder = session_leases ? NULL : lease_holder_open(client_socket);
 
-    // Lock Deletion Mutant: Commenting out the mutex lock (MUTANT CODE))
+    if (!session_leases && !holder)
+        sprintf(buffer, "Leases off");
+    else
+        sprintf(buffer, "Leases on: %d ms", lease_ms);
+    send_reply(client_socket, buffer);
+    if (holder)
+        session_leases = holder;
+}
 
-    int fd = open("books.txt", O_WRONLY | O_APPEND | O_CREAT, 0644);
-    if (fd < 0)
+// After an edit of book_id and before its reply goes out, so no client is
+// told of the edit while a cached search still shows the book without it.
+static void book_changed(int book_id, CatalogStatus status)
+{
+    // An error may leave the row either way.
+    if (status == CATALOG_OK || status == CATALOG_ERROR)
     {
-        perror("Error opening file");
-        pthread_mutex_unlock(&file_mutex);
-        return;
+        result_cache_invalidate(book_id);
+        lease_revoke(book_id);
     }
+}
+
+// Returns 0, after telling the client its login failed, when the member
+// cannot be recorded.
+int register_member(int client_socket, int id, int rent_id)
+{
+    char buffer[BUFFER_SIZE];
 
-    if (flock(fd, LOCK_EX) < 0)
+    pthread_mutex_lock(&file_mutex);
+    int fd = open(MEMBERS_PATH, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0 || flock(fd, LOCK_EX) < 0)
     {
-        perror("Error locking file");
-        close(fd);
+        perror(fd < 0 ? "Error opening file" : "Error locking file");
+        if (fd >= 0)
+            close(fd);
         pthread_mutex_unlock(&file_mutex);
-        return;
+        sprintf(buffer, "Authentication failed! Member '%d' could not be recorded", id);
+        conn_write(client_socket, buffer, strlen(buffer));
+        return 0;
     }
 
-    Book book;
-    book.id = get_next_id("books.txt");
-
-    char buffer[BUFFER_SIZE];
-    read(client_socket, book.title, sizeof(book.title));
-    read(client_socket, book.author, sizeof(book.author));
-
-    book.is_rented = 0;
+    Member member;
+    member.id = id;
+    member.rented_book_id = rent_id;
 
-    dprintf(fd, "%d %s %s %d\n", book.id, book.title, book.author, book.is_rented);
+    dprintf(fd, "%d  %d\n", member.id, member.rented_book_id);
 
     flock(fd, LOCK_UN);
     close(fd);
     pthread_mutex_unlock(&file_mutex);
 
-    sprintf(buffer, "Book added with ID: %d", book.id);
-    write(client_socket, buffer, strlen(buffer));
+    sprintf(buffer, "Member with registered ID '%d' logged in succesfully", member.id);
+    conn_write(client_socket, buffer, strlen(buffer));
+    return 1;
+}
+
+//ADD BOOK 
+void add_book(int client_socket)
+{
+    Book book;
+    char buffer[BUFFER_SIZE];
+    long long span = trace_mark();
+    ssize_t title_length = conn_read(client_socket, book.title, sizeof(book.title));
+    ssize_t author_length = conn_read(client_socket, book.author, sizeof(book.author));
+    payload_read(span);
+    if (title_length <= 0 || author_length <= 0)
+        return;
+    book.title[sizeof(book.title) - 1] = '\0';
+    book.author[sizeof(book.author) - 1] = '\0';
+
+    CatalogStatus status = CATALOG_CALL(catalog_add(catalog, book.title, book.author, &book.id));
+    request_args(status == CATALOG_OK ? book.id : 0, book.title, book.author);
+
+    if (status == CATALOG_OK)
+        sprintf(buffer, "Book added with ID: %d", book.id);
+    else
+        sprintf(buffer, "%s", CATALOG_FAILED_REPLY);
+    send_reply(client_socket, buffer);
 }
 
 //DELETE BOOK
 void delete_book(int client_socket)
 {
-    pthread_mutex_lock(&file_mutex);
-
-    int fd = open("books.txt", O_RDWR);
-    if (fd < 0)
-    {
-        perror("Error opening file");
-        pthread_mutex_unlock(&file_mutex);
+    int book_id = 0;
+    char buffer[BUFFER_SIZE];
+    long long span = trace_mark();
+    // The ID arrives as text with no terminator.
+    ssize_t n = conn_read(client_socket, buffer, BUFFER_SIZE - 1);
+    payload_read(span);
+    if (n <= 0)
         return;
-    }
+    buffer[n] = '\0';
+    sscanf(buffer, "%d", &book_id);
+    request_args(book_id, NULL, NULL);
 
-    if (flock(fd, LOCK_EX) < 0)
-    {
-        perror("Error locking file");
-        close(fd);
-        pthread_mutex_unlock(&file_mutex);
-        return;
-    }
+    CatalogStatus status = CATALOG_CALL(catalog_delete(catalog, book_id));
+    book_changed(book_id, status);
+    if (status == CATALOG_OK)
+        sprintf(buffer, "Book with ID %d has been deleted", book_id);
+    else if (status == CATALOG_ERROR)
+        sprintf(buffer, "%s", CATALOG_FAILED_REPLY);
+    else
+        sprintf(buffer, "Book with ID %d not found", book_id);
+    send_reply(client_socket, buffer);
+}
 
-    int book_id;
+
+//MODIFY BOOK
+void modify_book(int client_socket)
+{
+    int book_id = 0;
     char buffer[BUFFER_SIZE];
-    read(client_socket, buffer, BUFFER_SIZE);
-    sscanf(buffer, "%d", &book_id);
+    Book new_book = {0};
+    long long span = trace_mark();
+    ssize_t id_length = conn_read(client_socket, &book_id, sizeof(book_id));
+    ssize_t n = conn_read(client_socket, buffer, BUFFER_SIZE);
+    payload_read(span);
+    if (id_length <= 0 || n <= 0)
+        return;
+    buffer[BUFFER_SIZE - 1] = '\0';
+    sscanf(buffer, "%49s %49s", new_book.title, new_book.author);
+    request_args(book_id, new_book.title, new_book.author);
 
-    FILE *file = fdopen(fd, "r+");
-    char temp_filename[] = "books_temp.txt";
-    FILE *temp_file = fopen(temp_filename, "w");
+    CatalogStatus status = CATALOG_CALL(catalog_modify(catalog, book_id, new_book.title, new_book.author));
+    book_changed(book_id, status);
+    if (status == CATALOG_OK)
+        sprintf(buffer, "Book with ID %d has been modified", book_id);
+    else if (status == CATALOG_ERROR)
+        sprintf(buffer, "%s", CATALOG_FAILED_REPLY);
+    else
+        sprintf(buffer, "Book with ID %d not found", book_id);
+    send_reply(client_socket, buffer);
+}
 
 
-    int found = 0;
-    while (fgets(buffer, BUFFER_SIZE, file))
-    {
-        Book book;
-        sscanf(buffer, "%d %49s %49s %d", &book.id, book.title, book.author, &book.is_rented);
+//SEARCH BOOK
+// Found books are answered from the result cache until their next edit.
+void search_book(int client_socket)
+{
+    int book_id = 0;
+    char buffer[BUFFER_SIZE];
+    long long span = trace_mark();
+    // The ID arrives as text with no terminator.
+    ssize_t n = conn_read(client_socket, buffer, BUFFER_SIZE - 1);
+    payload_read(span);
+    if (n <= 0)
+        return;
+    buffer[n] = '\0';
+    sscanf(buffer, "%d", &book_id);
+    request_args(book_id, NULL, NULL);
 
-        if (book.id == book_id)
-        {
-            found = 1;
-            continue;
-        }
+    // Before the catalog is read: an edit that lands after the read still
+    // finds the lease and invalidates the reply.
+    lease_grant(session_leases, book_id);
 
-        fprintf(temp_file, "%d %s %s %d\n", book.id, book.title, book.author, book.is_rented);
+    unsigned long long ticket = 0;
+    if (result_cache_get(book_id, buffer, sizeof(buffer), &ticket) >= 0)
+    {
+        lease_settle(session_leases, book_id, 1);
+        send_reply(client_socket, buffer);
+        return;
     }
 
-    fclose(file);
-    fclose(temp_file);
-
-    if (found)
+    Book book;
+    CatalogStatus status = CATALOG_CALL(catalog_search(catalog, book_id, &book));
+    lease_settle(session_leases, book_id, status == CATALOG_OK);
+    if (status == CATALOG_OK)
     {
-        rename(temp_filename, "books.txt");
-        sprintf(buffer, "Book with ID %d has been deleted", book_id);
+        sprintf(buffer, "ID: %d, Title: %s, Author: %s, Rented: %d", book.id, book.title, book.author, book.is_rented);
+        result_cache_put(book_id, buffer, ticket);
     }
+    else if (status == CATALOG_ERROR)
+        sprintf(buffer, "%s", CATALOG_FAILED_REPLY);
     else
-    {
-        remove(temp_filename);
         sprintf(buffer, "Book with ID %d not found", book_id);
-    }
+    send_reply(client_socket, buffer);
+}
 
-    flock(fd, LOCK_UN);
-    close(fd);
-    pthread_mutex_unlock(&file_mutex);
+//RENT A BOOK
+// Counts against the member's loan limit when the server has one.
+void rent_book(int client_socket, int member_id)
+{
+    int book_id = 0;
+    char buffer[BUFFER_SIZE];
+    long long span = trace_mark();
+    ssize_t n = conn_read(client_socket, &book_id, sizeof(book_id));
+    payload_read(span);
+    if (n <= 0)
+        return;
+    request_args(book_id, NULL, NULL);
 
-    write(client_socket, buffer, strlen(buffer));
+    CatalogStatus status = CATALOG_CALL(catalog_rent_for(catalog, book_id, member_id));
+    book_changed(book_id, status);
+    if (status == CATALOG_OK)
+        sprintf(buffer, "Book with ID %d has been rented", book_id);
+    else if (status == CATALOG_ERROR)
+        sprintf(buffer, "%s", CATALOG_FAILED_REPLY);
+    else if (status == CATALOG_LIMIT)
+        sprintf(buffer, "Rent failed: member %d already has %d books out", member_id, catalog_loan_limit(catalog));
+    else
+        sprintf(buffer, "Book with ID %d not found or already rented", book_id);
+    send_reply(client_socket, buffer);
 }
 
-
-//MODIFY BOOK
-void modify_book(int client_socket)
+//RETURN BOOK
+void return_book(int client_socket)
 {
-    pthread_mutex_lock(&file_mutex);
-
-    int fd = open("books.txt", O_RDWR);
-    if (fd < 0)
-    {
-        perror("Error opening file");
-        pthread_mutex_unlock(&file_mutex);
+    int book_id = 0;
+    char buffer[BUFFER_SIZE];
+    long long span = trace_mark();
+    // The ID arrives as text with no terminator.
+    ssize_t n = conn_read(client_socket, buffer, BUFFER_SIZE - 1);
+    payload_read(span);
+    if (n <= 0)
         return;
-    }
+    buffer[n] = '\0';
+    sscanf(buffer, "%d", &book_id);
+    request_args(book_id, NULL, NULL);
+
+    CatalogStatus status = CATALOG_CALL(catalog_return(catalog, book_id));
+    book_changed(book_id, status);
+    if (status == CATALOG_OK)
+        sprintf(buffer, "Book with ID %d has been returned", book_id);
+    else if (status == CATALOG_ERROR)
+        sprintf(buffer, "%s", CATALOG_FAILED_REPLY);
+    else
+        sprintf(buffer, "Book with ID %d not found or not rented", book_id);
+    send_reply(client_socket, buffer);
+}
+
 
-    if (flock(fd, LOCK_EX) < 0)
+// Helper for the CUnit credential tests
+int check_admin_credentials_test(const char *username, const char *password)
+{
+    if (strcmp(username, "admin") == 0 && strcmp(password, "admin") == 0)
     {
-        perror("Error locking file");
-        close(fd);
-        pthread_mutex_unlock(&file_mutex);
-        return;
+        return 1; // Success
     }
-    // char title[50];
-    // char author[50];
-    int book_id;
-    char buffer[BUFFER_SIZE];
-
-    FILE *file = fdopen(fd, "r+");
-    char temp_filename[] = "books_temp.txt";
-    FILE *temp_file = fopen(temp_filename, "w");
+    return 0; // Failure
+}
 
-    int found = 0;
-    Book new_book;
-    read(client_socket, &book_id, sizeof(book_id));
-    new_book.id = book_id;
 
-    read(client_socket, buffer, BUFFER_SIZE);
-    sscanf(buffer, "%s %s", new_book.title, new_book.author);
+// Connections on the Unix socket may ask to continue over shared memory.
+// Everything after that uses the same request/response encoding as TCP.
+// Moves the session onto shared memory when the client asks for it first.
+// Returns the connection to serve (the socket itself otherwise), or -1 when
+// the client must be hung up on; the caller closes the socket.
+static int attach_unix_client(int sock)
+{
+    int request;
 
-    while (fgets(buffer, BUFFER_SIZE, file))
+    if (recv(sock, &request, sizeof(request), MSG_PEEK | MSG_WAITALL) == sizeof(request) &&
+        request == TRANSPORT_SHM_ATTACH)
     {
-        Book book;
-        sscanf(buffer, "%d %49s %49s %d", &book.id, book.title, book.author, &book.is_rented);
+        char name[SHM_NAME_LENGTH];
+        recv(sock, &request, sizeof(request), MSG_WAITALL);
+        if (recv(sock, name, sizeof(name), MSG_WAITALL) != sizeof(name))
+            return -1;
+        name[sizeof(name) - 1] = '\0';
 
-        if (book.id == book_id)
+        int conn = transport_attach_shm(name, sock);
+        if (conn < 0)
         {
-            new_book.is_rented = book.is_rented;
-            book = new_book;
-            book.id = book_id;
-            found = 1;
+            write(sock, "Rejected", strlen("Rejected"));
+            return -1;
         }
-
-        fprintf(temp_file, "%d %s %s %d\n", book.id, book.title, book.author, book.is_rented);
+        write(sock, "Attached", strlen("Attached"));
+        return conn;
     }
+    return sock;
+}
 
-    fclose(file);
-    fclose(temp_file);
+void *handle_unix_client(void *client_socket)
+{
+    int sock = *(int *)client_socket;
+    free(client_socket);
+    return serve_connections(sock, 1);
+}
 
-    if (found)
+int create_unix_listener(const char *path)
+{
+    struct sockaddr_un unix_addr;
+    int unix_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (unix_socket < 0)
     {
-        rename(temp_filename, "books.txt");
-        sprintf(buffer, "Book with ID %d has been modified", book_id);
+        perror("Unix socket creation failed");
+        return -1;
     }
-    else
+
+    memset(&unix_addr, 0, sizeof(unix_addr));
+    unix_addr.sun_family = AF_UNIX;
+    strncpy(unix_addr.sun_path, path, sizeof(unix_addr.sun_path) - 1);
+    unlink(path); // stale socket from an earlier run
+
+    if (bind(unix_socket, (struct sockaddr *)&unix_addr, sizeof(unix_addr)) < 0 ||
+        listen(unix_socket, MAX_CLIENTS) < 0)
     {
-        remove(temp_filename);
-        sprintf(buffer, "Book with ID %d not found", book_id);
+        perror("Unix socket bind failed");
+        close(unix_socket);
+        return -1;
     }
+    return unix_socket;
+}
 
-    flock(fd, LOCK_UN);
-    close(fd);
-    pthread_mutex_unlock(&file_mutex);
+static volatile sig_atomic_t stop_requested = 0;
 
-    write(client_socket, buffer, strlen(buffer));
+static void request_stop(int signal_number)
+{
+    (void)signal_number;
+    stop_requested = 1;
 }
 
+// int main()
 
-//SEARCH BOOK
-void search_book(int client_socket)
+// Modified line for testing:
+int server_main(int argc, char *argv[])
 {
-    pthread_mutex_lock(&file_mutex);
+    int server_socket, unix_socket, client_socket;
+    struct sockaddr_in server_addr, client_addr;
+    socklen_t addr_len;
+    pthread_t tid[MAX_CLIENTS];
+    int thread_count = 0;
+    int reuse = 1;
+    ServerConfig *config = &server_config;
+
+    // Defaults, then the config file, the environment and the flags (see config.h).
+    int parsed = config_parse(config, argc, argv);
+    if (parsed != 0)
+        return parsed > 0 ? 0 : 2;
 
-    int fd = open("books.txt", O_RDONLY);
-    if (fd < 0)
+    // Everything relative lives in the data directory, so instances with
+    // their own directories never share a file or a Unix socket.
+    if (mkdir(config->data_dir, 0755) < 0 && errno != EEXIST)
     {
-        perror("Error opening file");
-        pthread_mutex_unlock(&file_mutex);
-        return;
+        perror(config->data_dir);
+        return 1;
     }
-
-    if (flock(fd, LOCK_SH) < 0)
+    if (chdir(config->data_dir) < 0)
     {
-        perror("Error locking file");
-        close(fd);
-        pthread_mutex_unlock(&file_mutex);
-        return;
+        perror(config->data_dir);
+        return 1;
     }
 
-    int book_id;
-    char buffer[BUFFER_SIZE];
-    read(client_socket, buffer, BUFFER_SIZE);
-    sscanf(buffer, "%d", &book_id);
-
-    FILE *file = fdopen(fd, "r");
-
-    if (!file)
-    {
-        perror("Error opening file stream");
-        close(fd);
-        pthread_mutex_unlock(&file_mutex);
-        return;
-    }
-
-    int found = 0;
-    while (fgets(buffer, BUFFER_SIZE, file))
-    {
-        Book book;
-        sscanf(buffer, "%d %49s %49s %d", &book.id, book.title, book.author, &book.is_rented);
-
-        if (book.id == book_id)
-        {
-            sprintf(buffer, "ID: %d, Title: %s, Author: %s, Rented: %d", book.id, book.title, book.author, book.is_rented);
-            found = 1;
-            break;
-        }
-    }
-
-    if (!found)
-    {
-        sprintf(buffer, "Book with ID %d not found", book_id);
-    }
-
-    fclose(file);
-    flock(fd, LOCK_UN);
-    close(fd);
-    pthread_mutex_unlock(&file_mutex);
-
-    write(client_socket, buffer, strlen(buffer));
-}
-
-//Rented Books
-void number_of_rented_books(/*int client_socket,*/ int ptr, int member_id)
-{
-    pthread_mutex_lock(&file_mutex);
-
-    int fd = open("members.txt", O_RDWR);
-    flock(fd, LOCK_EX);
-    FILE *filee = fdopen(fd, "r+");
-
-    char buffer[BUFFER_SIZE];
-    char temp2_filename[] = "members_temp2.txt";
-    FILE *temp2_file = fopen(temp2_filename, "w");
-
-    int found = 0;
-    while (fgets(buffer, BUFFER_SIZE, filee))
-    {
-        Member member;
-        sscanf(buffer, "%d %d", &member.id, &member.rented_book_id);
-        if (member.id == member_id)
-        {
-            if (ptr == 1)
-            {
-                found = 1;
-                member.rented_book_id++;
-            }
-            else if (ptr == 0)
-            {
-                found = 1;
-                member.rented_book_id--;
-            }
-        }
-
-        fprintf(temp2_file, "%d %d\n", member.id, member.rented_book_id);
-    }
-
-    fclose(filee);
-    fclose(temp2_file);
-
-    if (found)
-    {
-        rename(temp2_filename, "members.txt");
-    }
-    else
-    {
-        remove(temp2_filename);
-    }
-
-    flock(fd, LOCK_UN);
-    pthread_mutex_unlock(&file_mutex);
-}
-
-
-//RENT A BOOK
-void rent_book(int client_socket)
-{
-    pthread_mutex_lock(&file_mutex);
-
-    int fd = open("books.txt", O_RDWR);
-    if (fd < 0)
-    {
-        perror("Error opening file");
-        pthread_mutex_unlock(&file_mutex);
-        return;
-    }
-
-    if (flock(fd, LOCK_EX) < 0)
-    {
-        perror("Error locking file");
-        close(fd);
-        pthread_mutex_unlock(&file_mutex);
-        return;
-    }
+    // A client that disconnects mid-reply must not take the whole server down.
+    signal(SIGPIPE, SIG_IGN);
 
-    int book_id;
-    char buffer[BUFFER_SIZE];
-    read(client_socket, &book_id, sizeof(book_id));
-  
-
-    FILE *file = fdopen(fd, "r+");
-    char temp_filename[] = "books_temp.txt";
-    FILE *temp_file = fopen(temp_filename, "w");
+    // Ctrl-C / kill interrupt poll() below so buffered trace records get written.
+    struct sigaction stop_action;
+    memset(&stop_action, 0, sizeof(stop_action));
+    stop_action.sa_handler = request_stop;
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
 
-    int found = 0;
-
-    while (fgets(buffer, BUFFER_SIZE, file))
+    if (credentials_load(config->credentials) < 0)
     {
-        Book book;
-        sscanf(buffer, "%d %49s %49s %d", &book.id, book.title, book.author, &book.is_rented);
-
-        if (book.id == book_id && book.is_rented == 0)
-        {
-            book.is_rented = 1;
-            found = 1;
-        }
-
-        fprintf(temp_file, "%d %s %s %d\n", book.id, book.title, book.author, book.is_rented);
+        fprintf(stderr, "Failed to load %s\n", config->credentials);
+        exit(EXIT_FAILURE);
     }
 
-    fclose(file);
-    fclose(temp_file);
-
-    if (found)
-    {
-        rename(temp_filename, "books.txt");
-        sprintf(buffer, "Book with ID %d has been rented", book_id);
-    }
-    else
+    // Create the server socket
+    server_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_socket < 0)
     {
-        remove(temp_filename);
-        sprintf(buffer, "Book with ID %d not found or already rented", book_id);
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
     }
+    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
 
-    flock(fd, LOCK_UN);
-    close(fd);
-    pthread_mutex_unlock(&file_mutex);
-    write(client_socket, buffer, strlen(buffer));
-
-    // if (found==1)
-    //  number_of_rented_books(client_socket,1,member_id);
-}
-
-//RETURN BOOK
-void return_book(int client_socket)
-{
-    pthread_mutex_lock(&file_mutex);
-
-    int fd = open("books.txt", O_RDWR);
-    if (fd < 0)
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(config->port);
+    if (inet_pton(AF_INET, config->listen_address, &server_addr.sin_addr) != 1)
     {
-        perror("Error opening file");
-        pthread_mutex_unlock(&file_mutex);
-        return;
+        fprintf(stderr, "listen-address: '%s' is not an IPv4 address\n", config->listen_address);
+        close(server_socket);
+        exit(EXIT_FAILURE);
     }
 
-    if (flock(fd, LOCK_EX) < 0)
+    // Bind 
+    if (bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
     {
-        perror("Error locking file");
-        close(fd);
-        pthread_mutex_unlock(&file_mutex);
-        return;
+        perror("Bind failed");
+        close(server_socket);
+        exit(EXIT_FAILURE);
     }
 
-    int book_id;
-    char buffer[BUFFER_SIZE];
-    read(client_socket, buffer, BUFFER_SIZE);
-    sscanf(buffer, "%d", &book_id);
-
-    FILE *file = fdopen(fd, "r+");
-    char temp_filename[] = "books_temp.txt";
-    FILE *temp_file = fopen(temp_filename, "w");
-
-    int found = 0;
-
-    while (fgets(buffer, BUFFER_SIZE, file))
+    // Listen 
+    if (listen(server_socket, config->backlog) < 0)
     {
-        Book book;
-        sscanf(buffer, "%d %49s %49s %d", &book.id, book.title, book.author, &book.is_rented);
-
-        if (book.id == book_id && book.is_rented == 1)
-        {
-            book.is_rented = 0;
-            found = 1;
-        }
-
-        fprintf(temp_file, "%d %s %s %d\n", book.id, book.title, book.author, book.is_rented);
+        perror("Listen failed");
+        close(server_socket);
+        exit(EXIT_FAILURE);
     }
 
-    fclose(file);
-    fclose(temp_file);
-
-    if (found)
-    {
-        rename(temp_filename, "books.txt");
-        sprintf(buffer, "Book with ID %d has been returned", book_id);
-    }
-    else
+    // Catalog storage (see storage.h); a bad backend or file is fatal here
+    // rather than on the first request.
+    if (!server_catalog())
     {
-        remove(temp_filename);
-        sprintf(buffer, "Book with ID %d not found or not rented", book_id);
+        close(server_socket);
+        exit(EXIT_FAILURE);
     }
+    printf("Catalog: %s storage on %s in %s\n", config->storage, catalog_location(catalog), config->data_dir);
 
-    flock(fd, LOCK_UN);
-    close(fd);
-    pthread_mutex_unlock(&file_mutex);
-    write(client_socket, buffer, strlen(buffer));
-
-    //  if (found == 1)
-    // number_of_rented_books(client_socket,0,member_id);
-}
+    // Co-located clients skip the TCP stack through the Unix socket (optional).
+    unix_socket = config->unix_socket[0] ? create_unix_listener(config->unix_socket) : -1;
 
+    // Optional workload capture for later replay (see capture.h).
+    if (config->capture[0] && capture_start(config->capture) == 0)
+        printf("Capturing requests to %s\n", config->capture);
 
+    // Optional HTTP scrape endpoint; the admin menu serves the same text.
+    if (config->metrics_port > 0 && metrics_serve_http(config->metrics_port) == 0)
+        printf("Serving metrics on 127.0.0.1:%d/metrics\n", config->metrics_port);
 
+    // Optional sampled phase tracing in Chrome trace format (see trace.h).
+    if (config->trace[0] && trace_start(config->trace, config->trace_rate) == 0)
+        printf("Tracing requests to %s\n", config->trace);
 
+    // Overload protection (see admission.h): bounded sessions, a bounded
+    // queue of connections waiting for one, and bounded requests in flight.
+    admission_configure(&config->admission);
 
+    // Idle sessions are shut down by the reaper (see idle.h); 0 turns it off.
+    if (config->idle_timeout > 0 && idle_start(config->idle_timeout) == 0)
+        printf("Closing sessions idle for %d s\n", config->idle_timeout);
 
+    // Optional log of individual slow requests (see slowlog.h).
+    if (config->slowlog[0] && slowlog_start(config->slowlog, config->slowlog_ms * 1000LL, config->slowlog_rate) == 0)
+        printf("Logging requests slower than %d ms to %s\n", config->slowlog_ms, config->slowlog);
 
-// Add this wrapper function to server.c (e.g., just before main)
-// Purpose: Enables unit testing of file deletion logic by bypassing socket reads.
-void delete_book_wrapper(int book_id)
-{
-    // Start critical section - Acquire pthread mutex lock (Lock 1)
-    pthread_mutex_lock(&file_mutex);
-
-    int fd = open("books.txt", O_RDWR);
-    if (fd < 0)
-    {
-        perror("Error opening file");
-        // Must unlock mutex before exiting on failure
-        pthread_mutex_unlock(&file_mutex);
-        return;
-    }
-
-    // Acquire advisory file lock (Lock 2) - Guarantees exclusive access to the file resource
-    if (flock(fd, LOCK_EX) < 0)
-    {
-        perror("Error locking file");
-        close(fd); // Close descriptor
-        pthread_mutex_unlock(&file_mutex); // Unlock mutex
-        return;
-    }
-
-    // Associate file descriptor with a C stream for fgets/fprintf
-    FILE *file = fdopen(fd, "r+");
-    // Ensure file stream was created successfully before proceeding
-    if (file == NULL) {
-        perror("Error creating file stream");
-        flock(fd, LOCK_UN); // Release file lock if fdopen fails
-        close(fd);
-        pthread_mutex_unlock(&file_mutex);
-        return;
-    }
+    // Clients may cache searches for this long unless told otherwise (see lease.h).
+    lease_configure(config->lease_ms);
 
-    char temp_filename[] = "books_temp.txt";
-    FILE *temp_file = fopen(temp_filename, "w");
-    // Handle error if temp file cannot be created
-    if (temp_file == NULL) {
-        perror("Error creating temporary file");
-        fclose(file);
-        flock(fd, LOCK_UN);
-        close(fd);
-        pthread_mutex_unlock(&file_mutex);
-        return;
-    }
+    // Search replies served from memory until the book is edited (see result_cache.h).
+    if (config->result_cache > 0 && result_cache_start(config->result_cache) == 0)
+        printf("Caching up to %d search replies\n", config->result_cache);
 
-    int found = 0;
-    char buffer[BUFFER_SIZE]; // Buffer for reading file lines
+    printf("Listening on %s:%d... \n", config->listen_address, config->port);
 
-    // Read every line from books.txt and write non-matching lines to temp file
-    while (fgets(buffer, BUFFER_SIZE, file))
+    while (!stop_requested)
     {
-        Book book;
-        // NOTE: Use %49s to prevent buffer overflow in sscanf for title/author
-        sscanf(buffer, "%d %49s %49s %d", &book.id, book.title, book.author, &book.is_rented);
-
-        if (book.id == book_id)
+        struct pollfd listeners[2] = {{server_socket, POLLIN, 0}, {unix_socket, POLLIN, 0}};
+        // Wake at least once a second to turn away connections that waited too long.
+        int ready = poll(listeners, unix_socket >= 0 ? 2 : 1, 1000);
+        admission_expire_waiting();
+        if (ready <= 0)
         {
-            found = 1; // Mark as found, but skip writing this line
+            if (ready < 0 && !stop_requested)
+                perror("Poll failed");
             continue;
         }
 
-        fprintf(temp_file, "%d %s %s %d\n", book.id, book.title, book.author, book.is_rented);
-    }
-
-    // Close both file streams before attempting rename/remove
-    fclose(file);
-    fclose(temp_file);
-
-    if (found)
-    {
-        // Successful deletion: Replace original file with temporary file
-        rename(temp_filename, "books.txt");
-    }
-    else
-    {
-        // Book not found: Delete the unnecessary temporary file
-        remove(temp_filename);
-        
-        // This is the VRR MUTATION TARGET: If activated, remove("books.txt") would be executed here.
-        // remove("books.txt"); 
-    }
-
-    // Final cleanup: Release locks and resources in reverse order of acquisition
-    flock(fd, LOCK_UN);
-    close(fd);
-    pthread_mutex_unlock(&file_mutex);
-}
-
-
-
-// TEST WRAPPER: Modified to take ID as argument instead of reading from socket.
-// Logic copied from the original rent_book function.
-void rent_book_wrapper(int book_id)
-{
-    pthread_mutex_lock(&file_mutex);
-
-    int fd = open("books.txt", O_RDWR);
-    if (fd < 0)
-    {
-        perror("Error opening file");
-        pthread_mutex_unlock(&file_mutex);
-        return;
-    }
-
-    if (flock(fd, LOCK_EX) < 0)
-    {
-        perror("Error locking file");
-        close(fd);
-        pthread_mutex_unlock(&file_mutex);
-        return;
-    }
-
-    FILE *file = fdopen(fd, "r+");
-    char temp_filename[] = "books_temp_rent.txt"; // Use a unique temp file name
-    FILE *temp_file = fopen(temp_filename, "w");
-
-    int found = 0;
-    char buffer[BUFFER_SIZE];
-
-    while (fgets(buffer, BUFFER_SIZE, file))
-    {
-        Book book;
-        sscanf(buffer, "%d %49s %49s %d", &book.id, book.title, book.author, &book.is_rented);
-
-        if (book.id == book_id && book.is_rented == 0) // <--- THIS IS THE COR TARGET LINE (ORGINAL CODE)
-
-        // MUTANT CODE: Change '&&' to '||'
-        // if (book.id == book_id || book.is_rented == 0)
-        {
-            book.is_rented = 1;
-            found = 1;
-        }
-
-        fprintf(temp_file, "%d %s %s %d\n", book.id, book.title, book.author, book.is_rented);
-    }
-
-    fclose(file);
-    fclose(temp_file);
-
-    if (found)
-    {
-        rename(temp_filename, "books.txt");
-    }
-    else
-    {
-        remove(temp_filename);
-    }
-
-    flock(fd, LOCK_UN);
-    close(fd);
-    pthread_mutex_unlock(&file_mutex);
-
-}
-
-
-// server.c: Add this wrapper function
-
-void return_book_wrapper(int book_id)
-{
-    pthread_mutex_lock(&file_mutex);
-
-    int fd = open("books.txt", O_RDWR);
-    if (fd < 0)
-    {
-        perror("Error opening file");
-        pthread_mutex_unlock(&file_mutex);
-        return;
-    }
-
-    if (flock(fd, LOCK_EX) < 0)
-    {
-        perror("Error locking file");
-        close(fd);
-        pthread_mutex_unlock(&file_mutex);
-        return;
-    }
-
-    // No socket read needed for book_id
-
-    FILE *file = fdopen(fd, "r+");
-    char temp_filename[] = "books_temp_return.txt"; // Unique temp file
-    FILE *temp_file = fopen(temp_filename, "w");
-
-    int found = 0;
-    char buffer[BUFFER_SIZE];
-
-    while (fgets(buffer, BUFFER_SIZE, file))
-    {
-        Book book;
-        sscanf(buffer, "%d %49s %49s %d", &book.id, book.title, book.author, &book.is_rented);
-
-        if (book.id == book_id && book.is_rented == 1) // <--- ROR TARGET LINE (ORIGINAL CODE)
-
-        // MUTANT CODE: Change '== 1' to '!= 1'
-        // if (book.id == book_id && book.is_rented != 1)
-        {
-            book.is_rented = 0; // Set to unrented
-            found = 1;
-        }
-        // {
-        //     book.is_rented = 0; // Set to unrented
-        //     found = 1;
-        // }
-
-        fprintf(temp_file, "%d %s %s %d\n", book.id, book.title, book.author, book.is_rented);
-    }
-
-    fclose(file);
-    fclose(temp_file);
-
-    if (found)
-    {
-        rename(temp_filename, "books.txt");
-    }
-    else
-    {
-        remove(temp_filename);
-    }
-
-    flock(fd, LOCK_UN);
-    close(fd);
-    pthread_mutex_unlock(&file_mutex);
-}
-
-
-// server.c: Helper function for CUnit testing ROR mutant
-int check_admin_credentials_test(const char *username, const char *password)
-{
-    // ROR TARGET LINE  (ORIGINAL CODE)
-    if (strcmp(username, "admin") == 0 && strcmp(password, "admin") == 0)
-
-    // MUTANT CODE: Change '== 0' to '!= 0'
-    // if (strcmp(username, "admin") != 0 && strcmp(password, "admin")==0)
-    {
-        return 1; // Success
-    }
-    return 0; // Failure
-}
-
-
-// server.c: Add this wrapper function
-void modify_book_wrapper(int book_id, const char *new_title, const char *new_author)
-{
-    pthread_mutex_lock(&file_mutex);
-
-    int fd = open("books.txt", O_RDWR);
-    // ... (Error checks for fd and flock(LOCK_EX) are the same as delete/rent wrappers)
-    // [Skipping boilerplate for brevity]
-
-    FILE *file = fdopen(fd, "r+");
-    char temp_filename[] = "books_temp_modify.txt";
-    FILE *temp_file = fopen(temp_filename, "w");
-
-    int found = 0;
-    Book new_book;
-    new_book.id = book_id;
-    // Copy new title/author into new_book structure
-    strncpy(new_book.title, new_title, 49);
-    strncpy(new_book.author, new_author, 49);
-
-    char buffer[BUFFER_SIZE];
-    
-    while (fgets(buffer, BUFFER_SIZE, file))
-    {
-        Book book;
-        sscanf(buffer, "%d %49s %49s %d", &book.id, book.title, book.author, &book.is_rented);
-
-        if (book.id == book_id)
-        {
-            // SDL TARGET LINE: This line preserves the status. (ORIGINAL CODE)
-
-            new_book.is_rented = book.is_rented; 
-            
-            // MUTANT CODE: SDL MUTANT APPLIED: DELETED (just comment the above line)
-
-            book = new_book;
-            book.id = book_id;
-            found = 1;
-        }
-
-        fprintf(temp_file, "%d %s %s %d\n", book.id, book.title, book.author, book.is_rented);
-    }
-
-    // ... (File close, rename/remove logic, and unlock/close fd are the same)
-    // [Skipping boilerplate for brevity]
-    flock(fd, LOCK_UN); 
-    close(fd);
-    pthread_mutex_unlock(&file_mutex);
-}
-
-
-// Logic copied from the original add_book function.
-void add_book_wrapper(const char *title, const char *author)
-{
-    pthread_mutex_lock(&file_mutex);
-
-    // INTEGRATION TARGET: O_WRONLY | O_APPEND | O_CREAT, 0644
-    int fd = open("books.txt", O_WRONLY | O_APPEND | O_CREAT, 0644); 
-
-    // int fd = open("books.txt", O_WRONLY | O_APPEND | O_CREAT, 0000); // MUTANT CODE: SCPR Applied
-
-    // MUTANT CODE: System Call Replacement (SCR) - Remove O_CREAT flag.
-    // int fd = open("books.txt", O_WRONLY | O_APPEND, 0644);
-
-
-    if (fd < 0)
-    {
-        perror("Error opening file");
-        pthread_mutex_unlock(&file_mutex);
-        return;
-    }
-
-    if (flock(fd, LOCK_EX) < 0)
-    {
-        perror("Error locking file");
-        close(fd);
-        pthread_mutex_unlock(&file_mutex);
-        return;
-    }
-
-    Book book;
-    book.id = get_next_id("books.txt");
-
-    // Copy data into book structure
-    strncpy(book.title, title, 49);
-    strncpy(book.author, author, 49);
-
-    book.is_rented = 0;
-
-    dprintf(fd, "%d %s %s %d\n", book.id, book.title, book.author, book.is_rented);
-
-    flock(fd, LOCK_UN);
-    close(fd);
-    pthread_mutex_unlock(&file_mutex);
-}
-
-
-
-
-
-// int main()
-
-// Modified line for testing:
-int server_main()
-{
-    int server_socket, client_socket;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t addr_len;
-    pthread_t tid[MAX_CLIENTS];
-    int thread_count = 0;
-
-    // Create the server socket
-    server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_socket == 0)
-    {
-        perror("Socket creation failed");
-        exit(EXIT_FAILURE);
-    }
-
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(PORT);
-
-    // Bind 
-    if (bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
-    {
-        perror("Bind failed");
-        close(server_socket);
-        exit(EXIT_FAILURE);
-    }
-
-    // Listen 
-    if (listen(server_socket, MAX_CLIENTS) < 0)
-    {
-        perror("Listen failed");
-        close(server_socket);
-        exit(EXIT_FAILURE);
-    }
-
-    printf("Listening... \n" );
-
-    while (1)
-    {
+        int from_unix = unix_socket >= 0 && (listeners[1].revents & POLLIN);
         addr_len = sizeof(client_addr);
         //Accept connection
-        client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &addr_len);
+        if (from_unix)
+            client_socket = accept(unix_socket, NULL, NULL);
+        else
+            client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &addr_len);
         if (client_socket < 0)
         {
             perror("Accept failed");
@@ -1103,23 +959,27 @@ int server_main()
 
        printf("Connection Accepted\n");
 
-        // Authenticate the client
-        authenticate(client_socket);
+        // Over the session limit the connection waits for a slot, or is told
+        // the server is busy; either way no thread is started for it here.
+        if (admission_accept(client_socket, from_unix) != ADMIT_RUN)
+            continue;
 
         int *client_sock = malloc(sizeof(int));
         if (client_sock == NULL)
         {
             perror("Malloc failed");
             close(client_socket);
+            admission_release();
             continue;
         }
         *client_sock = client_socket;
 
-        if (pthread_create(&tid[thread_count], NULL, handle_client, (void *)client_sock) != 0)
+        if (pthread_create(&tid[thread_count], NULL, from_unix ? handle_unix_client : handle_client, (void *)client_sock) != 0)
         {
             perror("Thread creation failed");
             close(client_socket);
             free(client_sock);
+            admission_release();
             continue;
         }
         pthread_detach(tid[thread_count]);
@@ -1127,5 +987,15 @@ int server_main()
     }
 
     close(server_socket);
+    if (unix_socket >= 0)
+    {
+        close(unix_socket);
+        unlink(config->unix_socket);
+    }
+    capture_stop();
+    idle_stop();
+    slowlog_stop();
+    trace_stop();
+    result_cache_stop();
     return 0;
 }
@@ -0,0 +1,10 @@
+//*******SERVER ENTRY POINT*******
+// server.c exposes server_main() so the CUnit runner can link it without a
+// second main(); this file turns it into the standalone server binary.
+int server_main(int argc, char *argv[]);
+
+// ./server --help lists the settings.
+int main(int argc, char *argv[])
+{
+    return server_main(argc, argv);
+}
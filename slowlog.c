@@ -0,0 +1,245 @@
+//*******SLOW-OPERATION LOG*******
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "slowlog.h"
+#include "trace.h"
+
+typedef struct
+{
+    RequestContext request;
+    long long phase_ns[TRACE_PHASE_COUNT];
+    int have_phases;
+    long long catalog_bytes;
+} SlowRecord;
+
+// Only requests over the threshold get past the first check in
+// slowlog_record, and the rate limit caps those, so a plain mutex and
+// condition variable are enough for the queue.
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_ready = PTHREAD_COND_INITIALIZER;
+static SlowRecord queue[SLOWLOG_QUEUE_SIZE];
+static int queue_head = 0;
+static int queue_count = 0;
+static long long suppressed = 0;          // since start
+static long long suppressed_unlogged = 0; // since the writer last reported
+
+static double tokens = 0;
+static double rate = SLOWLOG_DEFAULT_RATE;
+static long long refilled_ns = 0;
+
+static long long threshold_ns = 0;
+static int logging = 0;
+static int stopping = 0;
+static FILE *log_file = NULL;
+static pthread_t writer_thread;
+static Catalog *sized_catalog = NULL;
+
+static long long now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static long long wall_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (long long)now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+//WRITER
+static void write_record(const SlowRecord *record)
+{
+    const RequestContext *r = &record->request;
+    long long lock_wait_ns = record->phase_ns[TRACE_MUTEX_WAIT] + record->phase_ns[TRACE_FLOCK_WAIT];
+
+    fprintf(log_file, "{\"ts_us\":%lld,\"session\":%d,\"member_id\":%d,\"op\":\"%s\",\"book_id\":%d,\"latency_us\":%lld,",
+            r->timestamp_us, r->session, r->member_id, request_op_name(r->op), r->book_id, r->latency_ns / 1000);
+    if (record->have_phases)
+        fprintf(log_file, "\"lock_wait_us\":%lld,", lock_wait_ns / 1000);
+    fprintf(log_file, "\"catalog_bytes\":%lld,\"status\":\"%s\"", record->catalog_bytes, r->failed ? "fail" : "ok");
+    if (record->have_phases)
+    {
+        fputs(",\"phases_us\":{", log_file);
+        for (int phase = 0; phase < TRACE_PHASE_COUNT; phase++)
+            fprintf(log_file, "%s\"%s\":%lld", phase ? "," : "", trace_phase_name((TracePhase)phase),
+                    record->phase_ns[phase] / 1000);
+        fputc('}', log_file);
+    }
+    fputs("}\n", log_file);
+}
+
+static void *writer_main(void *arg)
+{
+    (void)arg;
+    static SlowRecord batch[SLOWLOG_QUEUE_SIZE];
+
+    pthread_mutex_lock(&queue_mutex);
+    while (1)
+    {
+        // Suppressions alone wake the writer at most once a second.
+        while (!queue_count && !stopping)
+        {
+            if (!suppressed_unlogged)
+            {
+                pthread_cond_wait(&queue_ready, &queue_mutex);
+                continue;
+            }
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += 1;
+            if (pthread_cond_timedwait(&queue_ready, &queue_mutex, &deadline) != 0)
+                break;
+        }
+        if (!queue_count && !suppressed_unlogged && stopping)
+            break;
+
+        // Copy out and write without the lock, so requests never wait on the disk.
+        int count = queue_count;
+        for (int i = 0; i < count; i++)
+            batch[i] = queue[(queue_head + i) % SLOWLOG_QUEUE_SIZE];
+        queue_head = (queue_head + count) % SLOWLOG_QUEUE_SIZE;
+        queue_count = 0;
+        long long newly_suppressed = suppressed_unlogged;
+        suppressed_unlogged = 0;
+        pthread_mutex_unlock(&queue_mutex);
+
+        for (int i = 0; i < count; i++)
+            write_record(&batch[i]);
+        if (newly_suppressed)
+            fprintf(log_file, "{\"ts_us\":%lld,\"suppressed\":%lld}\n", wall_us(), newly_suppressed);
+        fflush(log_file);
+
+        pthread_mutex_lock(&queue_mutex);
+    }
+    pthread_mutex_unlock(&queue_mutex);
+    return NULL;
+}
+
+int slowlog_start(const char *path, long long threshold_us, int records_per_second)
+{
+    if (logging || threshold_us < 0 || records_per_second < 1)
+        return -1;
+
+    log_file = fopen(path, "a");
+    if (!log_file)
+    {
+        perror("Error opening slow-op log");
+        return -1;
+    }
+
+    queue_head = queue_count = 0;
+    suppressed = suppressed_unlogged = 0;
+    rate = records_per_second;
+    tokens = rate;
+    refilled_ns = now_ns();
+    threshold_ns = threshold_us * 1000;
+    stopping = 0;
+
+    if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0)
+    {
+        fclose(log_file);
+        log_file = NULL;
+        return -1;
+    }
+
+    trace_time_phases(1);
+    __atomic_store_n(&logging, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void slowlog_stop(void)
+{
+    if (!logging)
+        return;
+
+    __atomic_store_n(&logging, 0, __ATOMIC_RELEASE);
+    trace_time_phases(0);
+
+    pthread_mutex_lock(&queue_mutex);
+    stopping = 1;
+    pthread_cond_signal(&queue_ready);
+    pthread_mutex_unlock(&queue_mutex);
+    pthread_join(writer_thread, NULL);
+
+    fclose(log_file);
+    log_file = NULL;
+}
+
+long long slowlog_suppressed(void)
+{
+    pthread_mutex_lock(&queue_mutex);
+    long long count = suppressed;
+    pthread_mutex_unlock(&queue_mutex);
+    return count;
+}
+
+void slowlog_catalog(Catalog *catalog)
+{
+    __atomic_store_n(&sized_catalog, catalog, __ATOMIC_RELEASE);
+}
+
+//RECORDING
+// Caller holds queue_mutex.
+static void suppress(void)
+{
+    suppressed++;
+    suppressed_unlogged++;
+}
+
+void slowlog_record(const RequestContext *request, const long long *phase_ns)
+{
+    if (!__atomic_load_n(&logging, __ATOMIC_ACQUIRE) || request->latency_ns < threshold_ns)
+        return;
+
+    // Token bucket first, so a stall that makes every request slow costs each
+    // one a lock round trip and nothing more.
+    pthread_mutex_lock(&queue_mutex);
+    long long now = now_ns();
+    tokens += (now - refilled_ns) / 1e9 * rate;
+    if (tokens > rate)
+        tokens = rate;
+    refilled_ns = now;
+    if (tokens < 1)
+    {
+        suppress();
+        pthread_mutex_unlock(&queue_mutex);
+        return;
+    }
+    tokens -= 1;
+    pthread_mutex_unlock(&queue_mutex);
+
+    SlowRecord record;
+    struct stat st;
+    record.request = *request;
+    record.have_phases = phase_ns != NULL;
+    if (phase_ns)
+        memcpy(record.phase_ns, phase_ns, sizeof(record.phase_ns));
+    else
+        memset(record.phase_ns, 0, sizeof(record.phase_ns));
+    // Sized as this request left the catalog, not when the writer gets to it.
+    Catalog *catalog = __atomic_load_n(&sized_catalog, __ATOMIC_ACQUIRE);
+    if (catalog)
+        record.catalog_bytes = catalog_bytes(catalog);
+    else
+        record.catalog_bytes = stat(CATALOG_DEFAULT_PATH, &st) == 0 ? (long long)st.st_size : 0;
+
+    pthread_mutex_lock(&queue_mutex);
+    if (queue_count == SLOWLOG_QUEUE_SIZE)
+    {
+        suppress();
+    }
+    else
+    {
+        queue[(queue_head + queue_count) % SLOWLOG_QUEUE_SIZE] = record;
+        queue_count++;
+        pthread_cond_signal(&queue_ready);
+    }
+    pthread_mutex_unlock(&queue_mutex);
+}
@@ -0,0 +1,33 @@
+//*******SLOW-OPERATION LOG*******
+#ifndef SLOWLOG_H
+#define SLOWLOG_H
+
+#include "request.h"
+#include "catalog.h"
+
+// Requests slower than the threshold are appended as JSON lines:
+// {"ts_us":...,"session":3,"member_id":2,"op":"rent","book_id":5,"latency_us":48211,"lock_wait_us":47950,
+//  "catalog_bytes":18342,"status":"ok","phases_us":{"mutex_wait":47901,"flock_wait":49,...}}
+// A line {"ts_us":...,"suppressed":N} follows any burst the rate limit cut off.
+#define SLOWLOG_ENV "LIBRARY_SLOWLOG"              // server logs slow requests to this file when set
+#define SLOWLOG_THRESHOLD_ENV "LIBRARY_SLOWLOG_MS" // latency threshold in ms (default 100)
+#define SLOWLOG_RATE_ENV "LIBRARY_SLOWLOG_RATE"    // records per second, with a burst of the same size (default 20)
+#define SLOWLOG_DEFAULT_THRESHOLD_MS 100
+#define SLOWLOG_DEFAULT_RATE 20
+#define SLOWLOG_QUEUE_SIZE 256 // records waiting for the writer before new ones count as suppressed
+
+// Starts the writer thread and turns on per-phase timing for every request.
+// Returns 0, or -1 if the file cannot be opened.
+int slowlog_start(const char *path, long long threshold_us, int records_per_second);
+// Writes out what is queued and closes the file.
+void slowlog_stop(void);
+long long slowlog_suppressed(void);
+// The catalog whose size goes into catalog_bytes; books.txt until set.
+void slowlog_catalog(Catalog *catalog);
+
+// Called by request_end with the phase breakdown from the trace module.
+// Fast requests return after one comparison; slow ones are copied into the
+// queue for the writer thread, never written on the request path.
+void slowlog_record(const RequestContext *request, const long long *phase_ns);
+
+#endif
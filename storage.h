@@ -0,0 +1,49 @@
+//*******STORAGE BACKENDS*******
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include "catalog.h"
+
+#define STORAGE_ENV "LIBRARY_STORAGE"      // text (default), binary or memory
+#define STORAGE_PATH_ENV "LIBRARY_CATALOG" // catalog file (default books.txt, or books.bin for binary)
+#define STORAGE_BINARY_DEFAULT_PATH "books.bin"
+// Member logins stay in a text file whatever the catalog backend; what each
+// member has out is recorded on the catalog rows.
+#define MEMBERS_PATH "members.txt"
+
+// Applied to the row being edited. Anything but CATALOG_OK leaves the store
+// untouched and becomes the result; on CATALOG_OK the row is written back,
+// or removed when *keep is cleared.
+typedef CatalogStatus (*StorageEdit)(Book *book, int *keep, void *context);
+typedef void (*StorageVisit)(const Book *book, void *context);
+
+// How the catalog engine reaches its rows. The engine serialises the calls
+// of one handle; a backend only has to guard against other handles and
+// other processes on the same file.
+struct StorageBackend
+{
+    const char *name;
+    void *(*open)(const char *path); // NULL path picks the backend default
+    void (*close)(void *store);
+    const char *(*location)(void *store); // file name, for metrics labels
+    // Appends a book under the next free ID and stores that ID in book->id.
+    CatalogStatus (*add)(void *store, Book *book);
+    CatalogStatus (*update)(void *store, int book_id, StorageEdit edit, void *context);
+    CatalogStatus (*find)(void *store, int book_id, Book *book);
+    long long (*bytes)(void *store); // cheap, and called without the engine's lock
+    int (*stats)(void *store, CatalogStats *stats); // may scan everything
+    // Every book in ID order; 0 when the catalog could not be read.
+    int (*each)(void *store, StorageVisit visit, void *context);
+};
+
+extern const StorageBackend storage_text;   // "id title author is_rented renter" lines, rewritten through a temp file
+extern const StorageBackend storage_memory; // sorted array, nothing touches the disk
+extern const StorageBackend storage_binary; // fixed-size records, updated in place
+
+// NULL when there is no backend of that name.
+const StorageBackend *storage_backend_named(const char *name);
+
+// Text backend: one past the highest ID in the file, 1 when there is no file.
+int get_next_id(const char *filename);
+
+#endif
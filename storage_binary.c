@@ -0,0 +1,457 @@
+//*******BINARY STORAGE BACKEND*******
+// A header followed by fixed-size records in ID order. A lookup is a binary
+// search of preads, and rent, return, modify and delete rewrite one record
+// in place instead of the whole file. Deleted records stay as tombstones so
+// the order holds; their IDs are never handed out again. A version 1 file,
+// from before records kept their renter, is rewritten as version 2 on open.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "storage.h"
+#include "trace.h"
+
+#define BINARY_MAGIC "LIBB"
+#define BINARY_VERSION 2
+#define BINARY_SCAN_RECORDS 256 // records per read when counting
+
+typedef struct
+{
+    char magic[4];
+    int32_t version;
+    int32_t next_id;
+    int32_t reserved;
+} BinaryHeader;
+
+typedef struct
+{
+    int32_t id;
+    int32_t is_rented;
+    int32_t deleted;
+    char title[CATALOG_FIELD_LENGTH];
+    char author[CATALOG_FIELD_LENGTH];
+    int32_t renter;
+} BinaryRecord;
+
+typedef struct
+{
+    int32_t id;
+    int32_t is_rented;
+    int32_t deleted;
+    char title[CATALOG_FIELD_LENGTH];
+    char author[CATALOG_FIELD_LENGTH];
+} BinaryRecordV1;
+
+typedef struct
+{
+    char *path;
+    int fd; // open for the life of the store; only an upgrade renames the file
+} BinaryStore;
+
+static off_t record_offset(long index)
+{
+    return (off_t)sizeof(BinaryHeader) + (off_t)index * (off_t)sizeof(BinaryRecord);
+}
+
+// Caller holds the file lock.
+static long record_count(BinaryStore *store)
+{
+    struct stat st;
+    if (fstat(store->fd, &st) < 0 || st.st_size < (off_t)sizeof(BinaryHeader))
+        return -1;
+    return (long)((st.st_size - (off_t)sizeof(BinaryHeader)) / (off_t)sizeof(BinaryRecord));
+}
+
+static int lock_file(BinaryStore *store, int operation)
+{
+    long long span = trace_mark();
+    int locked = flock(store->fd, operation);
+    trace_span(TRACE_FLOCK_WAIT, span);
+    if (locked < 0)
+        perror("Error locking file");
+    return locked;
+}
+
+static void unlock_file(BinaryStore *store)
+{
+    flock(store->fd, LOCK_UN);
+}
+
+// Copies a version 1 file into a version 2 one beside it and renames it
+// over the original. The new file is locked before the rename, so the
+// caller's lock carries over to store->fd.
+static int upgrade_v1(BinaryStore *store, BinaryHeader header)
+{
+    struct stat st;
+    BinaryRecordV1 old[BINARY_SCAN_RECORDS];
+    BinaryRecord records[BINARY_SCAN_RECORDS];
+    char temp_path[PATH_MAX];
+
+    if (fstat(store->fd, &st) < 0)
+        return -1;
+    long count = (long)((st.st_size - (off_t)sizeof(BinaryHeader)) / (off_t)sizeof(BinaryRecordV1));
+    snprintf(temp_path, sizeof(temp_path), "%s.upgrade", store->path);
+    int fd = open(temp_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror(temp_path);
+        return -1;
+    }
+
+    int ok = flock(fd, LOCK_EX) == 0;
+    header.version = BINARY_VERSION;
+    ok = ok && pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+    for (long first = 0; ok && first < count; first += BINARY_SCAN_RECORDS)
+    {
+        long batch = count - first < BINARY_SCAN_RECORDS ? count - first : BINARY_SCAN_RECORDS;
+        ssize_t wanted = (ssize_t)(batch * (long)sizeof(BinaryRecordV1));
+        off_t from = (off_t)sizeof(BinaryHeader) + (off_t)first * (off_t)sizeof(BinaryRecordV1);
+        if (pread(store->fd, old, (size_t)wanted, from) != wanted)
+        {
+            ok = 0;
+            break;
+        }
+        memset(records, 0, sizeof(records));
+        for (long i = 0; i < batch; i++)
+        {
+            records[i].id = old[i].id;
+            records[i].is_rented = old[i].is_rented;
+            records[i].deleted = old[i].deleted;
+            memcpy(records[i].title, old[i].title, sizeof(records[i].title));
+            memcpy(records[i].author, old[i].author, sizeof(records[i].author));
+        }
+        ssize_t size = (ssize_t)(batch * (long)sizeof(BinaryRecord));
+        ok = pwrite(fd, records, (size_t)size, record_offset(first)) == size;
+    }
+    ok = ok && fsync(fd) == 0 && rename(temp_path, store->path) == 0;
+    if (!ok)
+    {
+        perror("Error upgrading binary catalog");
+        close(fd);
+        unlink(temp_path);
+        return -1;
+    }
+    close(store->fd);
+    store->fd = fd;
+    return 0;
+}
+
+// Writes the header of a new file, or checks the one already there.
+static int init_header(BinaryStore *store)
+{
+    struct stat st;
+    BinaryHeader header;
+
+    if (fstat(store->fd, &st) < 0)
+        return -1;
+    if (st.st_size == 0)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+        header.version = BINARY_VERSION;
+        header.next_id = 1;
+        return pwrite(store->fd, &header, sizeof(header), 0) == sizeof(header) ? 0 : -1;
+    }
+    if (pread(store->fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, BINARY_MAGIC, sizeof(header.magic)) != 0 ||
+        (header.version != BINARY_VERSION && header.version != 1))
+    {
+        fprintf(stderr, "%s is not a binary catalog\n", store->path);
+        return -1;
+    }
+    return header.version == 1 ? upgrade_v1(store, header) : 0;
+}
+
+// After the lock: 0 when the descriptor is still the file at the path, 1 when
+// another store's upgrade renamed a new file over it.
+static int replaced(BinaryStore *store)
+{
+    struct stat held, named;
+    return fstat(store->fd, &held) == 0 && stat(store->path, &named) == 0 &&
+           (held.st_ino != named.st_ino || held.st_dev != named.st_dev);
+}
+
+static void *binary_open(const char *path)
+{
+    BinaryStore *store = calloc(1, sizeof(BinaryStore));
+    if (!store)
+        return NULL;
+
+    store->path = strdup(path ? path : STORAGE_BINARY_DEFAULT_PATH);
+    store->fd = store->path ? open(store->path, O_RDWR | O_CREAT, 0644) : -1;
+    if (store->fd < 0)
+    {
+        if (store->path)
+            perror(store->path);
+        free(store->path);
+        free(store);
+        return NULL;
+    }
+
+    int ready = lock_file(store, LOCK_EX) == 0;
+    while (ready && replaced(store))
+    {
+        int fd = open(store->path, O_RDWR);
+        ready = fd >= 0;
+        close(store->fd);
+        store->fd = fd;
+        ready = ready && lock_file(store, LOCK_EX) == 0;
+    }
+    ready = ready && init_header(store) == 0;
+    if (store->fd >= 0)
+        unlock_file(store);
+    if (!ready)
+    {
+        if (store->fd >= 0)
+            close(store->fd);
+        free(store->path);
+        free(store);
+        return NULL;
+    }
+    return store;
+}
+
+static void binary_close(void *opaque)
+{
+    BinaryStore *store = opaque;
+    close(store->fd);
+    free(store->path);
+    free(store);
+}
+
+static const char *binary_location(void *opaque)
+{
+    return ((BinaryStore *)opaque)->path;
+}
+
+static int read_record(BinaryStore *store, long index, BinaryRecord *record)
+{
+    return pread(store->fd, record, sizeof(*record), record_offset(index)) == sizeof(*record) ? 0 : -1;
+}
+
+static int write_record(BinaryStore *store, long index, const BinaryRecord *record)
+{
+    long long span = trace_mark();
+    int written = pwrite(store->fd, record, sizeof(*record), record_offset(index)) == sizeof(*record) ? 0 : -1;
+    trace_span(TRACE_FILE_WRITE, span);
+    return written;
+}
+
+// Binary search over the records. Returns the index of book_id (tombstone
+// or not), -1 when it is absent, -2 on a read error. Caller holds the lock.
+static long find_record(BinaryStore *store, int book_id, BinaryRecord *record)
+{
+    long count = record_count(store);
+    if (count < 0)
+        return -2;
+
+    long long span = trace_mark();
+    long low = 0, high = count, found = -1;
+    while (low < high)
+    {
+        long mid = low + (high - low) / 2;
+        if (read_record(store, mid, record) < 0)
+        {
+            found = -2;
+            break;
+        }
+        if (record->id == book_id)
+        {
+            found = mid;
+            break;
+        }
+        if (record->id < book_id)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    trace_span(TRACE_SCAN, span);
+    return found;
+}
+
+static void record_to_book(const BinaryRecord *record, Book *book)
+{
+    book->id = record->id;
+    book->is_rented = record->is_rented;
+    book->renter = record->renter;
+    memcpy(book->title, record->title, sizeof(book->title));
+    memcpy(book->author, record->author, sizeof(book->author));
+    book->title[sizeof(book->title) - 1] = '\0';
+    book->author[sizeof(book->author) - 1] = '\0';
+}
+
+static void book_to_record(const Book *book, BinaryRecord *record)
+{
+    memset(record, 0, sizeof(*record));
+    record->id = book->id;
+    record->is_rented = book->is_rented;
+    record->renter = book->renter;
+    snprintf(record->title, sizeof(record->title), "%s", book->title);
+    snprintf(record->author, sizeof(record->author), "%s", book->author);
+}
+
+//OPERATIONS
+static CatalogStatus binary_add(void *opaque, Book *book)
+{
+    BinaryStore *store = opaque;
+    BinaryHeader header;
+    BinaryRecord record;
+
+    if (lock_file(store, LOCK_EX) < 0)
+        return CATALOG_ERROR;
+
+    CatalogStatus status = CATALOG_ERROR;
+    long count = record_count(store);
+    if (count >= 0 && pread(store->fd, &header, sizeof(header), 0) == sizeof(header))
+    {
+        book->id = header.next_id;
+        book_to_record(book, &record);
+        if (write_record(store, count, &record) == 0)
+        {
+            header.next_id++;
+            if (pwrite(store->fd, &header, sizeof(header), 0) == sizeof(header))
+                status = CATALOG_OK;
+        }
+    }
+
+    unlock_file(store);
+    return status;
+}
+
+static CatalogStatus binary_update(void *opaque, int book_id, StorageEdit edit, void *context)
+{
+    BinaryStore *store = opaque;
+    BinaryRecord record;
+
+    if (lock_file(store, LOCK_EX) < 0)
+        return CATALOG_ERROR;
+
+    long index = find_record(store, book_id, &record);
+    CatalogStatus status = index == -2 ? CATALOG_ERROR : CATALOG_NOT_FOUND;
+    if (index >= 0 && !record.deleted)
+    {
+        Book book;
+        int keep = 1;
+        record_to_book(&record, &book);
+        status = edit(&book, &keep, context);
+        if (status == CATALOG_OK)
+        {
+            book.id = book_id;
+            book_to_record(&book, &record);
+            record.deleted = !keep;
+            if (write_record(store, index, &record) < 0)
+                status = CATALOG_ERROR;
+        }
+    }
+
+    unlock_file(store);
+    return status;
+}
+
+static CatalogStatus binary_find(void *opaque, int book_id, Book *book)
+{
+    BinaryStore *store = opaque;
+    BinaryRecord record;
+
+    if (lock_file(store, LOCK_SH) < 0)
+        return CATALOG_ERROR;
+
+    long index = find_record(store, book_id, &record);
+    CatalogStatus status = index == -2 ? CATALOG_ERROR : CATALOG_NOT_FOUND;
+    if (index >= 0 && !record.deleted)
+    {
+        record_to_book(&record, book);
+        status = CATALOG_OK;
+    }
+
+    unlock_file(store);
+    return status;
+}
+
+//STATISTICS
+static long long binary_bytes(void *opaque)
+{
+    struct stat st;
+    return fstat(((BinaryStore *)opaque)->fd, &st) == 0 ? (long long)st.st_size : 0;
+}
+
+static int binary_stats(void *opaque, CatalogStats *stats)
+{
+    BinaryStore *store = opaque;
+    BinaryRecord records[BINARY_SCAN_RECORDS];
+
+    if (lock_file(store, LOCK_SH) < 0)
+        return 0;
+
+    stats->bytes = binary_bytes(store);
+    long count = record_count(store);
+    for (long first = 0; first < count; first += BINARY_SCAN_RECORDS)
+    {
+        long batch = count - first < BINARY_SCAN_RECORDS ? count - first : BINARY_SCAN_RECORDS;
+        ssize_t wanted = (ssize_t)(batch * (long)sizeof(BinaryRecord));
+        if (pread(store->fd, records, (size_t)wanted, record_offset(first)) != wanted)
+            break;
+        for (long i = 0; i < batch; i++)
+        {
+            if (records[i].deleted)
+                continue;
+            stats->rows++;
+            stats->rented += records[i].is_rented == 1;
+        }
+    }
+
+    unlock_file(store);
+    return count >= 0;
+}
+
+static int binary_each(void *opaque, StorageVisit visit, void *context)
+{
+    BinaryStore *store = opaque;
+    BinaryRecord records[BINARY_SCAN_RECORDS];
+    int complete = 1;
+
+    if (lock_file(store, LOCK_SH) < 0)
+        return 0;
+
+    long count = record_count(store);
+    for (long first = 0; first < count; first += BINARY_SCAN_RECORDS)
+    {
+        long batch = count - first < BINARY_SCAN_RECORDS ? count - first : BINARY_SCAN_RECORDS;
+        ssize_t wanted = (ssize_t)(batch * (long)sizeof(BinaryRecord));
+        if (pread(store->fd, records, (size_t)wanted, record_offset(first)) != wanted)
+        {
+            complete = 0;
+            break;
+        }
+        for (long i = 0; i < batch; i++)
+        {
+            if (records[i].deleted)
+                continue;
+            Book book;
+            record_to_book(&records[i], &book);
+            visit(&book, context);
+        }
+    }
+
+    unlock_file(store);
+    return complete && count >= 0;
+}
+
+const StorageBackend storage_binary = {
+    .name = "binary",
+    .open = binary_open,
+    .close = binary_close,
+    .location = binary_location,
+    .add = binary_add,
+    .update = binary_update,
+    .find = binary_find,
+    .bytes = binary_bytes,
+    .stats = binary_stats,
+    .each = binary_each,
+};
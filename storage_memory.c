@@ -0,0 +1,149 @@
+//*******MEMORY STORAGE BACKEND*******
+// Books in an array sorted by ID; lookups are binary searches and nothing
+// touches the disk. Each open starts empty and everything is gone on close,
+// which is what tests and benchmarks want.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "storage.h"
+#include "trace.h"
+
+#define MEMORY_INITIAL_CAPACITY 64
+
+typedef struct
+{
+    Book *books;
+    size_t count; // read without the engine's lock by memory_bytes
+    size_t capacity;
+} MemoryStore;
+
+static void *memory_open(const char *path)
+{
+    (void)path;
+    return calloc(1, sizeof(MemoryStore));
+}
+
+static void memory_close(void *opaque)
+{
+    MemoryStore *store = opaque;
+    free(store->books);
+    free(store);
+}
+
+static const char *memory_location(void *opaque)
+{
+    (void)opaque;
+    return "memory";
+}
+
+// Index of book_id, or -1.
+static long find_index(const MemoryStore *store, int book_id)
+{
+    size_t low = 0, high = store->count;
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (store->books[mid].id < book_id)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low < store->count && store->books[low].id == book_id ? (long)low : -1;
+}
+
+// IDs follow the highest one, as with the text file, so the array stays sorted.
+static CatalogStatus memory_add(void *opaque, Book *book)
+{
+    MemoryStore *store = opaque;
+    if (store->count == store->capacity)
+    {
+        size_t capacity = store->capacity ? store->capacity * 2 : MEMORY_INITIAL_CAPACITY;
+        Book *books = realloc(store->books, capacity * sizeof(Book));
+        if (!books)
+            return CATALOG_ERROR;
+        store->books = books;
+        store->capacity = capacity;
+    }
+
+    book->id = store->count ? store->books[store->count - 1].id + 1 : 1;
+    store->books[store->count] = *book;
+    __atomic_store_n(&store->count, store->count + 1, __ATOMIC_RELEASE);
+    return CATALOG_OK;
+}
+
+static CatalogStatus memory_update(void *opaque, int book_id, StorageEdit edit, void *context)
+{
+    MemoryStore *store = opaque;
+    long long span = trace_mark();
+    long index = find_index(store, book_id);
+    trace_span(TRACE_SCAN, span);
+    if (index < 0)
+        return CATALOG_NOT_FOUND;
+
+    // Edited on a copy, so a refused edit leaves the row as it was.
+    Book book = store->books[index];
+    int keep = 1;
+    CatalogStatus status = edit(&book, &keep, context);
+    if (status != CATALOG_OK)
+        return status;
+
+    if (keep)
+    {
+        store->books[index] = book;
+    }
+    else
+    {
+        memmove(&store->books[index], &store->books[index + 1], (store->count - (size_t)index - 1) * sizeof(Book));
+        __atomic_store_n(&store->count, store->count - 1, __ATOMIC_RELEASE);
+    }
+    return CATALOG_OK;
+}
+
+static CatalogStatus memory_find(void *opaque, int book_id, Book *book)
+{
+    MemoryStore *store = opaque;
+    long long span = trace_mark();
+    long index = find_index(store, book_id);
+    trace_span(TRACE_SCAN, span);
+    if (index < 0)
+        return CATALOG_NOT_FOUND;
+    *book = store->books[index];
+    return CATALOG_OK;
+}
+
+static long long memory_bytes(void *opaque)
+{
+    MemoryStore *store = opaque;
+    return (long long)(__atomic_load_n(&store->count, __ATOMIC_ACQUIRE) * sizeof(Book));
+}
+
+static int memory_stats(void *opaque, CatalogStats *stats)
+{
+    MemoryStore *store = opaque;
+    stats->bytes = (long long)(store->count * sizeof(Book));
+    stats->rows = (long long)store->count;
+    for (size_t i = 0; i < store->count; i++)
+        stats->rented += store->books[i].is_rented == 1;
+    return 1;
+}
+
+static int memory_each(void *opaque, StorageVisit visit, void *context)
+{
+    MemoryStore *store = opaque;
+    for (size_t i = 0; i < store->count; i++)
+        visit(&store->books[i], context);
+    return 1;
+}
+
+const StorageBackend storage_memory = {
+    .name = "memory",
+    .open = memory_open,
+    .close = memory_close,
+    .location = memory_location,
+    .add = memory_add,
+    .update = memory_update,
+    .find = memory_find,
+    .bytes = memory_bytes,
+    .stats = memory_stats,
+    .each = memory_each,
+};
@@ -0,0 +1,374 @@
+//*******TEXT STORAGE BACKEND*******
+// The original format: one "id title author is_rented renter" line per book;
+// lines written before renters were kept end at is_rented.
+// Appends go to the end; every other change rewrites the whole file into a
+// temp file that is synced and renamed over it.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "storage.h"
+#include "trace.h"
+
+#define LINE_SIZE 1024
+
+typedef struct
+{
+    char *path;
+    char *temp_path; // rewrites go here and are renamed over path
+} TextStore;
+
+// books.txt rewrites through books_temp.txt, anything else through <path>.tmp.
+static char *temp_path_for(const char *path)
+{
+    char *temp = NULL;
+    size_t length = strlen(path);
+    if (length > 4 && strcmp(path + length - 4, ".txt") == 0)
+    {
+        if (asprintf(&temp, "%.*s_temp.txt", (int)(length - 4), path) < 0)
+            return NULL;
+    }
+    else if (asprintf(&temp, "%s.tmp", path) < 0)
+        return NULL;
+    return temp;
+}
+
+static void *text_open(const char *path)
+{
+    TextStore *store = calloc(1, sizeof(TextStore));
+    if (!store)
+        return NULL;
+
+    store->path = strdup(path ? path : CATALOG_DEFAULT_PATH);
+    store->temp_path = store->path ? temp_path_for(store->path) : NULL;
+    if (!store->temp_path)
+    {
+        free(store->path);
+        free(store);
+        return NULL;
+    }
+    return store;
+}
+
+static void text_close(void *opaque)
+{
+    TextStore *store = opaque;
+    free(store->path);
+    free(store->temp_path);
+    free(store);
+}
+
+static const char *text_location(void *opaque)
+{
+    return ((TextStore *)opaque)->path;
+}
+
+// A rename is on disk only once the directory holding the name is synced.
+static int sync_directory_of(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    char *dir = slash ? strndup(path, slash == path ? 1 : (size_t)(slash - path)) : strdup(".");
+    if (!dir)
+        return -1;
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    free(dir);
+    if (fd < 0)
+        return -1;
+    int result = fsync(fd);
+    close(fd);
+    return result;
+}
+
+int get_next_id(const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file)
+        return 1;
+
+    int id = 0;
+    char buffer[LINE_SIZE];
+
+    while (fgets(buffer, LINE_SIZE, file))
+    {
+        int current_id;
+        sscanf(buffer, "%d", &current_id);
+        if (current_id > id)
+        {
+            id = current_id;
+        }
+    }
+
+    fclose(file);
+    return id + 1;
+}
+
+//LOCKING
+// Opens the file and flocks it. Returns the descriptor, or -1 with errno
+// telling a missing file apart from a real failure (0).
+// A rewrite renames a new file over the path while others wait for the lock
+// on the old one (another handle, or another process); they open it again.
+static int lock_file(TextStore *store, int flags, int operation)
+{
+    for (;;)
+    {
+        int fd = open(store->path, flags, 0644);
+        if (fd < 0)
+        {
+            if (errno != ENOENT)
+                perror("Error opening file");
+            return -1;
+        }
+
+        long long span = trace_mark();
+        int locked = flock(fd, operation);
+        trace_span(TRACE_FLOCK_WAIT, span);
+        if (locked < 0)
+        {
+            perror("Error locking file");
+            close(fd);
+            errno = 0;
+            return -1;
+        }
+
+        struct stat held, current;
+        if (fstat(fd, &held) == 0 && stat(store->path, &current) == 0 &&
+            (held.st_ino != current.st_ino || held.st_dev != current.st_dev))
+        {
+            close(fd);
+            continue;
+        }
+        return fd;
+    }
+}
+
+// 0 for a line that is not a book.
+static int parse_line(const char *line, Book *book)
+{
+    book->renter = 0;
+    return sscanf(line, "%d %49s %49s %d %d", &book->id, book->title, book->author, &book->is_rented,
+                  &book->renter) >= 4;
+}
+
+static CatalogStatus open_failed(void)
+{
+    return errno == ENOENT ? CATALOG_NOT_FOUND : CATALOG_ERROR;
+}
+
+//ADD BOOK
+static CatalogStatus text_add(void *opaque, Book *book)
+{
+    TextStore *store = opaque;
+
+    // INTEGRATION TARGET: O_WRONLY | O_APPEND | O_CREAT, 0644
+    int fd = lock_file(store, O_WRONLY | O_APPEND | O_CREAT, LOCK_EX);
+
+    if (fd < 0)
+        return CATALOG_ERROR;
+
+    long long span = trace_mark();
+    book->id = get_next_id(store->path);
+    trace_span(TRACE_SCAN, span);
+
+    span = trace_mark();
+    int written = dprintf(fd, "%d %s %s %d %d\n", book->id, book->title, book->author, book->is_rented, book->renter);
+    trace_span(TRACE_FILE_WRITE, span);
+
+    flock(fd, LOCK_UN);
+    close(fd);
+    return written < 0 ? CATALOG_ERROR : CATALOG_OK;
+}
+
+//REWRITES
+// Copies the catalog into the temp file with the edit applied to book_id,
+// then renames it into place while the file lock is still held. The file
+// is left untouched unless the edit succeeded.
+static CatalogStatus text_update(void *opaque, int book_id, StorageEdit edit, void *context)
+{
+    TextStore *store = opaque;
+    int fd = lock_file(store, O_RDWR, LOCK_EX);
+    if (fd < 0)
+        return open_failed();
+
+    FILE *file = fdopen(fd, "r");
+    FILE *temp_file = file ? fopen(store->temp_path, "w") : NULL;
+    if (!temp_file)
+    {
+        perror(file ? "Error creating temporary file" : "Error opening file stream");
+        if (file)
+            fclose(file);
+        else
+            close(fd);
+        return CATALOG_ERROR;
+    }
+
+    CatalogStatus status = CATALOG_NOT_FOUND;
+    char buffer[LINE_SIZE];
+    long long span = trace_mark();
+    while (fgets(buffer, LINE_SIZE, file))
+    {
+        Book book;
+        // NOTE: parse_line reads at most 49 characters of title and author
+        if (!parse_line(buffer, &book))
+        {
+            // A line that is not a book goes through as it was.
+            fputs(buffer, temp_file);
+            continue;
+        }
+
+        if (book.id == book_id && status == CATALOG_NOT_FOUND)
+        {
+            int keep = 1;
+            status = edit(&book, &keep, context);
+            if (!keep)
+                continue;
+        }
+
+        fprintf(temp_file, "%d %s %s %d %d\n", book.id, book.title, book.author, book.is_rented, book.renter);
+    }
+    trace_span(TRACE_SCAN, span);
+
+    span = trace_mark();
+    int write_failed = fflush(temp_file) != 0 || ferror(temp_file);
+    // The new rows reach the disk before the rename that makes them the catalog.
+    if (!write_failed && status == CATALOG_OK)
+        write_failed = fsync(fileno(temp_file)) < 0;
+    write_failed |= fclose(temp_file) != 0;
+    trace_span(TRACE_FILE_WRITE, span);
+    if (write_failed && status == CATALOG_OK)
+        status = CATALOG_ERROR;
+
+    if (status == CATALOG_OK)
+    {
+        span = trace_mark();
+        if (rename(store->temp_path, store->path) < 0)
+        {
+            perror("Error replacing catalog");
+            status = CATALOG_ERROR;
+        }
+        // The edit already shows; only a crash now could still undo it.
+        else if (sync_directory_of(store->path) < 0)
+            perror("Error syncing catalog directory");
+        trace_span(TRACE_RENAME, span);
+    }
+    if (status != CATALOG_OK)
+    {
+        // Nothing changed, or the change cannot be kept: drop the temporary file
+        remove(store->temp_path);
+    }
+
+    // Closing the stream closes fd, which drops the flock.
+    fclose(file);
+    return status;
+}
+
+//SEARCH BOOK
+static CatalogStatus text_find(void *opaque, int book_id, Book *result)
+{
+    TextStore *store = opaque;
+    int fd = lock_file(store, O_RDONLY, LOCK_SH);
+    if (fd < 0)
+        return open_failed();
+
+    FILE *file = fdopen(fd, "r");
+    if (!file)
+    {
+        perror("Error opening file stream");
+        close(fd);
+        return CATALOG_ERROR;
+    }
+
+    CatalogStatus status = CATALOG_NOT_FOUND;
+    char buffer[LINE_SIZE];
+    long long span = trace_mark();
+    while (fgets(buffer, LINE_SIZE, file))
+    {
+        Book book;
+        if (!parse_line(buffer, &book))
+            continue;
+
+        if (book.id == book_id)
+        {
+            *result = book;
+            status = CATALOG_OK;
+            break;
+        }
+    }
+    trace_span(TRACE_SCAN, span);
+
+    fclose(file);
+    return status;
+}
+
+//STATISTICS
+static long long text_bytes(void *opaque)
+{
+    struct stat st;
+    return stat(((TextStore *)opaque)->path, &st) == 0 ? (long long)st.st_size : 0;
+}
+
+// Rented counts lines whose is_rented is 1.
+static int text_stats(void *opaque, CatalogStats *stats)
+{
+    TextStore *store = opaque;
+    struct stat st;
+    char line[LINE_SIZE];
+
+    FILE *file = fopen(store->path, "r");
+    if (!file)
+        return 0;
+    if (fstat(fileno(file), &st) == 0)
+        stats->bytes = st.st_size;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        Book book;
+        stats->rows++;
+        if (parse_line(line, &book) && book.is_rented == 1)
+            stats->rented++;
+    }
+    fclose(file);
+    return 1;
+}
+
+// No file yet is an empty catalog.
+static int text_each(void *opaque, StorageVisit visit, void *context)
+{
+    TextStore *store = opaque;
+    int fd = lock_file(store, O_RDONLY, LOCK_SH);
+    if (fd < 0)
+        return errno == ENOENT;
+
+    FILE *file = fdopen(fd, "r");
+    if (!file)
+    {
+        close(fd);
+        return 0;
+    }
+    char line[LINE_SIZE];
+    while (fgets(line, sizeof(line), file))
+    {
+        Book book;
+        if (parse_line(line, &book))
+            visit(&book, context);
+    }
+    fclose(file);
+    return 1;
+}
+
+const StorageBackend storage_text = {
+    .name = "text",
+    .open = text_open,
+    .close = text_close,
+    .location = text_location,
+    .add = text_add,
+    .update = text_update,
+    .find = text_find,
+    .bytes = text_bytes,
+    .stats = text_stats,
+    .each = text_each,
+};
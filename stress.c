@@ -0,0 +1,648 @@
+//*******CONCURRENCY STRESS*******
+// Rounds of concurrent catalog operations, each followed by a check of the
+// catalog against what the callers were told:
+//   - every add got an ID no other book holds, and reads back as added
+//   - a deleted book is gone (text and memory catalogs hand its ID out
+//     again when it was the highest, so only its title is checked)
+//   - each shared book is rented exactly when the rents that succeeded
+//     outnumber the returns that succeeded, and never twice over
+//   - the row and rental counts agree with all of the above
+// A missing lock shows up as two adds with one ID, a rewrite that loses
+// another thread's change, or a book rented twice.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "stress.h"
+#include "storage.h"
+#include "client_proto.h"
+#include "admission.h"
+
+#define STRESS_TITLE_LENGTH 32
+#define STRESS_AUTHOR "stress"
+// A request the server refused busy was not served, so it is sent again,
+// after 1, 2, 4 ... 64ms, this many times before it counts as an error.
+#define STRESS_BUSY_RETRIES 200
+
+typedef enum
+{
+    STRESS_RENT,
+    STRESS_RETURN,
+    STRESS_DELETE
+} StressEdit;
+
+// Where one thread's operations go: a catalog handle, or an admin and a
+// user session on the server.
+typedef struct
+{
+    Catalog *catalog;
+    int admin;
+    int user;
+    long long busy; // requests the server refused busy and that were sent again
+} StressClient;
+
+typedef struct
+{
+    int id;
+    int live;
+    char title[STRESS_TITLE_LENGTH];
+} OwnBook;
+
+typedef struct StressRun StressRun;
+
+typedef struct
+{
+    int index;
+    pthread_t tid;
+    StressRun *run;
+    StressClient client;
+    unsigned int seed; // this round's
+    OwnBook *own;      // the books this thread added this round
+    int own_count;
+    long long rented[STRESS_MAX_SHARED]; // rents minus returns that succeeded, this round
+    long long operations;
+    long long refused;
+    char violation[STRESS_MESSAGE_LENGTH];
+} StressThread;
+
+struct StressRun
+{
+    const StressConfig *config;
+    int round;
+    int stop;
+    pthread_mutex_t gate; // held while the threads are created
+    pthread_barrier_t start;
+    pthread_barrier_t end;
+    int shared_ids[STRESS_MAX_SHARED];
+    long long expected[STRESS_MAX_SHARED]; // is_rented each shared book should have
+    StressThread threads[STRESS_MAX_THREADS];
+};
+
+void stress_defaults(StressConfig *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->threads = 8;
+    config->rounds = 50;
+    config->ops = 200;
+    config->shared = 4;
+    config->spin = 2048;
+    config->seed = 1;
+    config->backend = &storage_text;
+    config->handles = 1;
+    config->yield = 1;
+    config->port = PORT;
+    config->admin = "admin:admin";
+    config->user = "user:user:1";
+}
+
+static void violation(char *message, const char *format, ...)
+{
+    va_list args;
+    if (message[0])
+        return;
+    va_start(args, format);
+    vsnprintf(message, STRESS_MESSAGE_LENGTH, format, args);
+    va_end(args);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//CLIENTS
+static int connect_session(const StressConfig *config, int role)
+{
+    char login[128], reply[BUFFER_SIZE];
+    int conn = proto_connect(config->host, config->port, config->unix_path, 0);
+    if (conn < 0)
+        return -1;
+
+    snprintf(login, sizeof(login), "%s", role == ROLE_ADMIN ? config->admin : config->user);
+    char *password = strchr(login, ':');
+    char *member = password ? strchr(password + 1, ':') : NULL;
+    if (password)
+        *password++ = '\0';
+    if (member)
+        *member++ = '\0';
+
+    int granted = 0;
+    if (password && role == ROLE_ADMIN)
+        granted = proto_login_admin(conn, login, password, NULL, reply);
+    else if (password && member)
+        granted = proto_login_user(conn, login, password, atoi(member), NULL, reply);
+    if (granted != role)
+    {
+        proto_close(conn);
+        return -1;
+    }
+    return conn;
+}
+
+// Admission control (max_pending, or a session's rate limit) answers busy
+// without touching the catalog. 1 when reply is such an answer and another
+// attempt is due; it waits out the backoff first.
+static int retry_busy(StressClient *client, const char *reply, int attempt)
+{
+    if (strncmp(reply, SERVER_BUSY_REPLY, strlen(SERVER_BUSY_REPLY)) != 0 || attempt >= STRESS_BUSY_RETRIES)
+        return 0;
+    struct timespec pause = {0, (1L << (attempt < 6 ? attempt : 6)) * 1000000L};
+    nanosleep(&pause, NULL);
+    client->busy++;
+    return 1;
+}
+
+static CatalogStatus client_add(StressClient *client, const char *title, int *book_id)
+{
+    char reply[BUFFER_SIZE];
+    if (client->catalog)
+        return catalog_add(client->catalog, title, STRESS_AUTHOR, book_id);
+    for (int attempt = 0;; attempt++)
+    {
+        if (proto_add(client->admin, title, STRESS_AUTHOR, reply) < 0)
+            return CATALOG_ERROR;
+        if (!retry_busy(client, reply, attempt))
+            break;
+    }
+    return sscanf(reply, "Book added with ID: %d", book_id) == 1 ? CATALOG_OK : CATALOG_ERROR;
+}
+
+static CatalogStatus client_edit(StressClient *client, StressEdit edit, int book_id)
+{
+    char reply[BUFFER_SIZE];
+    if (client->catalog)
+    {
+        if (edit == STRESS_RENT)
+            return catalog_rent(client->catalog, book_id);
+        if (edit == STRESS_RETURN)
+            return catalog_return(client->catalog, book_id);
+        return catalog_delete(client->catalog, book_id);
+    }
+
+    for (int attempt = 0;; attempt++)
+    {
+        int sent = edit == STRESS_RENT     ? proto_rent(client->user, book_id, reply)
+                   : edit == STRESS_RETURN ? proto_return(client->user, book_id, reply)
+                                           : proto_delete(client->admin, book_id, reply);
+        if (sent < 0)
+            return CATALOG_ERROR;
+        if (!retry_busy(client, reply, attempt))
+            break;
+    }
+    if (strncmp(reply, SERVER_BUSY_REPLY, strlen(SERVER_BUSY_REPLY)) == 0)
+        return CATALOG_ERROR;
+    if (!proto_reply_failed(reply))
+        return CATALOG_OK;
+    return edit == STRESS_DELETE ? CATALOG_NOT_FOUND : CATALOG_UNAVAILABLE;
+}
+
+static CatalogStatus client_search(StressClient *client, int book_id, Book *book)
+{
+    char reply[BUFFER_SIZE];
+    if (client->catalog)
+        return catalog_search(client->catalog, book_id, book);
+    for (int attempt = 0;; attempt++)
+    {
+        if (proto_search(client->admin, ROLE_ADMIN, book_id, reply) < 0)
+            return CATALOG_ERROR;
+        if (!retry_busy(client, reply, attempt))
+            break;
+    }
+    if (sscanf(reply, "ID: %d, Title: %49[^,], Author: %49[^,], Rented: %d", &book->id, book->title, book->author,
+               &book->is_rented) == 4)
+        return CATALOG_OK;
+    return strstr(reply, "not found") ? CATALOG_NOT_FOUND : CATALOG_ERROR;
+}
+
+static void close_client(StressClient *client)
+{
+    if (client->admin >= 0)
+        proto_close(client->admin);
+    if (client->user >= 0)
+        proto_close(client->user);
+    client->admin = client->user = -1;
+}
+
+//SCHEDULE
+// The backend a catalog sees when config->yield is set: the chosen one, but
+// every edit gives up the CPU after deciding and before the row is written
+// back. Threads on one core otherwise finish a read-modify-write within a
+// time slice and seldom meet inside one; with the yield, whatever lock should
+// keep them apart is the only thing that does.
+typedef struct
+{
+    const StorageBackend *inner;
+    void *store;
+} YieldStore;
+
+typedef struct
+{
+    StorageEdit edit;
+    void *context;
+} YieldEdit;
+
+static const StorageBackend *yield_inner; // for yield_open; runs never overlap
+
+static void *yield_open(const char *path)
+{
+    YieldStore *store = calloc(1, sizeof(YieldStore));
+    if (!store)
+        return NULL;
+    store->inner = yield_inner;
+    store->store = store->inner->open(path);
+    if (!store->store)
+    {
+        free(store);
+        return NULL;
+    }
+    return store;
+}
+
+static void yield_close(void *opaque)
+{
+    YieldStore *store = opaque;
+    store->inner->close(store->store);
+    free(store);
+}
+
+static const char *yield_location(void *opaque)
+{
+    YieldStore *store = opaque;
+    return store->inner->location(store->store);
+}
+
+static CatalogStatus yield_add(void *opaque, Book *book)
+{
+    YieldStore *store = opaque;
+    return store->inner->add(store->store, book);
+}
+
+static CatalogStatus yield_edit(Book *book, int *keep, void *context)
+{
+    YieldEdit *request = context;
+    CatalogStatus status = request->edit(book, keep, request->context);
+    sched_yield();
+    return status;
+}
+
+static CatalogStatus yield_update(void *opaque, int book_id, StorageEdit edit, void *context)
+{
+    YieldStore *store = opaque;
+    YieldEdit request = {edit, context};
+    return store->inner->update(store->store, book_id, yield_edit, &request);
+}
+
+static CatalogStatus yield_find(void *opaque, int book_id, Book *book)
+{
+    YieldStore *store = opaque;
+    return store->inner->find(store->store, book_id, book);
+}
+
+static long long yield_bytes(void *opaque)
+{
+    YieldStore *store = opaque;
+    return store->inner->bytes(store->store);
+}
+
+static int yield_stats(void *opaque, CatalogStats *stats)
+{
+    YieldStore *store = opaque;
+    return store->inner->stats(store->store, stats);
+}
+
+static int yield_each(void *opaque, StorageVisit visit, void *context)
+{
+    YieldStore *store = opaque;
+    return store->inner->each(store->store, visit, context);
+}
+
+static const StorageBackend storage_yield = {
+    .name = "yield",
+    .open = yield_open,
+    .close = yield_close,
+    .location = yield_location,
+    .add = yield_add,
+    .update = yield_update,
+    .find = yield_find,
+    .bytes = yield_bytes,
+    .stats = yield_stats,
+    .each = yield_each,
+};
+
+//ROUNDS
+// Every draw from the seed happens whatever the outcome of the operations
+// before it, so the same seed always gives the same schedule.
+static void run_round(StressThread *thread)
+{
+    const StressConfig *config = thread->run->config;
+    const int *shared_ids = thread->run->shared_ids;
+    unsigned int seed = thread->seed;
+
+    thread->own_count = 0;
+    memset(thread->rented, 0, sizeof(thread->rented));
+    for (int i = 0; i < config->ops && !thread->violation[0]; i++)
+    {
+        int pause = rand_r(&seed);
+        int roll = rand_r(&seed) % 100;
+        int shared = rand_r(&seed) % config->shared;
+        int pick = rand_r(&seed);
+        OwnBook *own = thread->own_count ? &thread->own[pick % thread->own_count] : NULL;
+
+        // A random pause shifts the interleaving from one round to the
+        // next; none at all packs the operations closest together.
+        if (config->spin && pause % 8 == 0)
+            sched_yield();
+        else if (config->spin)
+            for (volatile int s = 0; s < pause % config->spin; s++)
+                ;
+
+        thread->operations++;
+        CatalogStatus status;
+        if (roll < 30 || !own)
+        {
+            OwnBook *book = &thread->own[thread->own_count];
+            snprintf(book->title, sizeof(book->title), "t%dr%dn%d", thread->index, thread->run->round, i);
+            status = client_add(&thread->client, book->title, &book->id);
+            if (status != CATALOG_OK)
+                violation(thread->violation, "add of %s returned %d", book->title, status);
+            book->live = 1;
+            thread->own_count++;
+        }
+        else if (roll < 80)
+        {
+            StressEdit edit = roll < 55 ? STRESS_RENT : STRESS_RETURN;
+            status = client_edit(&thread->client, edit, shared_ids[shared]);
+            if (status == CATALOG_OK)
+                thread->rented[shared] += edit == STRESS_RENT ? 1 : -1;
+            else if (status == CATALOG_UNAVAILABLE)
+                thread->refused++;
+            else
+                violation(thread->violation, "%s of shared book %d returned %d",
+                          edit == STRESS_RENT ? "rent" : "return", shared_ids[shared], status);
+        }
+        else if (roll < 90 && own->live)
+        {
+            status = client_edit(&thread->client, STRESS_DELETE, own->id);
+            if (status != CATALOG_OK)
+                violation(thread->violation, "delete of book %d, added by this thread, returned %d", own->id,
+                          status);
+            own->live = 0;
+        }
+        else
+        {
+            Book book;
+            status = client_search(&thread->client, own->id, &book);
+            if (own->live && (status != CATALOG_OK || strcmp(book.title, own->title) != 0))
+                violation(thread->violation, "book %d added as %s reads back as %s", own->id, own->title,
+                          status == CATALOG_OK ? book.title : "missing");
+            else if (!own->live && status == CATALOG_OK && strcmp(book.title, own->title) == 0)
+                violation(thread->violation, "book %d is still there after its delete", own->id);
+        }
+    }
+}
+
+static void *stress_thread(void *arg)
+{
+    StressThread *thread = arg;
+    StressRun *run = thread->run;
+
+    pthread_mutex_lock(&run->gate);
+    pthread_mutex_unlock(&run->gate);
+    for (;;)
+    {
+        pthread_barrier_wait(&run->start);
+        if (run->stop)
+            break;
+        run_round(thread);
+        pthread_barrier_wait(&run->end);
+    }
+    return NULL;
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+// Single-threaded, with the workers parked at the barrier. The books the
+// round added are deleted again so the catalog stays the same size.
+static void check_round(StressRun *run, StressClient *client, const CatalogStats *before, char *message)
+{
+    const StressConfig *config = run->config;
+    int *ids = malloc(sizeof(int) * ((size_t)config->threads * config->ops + config->shared));
+    long long live = 0, rented = 0;
+    int count = 0;
+
+    for (int i = 0; i < config->shared; i++)
+        ids[count++] = run->shared_ids[i];
+    for (int t = 0; t < config->threads; t++)
+    {
+        StressThread *thread = &run->threads[t];
+        if (thread->violation[0])
+            violation(message, "thread %d: %s", t, thread->violation);
+        for (int i = 0; i < thread->own_count; i++)
+        {
+            OwnBook *own = &thread->own[i];
+            Book book;
+            CatalogStatus status = client_search(client, own->id, &book);
+            if (own->live)
+                ids[count++] = own->id;
+            live += own->live;
+            if (own->live && (status != CATALOG_OK || strcmp(book.title, own->title) != 0))
+                violation(message, "book %d added as %s reads back as %s", own->id, own->title,
+                          status == CATALOG_OK ? book.title : "missing");
+            else if (!own->live && status == CATALOG_OK && strcmp(book.title, own->title) == 0)
+                violation(message, "book %d is still there after its delete", own->id);
+        }
+    }
+
+    qsort(ids, (size_t)count, sizeof(int), compare_ids);
+    for (int i = 1; i < count; i++)
+    {
+        if (ids[i] == ids[i - 1])
+            violation(message, "ID %d was handed out twice", ids[i]);
+    }
+    free(ids);
+
+    for (int i = 0; i < config->shared; i++)
+    {
+        for (int t = 0; t < config->threads; t++)
+            run->expected[i] += run->threads[t].rented[i];
+        Book book;
+        CatalogStatus status = client_search(client, run->shared_ids[i], &book);
+        if (run->expected[i] != 0 && run->expected[i] != 1)
+            violation(message, "shared book %d: the rents and returns that succeeded leave it rented %lld times",
+                      run->shared_ids[i], run->expected[i]);
+        else if (status != CATALOG_OK || book.is_rented != run->expected[i])
+            violation(message, "shared book %d reads is_rented %d, but the rents and returns that succeeded say %lld",
+                      run->shared_ids[i], status == CATALOG_OK ? book.is_rented : -1, run->expected[i]);
+        rented += run->expected[i] == 1;
+    }
+
+    CatalogStats stats = {0, 0, 0};
+    if (client->catalog && !message[0] && catalog_stats(client->catalog, &stats) &&
+        (stats.rows != before->rows + live || stats.rented != before->rented + rented))
+        violation(message, "catalog holds %lld rows with %lld rented, expected %lld with %lld", stats.rows,
+                  stats.rented, before->rows + live, before->rented + rented);
+
+    for (int t = 0; t < config->threads && !message[0]; t++)
+    {
+        for (int i = 0; i < run->threads[t].own_count; i++)
+        {
+            OwnBook *own = &run->threads[t].own[i];
+            if (own->live && client_edit(client, STRESS_DELETE, own->id) != CATALOG_OK)
+                violation(message, "cleanup delete of book %d failed", own->id);
+        }
+    }
+}
+
+//RUN
+static int set_up(StressRun *run, Catalog **handles)
+{
+    const StressConfig *config = run->config;
+    if (config->host || config->unix_path)
+    {
+        for (int t = 0; t < config->threads; t++)
+        {
+            StressClient *client = &run->threads[t].client;
+            client->admin = connect_session(config, ROLE_ADMIN);
+            client->user = connect_session(config, ROLE_USER);
+            if (client->admin < 0 || client->user < 0)
+            {
+                fprintf(stderr, "stress: could not log in to the server\n");
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    yield_inner = config->backend;
+    for (int h = 0; h < config->handles; h++)
+    {
+        handles[h] = catalog_open_backend(config->yield ? &storage_yield : config->backend, config->path);
+        if (!handles[h])
+            return -1;
+    }
+    for (int t = 0; t < config->threads; t++)
+        run->threads[t].client.catalog = handles[t % config->handles];
+    return 0;
+}
+
+int stress_run(const StressConfig *config, StressReport *report)
+{
+    memset(report, 0, sizeof(*report));
+    if (config->threads < 1 || config->threads > STRESS_MAX_THREADS || config->shared < 1 ||
+        config->shared > STRESS_MAX_SHARED || config->ops < 1 || config->handles < 1 ||
+        config->handles > config->threads)
+    {
+        fprintf(stderr, "stress: 1-%d threads, 1-%d shared books, 1 or more ops and 1 to threads handles\n",
+                STRESS_MAX_THREADS, STRESS_MAX_SHARED);
+        return -1;
+    }
+    if (config->backend == &storage_memory && config->handles > 1)
+    {
+        fprintf(stderr, "stress: memory catalogs cannot be shared between handles\n");
+        return -1;
+    }
+
+    StressRun *run = calloc(1, sizeof(StressRun));
+    Catalog **handles = calloc((size_t)config->handles, sizeof(Catalog *));
+    if (!run || !handles)
+    {
+        free(run);
+        free(handles);
+        return -1;
+    }
+    run->config = config;
+    for (int t = 0; t < config->threads; t++)
+    {
+        run->threads[t].index = t;
+        run->threads[t].run = run;
+        run->threads[t].client.admin = run->threads[t].client.user = -1;
+        run->threads[t].own = calloc((size_t)config->ops, sizeof(OwnBook));
+    }
+
+    int result = set_up(run, handles);
+    StressClient *client = &run->threads[0].client;
+    int shared = 0;
+    for (; result == 0 && shared < config->shared; shared++)
+    {
+        char title[STRESS_TITLE_LENGTH];
+        snprintf(title, sizeof(title), "shared%d", shared);
+        if (client_add(client, title, &run->shared_ids[shared]) != CATALOG_OK)
+            result = -1;
+    }
+    CatalogStats before = {0, 0, 0};
+    if (result == 0 && client->catalog && !catalog_stats(client->catalog, &before))
+        result = -1;
+
+    // The threads wait at the gate until the barriers know how many came up.
+    int created = 0;
+    pthread_mutex_init(&run->gate, NULL);
+    pthread_mutex_lock(&run->gate);
+    for (; result == 0 && created < config->threads; created++)
+    {
+        if (pthread_create(&run->threads[created].tid, NULL, stress_thread, &run->threads[created]) != 0)
+            break;
+    }
+    pthread_barrier_init(&run->start, NULL, (unsigned)created + 1);
+    pthread_barrier_init(&run->end, NULL, (unsigned)created + 1);
+    pthread_mutex_unlock(&run->gate);
+    if (result == 0 && created < config->threads)
+    {
+        fprintf(stderr, "stress: could not start %d threads\n", config->threads);
+        result = -1;
+    }
+
+    double started = now_seconds();
+    for (int round = 0; result == 0 && round < config->rounds; round++)
+    {
+        unsigned int round_seed = config->seed + (unsigned int)round * 2654435761u;
+        run->round = round;
+        for (int t = 0; t < config->threads; t++)
+            run->threads[t].seed = round_seed ^ ((unsigned int)t + 1) * 0x9E3779B9u;
+
+        pthread_barrier_wait(&run->start);
+        pthread_barrier_wait(&run->end);
+        check_round(run, client, &before, report->violation);
+        if (report->violation[0])
+        {
+            report->round_seed = round_seed;
+            result = 1;
+            break;
+        }
+        report->rounds++;
+    }
+    report->seconds = now_seconds() - started;
+
+    run->stop = 1;
+    if (created > 0)
+        pthread_barrier_wait(&run->start);
+    for (int t = 0; t < created; t++)
+        pthread_join(run->threads[t].tid, NULL);
+    pthread_barrier_destroy(&run->start);
+    pthread_barrier_destroy(&run->end);
+    pthread_mutex_destroy(&run->gate);
+
+    for (int i = 0; i < shared && result == 0; i++)
+        client_edit(client, STRESS_DELETE, run->shared_ids[i]);
+    for (int t = 0; t < config->threads; t++)
+    {
+        report->operations += run->threads[t].operations;
+        report->refused += run->threads[t].refused;
+        report->busy += run->threads[t].client.busy;
+        close_client(&run->threads[t].client);
+        free(run->threads[t].own);
+    }
+    for (int h = 0; h < config->handles; h++)
+        catalog_close(handles[h]);
+    free(handles);
+    free(run);
+    return result;
+}
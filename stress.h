@@ -0,0 +1,56 @@
+//*******CONCURRENCY STRESS*******
+#ifndef STRESS_H
+#define STRESS_H
+
+#include "catalog.h"
+
+#define STRESS_MAX_THREADS 64
+#define STRESS_MAX_SHARED 64
+#define STRESS_MESSAGE_LENGTH 256
+
+// Threads released together by a barrier run a random mix of add, rent,
+// return, delete and search each round; between rounds the catalog is
+// checked against what the threads were told. Every random choice comes
+// from the seed, so a failing round replays with the same schedule.
+typedef struct
+{
+    int threads;
+    int rounds;
+    int ops;          // per thread per round
+    int shared;       // books every thread rents and returns
+    int spin;         // most busy-wait iterations before an operation; 0 for none
+    unsigned int seed;
+    // In process: handles catalogs on one backend and path, shared by the
+    // threads in turn. With more than one, the file lock alone keeps them
+    // apart, as it does for separate server processes.
+    const StorageBackend *backend;
+    const char *path;
+    int handles;
+    int yield; // give up the CPU between reading a row and writing it back
+    // Or a live server, when host or unix_path is set.
+    const char *host;
+    int port;
+    const char *unix_path;
+    const char *admin; // name:password
+    const char *user;  // name:password:member
+} StressConfig;
+
+typedef struct
+{
+    long long operations;
+    long long refused; // rents and returns another thread got to first
+    long long busy;    // requests the server refused busy, sent again
+    int rounds;        // rounds that passed
+    double seconds;
+    // Empty when every invariant held. Otherwise what broke, in the round
+    // that --seed round_seed --rounds 1 runs again.
+    unsigned int round_seed;
+    char violation[STRESS_MESSAGE_LENGTH];
+} StressReport;
+
+void stress_defaults(StressConfig *config);
+// 0 when every round kept the invariants, 1 on a violation, -1 when the
+// catalogs or connections could not be set up.
+int stress_run(const StressConfig *config, StressReport *report);
+
+#endif
@@ -0,0 +1,109 @@
+//*******CONCURRENCY STRESS ENTRY POINT*******
+// Runs stress.c against an in-process catalog or a running server.
+//   ./stress -t 8 -r 200                     text catalog in a scratch file
+//   ./stress -S memory -t 16 -r 500          the engine mutex alone
+//   ./stress -H 8 -t 8                       one handle per thread: the file lock alone
+//   ./stress -U library.sock -t 8            a live server
+//   ./stress -s 12345 -r 1                   replay the round a failure names
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "stress.h"
+#include "storage.h"
+#include "client_proto.h"
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -t n           threads (8)\n"
+            "  -r n           rounds (50)\n"
+            "  -n n           operations per thread per round (200)\n"
+            "  -b n           shared books the threads rent and return (4)\n"
+            "  -w n           most busy-wait iterations before an operation; 0 for none (2048)\n"
+            "  -s seed        random seed (1)\n"
+            "  -S backend     text, binary or memory (text)\n"
+            "  -f path        catalog file (a scratch file, removed afterwards)\n"
+            "  -H n           catalog handles shared by the threads (1)\n"
+            "  -y 0|1         yield between reading a row and writing it back (1)\n"
+            "  -h host        drive the server at host instead\n"
+            "  -p port        server port (%d)\n"
+            "  -U path        drive the server on its Unix socket instead\n"
+            "  -a name:pass   admin login (admin:admin)\n"
+            "  -u name:pass:member  user login (user:user:1)\n",
+            program, PORT);
+}
+
+int main(int argc, char *argv[])
+{
+    StressConfig config;
+    StressReport report;
+    char scratch[] = "/tmp/stress.XXXXXX";
+    char path[sizeof(scratch) + 16];
+    int opt;
+
+    stress_defaults(&config);
+    while ((opt = getopt(argc, argv, "t:r:n:b:w:s:S:f:H:y:h:p:U:a:u:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': config.threads = atoi(optarg); break;
+        case 'r': config.rounds = atoi(optarg); break;
+        case 'n': config.ops = atoi(optarg); break;
+        case 'b': config.shared = atoi(optarg); break;
+        case 'w': config.spin = atoi(optarg); break;
+        case 's': config.seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+        case 'f': config.path = optarg; break;
+        case 'H': config.handles = atoi(optarg); break;
+        case 'y': config.yield = atoi(optarg); break;
+        case 'h': config.host = optarg; break;
+        case 'p': config.port = atoi(optarg); break;
+        case 'U': config.unix_path = optarg; break;
+        case 'a': config.admin = optarg; break;
+        case 'u': config.user = optarg; break;
+        case 'S':
+            config.backend = storage_backend_named(optarg);
+            if (!config.backend)
+            {
+                fprintf(stderr, "Unknown backend %s\n", optarg);
+                return 2;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    int scratch_dir = !config.path && !config.host && !config.unix_path;
+    if (scratch_dir)
+    {
+        if (!mkdtemp(scratch))
+        {
+            perror("mkdtemp");
+            return 1;
+        }
+        snprintf(path, sizeof(path), "%s/books", scratch);
+        config.path = path;
+    }
+
+    int result = stress_run(&config, &report);
+    printf("%d rounds, %lld operations in %.2fs (%.0f/s), %lld rents and returns refused, %lld busy replies retried\n",
+           report.rounds, report.operations, report.seconds,
+           report.seconds > 0 ? report.operations / report.seconds : 0.0, report.refused, report.busy);
+    if (result == 1)
+        printf("VIOLATION in round %d: %s\nreplay with the same options and -s %u -r 1\n", report.rounds,
+               report.violation, report.round_seed);
+
+    if (scratch_dir)
+    {
+        char temp[sizeof(path) + 16];
+        snprintf(temp, sizeof(temp), "%s.tmp", path);
+        unlink(path);
+        unlink(temp);
+        rmdir(scratch);
+    }
+    return result == 0 ? 0 : 1;
+}
@@ -1,21 +1,51 @@
 // test_server.c
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <CUnit/Basic.h>
 #include <unistd.h> // For unlink()
 #include <pthread.h>
+#include <sys/socket.h>
+#include "credentials.h"
+#include "client_pool.h"
+#include "capture.h"
+#include "metrics.h"
+#include "trace.h"
+#include "slowlog.h"
+#include "idle.h"
+#include "admission.h"
+#include "catalog.h"
+#include "storage.h"
+#include <poll.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "config.h"
+#include "mutant.h"
+#include "stress.h"
+#include "result_cache.h"
+#include "lease.h"
+#include "transport.h"
+#include <sys/mman.h>
 
 extern void add_book(int client_socket);
 extern void delete_book(int client_socket);
-extern int get_next_id(const char *filename); 
-extern void delete_book_wrapper(int book_id); 
-extern void rent_book_wrapper(int book_id); 
-extern void return_book_wrapper(int book_id); 
 extern int check_admin_credentials_test(const char *username, const char *password);
-extern void modify_book_wrapper(int book_id, const char *new_title, const char *new_author);
-extern void add_book_wrapper(const char *title, const char *author); 
 extern pthread_mutex_t file_mutex;
+extern void *handle_unix_client(void *client_socket);
+extern int create_unix_listener(const char *path);
+
+// The same engine the socket handlers run, driven directly on ./books.txt.
+static Catalog *books(void) {
+    static Catalog *catalog = NULL;
+    if (!catalog)
+        catalog = catalog_open("books.txt");
+    return catalog;
+}
 
 // Setup: Run before each test
 int init_suite(void) {
@@ -93,17 +123,14 @@ void test_delete_nonexistent_book(void) {
         fclose(f);
     }
     
-    // NOTE: delete_book requires reading from a socket to get the ID. 
-    // The simplest way to proceed is to create a wrapper function 
-    // in the server code that takes the ID as an argument. 
-    
-    // Assuming delete_book is modified to take book_id: 
-    // delete_book_wrapper(999); 
-    
-    // Since we cannot run delete_book without modification, let's 
-    // focus on the simplest testable part: the comparison logic. 
-    
-    CU_ASSERT_TRUE(1 == 1); // Placeholder for actual test logic.
+    // The catalog engine takes the ID directly, so no socket is needed.
+    CU_ASSERT_EQUAL(catalog_delete(books(), 999), CATALOG_NOT_FOUND);
+
+    FILE *read_f = fopen("books.txt", "r");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(read_f);
+    char buffer[1024];
+    CU_ASSERT_PTR_NOT_NULL(fgets(buffer, 1024, read_f));
+    fclose(read_f);
 }
 
 
@@ -127,7 +154,7 @@ void test_delete_book_logic(void) {
     }
     
     // 2. Action: Delete book ID 2
-    delete_book_wrapper(2); 
+    catalog_delete(books(), 2); 
 
     // 3. Verification: Only book ID 1 should remain.
     // The VRR mutant (e.g., deleting 'books.txt' when ID is not found) 
@@ -165,7 +192,7 @@ void test_kill_vrr_mutant(void) {
     // 2. Action: Try to delete a NON-EXISTENT book (ID 999)
     // In the ORIGINAL code, this removes books_temp.txt, leaving books.txt intact.
     // In the MUTANT code, this removes the main file: books.txt.
-    delete_book_wrapper(999); 
+    catalog_delete(books(), 999); 
 
     // 3. Verification: Check that the books.txt file STILL EXISTS and is intact.
     FILE *read_f = fopen("books.txt", "r");
@@ -183,7 +210,7 @@ void test_kill_vrr_mutant(void) {
 }
 
 
-// Test Case 5: Kill the COR mutant (&& -> ||) in rent_book
+// Test Case 5: Kill the COR mutant (== 0 -> != 0) in catalog_rent
 void test_kill_cor_mutant(void) {
     unlink("books.txt");
     // 1. Setup: Add one UNRENTED book (ID 1)
@@ -195,9 +222,8 @@ void test_kill_cor_mutant(void) {
     }
     
     // 2. Action: Try to rent a NON-EXISTENT book (ID 99)
-    // Original Code (using &&): Fails to find book 99. Books.txt remains unchanged.
-    // Mutant Code (using ||): Finds book 1 is UNRENTED (is_rented==0 is TRUE), executes rent logic!
-    rent_book_wrapper(99); 
+    // Original Code: Fails to find book 99. Books.txt remains unchanged.
+    catalog_rent(books(), 99); 
 
     // 3. Verification: Check that Book 1's status is UNCHANGED (0).
     FILE *read_f = fopen("books.txt", "r");
@@ -217,7 +243,7 @@ void test_kill_cor_mutant(void) {
 
 
 
-// Test Case 6: Kill the ROR mutant (== 1 -> != 1) in return_book
+// Test Case 6: Kill the ROR mutant (== 1 -> != 1) in catalog_return
 void test_kill_ror_mutant(void) {
     unlink("books.txt");
     // 1. Setup: Add one book (ID 3) that is UNRENTED (status 0).
@@ -230,7 +256,7 @@ void test_kill_ror_mutant(void) {
     // 2. Action: Try to return the UNRENTED book (ID 3).
     // Original Code: Fails (found=0). Status remains 0.
     // Mutant Code (using != 1): Succeeds because status 0 satisfies != 1. Status changes to 0, but logic executes.
-    return_book_wrapper(3); 
+    CU_ASSERT_EQUAL(catalog_return(books(), 3), CATALOG_UNAVAILABLE); 
 
     // 3. Verification: Check the final status is 0 and that the file was not changed unnecessarily.
     // We check the file size/checksum, or simply re-read the status.
@@ -256,7 +282,7 @@ void test_kill_ror_mutant(void) {
 
     // Let's use a simpler, effective test: Rent, then return twice.
     
-    // ROR KILL RE-REFINED: Rent ID 3, then run return_book_wrapper(3) with mutant.
+    // ROR KILL RE-REFINED: Rent ID 3, then run catalog_return(3) with mutant.
     // We must test the case where we attempt to "un-return" an unrented book.
     
     // For this target, the assertion is simple: the book should not be returned again. 
@@ -291,13 +317,13 @@ void test_kill_sdl_mutant(void) {
     unlink("books.txt"); 
     
     // 1. Setup: Create Book ID 1 (Status 0).
-    add_book_wrapper("TestTitle", "TestAuthor"); 
+    catalog_add(books(), "TestTitle", "TestAuthor", NULL); 
 
     // 2. Action A (Rent): Flip Book ID 1's status to 1.
-    rent_book_wrapper(1); // <-- Corrected ID to 1
+    catalog_rent(books(), 1); // <-- Corrected ID to 1
     
     // 3. Action B (Modify): Change title of Book ID 1, preserving status 1.
-    modify_book_wrapper(1, "NewTitle", "NewAuthor"); // <-- Corrected ID to 1
+    catalog_modify(books(), 1, "NewTitle", "NewAuthor"); // <-- Corrected ID to 1
 
     // 4. Verification: Check the final status of Book ID 1. It MUST be 1.
     FILE *read_f = fopen("books.txt", "r");
@@ -332,9 +358,9 @@ void test_integration_invalid_data(void) {
         fclose(f);
     }
     
-    // 2. Action: Call delete_book_wrapper(3). 
-    // The wrapper must iterate through the corrupted line 2 without crashing the test runner.
-    delete_book_wrapper(3); 
+    // 2. Action: Call catalog_delete(3). 
+    // The engine must iterate through the corrupted line 2 without crashing the test runner.
+    catalog_delete(books(), 3); 
 
     // 3. Verification: Check that the system is stable and the expected number of records remain.
     // Original file had 3 lines. After deleting ID 3, 2 lines should remain (ID 1 and corrupted ID 2).
@@ -362,9 +388,9 @@ void test_integration_file_permissions(void) {
     const char *test_title = "PermissionTest";
     const char *test_author = "SystemAuthor";
     
-    // 2. Action: Call the function that creates the file (add_book_wrapper).
+    // 2. Action: Call the function that creates the file (catalog_add).
     // This tests the O_CREAT and 0644 permission integration.
-    add_book_wrapper(test_title, test_author); 
+    catalog_add(books(), test_title, test_author, NULL); 
 
     // 3. Verification: Check if the file was successfully created AND is readable 
     // by the application (confirming the OS permissions grant read access).
@@ -387,11 +413,1291 @@ void test_integration_file_permissions(void) {
 
 
 
+// Test Case 9: Credential store falls back to the built-in accounts and rejects bad passwords
+void test_credentials_default_accounts(void) {
+    unlink("credentials_test.txt");
+    CU_ASSERT_EQUAL(credentials_load("credentials_test.txt"), 2);
+
+    CU_ASSERT_EQUAL(credentials_check(ROLE_ADMIN, "admin", "admin"), 1);
+    CU_ASSERT_EQUAL(credentials_check(ROLE_USER, "user", "user"), 1);
+    CU_ASSERT_EQUAL(credentials_check(ROLE_ADMIN, "admin", "wrong"), 0);
+    // Accounts are per role: the user account cannot log in as admin.
+    CU_ASSERT_EQUAL(credentials_check(ROLE_ADMIN, "user", "user"), 0);
+    CU_ASSERT_EQUAL(credentials_check(ROLE_USER, "nobody", "user"), 0);
+
+    // Over-long passwords are refused, not compared by their first 128 bytes.
+    char long_password[PASSWORD_MAX_LENGTH + 2];
+    char line[512];
+    memset(long_password, 'x', sizeof(long_password) - 1);
+    long_password[sizeof(long_password) - 1] = '\0';
+    CU_ASSERT_FALSE(credentials_format_entry(ROLE_USER, "long", long_password, line, sizeof(line)));
+    long_password[PASSWORD_MAX_LENGTH] = '\0';
+    CU_ASSERT_TRUE(credentials_format_entry(ROLE_USER, "long", long_password, line, sizeof(line)));
+    CU_ASSERT_EQUAL(credentials_check(ROLE_USER, "user", long_password), 0);
+}
+
+// Test Case 10: Salted entries written by credgen load from file; sessions resume by token
+void test_credentials_file_and_sessions(void) {
+    char line[256];
+    FILE *f = fopen("credentials_test.txt", "w");
+    CU_ASSERT_PTR_NOT_NULL(f);
+    CU_ASSERT_TRUE(credentials_format_entry(ROLE_USER, "alice", "secret", line, sizeof(line)));
+    fputs(line, f);
+    CU_ASSERT_TRUE(credentials_format_entry(ROLE_ADMIN, "root", "toor", line, sizeof(line)));
+    fputs(line, f);
+    fclose(f);
+
+    CU_ASSERT_EQUAL(credentials_load("credentials_test.txt"), 2);
+    CU_ASSERT_EQUAL(credentials_check(ROLE_USER, "alice", "secret"), 1);
+    CU_ASSERT_EQUAL(credentials_check(ROLE_ADMIN, "root", "toor"), 1);
+    CU_ASSERT_EQUAL(credentials_check(ROLE_ADMIN, "admin", "admin"), 0);
+    unlink("credentials_test.txt");
+
+    char token[SESSION_TOKEN_LENGTH + 1];
+    int role = 0, member_id = 0;
+    CU_ASSERT_TRUE(session_issue(ROLE_USER, 42, token));
+    CU_ASSERT_TRUE(session_resume(token, &role, &member_id));
+    CU_ASSERT_EQUAL(role, ROLE_USER);
+    CU_ASSERT_EQUAL(member_id, 42);
+
+    session_revoke(token);
+    CU_ASSERT_FALSE(session_resume(token, &role, &member_id));
+    CU_ASSERT_FALSE(session_resume("not-a-token", &role, &member_id));
+}
+
+// Test Case 11 helpers: a minimal in-process server on a Unix socket
+static void *accept_loop(void *listener)
+{
+    while (1) {
+        int conn = accept(*(int *)listener, NULL, NULL);
+        if (conn < 0)
+            return NULL;
+        int *client = malloc(sizeof(int));
+        *client = conn;
+        pthread_t tid;
+        pthread_create(&tid, NULL, handle_unix_client, client);
+        pthread_detach(tid);
+    }
+}
+
+// Every test that talks to the server over the wire starts it this way,
+// with the built-in accounts, so each one also passes when run alone.
+typedef struct {
+    const char *path;
+    int listener;
+    pthread_t acceptor;
+} TestServer;
+
+static void start_test_server(TestServer *server, const char *path) {
+    unlink("credentials_test.txt");
+    credentials_load("credentials_test.txt");
+    server->path = path;
+    server->listener = create_unix_listener(path);
+    CU_ASSERT_FATAL(server->listener >= 0);
+    pthread_create(&server->acceptor, NULL, accept_loop, &server->listener);
+}
+
+static void stop_test_server(TestServer *server) {
+    shutdown(server->listener, SHUT_RDWR);
+    pthread_join(server->acceptor, NULL);
+    close(server->listener);
+    unlink(server->path);
+}
+
+static void count_completion(int status, const char *reply, void *counter) {
+    if (status > 0 && strstr(reply, "PoolTitle"))
+        __atomic_add_fetch((int *)counter, 1, __ATOMIC_RELAXED);
+}
+
+// Test Case 11: Pooled admin sessions serve sync, future and callback requests
+void test_integration_client_pool(void) {
+    char reply[BUFFER_SIZE];
+    TestServer server;
+    int completed = 0;
+
+    start_test_server(&server, "test_pool.sock");
+
+    PoolConfig config = {0};
+    config.unix_path = "test_pool.sock";
+    config.connections = 2;
+    config.role = ROLE_ADMIN;
+    config.username = "admin";
+    config.password = "admin";
+    ClientPool *pool = pool_create(&config);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pool);
+
+    int book_id = 0;
+    CU_ASSERT(pool_call(pool, OP_ADD, 0, "PoolTitle", "PoolAuthor", reply) > 0);
+    CU_ASSERT_EQUAL(sscanf(reply, "Book added with ID: %d", &book_id), 1);
+
+    PoolFuture *futures[16];
+    for (int i = 0; i < 16; i++)
+        futures[i] = pool_request(pool, OP_SEARCH, book_id, NULL, NULL);
+    for (int i = 0; i < 16; i++) {
+        CU_ASSERT_PTR_NOT_NULL_FATAL(futures[i]);
+        CU_ASSERT_TRUE(pool_future_wait(futures[i], 5000));
+        CU_ASSERT(pool_future_status(futures[i]) > 0);
+        CU_ASSERT_PTR_NOT_NULL(strstr(pool_future_reply(futures[i]), "Title: PoolTitle"));
+        pool_future_free(futures[i]);
+    }
+
+    for (int i = 0; i < 16; i++)
+        CU_ASSERT_EQUAL(pool_submit(pool, OP_SEARCH, book_id, NULL, NULL, count_completion, &completed), 0);
+    // Admin sessions cannot rent; the pool refuses instead of sending.
+    CU_ASSERT_PTR_NULL(pool_request(pool, OP_RENT, 1, NULL, NULL));
+
+    pool_destroy(pool); // drains the queue first
+    CU_ASSERT_EQUAL(completed, 16);
+
+    // User pools end their sessions with an exit on destroy too.
+    config.role = ROLE_USER;
+    config.username = "user";
+    config.password = "user";
+    config.member_id = 6;
+    pool = pool_create(&config);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pool);
+    CU_ASSERT(pool_call(pool, OP_SEARCH, book_id, NULL, NULL, reply) > 0);
+    CU_ASSERT_PTR_NOT_NULL(strstr(reply, "Title: PoolTitle"));
+    pool_destroy(pool);
+
+    // A password the pool could only send cut short is refused up front.
+    char long_password[PASSWORD_MAX_LENGTH + 2];
+    memset(long_password, 'p', sizeof(long_password) - 1);
+    long_password[sizeof(long_password) - 1] = '\0';
+    config.password = long_password;
+    CU_ASSERT_PTR_NULL(pool_create(&config));
+
+    // A member that cannot be recorded gets a failed login, not a hang.
+    unlink("members.txt");
+    CU_ASSERT_EQUAL_FATAL(mkdir("members.txt", 0755), 0);
+    int user = proto_connect(NULL, 0, "test_pool.sock", 0);
+    CU_ASSERT_FATAL(user >= 0);
+    CU_ASSERT_EQUAL(proto_login_user(user, "user", "user", 6, NULL, reply), 0);
+    CU_ASSERT_PTR_NOT_NULL(strstr(reply, "Authentication failed! Member '6' could not be recorded"));
+    proto_close(user);
+    rmdir("members.txt");
+
+    stop_test_server(&server);
+}
+
+
+
+// Test Case 12 helper: records searches until told to stop, across capture stops and starts
+static void *hammer_capture(void *running) {
+    RequestContext request = {0};
+    request.role = ROLE_USER;
+    request.op = REQUEST_SEARCH;
+    while (__atomic_load_n((int *)running, __ATOMIC_ACQUIRE))
+        capture_record(&request);
+    return NULL;
+}
+
+// Test Case 12: Captured requests reach the trace file as JSON lines once capture stops
+void test_capture_trace_records(void) {
+    char line[1024];
+    unlink("capture_test.jsonl");
+    CU_ASSERT_EQUAL_FATAL(capture_start("capture_test.jsonl"), 0);
+
+    request_begin(7, ROLE_ADMIN, 1);
+    request_args(3, "Dune", "Herbert \"Frank\"");
+    request_reply("Book added with ID: 3");
+    request_end();
+
+    request_begin(7, ROLE_USER, 1);
+    request_args(9, NULL, NULL);
+    request_reply("Book with ID 9 not found or already rented");
+    request_end();
+
+    // Exits are not requests and stay out of the trace.
+    request_begin(7, ROLE_ADMIN, 5);
+    request_end();
+    capture_stop();
+
+    FILE *f = fopen("capture_test.jsonl", "r");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+    CU_ASSERT_PTR_NOT_NULL(fgets(line, sizeof(line), f));
+    CU_ASSERT_PTR_NOT_NULL(strstr(line, "\"session\":7,\"role\":2,\"op\":\"add\",\"book_id\":3"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(line, "\"author\":\"Herbert \\\"Frank\\\"\""));
+    CU_ASSERT_PTR_NOT_NULL(strstr(line, "\"status\":\"ok\""));
+    CU_ASSERT_PTR_NOT_NULL(fgets(line, sizeof(line), f));
+    CU_ASSERT_PTR_NOT_NULL(strstr(line, "\"op\":\"rent\",\"book_id\":9"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(line, "\"status\":\"fail\""));
+    CU_ASSERT_PTR_NULL(fgets(line, sizeof(line), f));
+    fclose(f);
+    unlink("capture_test.jsonl");
+
+    // Stopping and restarting under producers loses no ring they still use.
+    pthread_t hammers[4];
+    int running = 1;
+    for (int t = 0; t < 4; t++)
+        pthread_create(&hammers[t], NULL, hammer_capture, &running);
+    for (int round = 0; round < 5; round++) {
+        CU_ASSERT_EQUAL(capture_start("capture_test.jsonl"), 0);
+        poll(NULL, 0, 10);
+        capture_stop();
+    }
+    __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+    for (int t = 0; t < 4; t++)
+        pthread_join(hammers[t], NULL);
+    f = fopen("capture_test.jsonl", "r");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+    int records = 0;
+    while (fgets(line, sizeof(line), f) && strstr(line, "\"op\":\"search\""))
+        records++;
+    CU_ASSERT(records > 0);
+    CU_ASSERT(feof(f));
+    fclose(f);
+    unlink("capture_test.jsonl");
+}
+
+
+
+// Test Case 13 helper: value of one sample line in the rendered metrics, or -1
+static long long metric_value(const char *text, const char *sample) {
+    const char *line = strstr(text, sample);
+    return line ? atoll(line + strlen(sample)) : -1;
+}
+
+// Test Case 13: Recorded requests show up in the Prometheus counters and histogram
+void test_metrics_render(void) {
+    char *before = metrics_render(NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(before);
+    long long deletes = metric_value(before, "library_requests_total{op=\"delete\"} ");
+    long long errors = metric_value(before, "library_request_errors_total{op=\"delete\"} ");
+    long long slow = metric_value(before, "library_request_duration_seconds_bucket{op=\"delete\",le=\"+Inf\"} ");
+    CU_ASSERT(deletes >= 0 && errors >= 0 && slow >= 0);
+    free(before);
+
+    request_begin(1, ROLE_ADMIN, 2);
+    request_reply("Book deleted successfully");
+    request_end();
+    request_begin(1, ROLE_ADMIN, 2);
+    request_reply("Book not found");
+    request_end();
+
+    size_t length = 0;
+    char *after = metrics_render(&length);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(after);
+    CU_ASSERT_EQUAL(length, strlen(after));
+    CU_ASSERT_EQUAL(metric_value(after, "library_requests_total{op=\"delete\"} "), deletes + 2);
+    CU_ASSERT_EQUAL(metric_value(after, "library_request_errors_total{op=\"delete\"} "), errors + 1);
+    CU_ASSERT_EQUAL(metric_value(after, "library_request_duration_seconds_bucket{op=\"delete\",le=\"+Inf\"} "), slow + 2);
+    CU_ASSERT_PTR_NOT_NULL(strstr(after, "# TYPE library_request_duration_seconds histogram"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(after, "library_storage_rows{file=\"books.txt\"} "));
+    free(after);
+}
+
+
+
+// Test Case 14: A sampled request and its phases land in a closed Chrome trace document
+void test_trace_spans(void) {
+    char text[4096];
+    unlink("trace_test.json");
+    CU_ASSERT_EQUAL_FATAL(trace_start("trace_test.json", 1.0), 0);
+
+    // Outside a request nothing is sampled.
+    CU_ASSERT_EQUAL(trace_mark(), 0);
+
+    request_begin(5, ROLE_USER, 1);
+    long long span = trace_mark();
+    CU_ASSERT(span > 0);
+    trace_span(TRACE_MUTEX_WAIT, span);
+    trace_span(TRACE_RENAME, trace_mark());
+    request_args(4, NULL, NULL);
+    request_reply("Book with ID 4 has been rented");
+    request_end();
+    trace_stop();
+
+    FILE *f = fopen("trace_test.json", "r");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+    size_t n = fread(text, 1, sizeof(text) - 1, f);
+    text[n] = '\0';
+    fclose(f);
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, "\"traceEvents\":["));
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, "{\"name\":\"rent\",\"cat\":\"request\",\"ph\":\"X\""));
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, "{\"name\":\"mutex_wait\",\"cat\":\"phase\""));
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, "{\"name\":\"rename\",\"cat\":\"phase\""));
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, "\"tid\":5"));
+    CU_ASSERT(n >= 4 && strcmp(text + n - 4, "\n]}\n") == 0);
+    unlink("trace_test.json");
+}
+
+
+
+// Test Case 15: Slow requests are logged with their phases until the rate limit cuts in
+void test_slowlog_rate_limit(void) {
+    char line[1024];
+    unlink("slow_test.jsonl");
+    CU_ASSERT_EQUAL_FATAL(slowlog_start("slow_test.jsonl", 0, 2), 0);
+
+    for (int i = 0; i < 4; i++) {
+        request_begin(9, ROLE_USER, 1);
+        request_member(42);
+        request_args(i, NULL, NULL);
+        trace_span(TRACE_MUTEX_WAIT, trace_mark());
+        request_reply("Book not found");
+        request_end();
+    }
+    slowlog_stop();
+    CU_ASSERT_EQUAL(slowlog_suppressed(), 2);
+
+    FILE *f = fopen("slow_test.jsonl", "r");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+    for (int i = 0; i < 2; i++) {
+        CU_ASSERT_PTR_NOT_NULL(fgets(line, sizeof(line), f));
+        CU_ASSERT_PTR_NOT_NULL(strstr(line, "\"session\":9,\"member_id\":42,\"op\":\"rent\""));
+        CU_ASSERT_PTR_NOT_NULL(strstr(line, "\"lock_wait_us\":"));
+        CU_ASSERT_PTR_NOT_NULL(strstr(line, "\"phases_us\":{\"mutex_wait\":"));
+        CU_ASSERT_PTR_NOT_NULL(strstr(line, "\"status\":\"fail\""));
+    }
+    CU_ASSERT_PTR_NOT_NULL(fgets(line, sizeof(line), f));
+    CU_ASSERT_PTR_NOT_NULL(strstr(line, "\"suppressed\":2}"));
+    CU_ASSERT_PTR_NULL(fgets(line, sizeof(line), f));
+    fclose(f);
+    unlink("slow_test.jsonl");
+}
+
+
+
+// Test Case 16: An idle or stalled session is shut down by the reaper and its thread exits
+void test_idle_session_reaped(void) {
+    char reply[BUFFER_SIZE];
+    TestServer server;
+
+    CU_ASSERT_EQUAL_FATAL(idle_start(1), 0);
+    long long reaped_before = idle_reaped();
+    start_test_server(&server, "test_idle.sock");
+
+    int conn = proto_connect(NULL, 0, "test_idle.sock", 0);
+    CU_ASSERT_FATAL(conn >= 0);
+    CU_ASSERT_EQUAL(proto_login_admin(conn, "admin", "admin", NULL, reply), ROLE_ADMIN);
+    CU_ASSERT(proto_search(conn, ROLE_ADMIN, 1, reply) > 0);
+
+    // Within two ticks of the timeout the server hangs up on us.
+    struct pollfd pfd = {conn, POLLIN, 0};
+    CU_ASSERT_EQUAL(poll(&pfd, 1, 5000), 1);
+    CU_ASSERT_EQUAL(read(conn, reply, sizeof(reply)), 0);
+    CU_ASSERT_EQUAL(idle_reaped(), reaped_before + 1);
+    proto_close(conn);
+
+    // A Unix client that never sends its first bytes is counted and reaped too.
+    int silent = proto_connect(NULL, 0, "test_idle.sock", 0);
+    CU_ASSERT_FATAL(silent >= 0);
+    poll(NULL, 0, 200);
+    size_t length;
+    char *text = metrics_render(&length);
+    CU_ASSERT(text && strstr(text, "\nlibrary_connections_active 1\n"));
+    free(text);
+    pfd.fd = silent;
+    CU_ASSERT_EQUAL(poll(&pfd, 1, 5000), 1);
+    CU_ASSERT_EQUAL(read(silent, reply, sizeof(reply)), 0);
+    CU_ASSERT_EQUAL(idle_reaped(), reaped_before + 2);
+    proto_close(silent);
+
+    // So is one that sends the start of a request and stalls.
+    int stalled = proto_connect(NULL, 0, "test_idle.sock", 0);
+    CU_ASSERT_FATAL(stalled >= 0);
+    CU_ASSERT_EQUAL(proto_login_admin(stalled, "admin", "admin", NULL, reply), ROLE_ADMIN);
+    int header[2] = {ROLE_ADMIN, 4};
+    CU_ASSERT_EQUAL(write(stalled, header, sizeof(header)), (ssize_t)sizeof(header));
+    pfd.fd = stalled;
+    CU_ASSERT_EQUAL(poll(&pfd, 1, 5000), 1);
+    CU_ASSERT_EQUAL(read(stalled, reply, sizeof(reply)), 0);
+    CU_ASSERT_EQUAL(idle_reaped(), reaped_before + 3);
+    proto_close(stalled);
+
+    idle_stop();
+    stop_test_server(&server);
+}
+
+
+
+// Session threads of earlier tests may still be winding down, and one that
+// ends while a connection is queued takes it over.
+static void wait_for_sessions_to_end(void) {
+    for (int i = 0; i < 500; i++) {
+        size_t length;
+        char *text = metrics_render(&length);
+        int idle = text && strstr(text, "\nlibrary_connections_active 0\n") != NULL;
+        free(text);
+        if (idle)
+            break;
+        poll(NULL, 0, 10);
+    }
+    poll(NULL, 0, 50);
+}
+
+// Test Case 17: Sessions over the limit queue then get refused; a rate-limited
+// session gets busy replies and stays in sync
+void test_admission_control(void) {
+    char reply[BUFFER_SIZE];
+    int pairs[3][2];
+    int fd, from_unix;
+    TestServer server;
+
+    wait_for_sessions_to_end();
+
+    AdmissionConfig sessions = {1, 1, 0, 0, 0, 0};
+    admission_configure(&sessions);
+    for (int i = 0; i < 3; i++)
+        CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[i]), 0);
+    CU_ASSERT_EQUAL(admission_accept(pairs[0][0], 0), ADMIT_RUN);
+    CU_ASSERT_EQUAL(admission_accept(pairs[1][0], 1), ADMIT_QUEUED);
+    CU_ASSERT_EQUAL(admission_accept(pairs[2][0], 0), ADMIT_REJECTED);
+    ssize_t n = read(pairs[2][1], reply, sizeof(reply) - 1);
+    CU_ASSERT(n > 0);
+    reply[n > 0 ? n : 0] = '\0';
+    CU_ASSERT_STRING_EQUAL(reply, SERVER_BUSY_REPLY);
+    // The finishing session hands its slot to the waiting connection, then frees it.
+    CU_ASSERT_EQUAL(admission_next(&fd, &from_unix), 1);
+    CU_ASSERT_EQUAL(fd, pairs[1][0]);
+    CU_ASSERT_EQUAL(from_unix, 1);
+    CU_ASSERT_EQUAL(admission_next(&fd, &from_unix), 0);
+    CU_ASSERT_EQUAL(admission_accept(pairs[2][1], 0), ADMIT_RUN);
+    CU_ASSERT_EQUAL(admission_next(&fd, &from_unix), 0);
+    close(pairs[0][0]);
+    close(pairs[0][1]);
+    close(pairs[1][0]);
+    close(pairs[1][1]);
+    close(pairs[2][1]);
+
+    // A connection that waits longer than session_wait is turned away too.
+    AdmissionConfig waiting = {1, 1, 0, 0, 0, 1};
+    admission_configure(&waiting);
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[0]), 0);
+    CU_ASSERT_EQUAL_FATAL(admission_accept(-1, 0), ADMIT_RUN);
+    CU_ASSERT_EQUAL_FATAL(admission_accept(pairs[0][0], 0), ADMIT_QUEUED);
+    admission_expire_waiting();
+    poll(NULL, 0, 1100);
+    admission_expire_waiting();
+    n = read(pairs[0][1], reply, sizeof(reply) - 1);
+    CU_ASSERT_EQUAL(n, (ssize_t)strlen(SERVER_BUSY_REPLY));
+    CU_ASSERT_EQUAL(admission_next(&fd, &from_unix), 0);
+    close(pairs[0][1]);
+
+    AdmissionConfig rate = {0, 0, 0, 2, 2, 0};
+    admission_configure(&rate);
+    start_test_server(&server, "test_admission.sock");
+    int conn = proto_connect(NULL, 0, "test_admission.sock", 0);
+    CU_ASSERT_FATAL(conn >= 0);
+    CU_ASSERT_EQUAL(proto_login_admin(conn, "admin", "admin", NULL, reply), ROLE_ADMIN);
+
+    CU_ASSERT(proto_add(conn, "RateTitle", "RateAuthor", reply) > 0);
+    CU_ASSERT_PTR_NOT_NULL(strstr(reply, "Book added"));
+    CU_ASSERT(proto_search(conn, ROLE_ADMIN, 1, reply) > 0);
+    CU_ASSERT(proto_add(conn, "RateTitle", "RateAuthor", reply) > 0);
+    CU_ASSERT_PTR_NOT_NULL(strstr(reply, SERVER_BUSY_REPLY ": rate limit"));
+    CU_ASSERT_TRUE(proto_reply_failed(reply));
+    // The refused add's title and author were drained, so the next reply lines up.
+    poll(NULL, 0, 600);
+    CU_ASSERT(proto_search(conn, ROLE_ADMIN, 999999, reply) > 0);
+    CU_ASSERT_STRING_EQUAL(reply, "Book with ID 999999 not found");
+
+    proto_exit(conn, ROLE_ADMIN);
+    proto_close(conn);
+    AdmissionConfig unlimited = {0, 0, 0, 0, 0, 0};
+    admission_configure(&unlimited);
+    stop_test_server(&server);
+}
+
+// Test Case 18: The embeddable catalog API on its own file: every operation
+// reports its outcome, a missing file reads as empty, and rewrites leave no
+// temp file behind.
+void test_catalog_api(void) {
+    unlink("catalog_test.txt");
+    Catalog *catalog = catalog_open("catalog_test.txt");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(catalog);
+
+    Book book;
+    CU_ASSERT_EQUAL(catalog_search(catalog, 1, &book), CATALOG_NOT_FOUND);
+    CU_ASSERT_EQUAL(catalog_rent(catalog, 1), CATALOG_NOT_FOUND);
+
+    int first = 0, second = 0;
+    CU_ASSERT_EQUAL(catalog_add(catalog, "Dune", "Herbert", &first), CATALOG_OK);
+    CU_ASSERT_EQUAL(catalog_add(catalog, "Emma", "Austen", &second), CATALOG_OK);
+    CU_ASSERT_EQUAL(first, 1);
+    CU_ASSERT_EQUAL(second, 2);
+
+    CU_ASSERT_EQUAL(catalog_rent(catalog, 2), CATALOG_OK);
+    CU_ASSERT_EQUAL(catalog_rent(catalog, 2), CATALOG_UNAVAILABLE);
+    CU_ASSERT_EQUAL(catalog_modify(catalog, 2, "Persuasion", "Austen"), CATALOG_OK);
+    CU_ASSERT_EQUAL_FATAL(catalog_search(catalog, 2, &book), CATALOG_OK);
+    CU_ASSERT_STRING_EQUAL(book.title, "Persuasion");
+    CU_ASSERT_EQUAL(book.is_rented, 1);
+
+    CU_ASSERT_EQUAL(catalog_return(catalog, 2), CATALOG_OK);
+    CU_ASSERT_EQUAL(catalog_return(catalog, 2), CATALOG_UNAVAILABLE);
+    CU_ASSERT_EQUAL(catalog_modify(catalog, 7, "Nobody", "None"), CATALOG_NOT_FOUND);
+    CU_ASSERT_EQUAL(catalog_delete(catalog, 1), CATALOG_OK);
+    CU_ASSERT_EQUAL(catalog_search(catalog, 1, &book), CATALOG_NOT_FOUND);
+    CU_ASSERT_EQUAL(catalog_search(catalog, 2, &book), CATALOG_OK);
+
+    // A line that is not a book is skipped by searches and kept by rewrites.
+    FILE *file = fopen("catalog_test.txt", "a");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+    fputs("not a book\n", file);
+    fclose(file);
+    CU_ASSERT_EQUAL(catalog_search(catalog, 3, &book), CATALOG_NOT_FOUND);
+    CU_ASSERT_EQUAL(catalog_modify(catalog, 2, "Emma", "Austen"), CATALOG_OK);
+    char line[256] = "";
+    file = fopen("catalog_test.txt", "r");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+    CU_ASSERT_PTR_NOT_NULL(fgets(line, sizeof(line), file));
+    CU_ASSERT_PTR_NOT_NULL(fgets(line, sizeof(line), file));
+    CU_ASSERT_STRING_EQUAL(line, "not a book\n");
+    fclose(file);
+
+    CU_ASSERT_EQUAL(access("catalog_test_temp.txt", F_OK), -1);
+    catalog_close(catalog);
+    unlink("catalog_test.txt");
+}
+
+// Test Case 19: Every storage backend gives the same answers for the same
+// operations; the binary one keeps them across a reopen and refuses a file
+// in another format.
+void test_storage_backends(void) {
+    const char *names[] = {"text", "memory", "binary"};
+    const char *paths[] = {"backend_test.txt", NULL, "backend_test.bin"};
+    CU_ASSERT_PTR_NULL(storage_backend_named("tape"));
 
+    for (int i = 0; i < 3; i++) {
+        const StorageBackend *backend = storage_backend_named(names[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(backend);
+        if (paths[i])
+            unlink(paths[i]);
+        Catalog *catalog = catalog_open_backend(backend, paths[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(catalog);
 
+        int id = 0;
+        Book book;
+        for (int n = 1; n <= 5; n++) {
+            CU_ASSERT_EQUAL(catalog_add(catalog, "Title", "Author", &id), CATALOG_OK);
+            CU_ASSERT_EQUAL(id, n);
+        }
+        // Counted once here, then kept up to date by the edits below.
+        CatalogStats counts;
+        CU_ASSERT_EQUAL(catalog_counts(catalog, &counts), 1);
+        CU_ASSERT_EQUAL(counts.rows, 5);
+        CU_ASSERT_EQUAL(catalog_rent(catalog, 3), CATALOG_OK);
+        CU_ASSERT_EQUAL(catalog_rent(catalog, 3), CATALOG_UNAVAILABLE);
+        CU_ASSERT_EQUAL(catalog_return(catalog, 4), CATALOG_UNAVAILABLE);
+        CU_ASSERT_EQUAL(catalog_modify(catalog, 3, "Renamed", "Someone"), CATALOG_OK);
+        CU_ASSERT_EQUAL(catalog_delete(catalog, 2), CATALOG_OK);
+        CU_ASSERT_EQUAL(catalog_delete(catalog, 2), CATALOG_NOT_FOUND);
+        CU_ASSERT_EQUAL(catalog_search(catalog, 2, &book), CATALOG_NOT_FOUND);
+        CU_ASSERT_EQUAL(catalog_search(catalog, 9, &book), CATALOG_NOT_FOUND);
+        CU_ASSERT_EQUAL_FATAL(catalog_search(catalog, 3, &book), CATALOG_OK);
+        CU_ASSERT_STRING_EQUAL(book.title, "Renamed");
+        CU_ASSERT_STRING_EQUAL(book.author, "Someone");
+        CU_ASSERT_EQUAL(book.is_rented, 1);
+
+        CatalogStats stats;
+        CU_ASSERT_EQUAL(catalog_stats(catalog, &stats), 1);
+        CU_ASSERT_EQUAL(stats.rows, 4);
+        CU_ASSERT_EQUAL(stats.rented, 1);
+        CU_ASSERT(catalog_bytes(catalog) > 0);
+        CU_ASSERT_EQUAL(catalog_counts(catalog, &counts), 1);
+        CU_ASSERT_EQUAL(counts.rows, 4);
+        CU_ASSERT_EQUAL(counts.rented, 1);
+        CU_ASSERT_EQUAL(counts.bytes, catalog_bytes(catalog));
+        CU_ASSERT_EQUAL(catalog_delete(catalog, 3), CATALOG_OK);
+        CU_ASSERT_EQUAL(catalog_add(catalog, "Title", "Author", &id), CATALOG_OK);
+        CU_ASSERT_EQUAL(catalog_rent(catalog, id), CATALOG_OK);
+        CU_ASSERT_EQUAL(catalog_counts(catalog, &counts), 1);
+        CU_ASSERT_EQUAL(catalog_stats(catalog, &stats), 1);
+        CU_ASSERT_EQUAL(counts.rows, stats.rows);
+        CU_ASSERT_EQUAL(counts.rented, stats.rented);
+        CU_ASSERT_EQUAL(counts.rented, 1);
+        catalog_close(catalog);
+    }
+
+    Catalog *reopened = catalog_open_backend(&storage_binary, "backend_test.bin");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(reopened);
+    Book book;
+    int id = 0;
+    CU_ASSERT_EQUAL(catalog_search(reopened, 3, &book), CATALOG_NOT_FOUND);
+    CU_ASSERT_EQUAL(catalog_search(reopened, 6, &book), CATALOG_OK);
+    CU_ASSERT_EQUAL(book.is_rented, 1);
+    CU_ASSERT_EQUAL(catalog_add(reopened, "Later", "Author", &id), CATALOG_OK);
+    CU_ASSERT_EQUAL(id, 7);
+    catalog_close(reopened);
+
+    CU_ASSERT_PTR_NULL(catalog_open_backend(&storage_binary, "backend_test.txt"));
+    unlink("backend_test.txt");
+    unlink("backend_test.bin");
+}
+
+// Test Case 20: Settings come from defaults, then the config file, then the
+// environment, then flags; bad values are refused, and a written config
+// reads back the same.
+void test_server_config(void) {
+    ServerConfig config;
+    config_defaults(&config);
+    CU_ASSERT_EQUAL(config.port, CONFIG_DEFAULT_PORT);
+    CU_ASSERT_STRING_EQUAL(config.data_dir, ".");
+    CU_ASSERT_EQUAL(config.admission.max_sessions, ADMISSION_DEFAULT_MAX_SESSIONS);
+
+    FILE *f = fopen("server_test.conf", "w");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+    fprintf(f, "# instance two\nport = 9002\ndata-dir = /srv/two\nmax-sessions = 8\nstorage = binary\n\nunix-socket =\n");
+    fclose(f);
+
+    setenv(ADMISSION_MAX_SESSIONS_ENV, "16", 1);
+    char *argv[] = {"server", "-c", "server_test.conf", "--port", "9003", "--rate-limit=2.5", NULL};
+    CU_ASSERT_EQUAL(config_parse(&config, 6, argv), 0);
+    unsetenv(ADMISSION_MAX_SESSIONS_ENV);
+    CU_ASSERT_EQUAL(config.port, 9003);
+    CU_ASSERT_STRING_EQUAL(config.data_dir, "/srv/two");
+    CU_ASSERT_STRING_EQUAL(config.storage, "binary");
+    CU_ASSERT_STRING_EQUAL(config.unix_socket, "");
+    CU_ASSERT_EQUAL(config.admission.max_sessions, 16);
+    CU_ASSERT(config.admission.rate == 2.5);
+
+    CU_ASSERT_EQUAL(config_set(&config, "port", "70000"), -1);
+    CU_ASSERT_EQUAL(config_set(&config, "max-sessions", "many"), -1);
+    CU_ASSERT_EQUAL(config_set(&config, "no-such-key", "1"), -1);
+    CU_ASSERT_EQUAL(config.port, 9003);
+    char *bad[] = {"server", "--port", "0", NULL};
+    ServerConfig rejected;
+    CU_ASSERT_EQUAL(config_parse(&rejected, 3, bad), -1);
+
+    f = fopen("server_test.conf", "w");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+    config_write(f, &config);
+    fclose(f);
+    ServerConfig reread;
+    config_defaults(&reread);
+    CU_ASSERT_EQUAL(config_load_file(&reread, "server_test.conf"), 0);
+    CU_ASSERT_EQUAL(reread.port, 9003);
+    CU_ASSERT_EQUAL(reread.admission.max_sessions, 16);
+    CU_ASSERT_STRING_EQUAL(reread.unix_socket, "");
+    unlink("server_test.conf");
+}
+
+// Test Case 21: Threads racing adds, rents, returns and deletes leave the
+// catalog consistent: on the memory backend only the engine mutex keeps
+// them apart, and with one text catalog handle per thread only the file
+// lock does.
+static void run_stress(const StorageBackend *backend, const char *path, int threads, int handles, int rounds) {
+    StressConfig config;
+    StressReport report;
+    stress_defaults(&config);
+    config.backend = backend;
+    config.path = path;
+    config.threads = threads;
+    config.handles = handles;
+    config.rounds = rounds;
+    config.ops = 100;
+    int result = stress_run(&config, &report);
+    if (result != 0)
+        printf("\n%s stress: %s (seed %u)\n", backend->name, report.violation, report.round_seed);
+    CU_ASSERT_EQUAL(result, 0);
+    CU_ASSERT_EQUAL(report.rounds, rounds);
+}
+
+void test_concurrency_stress(void) {
+    run_stress(&storage_memory, NULL, 8, 1, 10);
+    run_stress(&storage_text, "stress_test.txt", 4, 4, 5);
+    unlink("stress_test.txt");
+    unlink("stress_test_temp.txt");
+}
+
+// Test Case 22: A rent on behalf of a member is counted against them until
+// the book comes back or is deleted, the limit refuses one more, and the
+// counts are rebuilt from the rows when the catalog is opened again. A
+// version 1 binary catalog is upgraded on open.
+void test_member_loans(void) {
+    const char *names[] = {"text", "memory", "binary"};
+    const char *paths[] = {"loans_test.txt", NULL, "loans_test.bin"};
+
+    for (int i = 0; i < 3; i++) {
+        const StorageBackend *backend = storage_backend_named(names[i]);
+        if (paths[i])
+            unlink(paths[i]);
+        Catalog *catalog = catalog_open_backend(backend, paths[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(catalog);
+        for (int n = 1; n <= 5; n++)
+            CU_ASSERT_EQUAL(catalog_add(catalog, "Title", "Author", NULL), CATALOG_OK);
+
+        catalog_set_loan_limit(catalog, 2);
+        CU_ASSERT_EQUAL(catalog_loan_limit(catalog), 2);
+        CU_ASSERT_EQUAL(catalog_rent_for(catalog, 1, 7), CATALOG_OK);
+        CU_ASSERT_EQUAL(catalog_rent_for(catalog, 2, 7), CATALOG_OK);
+        CU_ASSERT_EQUAL(catalog_rent_for(catalog, 3, 7), CATALOG_LIMIT);
+        CU_ASSERT_EQUAL(catalog_rent_for(catalog, 1, 8), CATALOG_UNAVAILABLE);
+        CU_ASSERT_EQUAL(catalog_rent_for(catalog, 3, 8), CATALOG_OK);
+        CU_ASSERT_EQUAL(catalog_rent(catalog, 4), CATALOG_OK);
+        CU_ASSERT_EQUAL(catalog_loans(catalog, 7), 2);
+        CU_ASSERT_EQUAL(catalog_loans(catalog, 8), 1);
+        CU_ASSERT_EQUAL(catalog_loans(catalog, 9), 0);
+        CU_ASSERT_EQUAL(catalog_loans(catalog, 0), 0);
+
+        Book book;
+        CU_ASSERT_EQUAL(catalog_modify(catalog, 2, "Renamed", "Someone"), CATALOG_OK);
+        CU_ASSERT_EQUAL_FATAL(catalog_search(catalog, 2, &book), CATALOG_OK);
+        CU_ASSERT_EQUAL(book.renter, 7);
+        CU_ASSERT_EQUAL(catalog_return(catalog, 1), CATALOG_OK);
+        CU_ASSERT_EQUAL(catalog_loans(catalog, 7), 1);
+        CU_ASSERT_EQUAL(catalog_rent_for(catalog, 5, 7), CATALOG_OK);
+        CU_ASSERT_EQUAL(catalog_delete(catalog, 3), CATALOG_OK);
+        CU_ASSERT_EQUAL(catalog_loans(catalog, 8), 0);
+        CU_ASSERT_EQUAL(catalog_return(catalog, 4), CATALOG_OK);
+        CU_ASSERT_EQUAL(catalog_search(catalog, 1, &book), CATALOG_OK);
+        CU_ASSERT_EQUAL(book.renter, 0);
+        catalog_close(catalog);
+
+        if (paths[i]) {
+            catalog = catalog_open_backend(backend, paths[i]);
+            CU_ASSERT_PTR_NOT_NULL_FATAL(catalog);
+            catalog_set_loan_limit(catalog, 2);
+            CU_ASSERT_EQUAL(catalog_loans(catalog, 7), 2);
+            CU_ASSERT_EQUAL(catalog_rent_for(catalog, 1, 7), CATALOG_LIMIT);
+            catalog_set_loan_limit(catalog, -1);
+            CU_ASSERT_EQUAL(catalog_loan_limit(catalog), 0);
+            CU_ASSERT_EQUAL(catalog_rent_for(catalog, 1, 7), CATALOG_OK);
+            CU_ASSERT_EQUAL(catalog_loans(catalog, 7), 3);
+            catalog_close(catalog);
+            unlink(paths[i]);
+        }
+    }
+
+    // Header and two records as version 1 wrote them, the second rented.
+    struct {
+        char magic[4];
+        int32_t version, next_id, reserved;
+    } header = {{'L', 'I', 'B', 'B'}, 1, 3, 0};
+    struct {
+        int32_t id, is_rented, deleted;
+        char title[CATALOG_FIELD_LENGTH];
+        char author[CATALOG_FIELD_LENGTH];
+    } records[2] = {{1, 0, 0, "Dune", "Herbert"}, {2, 1, 0, "Emma", "Austen"}};
+    FILE *old = fopen("loans_test.bin", "wb");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(old);
+    fwrite(&header, sizeof(header), 1, old);
+    fwrite(records, sizeof(records), 1, old);
+    fclose(old);
+
+    Catalog *upgraded = catalog_open_backend(&storage_binary, "loans_test.bin");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(upgraded);
+    Book book;
+    int id = 0;
+    CU_ASSERT_EQUAL_FATAL(catalog_search(upgraded, 2, &book), CATALOG_OK);
+    CU_ASSERT_STRING_EQUAL(book.title, "Emma");
+    CU_ASSERT_EQUAL(book.is_rented, 1);
+    CU_ASSERT_EQUAL(book.renter, 0);
+    CU_ASSERT_EQUAL(catalog_add(upgraded, "Later", "Author", &id), CATALOG_OK);
+    CU_ASSERT_EQUAL(id, 3);
+    CU_ASSERT_EQUAL(catalog_rent_for(upgraded, 1, 7), CATALOG_OK);
+    CU_ASSERT_EQUAL(catalog_loans(upgraded, 7), 1);
+    catalog_close(upgraded);
+    CU_ASSERT_EQUAL(access("loans_test.bin.upgrade", F_OK), -1);
+    unlink("loans_test.bin");
+
+    ServerConfig config;
+    config_defaults(&config);
+    CU_ASSERT_EQUAL(config.loan_limit, 0);
+    CU_ASSERT_EQUAL(config_set(&config, "loan-limit", "3"), 0);
+    CU_ASSERT_EQUAL(config.loan_limit, 3);
+}
+
+// Test Case 23 helper: searches, fills and invalidates until the cache is stopped under it
+static void *hammer_result_cache(void *running) {
+    char reply[BUFFER_SIZE];
+    unsigned long long ticket = 0;
+    for (int n = 0; __atomic_load_n((int *)running, __ATOMIC_ACQUIRE); n++) {
+        if (result_cache_get(n % 64, reply, sizeof(reply), &ticket) < 0)
+            result_cache_put(n % 64, "hammered", ticket);
+        if (n % 7 == 0)
+            result_cache_invalidate(n % 64);
+    }
+    return NULL;
+}
+
+// Test Case 23: Search replies come from the result cache until the book is
+// rented, returned, modified or deleted; a reply read before an edit is not
+// kept after it, and a full cache drops its least recently used replies.
+// Stopping the cache while sessions still use it is safe.
+void test_result_cache(void) {
+    char reply[BUFFER_SIZE];
+    unsigned long long ticket = 0, stale = 0;
+    ResultCacheStats stats;
+    TestServer server;
+
+    CU_ASSERT_EQUAL_FATAL(result_cache_start(RESULT_CACHE_SHARDS), 0);
+    CU_ASSERT_EQUAL(result_cache_get(1, reply, sizeof(reply), &ticket), -1);
+    result_cache_put(1, "one", ticket);
+    CU_ASSERT_EQUAL(result_cache_get(1, reply, sizeof(reply), &ticket), 3);
+    CU_ASSERT_STRING_EQUAL(reply, "one");
+    CU_ASSERT_EQUAL(result_cache_get(2, reply, sizeof(reply), &stale), -1);
+    result_cache_invalidate(2);
+    result_cache_put(2, "read before the edit", stale);
+    CU_ASSERT_EQUAL(result_cache_get(2, reply, sizeof(reply), &ticket), -1);
+    result_cache_invalidate(1);
+    CU_ASSERT_EQUAL(result_cache_get(1, reply, sizeof(reply), &ticket), -1);
+
+    for (int id = 100; id < 1100; id++) {
+        CU_ASSERT_EQUAL(result_cache_get(id, reply, sizeof(reply), &ticket), -1);
+        result_cache_put(id, "filler", ticket);
+    }
+    CU_ASSERT_EQUAL(result_cache_get(1099, reply, sizeof(reply), &ticket), 6);
+    result_cache_stats(&stats);
+    CU_ASSERT_EQUAL(stats.capacity, RESULT_CACHE_SHARDS);
+    CU_ASSERT_EQUAL(stats.entries, RESULT_CACHE_SHARDS);
+    CU_ASSERT_EQUAL(stats.evictions, 1000 - RESULT_CACHE_SHARDS);
+    CU_ASSERT_EQUAL(stats.invalidations, 1);
+    CU_ASSERT_EQUAL(stats.hits, 2);
+    CU_ASSERT(stats.bytes > 0);
+    result_cache_stop();
+    result_cache_stats(&stats);
+    CU_ASSERT_EQUAL(stats.capacity, 0);
+    CU_ASSERT_EQUAL(result_cache_get(1099, reply, sizeof(reply), &ticket), -1);
+
+    // Through the server: the second search is a hit, each edit drops it.
+    wait_for_sessions_to_end();
+    CU_ASSERT_EQUAL_FATAL(result_cache_start(64), 0);
+    start_test_server(&server, "test_cache.sock");
+    int admin = proto_connect(NULL, 0, "test_cache.sock", 0);
+    int user = proto_connect(NULL, 0, "test_cache.sock", 0);
+    CU_ASSERT_FATAL(admin >= 0 && user >= 0);
+    CU_ASSERT_EQUAL(proto_login_admin(admin, "admin", "admin", NULL, reply), ROLE_ADMIN);
+    CU_ASSERT_EQUAL(proto_login_user(user, "user", "user", 3, NULL, reply), ROLE_USER);
+
+    int id = 0;
+    CU_ASSERT(proto_add(admin, "CacheTitle", "CacheAuthor", reply) > 0);
+    CU_ASSERT_EQUAL_FATAL(sscanf(reply, "Book added with ID: %d", &id), 1);
+    char expected[BUFFER_SIZE];
+    snprintf(expected, sizeof(expected), "ID: %d, Title: CacheTitle, Author: CacheAuthor, Rented: 0", id);
+    CU_ASSERT(proto_search(admin, ROLE_ADMIN, id, reply) > 0);
+    CU_ASSERT(proto_search(user, ROLE_USER, id, reply) > 0);
+    CU_ASSERT_STRING_EQUAL(reply, expected);
+    result_cache_stats(&stats);
+    CU_ASSERT_EQUAL(stats.hits, 1);
+    CU_ASSERT_EQUAL(stats.entries, 1);
+
+    CU_ASSERT(proto_rent(user, id, reply) > 0);
+    CU_ASSERT(proto_search(admin, ROLE_ADMIN, id, reply) > 0);
+    CU_ASSERT_PTR_NOT_NULL(strstr(reply, "Rented: 1"));
+    CU_ASSERT(proto_return(user, id, reply) > 0);
+    CU_ASSERT(proto_search(admin, ROLE_ADMIN, id, reply) > 0);
+    CU_ASSERT_PTR_NOT_NULL(strstr(reply, "Rented: 0"));
+    CU_ASSERT(proto_modify(admin, id, "Renamed", "CacheAuthor", reply) > 0);
+    CU_ASSERT(proto_search(user, ROLE_USER, id, reply) > 0);
+    CU_ASSERT_PTR_NOT_NULL(strstr(reply, "Title: Renamed"));
+    CU_ASSERT(proto_delete(admin, id, reply) > 0);
+    CU_ASSERT(proto_search(user, ROLE_USER, id, reply) > 0);
+    CU_ASSERT_PTR_NOT_NULL(strstr(reply, "not found"));
+    result_cache_stats(&stats);
+    CU_ASSERT_EQUAL(stats.hits, 1);
+    CU_ASSERT_EQUAL(stats.invalidations, 4);
+    CU_ASSERT_EQUAL(stats.entries, 0);
+
+    char *text = NULL;
+    CU_ASSERT(proto_metrics(admin, &text) > 0);
+    CU_ASSERT(text && strstr(text, "\nlibrary_result_cache_lookups_total{result=\"hit\"} 1\n"));
+    CU_ASSERT(text && strstr(text, "\nlibrary_result_cache_entries{state=\"capacity\"} 64\n"));
+    free(text);
+
+    proto_exit(admin, ROLE_ADMIN);
+    proto_exit(user, ROLE_USER);
+    proto_close(admin);
+    proto_close(user);
+    stop_test_server(&server);
+    wait_for_sessions_to_end();
+    result_cache_stop();
+
+    pthread_t hammers[4];
+    int running = 1;
+    CU_ASSERT_EQUAL_FATAL(result_cache_start(64), 0);
+    for (int t = 0; t < 4; t++)
+        pthread_create(&hammers[t], NULL, hammer_result_cache, &running);
+    poll(NULL, 0, 50);
+    result_cache_stop();
+    CU_ASSERT_EQUAL(result_cache_get(1, reply, sizeof(reply), &ticket), -1);
+    __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+    for (int t = 0; t < 4; t++)
+        pthread_join(hammers[t], NULL);
+    result_cache_stats(&stats);
+    CU_ASSERT_EQUAL(stats.capacity, 0);
+}
+
+// Test Case 24: A client with leases answers repeated searches itself until
+// the server invalidates the book or the lease runs out; everything else on
+// the framed connection still works, and with leases off nothing changes.
+void test_search_leases(void) {
+    char reply[BUFFER_SIZE];
+    ProtoCacheStats stats;
+    LeaseStats leases;
+    TestServer server;
+
+    wait_for_sessions_to_end();
+    lease_configure(300);
+    start_test_server(&server, "test_lease.sock");
+    int kiosk = proto_connect(NULL, 0, "test_lease.sock", 0);
+    int renter = proto_connect(NULL, 0, "test_lease.sock", 0);
+    int admin = proto_connect(NULL, 0, "test_lease.sock", 0);
+    CU_ASSERT_FATAL(kiosk >= 0 && renter >= 0 && admin >= 0);
+    CU_ASSERT_EQUAL(proto_login_user(kiosk, "user", "user", 4, NULL, reply), ROLE_USER);
+    CU_ASSERT_EQUAL(proto_login_user(renter, "user", "user", 5, NULL, reply), ROLE_USER);
+    CU_ASSERT_EQUAL(proto_login_admin(admin, "admin", "admin", NULL, reply), ROLE_ADMIN);
+    CU_ASSERT_FALSE(proto_cache_stats(kiosk, &stats));
+    CU_ASSERT_EQUAL(proto_cache_enable(kiosk, ROLE_USER, reply), 300);
+    CU_ASSERT_EQUAL(proto_cache_enable(admin, ROLE_ADMIN, reply), 300);
+
+    int id = 0;
+    CU_ASSERT(proto_add(admin, "LeaseTitle", "LeaseAuthor", reply) > 0);
+    CU_ASSERT_EQUAL_FATAL(sscanf(reply, "Book added with ID: %d", &id), 1);
+    CU_ASSERT(proto_search(kiosk, ROLE_USER, id, reply) > 0);
+    CU_ASSERT_PTR_NOT_NULL(strstr(reply, "Rented: 0"));
+    CU_ASSERT(proto_search(kiosk, ROLE_USER, id, reply) > 0);
+    CU_ASSERT_PTR_NOT_NULL(strstr(reply, "Title: LeaseTitle"));
+    CU_ASSERT_TRUE(proto_cache_stats(kiosk, &stats));
+    CU_ASSERT_EQUAL(stats.hits, 1);
+    CU_ASSERT_EQUAL(stats.misses, 1);
+
+    // The invalidation is on its way before the rent is answered.
+    CU_ASSERT(proto_rent(renter, id, reply) > 0);
+    CU_ASSERT_PTR_NOT_NULL(strstr(reply, "rented"));
+    CU_ASSERT(proto_search(kiosk, ROLE_USER, id, reply) > 0);
+    CU_ASSERT_PTR_NOT_NULL(strstr(reply, "Rented: 1"));
+    proto_cache_stats(kiosk, &stats);
+    CU_ASSERT_EQUAL(stats.misses, 2);
+    CU_ASSERT_EQUAL(stats.invalidations, 1);
+
+    // Missing books are not cached, and a lease that ran out is a miss.
+    CU_ASSERT(proto_search(kiosk, ROLE_USER, 999999, reply) > 0);
+    CU_ASSERT(proto_search(kiosk, ROLE_USER, 999999, reply) > 0);
+    CU_ASSERT_STRING_EQUAL(reply, "Book with ID 999999 not found");
+    lease_stats(&leases);
+    CU_ASSERT_EQUAL(leases.active, 1);
+    poll(NULL, 0, 350);
+    CU_ASSERT(proto_search(kiosk, ROLE_USER, id, reply) > 0);
+    proto_cache_stats(kiosk, &stats);
+    CU_ASSERT_EQUAL(stats.hits, 1);
+    CU_ASSERT_EQUAL(stats.misses, 5);
+
+    CU_ASSERT(proto_modify(admin, id, "Renamed", "LeaseAuthor", reply) > 0);
+    CU_ASSERT(proto_search(kiosk, ROLE_USER, id, reply) > 0);
+    CU_ASSERT_PTR_NOT_NULL(strstr(reply, "Title: Renamed"));
+    char *text = NULL;
+    CU_ASSERT(proto_metrics(admin, &text) > 0);
+    CU_ASSERT(text && strstr(text, "\nlibrary_lease_invalidations_total 2\n"));
+    free(text);
+    lease_stats(&leases);
+    CU_ASSERT_EQUAL(leases.granted, 4);
+
+    // A holder that stops reading is cut off instead of holding up the edit.
+    int stalled = proto_connect(NULL, 0, "test_lease.sock", 0);
+    CU_ASSERT_FATAL(stalled >= 0);
+    CU_ASSERT_EQUAL(proto_login_admin(stalled, "admin", "admin", NULL, reply), ROLE_ADMIN);
+    CU_ASSERT_EQUAL(proto_cache_enable(stalled, ROLE_ADMIN, reply), 300);
+    CU_ASSERT(proto_search(stalled, ROLE_ADMIN, id, reply) > 0);
+    int metrics_request[2] = {ROLE_ADMIN, ADMIN_METRICS};
+    for (int i = 0; i < 200; i++)
+        send(stalled, metrics_request, sizeof(metrics_request), MSG_DONTWAIT | MSG_NOSIGNAL);
+    poll(NULL, 0, 200);
+    struct timespec before, after;
+    clock_gettime(CLOCK_MONOTONIC, &before);
+    CU_ASSERT(proto_modify(admin, id, "Stalled", "LeaseAuthor", reply) > 0);
+    clock_gettime(CLOCK_MONOTONIC, &after);
+    CU_ASSERT(after.tv_sec - before.tv_sec < 2);
+    lease_stats(&leases);
+    CU_ASSERT_EQUAL(leases.dropped, 1);
+    proto_close(stalled);
+
+    // Off: the server says so and the connection stays unframed.
+    lease_configure(0);
+    CU_ASSERT_EQUAL(proto_cache_enable(renter, ROLE_USER, reply), 0);
+    CU_ASSERT_STRING_EQUAL(reply, "Leases off");
+    CU_ASSERT(proto_return(renter, id, reply) > 0);
+    CU_ASSERT(proto_search(renter, ROLE_USER, id, reply) > 0);
+    CU_ASSERT_PTR_NOT_NULL(strstr(reply, "Rented: 0"));
+
+    CU_ASSERT_EQUAL(proto_exit(kiosk, ROLE_USER), 0);
+    CU_ASSERT_EQUAL(proto_exit(admin, ROLE_ADMIN), 0);
+    proto_exit(renter, ROLE_USER);
+    proto_close(kiosk);
+    proto_close(renter);
+    proto_close(admin);
+    stop_test_server(&server);
+    wait_for_sessions_to_end();
+    lease_stats(&leases);
+    CU_ASSERT_EQUAL(leases.active, 0);
+
+    ServerConfig config;
+    config_defaults(&config);
+    CU_ASSERT_EQUAL(config.lease_ms, LEASE_DEFAULT_MS);
+    CU_ASSERT_EQUAL(config_set(&config, "lease-ms", "0"), 0);
+    CU_ASSERT_EQUAL(config.lease_ms, 0);
+}
+
+// Test Case 25 helper: a shared-memory segment of size bytes, named name, with a valid header
+static int make_segment(const char *name, size_t size) {
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+        return -1;
+    uint32_t magic = SHM_MAGIC;
+    int ok = ftruncate(fd, (off_t)size) == 0 && pwrite(fd, &magic, sizeof(magic), 0) == sizeof(magic);
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+// Test Case 25: The server maps only a channel its peer created under its
+// own pid, and only when the segment is large enough; sessions still move
+// onto shared memory.
+void test_shm_attach_checks(void) {
+    char name[SHM_NAME_LENGTH], reply[BUFFER_SIZE];
+    int pair[2];
+    TestServer server;
+
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), 0);
+    CU_ASSERT_EQUAL(transport_attach_shm("/library-shm-1-0", pair[0]), -1);
+    CU_ASSERT_EQUAL(transport_attach_shm("/not-a-channel", pair[0]), -1);
+    snprintf(name, sizeof(name), SHM_NAME_PREFIX "%d-x", (int)getpid());
+    CU_ASSERT_EQUAL(transport_attach_shm(name, pair[0]), -1);
+
+    // Cut short: refused without touching it.
+    snprintf(name, sizeof(name), SHM_NAME_PREFIX "%d-900001", (int)getpid());
+    CU_ASSERT_EQUAL_FATAL(make_segment(name, 4096), 0);
+    CU_ASSERT_EQUAL(transport_attach_shm(name, pair[0]), -1);
+    CU_ASSERT_EQUAL(shm_unlink(name), -1); // already removed
+
+    snprintf(name, sizeof(name), SHM_NAME_PREFIX "%d-900002", (int)getpid());
+    CU_ASSERT_EQUAL_FATAL(make_segment(name, sizeof(ShmChannel)), 0);
+    int conn = transport_attach_shm(name, pair[0]);
+    CU_ASSERT(conn >= SHM_CONN_BASE);
+    CU_ASSERT_EQUAL(conn_close(conn), 0); // closes pair[0] with it
+    close(pair[1]);
+
+    start_test_server(&server, "test_shm.sock");
+    conn = proto_connect(NULL, 0, "test_shm.sock", 1);
+    CU_ASSERT_FATAL(conn >= SHM_CONN_BASE);
+    CU_ASSERT_EQUAL(proto_login_admin(conn, "admin", "admin", NULL, reply), ROLE_ADMIN);
+    CU_ASSERT(proto_search(conn, ROLE_ADMIN, 999999, reply) > 0);
+    CU_ASSERT_STRING_EQUAL(reply, "Book with ID 999999 not found");
+    proto_exit(conn, ROLE_ADMIN);
+    proto_close(conn);
+    stop_test_server(&server);
+    wait_for_sessions_to_end();
+}
+
+// Removes a working directory and the files the tests left in it.
+static void remove_work_dir(const char *path) {
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    char file[1024];
+    while (dir && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+            unlink(file);
+        }
+    }
+    if (dir)
+        closedir(dir);
+    rmdir(path);
+}
+
+// ********* Fork Server *********
+// ./test_runner --fork-server reads mutants on stdin, one per line as "id"
+// or "id 4,0,7" to run only those tests in that order, and answers each
+// with "id outcome test seconds": outcome is killed, survived or timeout,
+// and test the index of the test that decided it (-1 when all passed). The
+// registry is set up once; each mutant runs in a child forked from that
+// state, in a directory of its own, and reports every finished test over a
+// pipe. The first failure decides the outcome. A test that runs longer
+// than FORK_TIMEOUT_FACTOR times its time in the unmutated baseline run,
+// plus FORK_TIMEOUT_SLACK_MS, is a timeout.
+#define FORK_TIMEOUT_FACTOR 3
+#define FORK_TIMEOUT_SLACK_MS 1000
+
+typedef struct {
+    int test;
+    int failed;
+} TestReport;
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// The index-th test of the suite, in registration order.
+static CU_pTest suite_test(CU_pSuite suite, int index) {
+    CU_pTest test = suite->pTest;
+    while (test != NULL && index-- > 0)
+        test = test->pNext;
+    return test;
+}
+
+// Parses "4,0,7" into tests. Returns how many, or -1 on a bad index.
+static int parse_tests(CU_pSuite suite, const char *list, int *tests) {
+    int count = 0;
+    char *end;
+    while (*list != '\0' && *list != '\n') {
+        long index = strtol(list, &end, 10);
+        if (end == list || index < 0 || index >= (long)suite->uiNumberOfTests || count == (int)suite->uiNumberOfTests)
+            return -1;
+        tests[count++] = (int)index;
+        list = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+static void run_mutant_child(CU_pSuite suite, int mutant, const int *tests, int count, int report_fd) {
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    mutant_select(mutant);
+    CU_basic_set_mode(CU_BRM_SILENT);
+
+    for (int i = 0; i < count; i++) {
+        CU_basic_run_test(suite, suite_test(suite, tests[i]));
+        TestReport report = {tests[i], CU_get_number_of_failures() != 0};
+        if (write(report_fd, &report, sizeof(report)) != sizeof(report))
+            _exit(2);
+    }
+    _exit(0);
+}
+
+// Runs the given tests against one mutant. budgets_ms NULL means no time
+// limit (the baseline run); elapsed_ms, when given, receives each test's
+// time. Both are indexed by test.
+static const char *run_mutant(CU_pSuite suite, int mutant, const int *tests, int count,
+                              const long long *budgets_ms, long long *elapsed_ms, int *decided) {
+    int fds[2];
+    char dir[] = "mutant.XXXXXX";
+    *decided = -1;
+    if (pipe(fds) < 0 || !mkdtemp(dir))
+        return "error";
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        if (chdir(dir) < 0)
+            _exit(2);
+        run_mutant_child(suite, mutant, tests, count, fds[1]);
+    }
+    close(fds[1]);
+
+    const char *outcome = pid < 0 ? "error" : "survived";
+    for (int i = 0; pid > 0 && i < count; i++) {
+        struct pollfd pfd = {fds[0], POLLIN, 0};
+        long long started = now_ms();
+        int ready = poll(&pfd, 1, budgets_ms ? (int)budgets_ms[tests[i]] : -1);
+        TestReport report;
+        if (ready == 0) {
+            outcome = "timeout";
+        } else if (ready < 0 || read(fds[0], &report, sizeof(report)) != sizeof(report) || report.failed) {
+            outcome = "killed"; // a failed assertion, or the child crashed
+        } else {
+            if (elapsed_ms)
+                elapsed_ms[tests[i]] = now_ms() - started;
+            continue;
+        }
+        *decided = tests[i];
+        break;
+    }
+
+    if (pid > 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    }
+    close(fds[0]);
+    remove_work_dir(dir);
+    return outcome;
+}
+
+static int fork_server(CU_pSuite suite) {
+    int count = (int)suite->uiNumberOfTests;
+    long long *budgets_ms = calloc(count, sizeof(long long));
+    int *all = calloc(count, sizeof(int));
+    int *tests = calloc(count, sizeof(int));
+    int status = 1;
+    int decided;
+    if (!budgets_ms || !all || !tests)
+        goto done;
+    for (int i = 0; i < count; i++)
+        all[i] = i;
+
+    // The baseline run both checks the suite passes and times each test.
+    const char *baseline = run_mutant(suite, 0, all, count, NULL, budgets_ms, &decided);
+    if (strcmp(baseline, "survived") != 0) {
+        fprintf(stderr, "Fork server: baseline run %s at test %d\n", baseline, decided);
+        goto done;
+    }
+    for (int i = 0; i < count; i++)
+        budgets_ms[i] = budgets_ms[i] * FORK_TIMEOUT_FACTOR + FORK_TIMEOUT_SLACK_MS;
+
+    char line[1024];
+    while (fgets(line, sizeof(line), stdin)) {
+        char *rest;
+        int mutant = (int)strtol(line, &rest, 10);
+        while (*rest == ' ')
+            rest++;
+        const int *order = all;
+        int selected = count;
+        if (*rest != '\n' && *rest != '\0') {
+            order = tests;
+            selected = parse_tests(suite, rest, tests);
+        }
+
+        long long started = now_ms();
+        const char *outcome = "error";
+        decided = -1;
+        if (selected >= 0)
+            outcome = run_mutant(suite, mutant, order, selected, budgets_ms, NULL, &decided);
+        printf("%d %s %d %.3f\n", mutant, outcome, decided, (now_ms() - started) / 1000.0);
+        fflush(stdout);
+    }
+    status = 0;
+
+done:
+    free(budgets_ms);
+    free(all);
+    free(tests);
+    return status;
+}
+
+// ./test_runner --list prints "index name" per test; --only 4,0,7 runs just
+// those tests, which is how mutate.py coverage maps tests to lines.
+static int list_tests(CU_pSuite suite) {
+    int index = 0;
+    for (CU_pTest test = suite->pTest; test != NULL; test = test->pNext)
+        printf("%d\t%s\n", index++, test->pName);
+    return 0;
+}
+
+static int run_only(CU_pSuite suite, const char *list) {
+    int *tests = calloc(suite->uiNumberOfTests, sizeof(int));
+    int count = tests ? parse_tests(suite, list, tests) : -1;
+    unsigned int failures = 0;
+    if (count < 0) {
+        fprintf(stderr, "Bad test list '%s'; see --list\n", list);
+        free(tests);
+        return 1;
+    }
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    for (int i = 0; i < count; i++) {
+        CU_basic_run_test(suite, suite_test(suite, tests[i]));
+        failures += CU_get_number_of_failures();
+    }
+    free(tests);
+    return failures != 0;
+}
 
 // ********* Main Runner *********
-int main() {
+// With --fork-server, --list or --only the suite serves mutant runs, lists
+// its tests or runs some of them (see above) instead of running them all.
+int main(int argc, char *argv[]) {
+    // Each run works in a fresh directory of its own, so several runners can
+    // go at once without sharing books.txt or the test sockets.
+    const char *tmp = getenv("TMPDIR");
+    char work_dir[512];
+    snprintf(work_dir, sizeof(work_dir), "%s/library_tests.XXXXXX", tmp && *tmp ? tmp : "/tmp");
+    if (!mkdtemp(work_dir) || chdir(work_dir) < 0) {
+        perror("Failed to set up a working directory");
+        return 1;
+    }
+
     // Initialize the CUnit test registry
     if (CU_initialize_registry() != CUE_SUCCESS)
         return CU_get_error();
@@ -412,8 +1718,25 @@ int main() {
         (CU_add_test(pSuite, "Test KILL COR mutant (rent failure)", test_kill_cor_mutant) == NULL) ||
         (CU_add_test(pSuite, "Test KILL ROR mutant (return unrented)", test_kill_ror_mutant) == NULL) ||
         (CU_add_test(pSuite, "Test KILL ROR mutant (Auth logic)", test_kill_ror_auth_mutant) == NULL) ||
-        // (CU_add_test(pSuite, "Test KILL SDL mutant (modify book)", test_kill_sdl_mutant) == NULL) ||
-        (CU_add_test(pSuite, "Integration Test 3: File Permissions Check", test_integration_file_permissions) == NULL))
+        (CU_add_test(pSuite, "Test KILL SDL mutant (modify book)", test_kill_sdl_mutant) == NULL) ||
+        (CU_add_test(pSuite, "Integration Test 3: File Permissions Check", test_integration_file_permissions) == NULL) ||
+        (CU_add_test(pSuite, "Test credential store defaults", test_credentials_default_accounts) == NULL) ||
+        (CU_add_test(pSuite, "Test credential file and session tokens", test_credentials_file_and_sessions) == NULL) ||
+        (CU_add_test(pSuite, "Integration Test 4: Client pool over Unix socket", test_integration_client_pool) == NULL) ||
+        (CU_add_test(pSuite, "Test workload capture trace records", test_capture_trace_records) == NULL) ||
+        (CU_add_test(pSuite, "Test Prometheus metrics rendering", test_metrics_render) == NULL) ||
+        (CU_add_test(pSuite, "Test Chrome trace phase spans", test_trace_spans) == NULL) ||
+        (CU_add_test(pSuite, "Test slow-op log rate limit", test_slowlog_rate_limit) == NULL) ||
+        (CU_add_test(pSuite, "Test idle session reaper", test_idle_session_reaped) == NULL) ||
+        (CU_add_test(pSuite, "Test admission control", test_admission_control) == NULL) ||
+        (CU_add_test(pSuite, "Test catalog library API", test_catalog_api) == NULL) ||
+        (CU_add_test(pSuite, "Test storage backends agree", test_storage_backends) == NULL) ||
+        (CU_add_test(pSuite, "Test server configuration sources", test_server_config) == NULL) ||
+        (CU_add_test(pSuite, "Test concurrency stress invariants", test_concurrency_stress) == NULL) ||
+        (CU_add_test(pSuite, "Test member loan accounting", test_member_loans) == NULL) ||
+        (CU_add_test(pSuite, "Test search result cache", test_result_cache) == NULL) ||
+        (CU_add_test(pSuite, "Test search leases and invalidations", test_search_leases) == NULL) ||
+        (CU_add_test(pSuite, "Test shared-memory attach checks", test_shm_attach_checks) == NULL))
         //  ||
         // (CU_add_test(pSuite, "Integration Test 2: Invalid Data Parsing", test_integration_invalid_data) == NULL))
     {
@@ -421,11 +1744,29 @@ int main() {
         return CU_get_error();
     }
 
+    int status = -1;
+    if (argc > 1 && strcmp(argv[1], "--fork-server") == 0)
+        status = fork_server(pSuite);
+    else if (argc > 1 && strcmp(argv[1], "--list") == 0)
+        status = list_tests(pSuite);
+    else if (argc > 2 && strcmp(argv[1], "--only") == 0)
+        status = run_only(pSuite, argv[2]);
+    if (status >= 0) {
+        CU_cleanup_registry();
+        if (chdir("/") == 0)
+            remove_work_dir(work_dir);
+        return status;
+    }
+
     // Run all tests using the basic interface
     CU_basic_set_mode(CU_BRM_VERBOSE);
     CU_basic_run_tests();
-    
-    // Cleanup and return status
+    unsigned int failures = CU_get_number_of_failures();
+
+    // Cleanup and return status; a failed assertion fails the run, which is
+    // how the mutation runner tells a killed mutant from a survivor.
     CU_cleanup_registry();
-    return CU_get_error();
+    if (chdir("/") == 0)
+        remove_work_dir(work_dir);
+    return CU_get_error() != CUE_SUCCESS || failures != 0;
 }
\ No newline at end of file
@@ -0,0 +1,180 @@
+//*******PHASE TRACING*******
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "trace.h"
+
+#define EVENT_BUFFER_SIZE ((TRACE_MAX_SPANS + 1) * 160)
+
+typedef struct
+{
+    TracePhase phase;
+    long long started_ns;
+    long long ended_ns;
+} TraceSpan;
+
+static const char *phase_names[TRACE_PHASE_COUNT] = {
+    "mutex_wait", "flock_wait", "socket_read", "scan", "file_write", "rename", "reply"};
+
+// Only sampled requests reach the file, so a mutex around buffered stdio is
+// cheap enough here; unsampled requests never touch it.
+static pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *output = NULL;
+static int first_event = 1;
+static int tracing = 0;
+static int phase_timing = 0;
+static unsigned long long sample_threshold = 0; // out of 2^32
+
+static __thread int sampled = 0;
+static __thread int timed = 0;
+static __thread long long phase_totals[TRACE_PHASE_COUNT];
+static __thread int span_count = 0;
+static __thread TraceSpan spans[TRACE_MAX_SPANS];
+static __thread unsigned long long rng_state = 0;
+
+static long long now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// xorshift64, seeded per thread, so sampling shares no state between threads.
+static unsigned long long next_random(void)
+{
+    if (!rng_state)
+        rng_state = (unsigned long long)(unsigned long)pthread_self() ^ (unsigned long long)now_ns() ^ 0x9e3779b97f4a7c15ULL;
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+const char *trace_phase_name(TracePhase phase)
+{
+    return phase >= 0 && phase < TRACE_PHASE_COUNT ? phase_names[phase] : "unknown";
+}
+
+int trace_start(const char *path, double rate)
+{
+    if (rate <= 0 || rate > 1)
+    {
+        fprintf(stderr, "Trace rate must be in (0, 1]\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&output_mutex);
+    if (output)
+    {
+        pthread_mutex_unlock(&output_mutex);
+        return -1;
+    }
+    output = fopen(path, "w");
+    if (!output)
+    {
+        pthread_mutex_unlock(&output_mutex);
+        perror("Error opening trace file");
+        return -1;
+    }
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", output);
+    first_event = 1;
+    sample_threshold = (unsigned long long)(rate * 4294967296.0);
+    pthread_mutex_unlock(&output_mutex);
+
+    __atomic_store_n(&tracing, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void trace_stop(void)
+{
+    __atomic_store_n(&tracing, 0, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&output_mutex);
+    if (output)
+    {
+        fputs("\n]}\n", output);
+        fclose(output);
+        output = NULL;
+    }
+    pthread_mutex_unlock(&output_mutex);
+}
+
+void trace_time_phases(int enabled)
+{
+    __atomic_store_n(&phase_timing, enabled, __ATOMIC_RELEASE);
+}
+
+//RECORDING
+void trace_request_begin(const RequestContext *request)
+{
+    (void)request;
+    span_count = 0;
+    sampled = __atomic_load_n(&tracing, __ATOMIC_ACQUIRE) && (next_random() >> 32) < sample_threshold;
+    timed = sampled || __atomic_load_n(&phase_timing, __ATOMIC_ACQUIRE);
+    if (timed)
+        memset(phase_totals, 0, sizeof(phase_totals));
+}
+
+long long trace_mark(void)
+{
+    return timed ? now_ns() : 0;
+}
+
+void trace_span(TracePhase phase, long long started_ns)
+{
+    if (!started_ns || !timed)
+        return;
+
+    long long ended_ns = now_ns();
+    phase_totals[phase] += ended_ns - started_ns;
+    if (!sampled || span_count >= TRACE_MAX_SPANS)
+        return;
+
+    spans[span_count].phase = phase;
+    spans[span_count].started_ns = started_ns;
+    spans[span_count].ended_ns = ended_ns;
+    span_count++;
+}
+
+const long long *trace_phase_totals(void)
+{
+    return timed ? phase_totals : NULL;
+}
+
+// Titles never reach the trace, so no JSON escaping is needed.
+void trace_request_end(const RequestContext *request)
+{
+    timed = 0;
+    if (!sampled)
+        return;
+    sampled = 0;
+
+    char events[EVENT_BUFFER_SIZE];
+    int used = snprintf(events, sizeof(events),
+                        "{\"name\":\"%s\",\"cat\":\"request\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,"
+                        "\"args\":{\"role\":%d,\"book_id\":%d,\"status\":\"%s\"}}",
+                        request_op_name(request->op), request->started_ns / 1e3, request->latency_ns / 1e3,
+                        request->session, request->role, request->book_id, request->failed ? "fail" : "ok");
+    for (int i = 0; i < span_count && used < (int)sizeof(events); i++)
+    {
+        used += snprintf(events + used, sizeof(events) - used,
+                         ",\n{\"name\":\"%s\",\"cat\":\"phase\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                         phase_names[spans[i].phase], spans[i].started_ns / 1e3,
+                         (spans[i].ended_ns - spans[i].started_ns) / 1e3, request->session);
+    }
+    if (used >= (int)sizeof(events))
+        return;
+
+    pthread_mutex_lock(&output_mutex);
+    if (output)
+    {
+        if (!first_event)
+            fputs(",\n", output);
+        fwrite(events, 1, (size_t)used, output);
+        first_event = 0;
+    }
+    pthread_mutex_unlock(&output_mutex);
+}
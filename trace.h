@@ -0,0 +1,55 @@
+//*******PHASE TRACING*******
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "request.h"
+
+// Sampled requests are written as Chrome trace events (chrome://tracing or
+// ui.perfetto.dev): one "X" event for the request and one per phase inside
+// it, with the connection's session number as the thread id.
+#define TRACE_ENV "LIBRARY_TRACE"           // server traces to this file when set
+#define TRACE_RATE_ENV "LIBRARY_TRACE_RATE" // fraction of requests traced (default 0.01)
+#define TRACE_DEFAULT_RATE 0.01
+#define TRACE_MAX_SPANS 16 // phases kept per request; later ones are dropped
+
+typedef enum
+{
+    TRACE_MUTEX_WAIT, // the catalog's mutex (lock_catalog in catalog.c)
+    TRACE_FLOCK_WAIT, // flock on the data file
+    TRACE_SOCKET_READ, // request payload
+    TRACE_SCAN,       // fgets/sscanf pass (and the buffered temp-file copy)
+    TRACE_FILE_WRITE, // temp file flushed by fclose, or the append
+    TRACE_RENAME,     // temp file over books.txt
+    TRACE_REPLY,      // reply written back to the client
+    TRACE_PHASE_COUNT
+} TracePhase;
+
+// Opens the trace file and traces about rate of the requests that follow
+// (0 < rate <= 1). Returns 0, or -1 if the file cannot be opened.
+int trace_start(const char *path, double rate);
+// Closes the JSON document. Spans finishing after this are dropped.
+void trace_stop(void);
+
+// Called by request_begin/request_end. Sampling is decided per request on
+// the connection thread; unsampled requests cost one branch per phase.
+void trace_request_begin(const RequestContext *request);
+void trace_request_end(const RequestContext *request);
+
+// Times the phases of every request, sampled or not, for sinks that need a
+// per-request breakdown (the slow-op log). Off by default.
+void trace_time_phases(int enabled);
+// Time spent in each phase of the current request so far, indexed by
+// TracePhase, or NULL while phases are not being timed.
+const long long *trace_phase_totals(void);
+
+// Phase hooks, as lock_catalog in catalog.c uses them:
+//     long long span = trace_mark();
+//     pthread_mutex_lock(&catalog->mutex);
+//     trace_span(TRACE_MUTEX_WAIT, span);
+// trace_mark returns 0 outside a timed request, which trace_span ignores.
+long long trace_mark(void);
+void trace_span(TracePhase phase, long long started_ns);
+
+const char *trace_phase_name(TracePhase phase);
+
+#endif
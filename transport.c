@@ -0,0 +1,439 @@
+//*******TRANSPORTS*******
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "transport.h"
+
+#define SPIN_LIMIT 2000
+#define YIELD_ROUNDS 100
+#define LIVENESS_CHECK_INTERVAL 200 // sleeps between peer checks
+
+typedef struct
+{
+    int in_use;
+    int is_server;
+    int liveness_socket;
+    ShmChannel *channel;
+} ShmConnection;
+
+static ShmConnection shm_connections[MAX_SHM_CONNECTIONS];
+static pthread_mutex_t shm_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int shm_sequence = 0;
+static int spin_limit = -1;
+
+static ShmConnection *lookup_shm(int conn)
+{
+    int index = conn - SHM_CONN_BASE;
+    if (index < 0 || index >= MAX_SHM_CONNECTIONS || !shm_connections[index].in_use)
+        return NULL;
+    return &shm_connections[index];
+}
+
+static int register_shm(ShmChannel *channel, int is_server, int liveness_socket)
+{
+    int conn = -1;
+    pthread_mutex_lock(&shm_mutex);
+    for (int i = 0; i < MAX_SHM_CONNECTIONS; i++)
+    {
+        if (!shm_connections[i].in_use)
+        {
+            shm_connections[i].in_use = 1;
+            shm_connections[i].is_server = is_server;
+            shm_connections[i].liveness_socket = liveness_socket;
+            shm_connections[i].channel = channel;
+            conn = SHM_CONN_BASE + i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&shm_mutex);
+    return conn;
+}
+
+// The peer is gone when its end of the Unix socket reports EOF or an error.
+static int peer_alive(int liveness_socket)
+{
+    struct pollfd pfd = {liveness_socket, POLLIN, 0};
+    if (poll(&pfd, 1, 0) <= 0)
+        return 1;
+    if (pfd.revents & (POLLHUP | POLLERR))
+        return 0;
+
+    char probe;
+    return recv(liveness_socket, &probe, 1, MSG_PEEK | MSG_DONTWAIT) != 0;
+}
+
+// Spin first (lowest latency), then yield, then back off to short sleeps.
+// Returns 0 once the peer has gone away.
+static int ring_wait(unsigned int *rounds, int liveness_socket)
+{
+    // Spinning only helps when the peer runs on another core.
+    if (spin_limit < 0)
+        spin_limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_LIMIT : 0;
+
+    unsigned int round = (*rounds)++;
+    if (round < (unsigned int)spin_limit)
+    {
+        __asm__ __volatile__("" ::: "memory");
+        return 1;
+    }
+    if (round < (unsigned int)spin_limit + YIELD_ROUNDS)
+    {
+        sched_yield();
+        return 1;
+    }
+
+    struct timespec pause = {0, 50000};
+    nanosleep(&pause, NULL);
+    if ((round - spin_limit - YIELD_ROUNDS) % LIVENESS_CHECK_INTERVAL == 0)
+        return peer_alive(liveness_socket);
+    return 1;
+}
+
+// Free bytes, with the peer's tail clamped so a corrupt one cannot claim
+// more than a ring.
+static uint32_t ring_space(ShmRing *ring)
+{
+    uint32_t used = ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return used < SHM_RING_SIZE ? SHM_RING_SIZE - used : 0;
+}
+
+// With dont_wait, a message that does not fit in the ring at once is -1
+// with EAGAIN and nothing is written.
+static ssize_t ring_write(ShmRing *ring, const unsigned char *buffer, size_t length, int dont_wait,
+                          int liveness_socket)
+{
+    size_t done = 0;
+    unsigned int rounds = 0;
+
+    if (dont_wait && ring_space(ring) < length)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    while (done < length)
+    {
+        if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE))
+        {
+            errno = EPIPE;
+            return -1;
+        }
+
+        uint32_t head = ring->head;
+        uint32_t space = ring_space(ring);
+        if (space == 0)
+        {
+            if (!ring_wait(&rounds, liveness_socket))
+            {
+                errno = EPIPE;
+                return -1;
+            }
+            continue;
+        }
+
+        size_t count = length - done < space ? length - done : space;
+        size_t offset = head & (SHM_RING_SIZE - 1);
+        size_t first = count < SHM_RING_SIZE - offset ? count : SHM_RING_SIZE - offset;
+        memcpy(ring->data + offset, buffer + done, first);
+        memcpy(ring->data, buffer + done + first, count - first);
+
+        // Publish the whole chunk at once so a reader never sees half a message.
+        __atomic_store_n(&ring->head, head + (uint32_t)count, __ATOMIC_RELEASE);
+        done += count;
+        rounds = 0;
+    }
+    return (ssize_t)done;
+}
+
+// With dont_wait, an empty ring is -1 with EAGAIN, as for a socket.
+static ssize_t ring_read(ShmRing *ring, unsigned char *buffer, size_t length, int wait_all, int dont_wait,
+                         int liveness_socket)
+{
+    size_t done = 0;
+    unsigned int rounds = 0;
+
+    while (done < length)
+    {
+        uint32_t tail = ring->tail;
+        uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint32_t available = head - tail;
+        // The counters are in memory the peer can write; never trust more than a ring.
+        if (available > SHM_RING_SIZE)
+            available = SHM_RING_SIZE;
+
+        if (available > 0)
+        {
+            size_t count = length - done < available ? length - done : available;
+            size_t offset = tail & (SHM_RING_SIZE - 1);
+            size_t first = count < SHM_RING_SIZE - offset ? count : SHM_RING_SIZE - offset;
+            memcpy(buffer + done, ring->data + offset, first);
+            memcpy(buffer + done + first, ring->data, count - first);
+
+            __atomic_store_n(&ring->tail, tail + (uint32_t)count, __ATOMIC_RELEASE);
+            done += count;
+            rounds = 0;
+            if (!wait_all)
+                break;
+            continue;
+        }
+
+        if (dont_wait && done == 0 && !__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE))
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        // Closed and drained: report EOF (or the short read so far).
+        if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE) || !ring_wait(&rounds, liveness_socket))
+            break;
+    }
+    return (ssize_t)done;
+}
+
+//CONNECTION I/O
+ssize_t conn_recv(int conn, void *buffer, size_t length, int flags)
+{
+    if (conn < SHM_CONN_BASE)
+        return recv(conn, buffer, length, flags);
+
+    ShmConnection *shm = lookup_shm(conn);
+    if (!shm)
+    {
+        errno = EBADF;
+        return -1;
+    }
+    ShmRing *ring = shm->is_server ? &shm->channel->request : &shm->channel->response;
+    return ring_read(ring, buffer, length, (flags & MSG_WAITALL) != 0, (flags & MSG_DONTWAIT) != 0,
+                     shm->liveness_socket);
+}
+
+ssize_t conn_send(int conn, const void *buffer, size_t length, int flags)
+{
+    if (conn < SHM_CONN_BASE)
+        return send(conn, buffer, length, flags);
+
+    ShmConnection *shm = lookup_shm(conn);
+    if (!shm)
+    {
+        errno = EBADF;
+        return -1;
+    }
+    ShmRing *ring = shm->is_server ? &shm->channel->response : &shm->channel->request;
+    return ring_write(ring, buffer, length, (flags & MSG_DONTWAIT) != 0, shm->liveness_socket);
+}
+
+ssize_t conn_read(int conn, void *buffer, size_t length)
+{
+    if (conn < SHM_CONN_BASE)
+        return read(conn, buffer, length);
+    return conn_recv(conn, buffer, length, 0);
+}
+
+ssize_t conn_write(int conn, const void *buffer, size_t length)
+{
+    if (conn < SHM_CONN_BASE)
+        return write(conn, buffer, length);
+    return conn_send(conn, buffer, length, 0);
+}
+
+int conn_close(int conn)
+{
+    if (conn < SHM_CONN_BASE)
+        return close(conn);
+
+    pthread_mutex_lock(&shm_mutex);
+    ShmConnection *shm = lookup_shm(conn);
+    if (!shm)
+    {
+        pthread_mutex_unlock(&shm_mutex);
+        errno = EBADF;
+        return -1;
+    }
+
+    // Tell the peer we are done with our outgoing ring.
+    ShmRing *outgoing = shm->is_server ? &shm->channel->response : &shm->channel->request;
+    __atomic_store_n(&outgoing->closed, 1, __ATOMIC_RELEASE);
+
+    munmap(shm->channel, sizeof(ShmChannel));
+    close(shm->liveness_socket);
+    shm->in_use = 0;
+    pthread_mutex_unlock(&shm_mutex);
+    return 0;
+}
+
+int conn_shutdown(int conn)
+{
+    if (conn < SHM_CONN_BASE)
+        return shutdown(conn, SHUT_RDWR);
+
+    pthread_mutex_lock(&shm_mutex);
+    ShmConnection *shm = lookup_shm(conn);
+    if (!shm)
+    {
+        pthread_mutex_unlock(&shm_mutex);
+        errno = EBADF;
+        return -1;
+    }
+
+    // Both directions: our reader sees EOF once drained, the peer stops writing.
+    __atomic_store_n(&shm->channel->request.closed, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&shm->channel->response.closed, 1, __ATOMIC_RELEASE);
+    shutdown(shm->liveness_socket, SHUT_RDWR);
+    pthread_mutex_unlock(&shm_mutex);
+    return 0;
+}
+
+//SHARED MEMORY SETUP
+// The name comes from an unauthenticated peer: it must be one the peer
+// created for itself, SHM_NAME_PREFIX "<its pid>-<sequence>", never
+// another client's pending channel or any other segment.
+static int peer_named_channel(const char *name, int liveness_socket, struct ucred *peer)
+{
+    socklen_t length = sizeof(*peer);
+    char expected[SHM_NAME_LENGTH];
+    if (getsockopt(liveness_socket, SOL_SOCKET, SO_PEERCRED, peer, &length) < 0)
+        return 0;
+    int prefix = snprintf(expected, sizeof(expected), SHM_NAME_PREFIX "%d-", (int)peer->pid);
+    if (strncmp(name, expected, (size_t)prefix) != 0 || name[prefix] == '\0')
+        return 0;
+    return strspn(name + prefix, "0123456789") == strlen(name + prefix);
+}
+
+int transport_attach_shm(const char *name, int liveness_socket)
+{
+    struct ucred peer;
+    if (!peer_named_channel(name, liveness_socket, &peer))
+    {
+        fprintf(stderr, "Shared memory channel name refused\n");
+        return -1;
+    }
+
+    int fd = shm_open(name, O_RDWR, 0600);
+    if (fd < 0)
+    {
+        perror("Error opening shared memory channel");
+        return -1;
+    }
+    // A short segment would fault on first access and take the server down.
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_uid != peer.uid || st.st_size < (off_t)sizeof(ShmChannel))
+    {
+        fprintf(stderr, "Shared memory channel %s is not the peer's or too small\n", name);
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+
+    ShmChannel *channel = mmap(NULL, sizeof(ShmChannel), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    // Both sides hold a mapping now; unlinking keeps crashed clients from leaking segments.
+    shm_unlink(name);
+
+    if (channel == MAP_FAILED)
+    {
+        perror("Error mapping shared memory channel");
+        return -1;
+    }
+    if (channel->magic != SHM_MAGIC)
+    {
+        fprintf(stderr, "Shared memory channel %s has a bad header\n", name);
+        munmap(channel, sizeof(ShmChannel));
+        return -1;
+    }
+
+    int conn = register_shm(channel, 1, liveness_socket);
+    if (conn < 0)
+    {
+        fprintf(stderr, "Too many shared memory connections\n");
+        munmap(channel, sizeof(ShmChannel));
+    }
+    return conn;
+}
+
+int transport_connect_unix(const char *path)
+{
+    struct sockaddr_un addr;
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int transport_connect_shm(const char *path)
+{
+    char name[SHM_NAME_LENGTH] = {0};
+    char reply[16] = {0};
+    int request = TRANSPORT_SHM_ATTACH;
+
+    int sock = transport_connect_unix(path);
+    if (sock < 0)
+        return -1;
+
+    pthread_mutex_lock(&shm_mutex);
+    snprintf(name, sizeof(name), SHM_NAME_PREFIX "%d-%u", (int)getpid(), shm_sequence++);
+    pthread_mutex_unlock(&shm_mutex);
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(ShmChannel)) < 0)
+    {
+        close(fd);
+        shm_unlink(name);
+        close(sock);
+        return -1;
+    }
+
+    ShmChannel *channel = mmap(NULL, sizeof(ShmChannel), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (channel == MAP_FAILED)
+    {
+        shm_unlink(name);
+        close(sock);
+        return -1;
+    }
+    channel->magic = SHM_MAGIC;
+
+    if (send(sock, &request, sizeof(request), 0) != sizeof(request) ||
+        send(sock, name, sizeof(name), 0) != sizeof(name) ||
+        recv(sock, reply, strlen("Attached"), MSG_WAITALL) <= 0 ||
+        strcmp(reply, "Attached") != 0)
+    {
+        munmap(channel, sizeof(ShmChannel));
+        shm_unlink(name);
+        close(sock);
+        return -1;
+    }
+
+    int conn = register_shm(channel, 0, sock);
+    if (conn < 0)
+    {
+        munmap(channel, sizeof(ShmChannel));
+        close(sock);
+    }
+    return conn;
+}
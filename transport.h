@@ -0,0 +1,71 @@
+//*******TRANSPORTS*******
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define UNIX_SOCKET_PATH "library.sock"
+
+// First int on a Unix socket connection asking to move the session onto
+// a shared-memory channel. Roles 1-3 keep their meaning from authenticate().
+#define TRANSPORT_SHM_ATTACH 4
+
+#define SHM_NAME_LENGTH 64
+#define SHM_NAME_PREFIX "/library-shm-" // then the creating client's pid, '-' and a sequence number
+#define SHM_RING_SIZE (64 * 1024) // must be a power of two
+#define SHM_MAGIC 0x4c494252     // "LIBR"
+
+// Connection ids at or above this value are shared-memory channels,
+// anything below is a plain socket descriptor.
+#define SHM_CONN_BASE (1 << 20)
+#define MAX_SHM_CONNECTIONS 256
+
+// Single-producer single-consumer byte ring. head and tail are free-running
+// counters; each lives on its own cache line so the two sides never share one.
+typedef struct
+{
+    uint32_t head;
+    char pad1[60];
+    uint32_t tail;
+    char pad2[60];
+    uint32_t closed;
+    char pad3[60];
+    unsigned char data[SHM_RING_SIZE];
+} ShmRing;
+
+typedef struct
+{
+    uint32_t magic;
+    char pad[60];
+    ShmRing request;  // client -> server
+    ShmRing response; // server -> client
+} ShmChannel;
+
+// Socket-compatible I/O on either kind of connection. flags accepts
+// MSG_WAITALL, and MSG_DONTWAIT; a send with it over shared memory goes
+// out whole or not at all.
+ssize_t conn_recv(int conn, void *buffer, size_t length, int flags);
+ssize_t conn_send(int conn, const void *buffer, size_t length, int flags);
+ssize_t conn_read(int conn, void *buffer, size_t length);
+ssize_t conn_write(int conn, const void *buffer, size_t length);
+int conn_close(int conn);
+// Makes blocked and future reads on conn return EOF without releasing it,
+// so another thread can wake the owner; the owner still calls conn_close.
+int conn_shutdown(int conn);
+
+// Server side: map a channel created by a client. liveness_socket is the Unix
+// socket the request arrived on; it is closed together with the channel.
+// Only a segment named for the peer's own pid, owned by its uid and large
+// enough for a ShmChannel is accepted.
+int transport_attach_shm(const char *name, int liveness_socket);
+
+// Client side: connect to the server's Unix socket.
+int transport_connect_unix(const char *path);
+
+// Client side: create a channel, hand it to the server over its Unix socket
+// and return a connection id usable with conn_recv/conn_send.
+int transport_connect_shm(const char *path);
+
+#endif
@@ -0,0 +1,197 @@
+//*******TRANSPORT LATENCY BENCHMARK*******
+// Compares request latency over loopback TCP, the Unix socket and the
+// shared-memory channel against a running server:
+//   ./transport_bench [-h host] [-p port] [-U path] [-n iterations] [-a name:pass]
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include "transport.h"
+
+#define PORT 8080
+#define BUFFER_SIZE 1024
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int compare_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static int connect_tcp(const char *host, int port)
+{
+    struct sockaddr_in serv_addr;
+    int nodelay = 1;
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0)
+        return -1;
+    // Requests go out as several small writes; without this Nagle adds ~40ms.
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &serv_addr.sin_addr) != 1 ||
+        connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static int admin_login(int conn, const char *username, const char *password)
+{
+    char buffer[BUFFER_SIZE] = {0};
+    int role = 2;
+
+    conn_send(conn, &role, sizeof(role), 0);
+    snprintf(buffer, sizeof(buffer), "%s %s", username, password);
+    conn_send(conn, buffer, sizeof(buffer), 0);
+
+    memset(buffer, 0, sizeof(buffer));
+    if (conn_recv(conn, buffer, sizeof(buffer) - 1, 0) <= 0)
+        return 0;
+    return strncmp(buffer, "Logged in", strlen("Logged in")) == 0;
+}
+
+static int admin_request(int conn, int choice, const void *payload, size_t length, char *reply)
+{
+    int role = 2;
+    conn_send(conn, &role, sizeof(role), 0);
+    conn_send(conn, &choice, sizeof(choice), 0);
+    conn_send(conn, payload, length, 0);
+
+    ssize_t n = conn_recv(conn, reply, BUFFER_SIZE - 1, 0);
+    if (n <= 0)
+        return 0;
+    reply[n] = '\0';
+    return 1;
+}
+
+static void admin_exit(int conn)
+{
+    int role = 2, choice = 5;
+    char reply[BUFFER_SIZE];
+    conn_send(conn, &role, sizeof(role), 0);
+    conn_send(conn, &choice, sizeof(choice), 0);
+    conn_recv(conn, reply, sizeof(reply), 0);
+}
+
+static void run(const char *name, int conn, int iterations, const char *username, const char *password)
+{
+    char reply[BUFFER_SIZE];
+    char title[50] = "BenchTitle";
+    char author[50] = "BenchAuthor";
+    char payload[32];
+    int book_id = 0;
+
+    if (conn < 0)
+    {
+        printf("%-10s unavailable (is the server running?)\n", name);
+        return;
+    }
+    if (!admin_login(conn, username, password))
+    {
+        printf("%-10s login failed\n", name);
+        conn_close(conn);
+        return;
+    }
+
+    // A book to look up, so every search walks the same path.
+    char add[100];
+    memcpy(add, title, sizeof(title));
+    memcpy(add + sizeof(title), author, sizeof(author));
+    if (!admin_request(conn, 1, add, sizeof(add), reply) || sscanf(reply, "Book added with ID: %d", &book_id) != 1)
+    {
+        printf("%-10s add failed: %s\n", name, reply);
+        conn_close(conn);
+        return;
+    }
+    snprintf(payload, sizeof(payload), "%d", book_id);
+
+    long long *samples = malloc(sizeof(long long) * (size_t)iterations);
+    long long started = now_ns();
+    for (int i = 0; i < iterations; i++)
+    {
+        long long t0 = now_ns();
+        admin_request(conn, 4, payload, strlen(payload), reply);
+        samples[i] = now_ns() - t0;
+    }
+    long long elapsed = now_ns() - started;
+
+    snprintf(payload, sizeof(payload), "%d", book_id);
+    admin_request(conn, 2, payload, strlen(payload), reply);
+    admin_exit(conn);
+    conn_close(conn);
+
+    qsort(samples, (size_t)iterations, sizeof(long long), compare_ll);
+    printf("%-10s %10d %10.1f %10.1f %10.1f %12.0f\n", name, iterations,
+           (double)elapsed / iterations / 1000.0,
+           samples[iterations / 2] / 1000.0,
+           samples[(int)(iterations * 0.99)] / 1000.0,
+           iterations / ((double)elapsed / 1e9));
+    free(samples);
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -h host        server address for the TCP run (127.0.0.1)\n"
+            "  -p port        server port (%d)\n"
+            "  -U path        server's Unix socket for the unix and shm runs (%s)\n"
+            "  -n iterations  searches per transport (10000)\n"
+            "  -a name:pass   admin login (admin:admin)\n",
+            program, PORT, UNIX_SOCKET_PATH);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *host = "127.0.0.1";
+    const char *unix_path = UNIX_SOCKET_PATH;
+    char admin[BUFFER_SIZE] = "admin:admin";
+    int port = PORT;
+    int iterations = 10000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "h:p:U:n:a:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'h': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'U': unix_path = optarg; break;
+        case 'n': iterations = atoi(optarg); break;
+        case 'a': snprintf(admin, sizeof(admin), "%s", optarg); break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    char *password = strchr(admin, ':');
+    if (optind != argc || iterations <= 0 || port <= 0 || !password)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    *password++ = '\0';
+    const char *username = admin;
+
+    printf("%-10s %10s %10s %10s %10s %12s\n", "transport", "ops", "mean_us", "p50_us", "p99_us", "ops_per_sec");
+    run("tcp", connect_tcp(host, port), iterations, username, password);
+    run("unix", transport_connect_unix(unix_path), iterations, username, password);
+    run("shm", transport_connect_shm(unix_path), iterations, username, password);
+    return 0;
+}